@@ -0,0 +1,406 @@
+/**
+ * @file         : api_load_test.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Load test of the firmware REST handlers on the native build. The real
+ * handlers from api.cpp answer on a loopback HttpServer against fake
+ * peripherals, a memory SD card holding a synthetic log archive and a
+ * telemetry snapshot collected once. Each endpoint is loaded on its own by
+ * keep-alive clients, the CSV reports its throughput, latency percentiles,
+ * allocations per request, the highest heap growth of a single request and
+ * the process peak RSS. With --baseline=previous.csv the run exits with 1
+ * when an endpoint lost more than --threshold percent of its throughput or
+ * its median latency grew by as much. Firmware traces share stdout, --out
+ * keeps the CSV apart from them.
+ *
+ * While an endpoint is loaded a control thread sleeps at the flow poll pace
+ * and records how late it wakes up, pinned to its own CPU like the control
+ * core of the device unless --partition=0 lets it share with the server.
+ *
+ * pio run -e loadtest && .pio/build/loadtest/program [--out=load.csv] [--filter=name]
+ *   [--clients=4] [--requests=2000] [--pipeline=1] [--logs=500]
+ *   [--baseline=previous.csv] [--threshold=10] [--partition=1]
+ */
+#include <Arduino.h>
+#include <SD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "constants.h"
+#include "settings.h"
+#include "hal.h"
+#include "hal_fake.h"
+#include "watering.h"
+#include "httpserver.h"
+#include "api.h"
+#include "telemetry.h"
+#include "heapprofile.h"
+#include "loadclient.h"
+
+#define LOAD_START_TIME                   1719676800  /* 2024-06-29 16:00:00 UTC, a Saturday */
+#define LOAD_CLIENTS                      4
+#define LOAD_REQUESTS                     2000    /* Per client and endpoint */
+#define LOAD_PIPELINE                     1       /* One request in flight per client, latencies are per request */
+#define LOAD_LOGS                         500     /* Log entries, about a season of one alarm */
+#define LOAD_LOG_SPACING                  3600    /* Seconds between synthetic log entries */
+#define LOAD_THRESHOLD                    10      /* Percent of throughput or median latency before it counts as a regression */
+#define LOAD_MAX_CASES                    16
+
+FakeClock fakeClock(LOAD_START_TIME, 0);
+FakeGpioExpander fakeExpander;
+FakeFlowSensor fakeFlow;
+FakeStore fakeStore(EEPROM_SIZE);
+Hal hal = { &fakeClock, &fakeExpander, &fakeFlow, NULL, &fakeStore, &SD };
+
+struct LoadCase {
+  const char* name;
+  LoadRequest request;
+};
+
+struct LoadSummary {
+  unsigned long completed;
+  unsigned long failed;
+  double requestsPerSecond;
+  double p50;
+  double p90;
+  double p99;
+  double slowest;
+  double allocations;     // Per request
+  uint32_t heapPeak;      // Highest net growth of one request, bytes
+  long maxRss;            // Kilobytes, for the whole process so far
+  double controlP99;      // Wake up lateness of the control thread, microseconds
+  double controlMax;
+};
+
+static Settings settings;
+static HttpServer server(0);
+static RTC_DS3231 rtc;
+static Adafruit_MCP23X17 mcp;
+static std::atomic<bool> running(true);
+static std::atomic<uint32_t> heapPeak(0);
+static std::atomic<bool> controlling(false);
+static int controlCpu = -1;               // -1 shares every CPU with the server
+
+// Same schedule as the firmware benchmarks, 8 alarms and every plant enabled
+static void fillSettings(Settings* settings) {
+  memset(settings, 0, sizeof(Settings));
+  strncpy(settings->hostname, "loadtest", HOSTNAME_MAX_LENGTH - 1);
+  settings->maxPlants = SETTINGS_MAX_PLANTS;
+  settings->hasRTC = true;
+  settings->hasMCP = true;
+  for (uint8_t i = 0; i < SETTINGS_MAX_ALARMS; i++) {
+    uint8_t weekday = 1 << (i % 7);
+    settings->alarm[i][0] = { i, weekday, (uint8_t)(6 + i * 2), 30, 1 };
+    settings->alarm[i][1] = { i, weekday, (uint8_t)(6 + i * 2), 31, 1 };
+  }
+  for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    settings->plant[i] = { i, (uint8_t)(i == 0 ? 10 : 18), 1 };
+  }
+}
+
+static void fillArchive(const char* folder, uint32_t entries) {
+  for (uint32_t i = 0; i < entries; i++) {
+    writeLog(DateTime(LOAD_START_TIME + i * LOAD_LOG_SPACING), "plant", i % SETTINGS_MAX_PLANTS, 450, 50, folder);
+  }
+}
+
+// Same scope per route as the firmware, the peak of every request is kept for the running case
+static void invokeProfiled(HttpHandler handler, const char* route) {
+  HeapScope scope(route != NULL ? route : "notFound");
+  handler();
+  uint32_t peak = scope.peak() > 0 ? scope.peak() : 0;
+  uint32_t highest = heapPeak.load(std::memory_order_relaxed);
+  while (peak > highest && !heapPeak.compare_exchange_weak(highest, peak, std::memory_order_relaxed)) {
+  }
+}
+
+static void handleNotFound() {
+  SERVER_RESPONSE_ERROR(404, "Not Found");
+}
+
+static void serverLoop() {
+  while (running.load()) {
+    if (server.waitForClient(50)) {
+      server.handleClient();
+    }
+  }
+}
+
+static void pinThread(int cpu, bool exclude) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  int cpus = std::thread::hardware_concurrency();
+  for (int i = 0; i < cpus; i++) {
+    if ((i == cpu) != exclude) {
+      CPU_SET(i, &set);
+    }
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Stand-in for the flow poll of the watering task, only measures its wake ups
+static void controlLoop(std::vector<double>* lateness) {
+  if (controlCpu >= 0) {
+    pinThread(controlCpu, false);
+  }
+  while (controlling.load()) {
+    auto asked = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(WATERING_POLL_MS));
+    double late = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - asked).count() - WATERING_POLL_MS * 1000;
+    lateness->push_back(late > 0 ? late : 0);
+  }
+}
+
+static std::string get(const char* path, const char* headers = "") {
+  return std::string("GET ") + path + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n";
+}
+
+static std::string post(const char* path, const String& body) {
+  return std::string("POST ") + path + " HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\nContent-Length: "
+    + std::to_string(body.length()) + "\r\n\r\n" + body.c_str();
+}
+
+static double percentile(const std::vector<double>& sorted, unsigned int percent) {
+  return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, (sorted.size() * percent) / 100)];
+}
+
+static LoadSummary runCase(const LoadCase& load, unsigned int clients, unsigned long count, unsigned int pipeline) {
+  std::vector<LoadResult> results(clients);
+  std::vector<std::thread> threads;
+  HeapTotals before;
+  HeapTotals after;
+  std::vector<double> lateness;
+  heapPeak.store(0);
+  getHeapTotals(&before);
+  controlling.store(true);
+  std::thread control(controlLoop, &lateness);
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < clients; i++) {
+    threads.emplace_back(runLoadClient, server.port(), &load.request, 1, count, pipeline, 0, &results[i]);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  getHeapTotals(&after);
+  controlling.store(false);
+  control.join();
+
+  LoadSummary summary = {};
+  std::vector<double> latencies;
+  for (LoadResult& result : results) {
+    summary.completed += result.completed;
+    summary.failed += result.failed;
+    latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  summary.requestsPerSecond = summary.completed / seconds;
+  summary.p50 = percentile(latencies, 50);
+  summary.p90 = percentile(latencies, 90);
+  summary.p99 = percentile(latencies, 99);
+  summary.slowest = latencies.empty() ? 0 : latencies.back();
+  summary.allocations = summary.completed > 0 ? (double)(after.allocations - before.allocations) / summary.completed : 0;
+  summary.heapPeak = heapPeak.load();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  summary.maxRss = usage.ru_maxrss;
+  std::sort(lateness.begin(), lateness.end());
+  summary.controlP99 = percentile(lateness, 99);
+  summary.controlMax = lateness.empty() ? 0 : lateness.back();
+  return summary;
+}
+
+// Throughput and median latency of a previous run, keyed by endpoint
+static size_t loadBaseline(const char* path, char names[][64], double* throughputs, double* medians, size_t capacity) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    TRACE("Failed to open %s\n", path);
+    return 0;
+  }
+  char line[256];
+  size_t count = 0;
+  while (count < capacity && fgets(line, sizeof(line), file) != NULL) {
+    unsigned int clients, pipeline;
+    unsigned long completed, failed;
+    if (sscanf(line, "%63[^,],%u,%u,%lu,%lu,%lf,%lf", names[count], &clients, &pipeline, &completed, &failed, &throughputs[count], &medians[count]) == 7) {
+      count++;
+    }
+  }
+  fclose(file);
+  return count;
+}
+
+static bool option(const char* arg, const char* name, uint32_t* value) {
+  size_t length = strlen(name);
+  if (strncmp(arg, name, length) != 0) {
+    return false;
+  }
+  *value = strtoul(arg + length, NULL, 10);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* filter = NULL;
+  const char* baseline = NULL;
+  const char* path = NULL;
+  uint32_t clients = LOAD_CLIENTS;
+  uint32_t requests = LOAD_REQUESTS;
+  uint32_t pipeline = LOAD_PIPELINE;
+  uint32_t logs = LOAD_LOGS;
+  uint32_t threshold = LOAD_THRESHOLD;
+  uint32_t partition = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+      baseline = argv[i] + 11;
+    } else if (strncmp(argv[i], "--out=", 6) == 0) {
+      path = argv[i] + 6;
+    } else if (!option(argv[i], "--clients=", &clients) && !option(argv[i], "--requests=", &requests)
+      && !option(argv[i], "--pipeline=", &pipeline) && !option(argv[i], "--logs=", &logs)
+      && !option(argv[i], "--threshold=", &threshold) && !option(argv[i], "--partition=", &partition)) {
+      TRACE("Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  clients = std::min(std::max(clients, (uint32_t)1), (uint32_t)HTTP_MAX_CLIENTS);
+  pipeline = std::min(std::max(pipeline, (uint32_t)1), (uint32_t)LOAD_MAX_PIPELINE);
+  if (partition != 0 && std::thread::hardware_concurrency() > 1) {
+    // The last CPU is the control core, the server and the clients inherit the rest
+    controlCpu = std::thread::hardware_concurrency() - 1;
+    pinThread(controlCpu, true);
+  }
+
+  beginHeapProfile();
+  fillSettings(&settings);
+  fillArchive("/logs", logs);
+  TelemetrySources sources = { &settings, &rtc, &mcp, xSemaphoreCreateMutex(), NULL };
+  collectTelemetry(sources);
+
+  setupApi(&server, &settings);
+  const char* collectedHeaders[] = { "If-None-Match", "Accept", "Content-Type" };
+  server.collectHeaders(collectedHeaders, 3);
+  server.onNotFound(handleNotFound);
+  server.onInvoke(invokeProfiled);
+  server.on("/api/plants", handlePlants);
+  server.on("/api/alarm", handleAlarm);
+  server.on("/api/systeminfo", HTTP_GET, handleSystemInfo);
+  server.on("/api/logs", handleLogs);
+  if (!server.begin()) {
+    TRACE("Failed to start the server\n");
+    return 2;
+  }
+
+  // Conditional requests need the tag the cache hands out for the current settings
+  std::string ifNoneMatch = std::string("If-None-Match: ") + getCachedResponse(CACHE_PLANTS, writePlantsResponse).etag + "\r\n";
+  String plantsBody = "{\"plants\":" + getPlants(settings) + "}";
+  String alarmsBody = "{\"alarm\":" + getAlarms(settings) + "}";
+  char logsOffset[64];
+  snprintf(logsOffset, sizeof(logsOffset), "/api/logs?offset=%u&limit=20", (unsigned int)(logs / 2));
+  const LoadCase cases[] = {
+    { "plants", { get("/api/plants"), 200 } },
+    { "plants/not-modified", { get("/api/plants", ifNoneMatch.c_str()), 304 } },
+    { "plants/msgpack", { get("/api/plants", "Accept: application/msgpack\r\n"), 200 } },
+    { "plants/post", { post("/api/plants", plantsBody), 200 } },
+    { "alarm", { get("/api/alarm"), 200 } },
+    { "alarm/post", { post("/api/alarm", alarmsBody), 200 } },
+    { "systeminfo", { get("/api/systeminfo"), 200 } },
+    { "logs", { get("/api/logs?limit=20"), 200 } },
+    { "logs/offset", { get(logsOffset), 200 } },
+    { "notFound", { get("/api/missing"), 404 } },
+  };
+
+  char names[LOAD_MAX_CASES][64];
+  double throughputs[LOAD_MAX_CASES];
+  double medians[LOAD_MAX_CASES];
+  size_t baselines = baseline != NULL ? loadBaseline(baseline, names, throughputs, medians, LOAD_MAX_CASES) : 0;
+  if (baseline != NULL && baselines == 0) {
+    return 2;
+  }
+
+  FILE* out = path != NULL ? fopen(path, "w") : stdout;
+  if (out == NULL) {
+    TRACE("Failed to open %s\n", path);
+    return 2;
+  }
+
+  std::thread serverThread(serverLoop);
+  int regressions = 0;
+  unsigned long failed = 0;
+  fprintf(out, "endpoint,clients,pipeline,completed,failed,requests_per_second,p50_us,p90_us,p99_us,max_us,allocs_per_request,heap_peak_bytes,max_rss_kb,control_p99_us,control_max_us%s\n",
+    baseline != NULL ? ",baseline_rps,rps_change_pct,baseline_p50_us,p50_change_pct" : "");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    if (filter != NULL && strstr(cases[i].name, filter) == NULL) {
+      continue;
+    }
+    LoadSummary summary = runCase(cases[i], clients, requests, pipeline);
+    failed += summary.failed;
+    fprintf(out, "%s,%u,%u,%lu,%lu,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%u,%ld,%.1f,%.1f", cases[i].name, clients, pipeline, summary.completed, summary.failed,
+      summary.requestsPerSecond, summary.p50, summary.p90, summary.p99, summary.slowest, summary.allocations, summary.heapPeak, summary.maxRss,
+      summary.controlP99, summary.controlMax);
+    if (baseline != NULL) {
+      size_t match = 0;
+      while (match < baselines && strcmp(names[match], cases[i].name) != 0) {
+        match++;
+      }
+      if (match < baselines && throughputs[match] > 0 && medians[match] > 0) {
+        double throughput = (summary.requestsPerSecond - throughputs[match]) * 100 / throughputs[match];
+        double median = (summary.p50 - medians[match]) * 100 / medians[match];
+        regressions += -throughput > threshold || median > threshold ? 1 : 0;
+        fprintf(out, ",%.0f,%.1f,%.1f,%.1f", throughputs[match], throughput, medians[match], median);
+      } else {
+        fprintf(out, ",,,,");
+      }
+    }
+    fprintf(out, "\n");
+    fflush(out);
+  }
+  running.store(false);
+  serverThread.join();
+  server.stop();
+  if (out != stdout) {
+    fclose(out);
+  }
+  return failed > 0 || regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,374 @@
+/**
+ * @file         : firmware_bench.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Microbenchmarks of the firmware hot paths on the native build: alarm
+ * lookups, watering time, the JSON builders and parsers, the RTC setter and
+ * log listings over synthetic archives. Every case is calibrated to run for
+ * at least --min-ms per repetition, the CSV reports the median, fastest and
+ * slowest repetition. With --baseline=previous.csv the run also compares the
+ * medians and exits with 1 when one got slower than --threshold percent.
+ * Firmware traces share stdout, --out keeps the CSV apart from them.
+ *
+ * pio run -e bench && .pio/build/bench/program [--out=bench.csv] [--filter=name]
+ *   [--min-ms=200] [--repetitions=5] [--baseline=previous.csv] [--threshold=10]
+ */
+#include <Arduino.h>
+#include <SD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include "constants.h"
+#include "settings.h"
+#include "hal.h"
+#include "hal_fake.h"
+#include "logindex.h"
+
+#define BENCH_START_TIME                  1719676800  /* 2024-06-29 16:00:00 UTC, a Saturday */
+#define BENCH_MIN_MS                      200
+#define BENCH_REPETITIONS                 5
+#define BENCH_MAX_REPETITIONS             31
+#define BENCH_THRESHOLD                   10      /* Percent a median may grow before it counts as a regression */
+#define BENCH_SMALL_ARCHIVE               500     /* Log entries, about a season of one alarm */
+#define BENCH_LARGE_ARCHIVE               10000   /* Log entries, years of daily cycles */
+#define BENCH_LOG_SPACING                 3600    /* Seconds between synthetic log entries */
+#define BENCH_MAX_CASES                   32
+
+FakeClock fakeClock(BENCH_START_TIME, 0);
+FakeGpioExpander fakeExpander;
+FakeFlowSensor fakeFlow;
+FakeStore fakeStore(EEPROM_SIZE);
+Hal hal = { &fakeClock, &fakeExpander, &fakeFlow, NULL, &fakeStore, &SD };
+
+struct BenchCase {
+  const char* name;
+  size_t (*body)();       // Returns something derived from the work so it is not optimised away
+};
+
+struct BenchResult {
+  const char* name;
+  unsigned long iterations;
+  double median;          // Nanoseconds per call
+  double fastest;
+  double slowest;
+  size_t result;          // Last return value, the output size for the JSON builders and listings
+};
+
+static Settings settings;
+static RTC_DS3231 rtc;
+static JsonDocument alarmsJson;
+static JsonDocument plantsJson;
+static String alarmsText;
+static String plantsText;
+static volatile size_t sink = 0;
+
+static uint32_t fakeMillis() { return fakeClock.millis(); }
+static void fakeDelay(uint32_t ms) { fakeClock.delay(ms); }
+static uint32_t fakeNow() { return fakeClock.now(); }
+static void fakeAdjust(uint32_t unixTime) { fakeClock.adjust(unixTime); }
+
+// Same schedule as the README examples, 8 alarms so every slot is walked
+static void fillSettings(Settings* settings) {
+  memset(settings, 0, sizeof(Settings));
+  strncpy(settings->hostname, "bench", HOSTNAME_MAX_LENGTH - 1);
+  settings->maxPlants = SETTINGS_MAX_PLANTS;
+  settings->hasRTC = true;
+  for (uint8_t i = 0; i < SETTINGS_MAX_ALARMS; i++) {
+    uint8_t weekday = 1 << (i % 7);
+    settings->alarm[i][0] = { i, weekday, (uint8_t)(6 + i * 2), 30, 1 };
+    settings->alarm[i][1] = { i, weekday, (uint8_t)(6 + i * 2), 31, 1 };
+  }
+  for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    settings->plant[i] = { i, (uint8_t)(i == 0 ? 10 : 18), 1 };
+  }
+}
+
+// Log entries one hour apart, spread over as many monthly segments as they cover
+static void fillArchive(const char* folder, uint32_t entries) {
+  for (uint32_t i = 0; i < entries; i++) {
+    writeLog(DateTime(BENCH_START_TIME + i * BENCH_LOG_SPACING), "plant", i % SETTINGS_MAX_PLANTS, 450, 50, folder);
+  }
+}
+
+static size_t activeAlarmIdle() {
+  return getActiveAlarmId(settings, DateTime(BENCH_START_TIME)) + 1;
+}
+
+static size_t activeAlarmHit() {
+  // Last slot, fires Monday 20:30 so every earlier alarm is checked first
+  return getActiveAlarmId(settings, DateTime(2024, 7, 1, 20, 30, 15)) + 1;
+}
+
+static size_t nextAlarmTime() {
+  return getNextAlarmTime(settings, DateTime(BENCH_START_TIME));
+}
+
+static size_t wateringDuration() {
+  size_t total = 0;
+  for (uint8_t size = 0; size < 64; size++) {
+    total += calculateWateringDuration(size);
+  }
+  return total;
+}
+
+static size_t totalWateringTime() {
+  return getTotalWateringTime(settings);
+}
+
+static size_t alarmsToJson() {
+  return getAlarms(settings).length();
+}
+
+static size_t plantsToJson() {
+  return getPlants(settings).length();
+}
+
+static size_t settingsJson() {
+  return settingsToJson(settings).length();
+}
+
+static size_t parseAlarmsDocument() {
+  Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALARM_STATES];
+  return saveAlarms(alarmsJson, alarm) ? alarm[SETTINGS_MAX_ALARMS - 1][1].minute : 0;
+}
+
+static size_t parsePlantsDocument() {
+  Plant plants[SETTINGS_MAX_PLANTS];
+  return savePlants(plantsJson, plants) ? plants[SETTINGS_MAX_PLANTS - 1].size : 0;
+}
+
+// What set-alarms costs end to end, deserialisation included
+static size_t parseAlarmsText() {
+  JsonDocument json;
+  deserializeJson(json, alarmsText);
+  Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALARM_STATES];
+  return saveAlarms(json, alarm) ? alarm[0][0].hour : 0;
+}
+
+static size_t parsePlantsText() {
+  JsonDocument json;
+  deserializeJson(json, plantsText);
+  Plant plants[SETTINGS_MAX_PLANTS];
+  return savePlants(json, plants) ? plants[0].size : 0;
+}
+
+static size_t setRtc() {
+  return setRTCFromISODate("2024-06-29T16:00:00", rtc) ? 1 : 0;
+}
+
+static size_t setRtcInvalid() {
+  return setRTCFromISODate("2024-13-29T16:00:00", rtc) ? 1 : 0;
+}
+
+static size_t listSmallArchive() {
+  return listDirectory("/small", 0, UINT32_MAX, 0, LOG_INDEX_PAGE_SIZE).length();
+}
+
+static size_t listLargeArchive() {
+  return listDirectory("/large", 0, UINT32_MAX, 0, LOG_INDEX_PAGE_SIZE).length();
+}
+
+// A page from the middle of the archive, the index has to skip to the offset
+static size_t listLargeArchiveOffset() {
+  return listDirectory("/large", 0, UINT32_MAX, BENCH_LARGE_ARCHIVE / 2, LOG_INDEX_PAGE_SIZE).length();
+}
+
+// A week in the middle of the archive, only the segments overlapping it are read
+static size_t listLargeArchiveRange() {
+  uint32_t from = BENCH_START_TIME + (BENCH_LARGE_ARCHIVE / 2) * BENCH_LOG_SPACING;
+  return listDirectory("/large", from, from + 7 * 86400, 0, LOG_INDEX_PAGE_SIZE).length();
+}
+
+static size_t walkLargeArchive() {
+  return listDirectory2("/large").length();
+}
+
+static const BenchCase cases[] = {
+  { "getActiveAlarmId/idle", activeAlarmIdle },
+  { "getActiveAlarmId/hit", activeAlarmHit },
+  { "getNextAlarmTime", nextAlarmTime },
+  { "calculateWateringDuration/64", wateringDuration },
+  { "getTotalWateringTime", totalWateringTime },
+  { "getAlarms", alarmsToJson },
+  { "getPlants", plantsToJson },
+  { "settingsToJson", settingsJson },
+  { "saveAlarms", parseAlarmsDocument },
+  { "savePlants", parsePlantsDocument },
+  { "saveAlarms/deserialize", parseAlarmsText },
+  { "savePlants/deserialize", parsePlantsText },
+  { "setRTCFromISODate", setRtc },
+  { "setRTCFromISODate/invalid", setRtcInvalid },
+  { "listDirectory/500", listSmallArchive },
+  { "listDirectory/10000", listLargeArchive },
+  { "listDirectory/10000/offset", listLargeArchiveOffset },
+  { "listDirectory/10000/week", listLargeArchiveRange },
+  { "listDirectory2/10000", walkLargeArchive },
+};
+
+static double nanosPerCall(const BenchCase& bench, unsigned long iterations) {
+  size_t result = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++) {
+    result += bench.body();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  sink = sink + result;
+  return (double)elapsed / iterations;
+}
+
+static BenchResult measure(const BenchCase& bench, uint32_t minMs, uint32_t repetitions) {
+  // Grow the batch until one repetition takes long enough to time reliably
+  unsigned long iterations = 1;
+  double nanos = nanosPerCall(bench, iterations);
+  while (nanos * iterations < minMs * 1e6 && iterations < (1ul << 30)) {
+    double target = minMs * 1.2e6 / (nanos > 1 ? nanos : 1);
+    iterations = std::min(std::max((unsigned long)target, iterations * 2), iterations * 100);
+    nanos = nanosPerCall(bench, iterations);
+  }
+
+  double samples[BENCH_MAX_REPETITIONS];
+  samples[0] = nanos;
+  for (uint32_t i = 1; i < repetitions; i++) {
+    samples[i] = nanosPerCall(bench, iterations);
+  }
+  std::sort(samples, samples + repetitions);
+  return { bench.name, iterations, samples[repetitions / 2], samples[0], samples[repetitions - 1], bench.body() };
+}
+
+// Medians of a previous run, keyed by benchmark name
+static size_t loadBaseline(const char* path, char names[][64], double* medians, size_t capacity) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    TRACE("Failed to open %s\n", path);
+    return 0;
+  }
+  char line[256];
+  size_t count = 0;
+  while (count < capacity && fgets(line, sizeof(line), file) != NULL) {
+    unsigned long iterations;
+    if (sscanf(line, "%63[^,],%lu,%lf", names[count], &iterations, &medians[count]) == 3) {
+      count++;
+    }
+  }
+  fclose(file);
+  return count;
+}
+
+static bool option(const char* arg, const char* name, uint32_t* value) {
+  size_t length = strlen(name);
+  if (strncmp(arg, name, length) != 0) {
+    return false;
+  }
+  *value = strtoul(arg + length, NULL, 10);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* filter = NULL;
+  const char* baseline = NULL;
+  const char* path = NULL;
+  uint32_t minMs = BENCH_MIN_MS;
+  uint32_t repetitions = BENCH_REPETITIONS;
+  uint32_t threshold = BENCH_THRESHOLD;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+      baseline = argv[i] + 11;
+    } else if (strncmp(argv[i], "--out=", 6) == 0) {
+      path = argv[i] + 6;
+    } else if (!option(argv[i], "--min-ms=", &minMs) && !option(argv[i], "--repetitions=", &repetitions)
+      && !option(argv[i], "--threshold=", &threshold)) {
+      TRACE("Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  repetitions = std::min(std::max(repetitions, (uint32_t)1), (uint32_t)BENCH_MAX_REPETITIONS);
+
+  NativeClock nativeClock = { fakeMillis, fakeDelay, fakeNow, fakeAdjust };
+  setNativeClock(nativeClock);
+  fillSettings(&settings);
+  alarmsText = "{\"alarm\":" + getAlarms(settings) + "}";
+  plantsText = "{\"plants\":" + getPlants(settings) + "}";
+  deserializeJson(alarmsJson, alarmsText);
+  deserializeJson(plantsJson, plantsText);
+  fillArchive("/small", BENCH_SMALL_ARCHIVE);
+  fillArchive("/large", BENCH_LARGE_ARCHIVE);
+
+  char names[BENCH_MAX_CASES][64];
+  double medians[BENCH_MAX_CASES];
+  size_t baselines = baseline != NULL ? loadBaseline(baseline, names, medians, BENCH_MAX_CASES) : 0;
+  if (baseline != NULL && baselines == 0) {
+    return 2;
+  }
+
+  FILE* out = path != NULL ? fopen(path, "w") : stdout;
+  if (out == NULL) {
+    TRACE("Failed to open %s\n", path);
+    return 2;
+  }
+
+  int regressions = 0;
+  fprintf(out, baseline != NULL ? "benchmark,iterations,ns_median,ns_min,ns_max,result,baseline_ns,change_pct\n"
+    : "benchmark,iterations,ns_median,ns_min,ns_max,result\n");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    if (filter != NULL && strstr(cases[i].name, filter) == NULL) {
+      continue;
+    }
+    BenchResult result = measure(cases[i], minMs, repetitions);
+    fprintf(out, "%s,%lu,%.1f,%.1f,%.1f,%zu", result.name, result.iterations, result.median, result.fastest, result.slowest, result.result);
+    if (baseline != NULL) {
+      size_t match = 0;
+      while (match < baselines && strcmp(names[match], result.name) != 0) {
+        match++;
+      }
+      if (match < baselines && medians[match] > 0) {
+        double change = (result.median - medians[match]) * 100 / medians[match];
+        regressions += change > threshold ? 1 : 0;
+        fprintf(out, ",%.1f,%.1f", medians[match], change);
+      } else {
+        fprintf(out, ",,");
+      }
+    }
+    fprintf(out, "\n");
+    fflush(out);
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  return regressions > 0 ? 1 : 0;
+}
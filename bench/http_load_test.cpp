@@ -0,0 +1,194 @@
+/**
+ * @file         : http_load_test.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Host load test for the HTTP routing layer. Runs HttpServer on a loopback
+ * port with handlers shaped like the firmware ones (cached JSON, chunked
+ * JsonWriter output, path arguments, POST bodies) and drives it with
+ * several keep-alive clients that pipeline their requests. Every response
+ * is parsed and checked, the summary is CSV.
+ *
+ * g++ -O2 -std=c++17 -pthread -Isrc bench/http_load_test.cpp src/httpserver.cpp src/jsonwriter.cpp -o http_load_test
+ * ./http_load_test [clients] [requests per client] [pipeline depth]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "httpserver.h"
+#include "jsonwriter.h"
+#include "loadclient.h"
+
+#define LOAD_DEFAULT_CLIENTS              4
+#define LOAD_DEFAULT_REQUESTS             5000
+#define LOAD_DEFAULT_PIPELINE             4
+
+static HttpServer server(0);
+static std::atomic<bool> running(true);
+
+static const char* plantsBody =
+  "{\"plants\":[{\"id\":0,\"size\":10,\"status\":1},{\"id\":1,\"size\":18,\"status\":1},"
+  "{\"id\":2,\"size\":18,\"status\":1},{\"id\":3,\"size\":18,\"status\":1}]}";
+
+static void handlePlants() {
+  if (server.method() != HTTP_GET) {
+    server.send(405, "application/json; charset=utf-8", "{\"error\":\"Method Not Allowed\"}");
+    return;
+  }
+  server.sendHeader("Cache-Control", "no-cache");
+  server.sendHeader("ETag", "\"5a1c0de1\"");
+  if (strcmp(server.headerValue("If-None-Match"), "\"5a1c0de1\"") == 0) {
+    server.send(304);
+    return;
+  }
+  server.send(200, "application/json; charset=utf-8", plantsBody);
+}
+
+static void sendChunk(const char* data, size_t length, void*) {
+  server.sendContent(data, length);
+}
+
+// Same shape as the chunked handlers, enough points to span several chunks
+static void handleFlow() {
+  unsigned long points = strtoul(server.argValue("points"), NULL, 10);
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), sendChunk, NULL);
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json; charset=utf-8", "");
+  json.beginObject();
+  json.key("points").beginArray();
+  for (unsigned long i = 0; i < points; i++) {
+    json.beginArray().value(1719676800ul + i).value(i * 3).value(i % 17).endArray();
+  }
+  json.endArray();
+  json.endObject();
+  json.flush();
+  server.sendContent("");
+}
+
+static void handleJob() {
+  char body[64];
+  snprintf(body, sizeof(body), "{\"id\":%s}", server.pathArgValue(0));
+  server.send(200, "application/json; charset=utf-8", body);
+}
+
+static void handleEcho() {
+  server.send(200, "application/json; charset=utf-8", server.body(), server.bodyLength());
+}
+
+static void handleNotFound() {
+  server.send(404, "application/json; charset=utf-8", "{\"error\":\"Not Found\"}");
+}
+
+static void serverLoop() {
+  while (running.load()) {
+    if (server.waitForClient(50)) {
+      server.handleClient();
+    }
+  }
+}
+
+static const LoadRequest requests[] = {
+  { "GET /api/plants HTTP/1.1\r\nHost: localhost\r\n\r\n", 200 },
+  { "GET /api/plants HTTP/1.1\r\nHost: localhost\r\nIf-None-Match: \"5a1c0de1\"\r\n\r\n", 304 },
+  { "GET /api/flow?points=200 HTTP/1.1\r\nHost: localhost\r\n\r\n", 200 },
+  { "GET /api/jobs/42 HTTP/1.1\r\nHost: localhost\r\n\r\n", 200 },
+  { "POST /api/alarm HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\nContent-Length: 25\r\n\r\n{\"alarm\":[[{\"hour\":19}]]}", 200 },
+  { "GET /missing HTTP/1.1\r\nHost: localhost\r\n\r\n", 404 }
+};
+#define LOAD_REQUEST_KINDS (sizeof(requests) / sizeof(requests[0]))
+
+int main(int argc, char** argv) {
+  unsigned int clients = argc > 1 ? atoi(argv[1]) : LOAD_DEFAULT_CLIENTS;
+  unsigned long count = argc > 2 ? strtoul(argv[2], NULL, 10) : LOAD_DEFAULT_REQUESTS;
+  unsigned int pipeline = argc > 3 ? atoi(argv[3]) : LOAD_DEFAULT_PIPELINE;
+  if (clients > HTTP_MAX_CLIENTS) {
+    clients = HTTP_MAX_CLIENTS;
+  }
+  if (pipeline < 1 || pipeline > LOAD_MAX_PIPELINE) {
+    pipeline = LOAD_DEFAULT_PIPELINE;
+  }
+
+  const char* headers[] = { "If-None-Match" };
+  server.collectHeaders(headers, 1);
+  server.enableCORS(true);
+  server.onNotFound(handleNotFound);
+  server.on("/api/plants", handlePlants);
+  server.on("/api/flow", HTTP_GET, handleFlow);
+  server.on("/api/jobs/{}", HTTP_GET, handleJob);
+  server.on("/api/alarm", HTTP_POST, handleEcho);
+  if (!server.begin()) {
+    fprintf(stderr, "Failed to start the server\n");
+    return 1;
+  }
+  std::thread serverThread(serverLoop);
+
+  std::vector<LoadResult> results(clients);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < clients; i++) {
+    threads.emplace_back(runLoadClient, server.port(), requests, LOAD_REQUEST_KINDS, count, pipeline, i, &results[i]);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  running.store(false);
+  serverThread.join();
+  server.stop();
+
+  unsigned long completed = 0;
+  unsigned long failed = 0;
+  unsigned long reconnects = 0;
+  std::vector<double> latencies;
+  for (LoadResult& result : results) {
+    completed += result.completed;
+    failed += result.failed;
+    reconnects += result.reconnects;
+    latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  double p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+  double p99 = latencies.empty() ? 0 : latencies[(latencies.size() * 99) / 100];
+
+  printf("clients,pipeline,completed,failed,reconnects,requests_per_second,batch_p50_us,batch_p99_us\n");
+  printf("%u,%u,%lu,%lu,%lu,%.0f,%.1f,%.1f\n", clients, pipeline, completed, failed, reconnects, completed / seconds, p50, p99);
+  return failed == 0 ? 0 : 1;
+}
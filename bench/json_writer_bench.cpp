@@ -0,0 +1,223 @@
+/**
+ * @file         : json_writer_bench.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Host benchmark for the streaming JSON serializer. Runs the String
+ * builders /api/alarm and /api/plants answered with before JsonWriter,
+ * kept here verbatim, and the writeAlarms/writePlants the handlers stream
+ * today over the same settings. Both documents are checked to be equal
+ * apart from whitespace, then heap allocations, peak heap growth, bytes
+ * and time per response are reported, allocations are counted by the
+ * native heap profiler.
+ *
+ * pio run -e jsonbench && .pio/build/jsonbench/program [iterations]
+ */
+#include <Arduino.h>
+#include <SD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include "constants.h"
+#include "settings.h"
+#include "hal.h"
+#include "hal_fake.h"
+#include "jsonwriter.h"
+#include "heapprofile.h"
+
+#define BENCH_START_TIME                  1719676800  /* 2024-06-29 16:00:00 UTC */
+#define BENCH_DEFAULT_ITERATIONS          20000
+
+FakeClock fakeClock(BENCH_START_TIME, 0);
+FakeGpioExpander fakeExpander;
+FakeFlowSensor fakeFlow;
+FakeStore fakeStore(EEPROM_SIZE);
+Hal hal = { &fakeClock, &fakeExpander, &fakeFlow, NULL, &fakeStore, &SD };
+
+static Settings settings;
+
+// The builders as they were before the handlers streamed their responses
+static String legacyGetAlarms(Settings settings) {
+  String result = "[";
+  for (int i = 0; i < SETTINGS_MAX_ALARMS; i++) {
+    result += "[";
+    for (int j = 0; j < SETTINGS_ALARM_STATES; j++) {
+      result += "{";
+        result += "  \"id\": " + String(settings.alarm[i][j].id) + ",\n";
+        result += "  \"weekday\": " + String(settings.alarm[i][j].weekday) + ",\n";
+        result += "  \"hour\": " + String(settings.alarm[i][j].hour) + ",\n";
+        result += "  \"minute\": " + String(settings.alarm[i][j].minute) + ",\n";
+        result += "  \"status\": " + String(settings.alarm[i][j].status) + "\n";
+      result += "}";
+      if (j < SETTINGS_ALARM_STATES - 1) result += ",";
+    }
+    result += "]";
+    if (i < SETTINGS_MAX_ALARMS - 1) result += ",";
+  }
+  result += "]";
+  return result;
+}
+
+static String legacyGetPlants(Settings settings) {
+  String result = "[";
+  for (int i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    result += "{";
+      result += "  \"id\": " + String(settings.plant[i].id) + ",\n";
+      result += "  \"size\": " + String(settings.plant[i].size) + ",\n";
+      result += "  \"status\": " + String(settings.plant[i].status) + "\n";
+    result += "}";
+    if (i < SETTINGS_MAX_PLANTS - 1) result += ",";
+  }
+  result += "]";
+  return result;
+}
+
+// Same schedule as the README examples, every alarm slot filled
+static void fillSettings(Settings* settings) {
+  memset(settings, 0, sizeof(Settings));
+  for (uint8_t i = 0; i < SETTINGS_MAX_ALARMS; i++) {
+    uint8_t weekday = 1 << (i % 7);
+    settings->alarm[i][0] = { i, weekday, 19, 30, 1 };
+    settings->alarm[i][1] = { i, weekday, 19, 31, 1 };
+  }
+  for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    settings->plant[i] = { i, (uint8_t)(i == 0 ? 10 : 18), 1 };
+  }
+}
+
+static unsigned long sinkChunks = 0;
+
+// Stands in for the socket, the handlers send every flushed chunk as is
+static void countingSink(const char*, size_t, void*) {
+  sinkChunks++;
+}
+
+static void captureSink(const char* data, size_t length, void* context) {
+  ((std::string*)context)->append(data, length);
+}
+
+static size_t legacyAlarms() {
+  return legacyGetAlarms(settings).length();
+}
+
+static size_t legacyPlants() {
+  return legacyGetPlants(settings).length();
+}
+
+static size_t streamedAlarms() {
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), countingSink, NULL);
+  writeAlarms(json, settings);
+  json.flush();
+  return json.size();
+}
+
+static size_t streamedPlants() {
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), countingSink, NULL);
+  writePlants(json, settings);
+  json.flush();
+  return json.size();
+}
+
+// The legacy builders pretty printed inside the objects, only keys hold no spaces
+static std::string compact(const String& text) {
+  std::string result;
+  bool quoted = false;
+  for (size_t i = 0; i < text.length(); i++) {
+    char character = text[i];
+    if (character == '"' && (i == 0 || text[i - 1] != '\\')) {
+      quoted = !quoted;
+    }
+    if (quoted || (character != ' ' && character != '\n')) {
+      result += character;
+    }
+  }
+  return result;
+}
+
+static bool sameDocument(const char* name, const String& legacy, void (*writer)(JsonWriter&, const Settings&)) {
+  std::string streamed;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), captureSink, &streamed);
+  writer(json, settings);
+  json.flush();
+  if (compact(legacy) != streamed) {
+    fprintf(stderr, "%s: documents differ\n%s\n%s\n", name, compact(legacy).c_str(), streamed.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void run(const char* name, const char* builder, size_t (*body)(), unsigned long iterations, size_t stackBytes) {
+  HeapTotals before;
+  HeapTotals after;
+  int32_t peak = 0;
+  size_t bytes = 0;
+  sinkChunks = 0;
+  getHeapTotals(&before);
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++) {
+    HeapScope scope(name);
+    bytes = body();
+    if (scope.peak() > peak) {
+      peak = scope.peak();
+    }
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  getHeapTotals(&after);
+  printf("%s,%s,%zu,%.1f,%ld,%zu,%.1f,%.1f\n", name, builder, bytes, (double)(after.allocations - before.allocations) / iterations,
+    (long)peak, stackBytes, (double)sinkChunks / iterations, (double)elapsed / iterations);
+}
+
+int main(int argc, char** argv) {
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_ITERATIONS;
+  if (iterations == 0) {
+    iterations = 1;
+  }
+  fillSettings(&settings);
+  if (!sameDocument("alarms", legacyGetAlarms(settings), writeAlarms) ||
+      !sameDocument("plants", legacyGetPlants(settings), writePlants)) {
+    return 1;
+  }
+  beginHeapProfile();
+  printf("response,builder,bytes,allocations,peak_heap,stack_buffer,chunks,ns_per_response\n");
+  run("alarms", "string", legacyAlarms, iterations, 0);
+  run("alarms", "jsonwriter", streamedAlarms, iterations, JSON_WRITER_BUFFER_SIZE);
+  run("plants", "string", legacyPlants, iterations, 0);
+  run("plants", "jsonwriter", streamedPlants, iterations, JSON_WRITER_BUFFER_SIZE);
+  return 0;
+}
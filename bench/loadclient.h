@@ -0,0 +1,193 @@
+/**
+ * @file         : loadclient.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Keep-alive load client shared by the host HTTP load tests. Each client
+ * writes its requests in pipelined batches, parses every response and checks
+ * its status, and reconnects when the server recycles the connection.
+ */
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <chrono>
+#include <vector>
+
+#define LOAD_RESPONSE_BUFFER_SIZE         16384
+#define LOAD_MAX_PIPELINE                 64
+
+struct LoadRequest {
+  std::string text;
+  int status;
+};
+
+struct LoadResult {
+  unsigned long completed;
+  unsigned long failed;
+  unsigned long reconnects;       // Connections recycled by the server
+  std::vector<double> latencies;  // Microseconds per pipelined batch
+};
+
+// Parses one response at the head of the buffer, returns its size or 0 when incomplete
+static size_t parseResponse(const char* data, size_t length, int* status) {
+  const char* end = NULL;
+  for (size_t i = 3; i < length; i++) {
+    if (memcmp(data + i - 3, "\r\n\r\n", 4) == 0) {
+      end = data + i + 1;
+      break;
+    }
+  }
+  if (end == NULL) {
+    return 0;
+  }
+  *status = atoi(data + 9);
+  size_t headerLength = end - data;
+  const char* contentLength = strcasestr(data, "Content-Length:");
+  if (contentLength != NULL && contentLength < end) {
+    size_t total = headerLength + strtoul(contentLength + 15, NULL, 10);
+    return length >= total ? total : 0;
+  }
+  const char* chunked = strcasestr(data, "Transfer-Encoding: chunked");
+  if (chunked == NULL || chunked > end) {
+    return headerLength;
+  }
+  size_t offset = headerLength;
+  for (;;) {
+    if (offset >= length) {
+      return 0;
+    }
+    char* sizeEnd = NULL;
+    size_t size = strtoul(data + offset, &sizeEnd, 16);
+    const char* lineEnd = (const char*)memmem(data + offset, length - offset, "\r\n", 2);
+    if (lineEnd == NULL) {
+      return 0;
+    }
+    offset = (lineEnd - data) + 2 + size + 2;
+    if (offset > length) {
+      return 0;
+    }
+    if (size == 0) {
+      return offset;
+    }
+  }
+}
+
+static int connectClient(uint16_t port) {
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(client, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    close(client);
+    return -1;
+  }
+  return client;
+}
+
+// Sends count requests cycling through kinds from seed on, pipeline at a time
+static void runLoadClient(uint16_t port, const LoadRequest* requests, size_t kinds, unsigned long count, unsigned int pipeline, unsigned int seed, LoadResult* result) {
+  static thread_local char buffer[LOAD_RESPONSE_BUFFER_SIZE];
+  result->completed = 0;
+  result->failed = 0;
+  result->reconnects = 0;
+  int client = connectClient(port);
+  unsigned long sent = 0;
+  unsigned int kind = seed;
+  while (client >= 0 && sent < count) {
+    // Write a batch of requests back to back, then read all the answers
+    const LoadRequest* batch[LOAD_MAX_PIPELINE];
+    unsigned int size = 0;
+    for (; size < pipeline && sent < count; size++, sent++, kind++) {
+      batch[size] = &requests[kind % kinds];
+    }
+    auto start = std::chrono::steady_clock::now();
+    unsigned int answered = 0;
+    unsigned int attempts = 0;
+    while (answered < size && attempts++ < 3) {
+      // The server recycles keep-alive connections, resend what was not answered on a new one
+      if (attempts > 1) {
+        close(client);
+        client = connectClient(port);
+        result->reconnects++;
+        if (client < 0) {
+          break;
+        }
+      }
+      std::string out;
+      for (unsigned int i = answered; i < size; i++) {
+        out += batch[i]->text;
+      }
+      if (::send(client, out.data(), out.size(), MSG_NOSIGNAL) != (ssize_t)out.size()) {
+        continue;
+      }
+      size_t length = 0;
+      buffer[0] = '\0';
+      while (answered < size) {
+        int status = 0;
+        size_t used = parseResponse(buffer, length, &status);
+        if (used > 0) {
+          if (status == batch[answered]->status) {
+            result->completed++;
+          } else {
+            result->failed++;
+          }
+          answered++;
+          length -= used;
+          memmove(buffer, buffer + used, length);
+          buffer[length] = '\0';
+          continue;
+        }
+        ssize_t received = recv(client, buffer + length, sizeof(buffer) - length - 1, 0);
+        if (received <= 0) {
+          break;
+        }
+        length += received;
+        buffer[length] = '\0';
+      }
+    }
+    result->failed += size - answered;
+    result->latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+  }
+  if (client >= 0) {
+    close(client);
+  }
+  result->failed += count - sent;
+}
@@ -0,0 +1,110 @@
+import gzip
+import hashlib
+import os
+import sys
+
+# Bundles web/ into src/dashboardassets.h: every asset is gzip compressed and
+# stored in flash, everything but index.html gets a content hash in its name
+# so it can be cached forever. Runs as a PlatformIO pre script or standalone.
+
+CONTENT_TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.js': 'application/javascript; charset=utf-8',
+    '.css': 'text/css; charset=utf-8',
+    '.svg': 'image/svg+xml',
+    '.png': 'image/png',
+    '.ico': 'image/x-icon',
+    '.json': 'application/json; charset=utf-8',
+}
+ENTRY = 'index.html'
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:8]
+
+def compress(data):
+    # mtime 0 keeps the output and the generated header reproducible
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+def hashed_name(name, digest):
+    stem, extension = os.path.splitext(name)
+    return '%s.%s%s' % (stem, digest, extension)
+
+def collect(web_dir):
+    assets = {}
+    for root, _, files in os.walk(web_dir):
+        for file in sorted(files):
+            path = os.path.join(root, file)
+            name = os.path.relpath(path, web_dir).replace(os.sep, '/')
+            if os.path.splitext(name)[1] not in CONTENT_TYPES:
+                continue
+            with open(path, 'rb') as f:
+                assets[name] = f.read()
+    if ENTRY not in assets:
+        raise SystemExit('%s/%s is missing' % (web_dir, ENTRY))
+    return assets
+
+def bundle(assets):
+    bundled = []
+    renames = {}
+    for name, data in sorted(assets.items()):
+        if name == ENTRY:
+            continue
+        digest = content_hash(data)
+        renames[name] = hashed_name(name, digest)
+        bundled.append(('/' + renames[name], name, data, digest, True))
+    # The entry page keeps its URL and points at the hashed names
+    page = assets[ENTRY].decode('utf-8')
+    for name, renamed in renames.items():
+        page = page.replace('"/%s"' % name, '"/%s"' % renamed).replace('"%s"' % name, '"/%s"' % renamed)
+    page = page.encode('utf-8')
+    bundled.insert(0, ('/', ENTRY, page, content_hash(page), False))
+    return bundled
+
+def c_array(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append('  ' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+    return '\n'.join(lines)
+
+def render(bundled):
+    out = ['// Generated by build-dashboard.py from web/, do not edit', '#pragma once', '']
+    entries = []
+    raw_total = packed_total = 0
+    for index, (path, name, data, digest, immutable) in enumerate(bundled):
+        packed = compress(data)
+        raw_total += len(data)
+        packed_total += len(packed)
+        content_type = CONTENT_TYPES[os.path.splitext(name)[1]]
+        out.append('// %s, %d bytes, %d gzipped' % (name, len(data), len(packed)))
+        out.append('static const uint8_t dashboardAsset%d[] PROGMEM = {' % index)
+        out.append(c_array(packed))
+        out.append('};')
+        out.append('')
+        entries.append('  { "%s", "%s", "\\"%s\\"", %s, dashboardAsset%d, sizeof(dashboardAsset%d) },'
+                       % (path, content_type, digest, 'true' if immutable else 'false', index, index))
+    out.append('static const DashboardAsset dashboardAssets[] = {')
+    out.extend(entries)
+    out.append('};')
+    out.append('')
+    return '\n'.join(out), raw_total, packed_total
+
+def build(project_dir):
+    web_dir = os.path.join(project_dir, 'web')
+    target = os.path.join(project_dir, 'src', 'dashboardassets.h')
+    header, raw_total, packed_total = render(bundle(collect(web_dir)))
+    current = None
+    if os.path.exists(target):
+        with open(target) as f:
+            current = f.read()
+    # Leave the file alone when nothing changed so the firmware is not rebuilt
+    if header != current:
+        with open(target, 'w') as f:
+            f.write(header)
+    print('Dashboard: %d bytes, %d gzipped' % (raw_total, packed_total))
+
+try:
+    Import('env')
+    build(env.subst('$PROJECT_DIR'))
+except NameError:
+    if __name__ == '__main__':
+        build(sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__)))
@@ -0,0 +1,66 @@
+import argparse
+import struct
+import sys
+
+# Mirrors FlowBlockHeader in src/flowcodec.h
+HEADER = struct.Struct('<HBBIHHH')
+MAGIC = 0x4653
+VERSION = 1
+
+def read_varint(data, position):
+    result = 0
+    shift = 0
+    while True:
+        byte = data[position]
+        position += 1
+        result |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return result, position
+        shift += 7
+
+def zigzag_decode(value):
+    return (value >> 1) ^ -(value & 1)
+
+def decode_block(data, offset):
+    magic, version, plant, base_time, count, times_length, values_length = HEADER.unpack_from(data, offset)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('Invalid flow block at offset %d' % offset)
+    times = offset + HEADER.size
+    values = times + times_length
+    time = delta = value = 0
+    samples = []
+    for i in range(count):
+        encoded_time, times = read_varint(data, times)
+        encoded_value, values = read_varint(data, values)
+        if i == 0:
+            time = encoded_time
+            value = zigzag_decode(encoded_value)
+        else:
+            delta += zigzag_decode(encoded_time)
+            time += delta
+            value += zigzag_decode(encoded_value)
+        samples.append((base_time * 1000 + time, plant, value))
+    return samples, HEADER.size + times_length + values_length
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode smart-green flow segments (.flw) into csv')
+    parser.add_argument('files', nargs='+', help='Flow segment files copied from the SD card')
+    args = parser.parse_args()
+
+    print('timestamp_ms,plant,milliliters')
+    for file_name in args.files:
+        with open(file_name, 'rb') as segment:
+            data = segment.read()
+        offset = 0
+        while offset + HEADER.size <= len(data):
+            try:
+                samples, length = decode_block(data, offset)
+            except (ValueError, IndexError) as error:
+                print('%s: %s' % (file_name, error), file=sys.stderr)
+                break
+            for timestamp, plant, value in samples:
+                print('%d,%d,%d' % (timestamp, plant, value))
+            offset += length
+
+if __name__ == '__main__':
+    main()
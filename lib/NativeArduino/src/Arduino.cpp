@@ -0,0 +1,229 @@
+/**
+ * @file         : Arduino.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "Arduino.h"
+#include <stdarg.h>
+#include <malloc.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+static uint32_t hostMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+static void hostDelay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static uint32_t hostNow() {
+  return time(NULL);
+}
+
+static void hostAdjust(uint32_t unixTime) {}
+
+static NativeClock nativeClock = { hostMillis, hostDelay, hostNow, hostAdjust };
+
+void setNativeClock(const NativeClock& clock) {
+  nativeClock = clock;
+}
+
+const NativeClock& getNativeClock() {
+  return nativeClock;
+}
+
+uint32_t millis() {
+  return nativeClock.millis();
+}
+
+uint32_t micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+void delay(uint32_t ms) {
+  nativeClock.delay(ms);
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+uint8_t EspClass::getChipCores() {
+  return std::thread::hardware_concurrency();
+}
+
+uint32_t EspClass::getHeapSize() {
+  struct mallinfo2 info = mallinfo2();
+  return info.arena + info.hblkhd;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  struct mallinfo2 info = mallinfo2();
+  return info.fordblks;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackSize, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  std::thread thread(task, parameter);
+  if (handle != NULL) {
+    *handle = (TaskHandle_t)(uintptr_t)std::hash<std::thread::id>()(thread.get_id());
+  }
+  thread.detach();
+  return pdPASS;
+}
+
+/**
+ * Timeouts are not modelled, takes either succeed right away or block
+ */
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new std::recursive_mutex();
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return new std::recursive_mutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  std::recursive_mutex* mutex = (std::recursive_mutex*)semaphore;
+  if (ticks == 0) {
+    return mutex->try_lock() ? pdTRUE : pdFALSE;
+  }
+  mutex->lock();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  ((std::recursive_mutex*)semaphore)->unlock();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  return xSemaphoreTake(semaphore, ticks);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+  return xSemaphoreGive(semaphore);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete (std::recursive_mutex*)semaphore;
+}
+
+// One lock behind every critical section, like disabling interrupts on a single core
+static std::recursive_mutex criticalSection;
+
+void portENTER_CRITICAL(portMUX_TYPE* mux) {
+  criticalSection.lock();
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+  criticalSection.unlock();
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (written < size && write(buffer[written]) == 1) {
+    written++;
+  }
+  return written;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char stack[128];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(stack, sizeof(stack), format, args);
+  va_end(args);
+  if (length < 0) {
+    return 0;
+  }
+  if ((size_t)length < sizeof(stack)) {
+    return write((const uint8_t*)stack, length);
+  }
+  char* heap = (char*)malloc(length + 1);
+  if (heap == NULL) {
+    return 0;
+  }
+  va_start(args, format);
+  vsnprintf(heap, length + 1, format, args);
+  va_end(args);
+  size_t written = write((const uint8_t*)heap, length);
+  free(heap);
+  return written;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+  size_t count = 0;
+  int value;
+  while (count < length && (value = read()) >= 0) {
+    buffer[count++] = (char)value;
+  }
+  return count;
+}
+
+String Stream::readString() {
+  String result;
+  int value;
+  while ((value = read()) >= 0) {
+    result.concat((char)value);
+  }
+  return result;
+}
+
+size_t Stream::readBytesUntil(char terminator, char* buffer, size_t length) {
+  size_t count = 0;
+  int value;
+  while (count < length && (value = read()) >= 0 && value != terminator) {
+    buffer[count++] = (char)value;
+  }
+  return count;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String result;
+  int value;
+  while ((value = read()) >= 0 && value != terminator) {
+    result.concat((char)value);
+  }
+  return result;
+}
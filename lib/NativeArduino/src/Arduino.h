@@ -0,0 +1,230 @@
+/**
+ * @file         : Arduino.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include "WString.h"
+
+/**
+ * Host stand-in for the parts of the ESP32 Arduino core the portable modules
+ * use. Pins and interrupts are no-ops, peripherals are reached through the
+ * HAL instead.
+ */
+
+#define HIGH                              0x1
+#define LOW                               0x0
+#define INPUT                             0x01
+#define OUTPUT                            0x03
+#define INPUT_PULLUP                      0x05
+#define RISING                            0x01
+#define FALLING                           0x02
+#define CHANGE                            0x03
+#define SS                                5
+#define DEC                               10
+#define HEX                               16
+#define OCT                               8
+#define BIN                               2
+
+#define PROGMEM
+#define PSTR(s)                           (s)
+#define F(s)                              (s)
+#define pgm_read_byte(address)            (*(const uint8_t*)(address))
+#define memcpy_P                          memcpy
+#define strlen_P                          strlen
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/**
+ * Time, millis() and delay() follow the installed clock (virtual time under
+ * simulation), micros() always reads the host monotonic clock so durations
+ * of the code itself stay real.
+ */
+struct NativeClock {
+  uint32_t (*millis)();
+  void (*delay)(uint32_t ms);
+  uint32_t (*now)();                      // Unix time read by RTC_DS3231
+  void (*adjust)(uint32_t unixTime);
+};
+
+void setNativeClock(const NativeClock& clock);
+const NativeClock& getNativeClock();
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return HIGH; }
+inline void attachInterrupt(uint8_t, void (*)(void), int) {}
+inline void detachInterrupt(uint8_t) {}
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+/**
+ * FreeRTOS primitives the modules share state with, backed by std mutexes
+ */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void* SemaphoreHandle_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* parameter);
+struct portMUX_TYPE { volatile int owner; };
+
+#define portTICK_PERIOD_MS                1
+#define portMAX_DELAY                     0xFFFFFFFF
+#define pdFALSE                           0
+#define pdTRUE                            1
+#define pdPASS                            pdTRUE
+#define pdFAIL                            pdFALSE
+#define portMUX_INITIALIZER_UNLOCKED      {0}
+#define tskIDLE_PRIORITY                  0
+
+void vTaskDelay(TickType_t ticks);
+// Tasks are detached host threads, priority and core are ignored
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackSize, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+void portENTER_CRITICAL(portMUX_TYPE* mux);
+void portEXIT_CRITICAL(portMUX_TYPE* mux);
+#define portENTER_CRITICAL_ISR            portENTER_CRITICAL
+#define portEXIT_CRITICAL_ISR             portEXIT_CRITICAL
+
+enum esp_reset_reason_t {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO
+};
+
+inline esp_reset_reason_t esp_reset_reason() { return ESP_RST_POWERON; }
+
+// Chip queries describe the host, heap figures come from the C allocator
+class EspClass {
+public:
+  const char* getChipModel() { return "native"; }
+  uint8_t getChipCores();
+  uint8_t getChipRevision() { return 0; }
+  uint32_t getFlashChipSize() { return 0; }
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap() { return getFreeHeap(); }
+  void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+inline uint32_t esp_get_free_heap_size() { return ESP.getFreeHeap(); }
+
+// newlib has it, glibc only since 2.38
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char* destination, const char* source, size_t size) {
+  size_t length = strlen(source);
+  if (size > 0) {
+    size_t copied = length < size - 1 ? length : size - 1;
+    memcpy(destination, source, copied);
+    destination[copied] = '\0';
+  }
+  return length;
+}
+#endif
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* text) { return text == NULL ? 0 : write((const uint8_t*)text, strlen(text)); }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char* text) { return write(text); }
+  size_t print(const String& text) { return write((const uint8_t*)text.c_str(), text.length()); }
+  size_t print(char value) { return write((uint8_t)value); }
+  size_t print(int value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String(value, base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+  size_t println() { return write((uint8_t)'\n'); }
+  template <typename T> size_t println(const T& value) { return print(value) + println(); }
+  template <typename T> size_t println(const T& value, int format) { return print(value, format) + println(); }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(char* buffer, size_t length);
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+  String readString();
+  String readStringUntil(char terminator);
+  size_t readBytesUntil(char terminator, char* buffer, size_t length);
+};
+
+// Serial goes to stdout, nothing is ever received
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  using Print::write;
+  size_t write(uint8_t value) { return fputc(value, stdout) == EOF ? 0 : 1; }
+  size_t write(const uint8_t* buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  void flush() { fflush(stdout); }
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
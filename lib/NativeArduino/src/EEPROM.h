@@ -0,0 +1,57 @@
+/**
+ * @file         : EEPROM.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+// RAM backed, commit() only counts
+class EEPROMClass {
+public:
+  bool begin(size_t size) { data.assign(size, 0xFF); return true; }
+  size_t length() const { return data.size(); }
+  size_t readBytes(int address, void* value, size_t length);
+  size_t writeBytes(int address, const void* value, size_t length);
+  bool commit() { commits++; return true; }
+  uint32_t commitCount() const { return commits; }
+  template <typename T> T& get(int address, T& value) { readBytes(address, &value, sizeof(T)); return value; }
+  template <typename T> const T& put(int address, const T& value) { writeBytes(address, &value, sizeof(T)); return value; }
+
+private:
+  std::vector<uint8_t> data;
+  uint32_t commits = 0;
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,397 @@
+/**
+ * @file         : FS.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "FS.h"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace fs;
+
+size_t File::write(uint8_t value) {
+  return write(&value, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  return impl ? impl->write(buffer, size) : 0;
+}
+
+int File::available() {
+  return impl ? (int)(impl->size() - impl->position()) : 0;
+}
+
+int File::read() {
+  uint8_t value;
+  return read(&value, 1) == 1 ? value : -1;
+}
+
+int File::peek() {
+  if (!impl) {
+    return -1;
+  }
+  size_t position = impl->position();
+  int value = read();
+  impl->seek(position, SeekSet);
+  return value;
+}
+
+void File::flush() {
+  if (impl) {
+    impl->flush();
+  }
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  return impl ? impl->read(buffer, size) : 0;
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+  return impl ? impl->seek(position, mode) : false;
+}
+
+size_t File::position() const {
+  return impl ? impl->position() : 0;
+}
+
+size_t File::size() const {
+  return impl ? impl->size() : 0;
+}
+
+void File::close() {
+  if (impl) {
+    impl->close();
+    impl = NULL;
+  }
+}
+
+File::operator bool() const {
+  return impl && *impl;
+}
+
+const char* File::path() const {
+  return impl ? impl->path() : NULL;
+}
+
+const char* File::name() const {
+  return impl ? impl->name() : NULL;
+}
+
+bool File::isDirectory() const {
+  return impl ? impl->isDirectory() : false;
+}
+
+File File::openNextFile(const char* mode) {
+  return impl ? File(impl->openNextFile(mode)) : File();
+}
+
+void File::rewindDirectory() {
+  if (impl) {
+    impl->rewindDirectory();
+  }
+}
+
+File FS::open(const char* path, const char* mode, const bool create) {
+  return impl ? File(impl->open(path, mode, create)) : File();
+}
+
+bool FS::exists(const char* path) {
+  return impl && impl->exists(path);
+}
+
+bool FS::remove(const char* path) {
+  return impl && impl->remove(path);
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return impl && impl->rename(from, to);
+}
+
+bool FS::mkdir(const char* path) {
+  return impl && impl->mkdir(path);
+}
+
+bool FS::rmdir(const char* path) {
+  return impl && impl->rmdir(path);
+}
+
+namespace {
+
+typedef std::shared_ptr<std::vector<uint8_t> > MemoryData;
+
+struct MemoryNode {
+  bool directory;
+  MemoryData data;
+};
+
+typedef std::map<std::string, MemoryNode> MemoryTree;
+
+// "/a//b/" -> "/a/b", the root is "/"
+std::string normalize(const char* path) {
+  std::string result;
+  for (const char* cursor = path; cursor != NULL && *cursor != '\0'; cursor++) {
+    if (*cursor == '/' && (result.empty() || result[result.size() - 1] == '/')) {
+      continue;
+    }
+    if (result.empty()) {
+      result = "/";
+    }
+    result += *cursor;
+  }
+  if (result.size() > 1 && result[result.size() - 1] == '/') {
+    result.erase(result.size() - 1);
+  }
+  return result.empty() ? "/" : result;
+}
+
+std::string parentOf(const std::string& path) {
+  size_t slash = path.rfind('/');
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+class MemoryFile : public FileImpl {
+public:
+  MemoryFile(const std::string& path, MemoryData data, bool readable, bool writable, bool append)
+    : filePath(path), baseName(path.substr(path.rfind('/') + 1)), data(data),
+      readable(readable), writable(writable), append(append), open(true), cursor(0) {}
+
+  size_t write(const uint8_t* buffer, size_t size) {
+    if (!open || !writable) {
+      return 0;
+    }
+    if (append) {
+      cursor = data->size();
+    }
+    if (cursor + size > data->size()) {
+      data->resize(cursor + size);
+    }
+    memcpy(data->data() + cursor, buffer, size);
+    cursor += size;
+    return size;
+  }
+
+  size_t read(uint8_t* buffer, size_t size) {
+    if (!open || !readable || cursor >= data->size()) {
+      return 0;
+    }
+    size_t count = data->size() - cursor < size ? data->size() - cursor : size;
+    memcpy(buffer, data->data() + cursor, count);
+    cursor += count;
+    return count;
+  }
+
+  void flush() {}
+
+  bool seek(uint32_t position, SeekMode mode) {
+    size_t base = mode == SeekCur ? cursor : mode == SeekEnd ? data->size() : 0;
+    cursor = base + position;
+    return open;
+  }
+
+  size_t position() const { return cursor; }
+  size_t size() const { return data->size(); }
+  void close() { open = false; }
+  const char* path() const { return filePath.c_str(); }
+  const char* name() const { return baseName.c_str(); }
+  bool isDirectory() const { return false; }
+  FileImplPtr openNextFile(const char* mode) { return FileImplPtr(); }
+  void rewindDirectory() {}
+  operator bool() { return open; }
+
+private:
+  std::string filePath;
+  std::string baseName;
+  MemoryData data;
+  bool readable;
+  bool writable;
+  bool append;
+  bool open;
+  size_t cursor;
+};
+
+class MemoryFileSystem;
+
+class MemoryDirectory : public FileImpl {
+public:
+  MemoryDirectory(MemoryFileSystem* fs, const std::string& path, const std::vector<std::string>& entries)
+    : fs(fs), directoryPath(path), baseName(path == "/" ? "/" : path.substr(path.rfind('/') + 1)),
+      entries(entries), next(0), open(true) {}
+
+  size_t write(const uint8_t* buffer, size_t size) { return 0; }
+  size_t read(uint8_t* buffer, size_t size) { return 0; }
+  void flush() {}
+  bool seek(uint32_t position, SeekMode mode) { return false; }
+  size_t position() const { return 0; }
+  size_t size() const { return 0; }
+  void close() { open = false; }
+  const char* path() const { return directoryPath.c_str(); }
+  const char* name() const { return baseName.c_str(); }
+  bool isDirectory() const { return true; }
+  FileImplPtr openNextFile(const char* mode);
+  void rewindDirectory() { next = 0; }
+  operator bool() { return open; }
+
+private:
+  MemoryFileSystem* fs;
+  std::string directoryPath;
+  std::string baseName;
+  std::vector<std::string> entries;
+  size_t next;
+  bool open;
+};
+
+class MemoryFileSystem : public FSImpl {
+public:
+  MemoryFileSystem() {
+    MemoryNode root = { true, MemoryData() };
+    tree["/"] = root;
+  }
+
+  FileImplPtr open(const char* path, const char* mode, const bool create) {
+    std::string key = normalize(path);
+    MemoryTree::iterator node = tree.find(key);
+    if (node != tree.end() && node->second.directory) {
+      return FileImplPtr(new MemoryDirectory(this, key, children(key)));
+    }
+    bool plus = strchr(mode, '+') != NULL;
+    if (mode[0] == 'r') {
+      if (node == tree.end()) {
+        return FileImplPtr();
+      }
+      return FileImplPtr(new MemoryFile(key, node->second.data, true, plus, false));
+    }
+    if (mode[0] != 'w' && mode[0] != 'a') {
+      return FileImplPtr();
+    }
+    if (node == tree.end()) {
+      MemoryTree::iterator parent = tree.find(parentOf(key));
+      if (parent == tree.end() || !parent->second.directory) {
+        return FileImplPtr();
+      }
+      MemoryNode file = { false, MemoryData(new std::vector<uint8_t>()) };
+      node = tree.insert(std::make_pair(key, file)).first;
+    } else if (mode[0] == 'w') {
+      node->second.data->clear();
+    }
+    return FileImplPtr(new MemoryFile(key, node->second.data, plus, true, mode[0] == 'a'));
+  }
+
+  bool exists(const char* path) {
+    return tree.count(normalize(path)) > 0;
+  }
+
+  bool rename(const char* from, const char* to) {
+    std::string source = normalize(from);
+    std::string target = normalize(to);
+    MemoryTree::iterator parent = tree.find(parentOf(target));
+    if (source == "/" || !tree.count(source) || tree.count(target) || parent == tree.end() || !parent->second.directory) {
+      return false;
+    }
+    // Move the node and everything below it
+    std::vector<std::string> moved;
+    for (MemoryTree::iterator entry = tree.begin(); entry != tree.end(); ++entry) {
+      if (entry->first == source || entry->first.compare(0, source.size() + 1, source + "/") == 0) {
+        moved.push_back(entry->first);
+      }
+    }
+    for (size_t i = 0; i < moved.size(); i++) {
+      tree[target + moved[i].substr(source.size())] = tree[moved[i]];
+      tree.erase(moved[i]);
+    }
+    return true;
+  }
+
+  bool remove(const char* path) {
+    MemoryTree::iterator node = tree.find(normalize(path));
+    if (node == tree.end() || node->second.directory) {
+      return false;
+    }
+    tree.erase(node);
+    return true;
+  }
+
+  bool mkdir(const char* path) {
+    std::string key = normalize(path);
+    MemoryTree::iterator parent = tree.find(parentOf(key));
+    if (tree.count(key) || parent == tree.end() || !parent->second.directory) {
+      return false;
+    }
+    MemoryNode directory = { true, MemoryData() };
+    tree[key] = directory;
+    return true;
+  }
+
+  bool rmdir(const char* path) {
+    std::string key = normalize(path);
+    MemoryTree::iterator node = tree.find(key);
+    if (key == "/" || node == tree.end() || !node->second.directory || !children(key).empty()) {
+      return false;
+    }
+    tree.erase(node);
+    return true;
+  }
+
+  std::vector<std::string> children(const std::string& directory) {
+    std::vector<std::string> result;
+    std::string prefix = directory == "/" ? "/" : directory + "/";
+    for (MemoryTree::iterator entry = tree.lower_bound(prefix); entry != tree.end(); ++entry) {
+      if (entry->first.compare(0, prefix.size(), prefix) != 0) {
+        break;
+      }
+      if (entry->first.size() > prefix.size() && entry->first.find('/', prefix.size()) == std::string::npos) {
+        result.push_back(entry->first);
+      }
+    }
+    return result;
+  }
+
+private:
+  MemoryTree tree;
+};
+
+FileImplPtr MemoryDirectory::openNextFile(const char* mode) {
+  while (open && next < entries.size()) {
+    FileImplPtr entry = fs->open(entries[next++].c_str(), mode, false);
+    if (entry) {
+      return entry;
+    }
+  }
+  return FileImplPtr();
+}
+
+} // namespace
+
+FSImplPtr fs::createMemoryFS() {
+  return FSImplPtr(new MemoryFileSystem());
+}
@@ -0,0 +1,153 @@
+/**
+ * @file         : FS.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <memory>
+
+#define FILE_READ                         "r"
+#define FILE_WRITE                        "w"
+#define FILE_APPEND                       "a"
+
+/**
+ * Mirror of the ESP32 core fs::FS and fs::File wrappers, implementations plug
+ * in through FSImpl and FileImpl.
+ */
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+class FileImpl;
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+class FSImpl;
+typedef std::shared_ptr<FSImpl> FSImplPtr;
+
+class File : public Stream {
+public:
+  File(FileImplPtr impl = FileImplPtr()) : impl(impl) {}
+
+  using Print::write;
+  size_t write(uint8_t value);
+  size_t write(const uint8_t* buffer, size_t size);
+  int available();
+  int read();
+  int peek();
+  void flush();
+  size_t read(uint8_t* buffer, size_t size);
+  bool seek(uint32_t position, SeekMode mode);
+  bool seek(uint32_t position) { return seek(position, SeekSet); }
+  size_t position() const;
+  size_t size() const;
+  void close();
+  operator bool() const;
+  const char* path() const;
+  const char* name() const;
+  bool isDirectory() const;
+  File openNextFile(const char* mode = FILE_READ);
+  void rewindDirectory();
+
+protected:
+  FileImplPtr impl;
+};
+
+class FileImpl {
+public:
+  virtual ~FileImpl() {}
+  virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+  virtual size_t read(uint8_t* buffer, size_t size) = 0;
+  virtual void flush() = 0;
+  virtual bool seek(uint32_t position, SeekMode mode) = 0;
+  virtual size_t position() const = 0;
+  virtual size_t size() const = 0;
+  virtual void close() = 0;
+  virtual const char* path() const = 0;
+  virtual const char* name() const = 0;
+  virtual bool isDirectory() const = 0;
+  virtual FileImplPtr openNextFile(const char* mode) = 0;
+  virtual void rewindDirectory() = 0;
+  virtual operator bool() = 0;
+};
+
+class FSImpl {
+public:
+  virtual ~FSImpl() {}
+  virtual FileImplPtr open(const char* path, const char* mode, const bool create) = 0;
+  virtual bool exists(const char* path) = 0;
+  virtual bool rename(const char* from, const char* to) = 0;
+  virtual bool remove(const char* path) = 0;
+  virtual bool mkdir(const char* path) = 0;
+  virtual bool rmdir(const char* path) = 0;
+};
+
+class FS {
+public:
+  FS(FSImplPtr impl) : impl(impl) {}
+
+  File open(const char* path, const char* mode = FILE_READ, const bool create = false);
+  File open(const String& path, const char* mode = FILE_READ, const bool create = false) { return open(path.c_str(), mode, create); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char* path);
+  bool mkdir(const String& path) { return mkdir(path.c_str()); }
+  bool rmdir(const char* path);
+  bool rmdir(const String& path) { return rmdir(path.c_str()); }
+
+protected:
+  FSImplPtr impl;
+};
+
+/**
+ * Whole filesystem kept in memory, stands in for the SD card on the host.
+ * Behaves like FAT through the ESP32 VFS: parents must exist, renames do not
+ * overwrite and only empty directories can be removed.
+ */
+FSImplPtr createMemoryFS();
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
@@ -0,0 +1,128 @@
+/**
+ * @file         : RTClib.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "RTClib.h"
+
+static const uint8_t daysInMonth[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30 };
+
+static uint16_t date2days(uint16_t y, uint8_t m, uint8_t d) {
+  if (y >= 2000U) {
+    y -= 2000U;
+  }
+  uint16_t days = d;
+  for (uint8_t i = 1; i < m; ++i) {
+    days += daysInMonth[i - 1];
+  }
+  if (m > 2 && y % 4 == 0) {
+    ++days;
+  }
+  return days + 365 * y + (y + 3) / 4 - 1;
+}
+
+static uint8_t conv2d(const char* p) {
+  uint8_t v = 0;
+  if ('0' <= *p && *p <= '9') {
+    v = *p - '0';
+  }
+  return 10 * v + *++p - '0';
+}
+
+DateTime::DateTime(uint32_t t) {
+  t -= SECONDS_FROM_1970_TO_2000;
+  ss = t % 60;
+  t /= 60;
+  mm = t % 60;
+  t /= 60;
+  hh = t % 24;
+  uint16_t days = t / 24;
+  uint8_t leap;
+  for (yOff = 0;; ++yOff) {
+    leap = yOff % 4 == 0;
+    if (days < 365U + leap) {
+      break;
+    }
+    days -= 365 + leap;
+  }
+  for (m = 1; m < 12; ++m) {
+    uint8_t daysPerMonth = daysInMonth[m - 1];
+    if (leap && m == 2) {
+      ++daysPerMonth;
+    }
+    if (days < daysPerMonth) {
+      break;
+    }
+    days -= daysPerMonth;
+  }
+  d = days + 1;
+}
+
+DateTime::DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+  if (year >= 2000U) {
+    year -= 2000U;
+  }
+  yOff = year;
+  m = month;
+  d = day;
+  hh = hour;
+  mm = minute;
+  ss = second;
+}
+
+DateTime::DateTime(const char* date, const char* time) {
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  yOff = conv2d(date + 9);
+  m = 1;
+  for (uint8_t i = 0; i < 12; i++) {
+    if (strncmp(date, months + i * 3, 3) == 0) {
+      m = i + 1;
+      break;
+    }
+  }
+  d = conv2d(date + 4);
+  hh = conv2d(time);
+  mm = conv2d(time + 3);
+  ss = conv2d(time + 6);
+}
+
+uint8_t DateTime::dayOfTheWeek() const {
+  uint16_t day = date2days(yOff, m, d);
+  // Jan 1, 2000 is a Saturday
+  return (day + 6) % 7;
+}
+
+uint32_t DateTime::unixtime() const {
+  uint16_t days = date2days(yOff, m, d);
+  return ((days * 24UL + hh) * 60 + mm) * 60 + ss + SECONDS_FROM_1970_TO_2000;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file         : RTClib.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+
+#define SECONDS_FROM_1970_TO_2000         946684800
+
+/**
+ * Same calendar arithmetic as Adafruit RTClib, valid from 2000 to 2099
+ */
+class TimeSpan {
+public:
+  TimeSpan(int32_t seconds = 0) : total(seconds) {}
+  TimeSpan(int16_t days, int8_t hours, int8_t minutes, int8_t seconds)
+    : total((int32_t)days * 86400L + (int32_t)hours * 3600 + (int32_t)minutes * 60 + seconds) {}
+  int16_t days() const { return total / 86400L; }
+  int8_t hours() const { return total / 3600 % 24; }
+  int8_t minutes() const { return total / 60 % 60; }
+  int8_t seconds() const { return total % 60; }
+  int32_t totalseconds() const { return total; }
+  TimeSpan operator+(const TimeSpan& right) const { return TimeSpan(total + right.total); }
+  TimeSpan operator-(const TimeSpan& right) const { return TimeSpan(total - right.total); }
+
+private:
+  int32_t total;
+};
+
+class DateTime {
+public:
+  DateTime(uint32_t unixTime = SECONDS_FROM_1970_TO_2000);
+  DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t minute = 0, uint8_t second = 0);
+  DateTime(const char* date, const char* time);   // __DATE__ and __TIME__
+
+  uint16_t year() const { return 2000U + yOff; }
+  uint8_t month() const { return m; }
+  uint8_t day() const { return d; }
+  uint8_t hour() const { return hh; }
+  uint8_t minute() const { return mm; }
+  uint8_t second() const { return ss; }
+  uint8_t dayOfTheWeek() const;
+  uint32_t secondstime() const { return unixtime() - SECONDS_FROM_1970_TO_2000; }
+  uint32_t unixtime() const;
+
+  DateTime operator+(const TimeSpan& span) const { return DateTime(unixtime() + span.totalseconds()); }
+  DateTime operator-(const TimeSpan& span) const { return DateTime(unixtime() - span.totalseconds()); }
+  TimeSpan operator-(const DateTime& right) const { return TimeSpan(unixtime() - right.unixtime()); }
+  bool operator<(const DateTime& right) const { return unixtime() < right.unixtime(); }
+  bool operator>(const DateTime& right) const { return right < *this; }
+  bool operator<=(const DateTime& right) const { return !(*this > right); }
+  bool operator>=(const DateTime& right) const { return !(*this < right); }
+  bool operator==(const DateTime& right) const { return unixtime() == right.unixtime(); }
+  bool operator!=(const DateTime& right) const { return !(*this == right); }
+
+private:
+  uint8_t yOff;
+  uint8_t m;
+  uint8_t d;
+  uint8_t hh;
+  uint8_t mm;
+  uint8_t ss;
+};
+
+// Reads and sets the time of the installed NativeClock
+class RTC_DS3231 {
+public:
+  bool begin(TwoWire* = &Wire) { return true; }
+  bool lostPower() { return false; }
+  DateTime now() { return DateTime(getNativeClock().now()); }
+  void adjust(const DateTime& dt) { getNativeClock().adjust(dt.unixtime()); }
+  float getTemperature() { return 25.0; }
+};
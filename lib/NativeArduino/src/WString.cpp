@@ -0,0 +1,200 @@
+/**
+ * @file         : WString.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "WString.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static std::string formatUnsigned(unsigned long long value, unsigned char base) {
+  if (base < 2 || base > 36) {
+    base = 10;
+  }
+  char buffer[66];
+  char* cursor = buffer + sizeof(buffer) - 1;
+  *cursor = '\0';
+  do {
+    unsigned digit = value % base;
+    *--cursor = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value > 0);
+  return std::string(cursor);
+}
+
+static std::string formatSigned(long long value, unsigned char base) {
+  if (value < 0 && base == 10) {
+    return "-" + formatUnsigned(0ULL - (unsigned long long)value, base);
+  }
+  return formatUnsigned((unsigned long long)value, base);
+}
+
+static std::string formatDouble(double value, unsigned int decimals) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  return std::string(buffer);
+}
+
+String::String(unsigned char value, unsigned char base) : text(formatUnsigned(value, base)) {}
+String::String(int value, unsigned char base) : text(formatSigned(value, base)) {}
+String::String(unsigned int value, unsigned char base) : text(formatUnsigned(value, base)) {}
+String::String(long value, unsigned char base) : text(formatSigned(value, base)) {}
+String::String(unsigned long value, unsigned char base) : text(formatUnsigned(value, base)) {}
+String::String(long long value, unsigned char base) : text(formatSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : text(formatUnsigned(value, base)) {}
+String::String(float value, unsigned int decimals) : text(formatDouble(value, decimals)) {}
+String::String(double value, unsigned int decimals) : text(formatDouble(value, decimals)) {}
+
+bool String::equalsIgnoreCase(const String& value) const {
+  return text.length() == value.text.length() && strcasecmp(text.c_str(), value.text.c_str()) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return text.length() >= suffix.text.length() &&
+    text.compare(text.length() - suffix.text.length(), suffix.text.length(), suffix.text) == 0;
+}
+
+void String::toCharArray(char* buffer, unsigned int size, unsigned int index) const {
+  if (size == 0) {
+    return;
+  }
+  size_t count = index < text.length() ? text.length() - index : 0;
+  if (count > size - 1) {
+    count = size - 1;
+  }
+  memcpy(buffer, text.c_str() + (index < text.length() ? index : text.length()), count);
+  buffer[count] = '\0';
+}
+
+int String::indexOf(char value, unsigned int from) const {
+  size_t position = text.find(value, from);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::indexOf(const String& value, unsigned int from) const {
+  size_t position = text.find(value.text, from);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::lastIndexOf(char value) const {
+  size_t position = text.rfind(value);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::lastIndexOf(const String& value) const {
+  size_t position = text.rfind(value.text);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    unsigned int swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from >= text.length()) {
+    return String();
+  }
+  if (to > text.length()) {
+    to = text.length();
+  }
+  return String(text.substr(from, to - from));
+}
+
+void String::replace(char find, char replacement) {
+  for (size_t i = 0; i < text.length(); i++) {
+    if (text[i] == find) {
+      text[i] = replacement;
+    }
+  }
+}
+
+void String::replace(const String& find, const String& replacement) {
+  if (find.text.empty()) {
+    return;
+  }
+  size_t position = 0;
+  while ((position = text.find(find.text, position)) != std::string::npos) {
+    text.replace(position, find.text.length(), replacement.text);
+    position += replacement.text.length();
+  }
+}
+
+void String::toLowerCase() {
+  for (size_t i = 0; i < text.length(); i++) {
+    text[i] = tolower((unsigned char)text[i]);
+  }
+}
+
+void String::toUpperCase() {
+  for (size_t i = 0; i < text.length(); i++) {
+    text[i] = toupper((unsigned char)text[i]);
+  }
+}
+
+void String::trim() {
+  size_t begin = 0;
+  size_t end = text.length();
+  while (begin < end && isspace((unsigned char)text[begin])) {
+    begin++;
+  }
+  while (end > begin && isspace((unsigned char)text[end - 1])) {
+    end--;
+  }
+  text = text.substr(begin, end - begin);
+}
+
+long String::toInt() const {
+  return atol(text.c_str());
+}
+
+float String::toFloat() const {
+  return atof(text.c_str());
+}
+
+double String::toDouble() const {
+  return atof(text.c_str());
+}
+
+String operator+(const String& left, const String& right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, const char* right) { String result(left); result.concat(right); return result; }
+String operator+(const char* left, const String& right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, char right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, int right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, unsigned int right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, long right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, unsigned long right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, float right) { String result(left); result.concat(right); return result; }
+String operator+(const String& left, double right) { String result(left); result.concat(right); return result; }
@@ -0,0 +1,138 @@
+/**
+ * @file         : WString.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/**
+ * Arduino String for host builds, the subset the firmware relies on over a
+ * std::string.
+ */
+class String {
+public:
+  String(const char* value = "") : text(value != NULL ? value : "") {}
+  String(const char* value, size_t length) : text(value, length) {}
+  String(const String& value) : text(value.text) {}
+  String(const std::string& value) : text(value) {}
+  explicit String(char value) : text(1, value) {}
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned int decimals = 2);
+  explicit String(double value, unsigned int decimals = 2);
+
+  String& operator=(const String& value) { text = value.text; return *this; }
+  String& operator=(const char* value) { text = value != NULL ? value : ""; return *this; }
+
+  unsigned int length() const { return text.length(); }
+  bool isEmpty() const { return text.empty(); }
+  const char* c_str() const { return text.c_str(); }
+  bool reserve(unsigned int size) { text.reserve(size); return true; }
+
+  bool concat(const String& value) { text += value.text; return true; }
+  bool concat(const char* value) { if (value == NULL) return false; text += value; return true; }
+  bool concat(const char* value, unsigned int length) { if (value == NULL) return false; text.append(value, length); return true; }
+  bool concat(char value) { text += value; return true; }
+  bool concat(unsigned char value) { return concat(String(value)); }
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+  bool concat(long long value) { return concat(String(value)); }
+  bool concat(unsigned long long value) { return concat(String(value)); }
+  bool concat(float value) { return concat(String(value)); }
+  bool concat(double value) { return concat(String(value)); }
+
+  template <typename T> String& operator+=(const T& value) { concat(value); return *this; }
+
+  bool equals(const String& value) const { return text == value.text; }
+  bool equals(const char* value) const { return value != NULL && text == value; }
+  bool equalsIgnoreCase(const String& value) const;
+  bool startsWith(const String& prefix) const { return text.compare(0, prefix.text.length(), prefix.text) == 0; }
+  bool endsWith(const String& suffix) const;
+  bool operator==(const String& value) const { return text == value.text; }
+  bool operator==(const char* value) const { return equals(value); }
+  bool operator!=(const String& value) const { return text != value.text; }
+  bool operator!=(const char* value) const { return !equals(value); }
+  bool operator<(const String& value) const { return text < value.text; }
+  bool operator>(const String& value) const { return text > value.text; }
+
+  char charAt(unsigned int index) const { return index < text.length() ? text[index] : 0; }
+  void setCharAt(unsigned int index, char value) { if (index < text.length()) text[index] = value; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char& operator[](unsigned int index) { return text[index]; }
+  void toCharArray(char* buffer, unsigned int size, unsigned int index = 0) const;
+
+  int indexOf(char value, unsigned int from = 0) const;
+  int indexOf(const String& value, unsigned int from = 0) const;
+  int lastIndexOf(char value) const;
+  int lastIndexOf(const String& value) const;
+  String substring(unsigned int from) const { return substring(from, text.length()); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(char find, char replacement);
+  void replace(const String& find, const String& replacement);
+  void remove(unsigned int index) { if (index < text.length()) text.erase(index); }
+  void remove(unsigned int index, unsigned int count) { if (index < text.length()) text.erase(index, count); }
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const;
+  float toFloat() const;
+  double toDouble() const;
+
+private:
+  std::string text;
+};
+
+String operator+(const String& left, const String& right);
+String operator+(const String& left, const char* right);
+String operator+(const char* left, const String& right);
+String operator+(const String& left, char right);
+String operator+(const String& left, int right);
+String operator+(const String& left, unsigned int right);
+String operator+(const String& left, long right);
+String operator+(const String& left, unsigned long right);
+String operator+(const String& left, float right);
+String operator+(const String& left, double right);
+inline bool operator==(const char* left, const String& right) { return right == left; }
+inline bool operator!=(const char* left, const String& right) { return right != left; }
@@ -0,0 +1,412 @@
+/**
+ * @file         : api.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "api.h"
+#include <stdlib.h>
+#include "constants.h"
+#include "hal.h"
+#include "watering.h"
+#include "telemetry.h"
+#include "logger.h"
+#include "logcompactor.h"
+#include "logindex.h"
+#include "heapprofile.h"
+
+// Server and settings the handlers answer from, owned by the caller of setupApi()
+static HttpServer* server = NULL;
+static Settings* settings = NULL;
+
+void setupApi(HttpServer* apiServer, Settings* apiSettings) {
+  server = apiServer;
+  settings = apiSettings;
+  setCachedSettings(apiSettings);
+}
+
+// Format picked from the Accept header for the response being built, binary
+// formats stage the JSON produced by the handler and transcode it at the end.
+// Staging stops at API_ENCODED_MAX_LENGTH, the client gets 406 and can ask for JSON
+static ContentFormat responseFormat = FORMAT_JSON;
+static int responseCode = 200;
+static String stagedResponse;
+static bool stagedOverflow = false;
+
+// Hands every filled JsonWriter buffer to the client as one HTTP chunk
+void sendBodyChunk(const char* data, size_t length, void* context) {
+  server->sendContent(data, length);
+}
+
+void sendJsonChunk(const char* data, size_t length, void* context) {
+  if (responseFormat == FORMAT_JSON) {
+    server->sendContent(data, length);
+  } else if (!stagedOverflow) {
+    if (stagedResponse.length() + length > API_ENCODED_MAX_LENGTH) {
+      stagedOverflow = true;
+      stagedResponse = String();
+    } else {
+      stagedResponse.concat(data, length);
+    }
+  }
+}
+
+static void sendEncodingTooLarge() {
+  server->send(406, contentFormatType(FORMAT_JSON), "{\"error\":\"Response too large to encode, ask for application/json\"}");
+}
+
+// Re-encodes a JSON body in a binary format and sends it chunked
+void sendEncodedResponse(int code, const char* json, size_t length, ContentFormat format) {
+  if (length > API_ENCODED_MAX_LENGTH) {
+    sendEncodingTooLarge();
+    return;
+  }
+  JsonDocument document;
+  if (deserializeJson(document, json, length)) {
+    server->send(500, contentFormatType(FORMAT_JSON), "{\"error\":\"Serialization error\"}");
+    return;
+  }
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(code, contentFormatType(format), "");
+  serializeBody(document, format, sendBodyChunk, NULL);
+  server->sendContent("");
+}
+
+// Sends a complete JSON body in the format the client accepts
+void sendNegotiatedResponse(int code, const String& json) {
+  ContentFormat format = negotiateFormat(server->headerValue("Accept"));
+  server->sendHeader("Vary", "Accept");
+  if (format == FORMAT_JSON) {
+    server->send(code, contentFormatType(FORMAT_JSON), json);
+  } else {
+    sendEncodedResponse(code, json.c_str(), json.length(), format);
+  }
+}
+
+// Sends {"error": reason}, the writer escapes reasons that carry client input
+void sendErrorResponse(int code, const char* reason) {
+  String body;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &body);
+  json.beginObject();
+  json.field("error", reason);
+  json.endObject();
+  json.flush();
+  sendNegotiatedResponse(code, body);
+}
+
+void sendErrorResponse(int code, const String& reason) {
+  sendErrorResponse(code, reason.c_str());
+}
+
+// Parses the request body in the format named by its Content-Type
+DeserializationError deserializeRequest(JsonDocument& json) {
+  return deserializeBody(json, server->body(), server->bodyLength(), requestFormat(server->headerValue("Content-Type")));
+}
+
+// Starts a chunked JSON response, the body is streamed afterwards by a JsonWriter
+void beginJsonResponse(int code) {
+  responseFormat = negotiateFormat(server->headerValue("Accept"));
+  server->sendHeader("Cache-Control", "no-cache");
+  server->sendHeader("Vary", "Accept");
+  if (responseFormat != FORMAT_JSON) {
+    responseCode = code;
+    stagedResponse = "";
+    stagedOverflow = false;
+    return;
+  }
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(code, contentFormatType(FORMAT_JSON), "");
+}
+
+// Flushes the last chunk and sends the zero length terminator
+void endJsonResponse(JsonWriter& writer) {
+  writer.flush();
+  if (responseFormat != FORMAT_JSON) {
+    if (stagedOverflow) {
+      sendEncodingTooLarge();
+    } else {
+      sendEncodedResponse(responseCode, stagedResponse.c_str(), stagedResponse.length(), responseFormat);
+    }
+    stagedResponse = String();
+    stagedOverflow = false;
+    responseFormat = FORMAT_JSON;
+    return;
+  }
+  server->sendContent("");
+}
+
+// Sends a cached body with its ETag, or a bare 304 when the client already has it.
+// Each format is a separate representation so it gets its own tag
+void sendCachedResponse(const CachedResponse& response) {
+  ContentFormat format = negotiateFormat(server->headerValue("Accept"));
+  char etag[RESPONSE_CACHE_ETAG_LENGTH + 8];
+  if (format == FORMAT_JSON) {
+    snprintf(etag, sizeof(etag), "%s", response.etag);
+  } else {
+    snprintf(etag, sizeof(etag), "\"%.8s-%s\"", response.etag + 1, contentFormatName(format));
+  }
+  server->sendHeader("Cache-Control", "no-cache");
+  server->sendHeader("Vary", "Accept");
+  server->sendHeader("ETag", etag);
+  if (cachedResponseMatches(etag, server->header("If-None-Match"))) {
+    server->send(304);
+    return;
+  }
+  if (format == FORMAT_JSON) {
+    server->send(200, contentFormatType(FORMAT_JSON), response.body);
+  } else {
+    sendEncodedResponse(200, response.body.c_str(), response.body.length(), format);
+  }
+}
+
+void writeAlarmsResponse(JsonWriter& writer) {
+  writer.beginObject();
+  writer.key("alarm");
+  writeAlarms(writer, *settings);
+  writer.endObject();
+}
+
+void writePlantsResponse(JsonWriter& writer) {
+  writer.beginObject();
+  writer.key("plants");
+  writePlants(writer, *settings);
+  writer.endObject();
+}
+
+void writeSettingsResponse(JsonWriter& writer) {
+  writeSettings(writer, *settings);
+}
+
+// This function is called when the sysInfo service was requested.
+void handleSystemInfo() {
+  // Everything that needs the bus, flash or SD comes from the collector snapshot
+  static SystemSnapshot snapshot;
+  getSystemSnapshot(&snapshot);
+
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+
+  beginJsonResponse(200);
+  writer.beginObject();
+  writer.field("chipModel", snapshot.chipModel);
+  writer.field("chipCores", snapshot.chipCores);
+  writer.field("chipRevision", snapshot.chipRevision);
+  writer.field("flashSize", snapshot.flashSize);
+  writer.field("freeHeap", snapshot.freeHeap);
+  writer.field("heapSize", snapshot.heapSize);
+  HeapSample heapSample;
+  if (getLatestHeapSample(&heapSample)) {
+    writer.field("largestFreeBlock", heapSample.largestBlock);
+    writer.field("heapFragmentation", heapSample.fragmentation);
+  }
+  writer.field("SSID", WIFI_SSID);
+  writer.field("signalDbm", snapshot.signalDbm);
+  if (hasTelemetrySection(snapshot, TELEMETRY_CLOCK)) {
+    if (settings->hasRTC) {
+      writer.field("temperature", snapshot.temperature);
+    }
+    writer.field("timestamp", snapshot.timestamp);
+    if (settings->hasRTC) {
+      writer.field("offset", snapshot.offset);
+    }
+  }
+  writer.field("uptime", uptimeStr().c_str());
+  writer.field("resetReason", getResetReason());
+  writer.field("timezone", TIMEZONE);
+  if (settings->hasMCP && hasTelemetrySection(snapshot, TELEMETRY_EXPANDER)) {
+    writer.field("mcp", snapshot.mcp);
+  }
+
+  writer.key("watering").beginObject();
+  writer.field("totalMillilitres", flowState.total);
+  writer.field("totalFlowPulses", hal.flow->totalPulses());
+  writer.endObject();
+
+  if (hasTelemetrySection(snapshot, TELEMETRY_STORAGE)) {
+    writer.key("sdcard").beginObject();
+    writer.field("cardType", snapshot.cardType);
+    writer.field("cardSize", snapshot.cardSize);
+    writer.field("freeSize", snapshot.freeSize);
+    writer.field("logCount", snapshot.logCount);
+    writer.endObject();
+  }
+
+  LoggerStats loggerStats = getLoggerStats();
+  LogCompactionStats compactionStats = getLogCompactionStats();
+  writer.key("logger").beginObject();
+  writer.field("queued", loggerStats.queued);
+  writer.field("written", loggerStats.written);
+  writer.field("dropped", loggerStats.dropped);
+  writer.field("failed", loggerStats.failed);
+  writer.field("depth", loggerStats.depth);
+  writer.field("usedBytes", compactionStats.usedBytes);
+  writer.field("compactedDays", compactionStats.compactedDays);
+  writer.field("deletedDays", compactionStats.deletedDays);
+  writer.field("migratedLogs", compactionStats.migratedLogs);
+  writer.endObject();
+
+  if (snapshot.configValid) {
+    writer.key("config").beginObject();
+    writer.key("network").beginObject();
+    writer.field("enabled", snapshot.networkEnabled ? "true" : "false");
+    writer.field("ssid", snapshot.ssid);
+    writer.field("password", snapshot.password);
+    writer.endObject();
+    writer.endObject();
+  }
+
+  writer.key("settings").raw(getCachedResponse(CACHE_SETTINGS, writeSettingsResponse).body.c_str());
+
+  if (hasTelemetrySection(snapshot, TELEMETRY_CLOCK)) {
+    writer.key("env").beginObject();
+    writer.field("nextAlarmSecs", snapshot.nextAlarmSecs);
+    writer.field("nextAlarm", snapshot.nextAlarm);
+    writer.endObject();
+  }
+  writer.endObject();
+  endJsonResponse(writer);
+}
+
+
+void handleAlarm() {
+  if (server->method() == HTTP_GET) {
+    sendCachedResponse(getCachedResponse(CACHE_ALARMS, writeAlarmsResponse));
+  } else if (server->method() == HTTP_POST) {
+    JsonDocument json;
+    DeserializationError error = deserializeRequest(json);
+    
+    if (error) {
+      TRACE("deserializeJson() failed:\n");
+      TRACE(error.c_str());
+      SERVER_RESPONSE_ERROR(500, "Serialization error");
+      return;
+    }
+
+    uint32_t now = hal.clock->now();
+    bool saved;
+    {
+      SettingsLock lock;
+      saved = saveAlarms(json, settings->alarm);
+      if (saved) {
+        touchSettings(settings, now);
+        saveSettings(settings);
+      }
+    }
+    if (!saved) {
+      SERVER_RESPONSE_ERROR(500, "Serialization error");
+      return;
+    }
+
+    sendCachedResponse(getCachedResponse(CACHE_ALARMS, writeAlarmsResponse));
+  } else {
+    SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
+  }
+  return;
+}
+
+void handleLogs() {
+  if (server->method() == HTTP_GET || server->method() == HTTP_POST) {
+    uint32_t from = server->hasArg("from") ? strtoul(server->arg("from").c_str(), NULL, 10) : 0;
+    uint32_t to = server->hasArg("to") ? strtoul(server->arg("to").c_str(), NULL, 10) : UINT32_MAX;
+    unsigned long offset = server->hasArg("offset") ? strtoul(server->arg("offset").c_str(), NULL, 10) : 0;
+    unsigned long limit = server->hasArg("limit") ? strtoul(server->arg("limit").c_str(), NULL, 10) : LOG_INDEX_PAGE_SIZE;
+    unsigned long total = 0;
+    if (limit > LOG_INDEX_MAX_PAGE_SIZE) {
+      limit = LOG_INDEX_MAX_PAGE_SIZE;
+    }
+    char buffer[JSON_WRITER_BUFFER_SIZE];
+    JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+
+    beginJsonResponse(200);
+    writer.beginObject();
+    writer.key("files");
+    writeLogIndexQuery(writer, "/logs", from, to, offset, limit, &total);
+    writer.field("total", total);
+    writer.field("offset", offset);
+    writer.field("limit", limit);
+    writer.endObject();
+    endJsonResponse(writer);
+    return;
+  } else if (server->method() == HTTP_DELETE) {
+    char buffer[JSON_WRITER_BUFFER_SIZE];
+    JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+
+    beginJsonResponse(200);
+    writer.beginObject();
+    writer.key("files");
+    writeLogIndexQuery(writer, "/logs", 0, UINT32_MAX, 0, LOG_INDEX_PAGE_SIZE);
+    writer.endObject();
+    endJsonResponse(writer);
+  } else {
+    SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
+    return;
+  }
+  return;
+}
+
+void handlePlants() {
+  if (server->method() == HTTP_GET) {
+    sendCachedResponse(getCachedResponse(CACHE_PLANTS, writePlantsResponse));
+  } else if (server->method() == HTTP_POST) {
+
+    JsonDocument json;
+    DeserializationError error = deserializeRequest(json);
+
+    if (error) {
+      TRACE("deserializeJson() failed:\n");
+      TRACE(error.c_str());
+      SERVER_RESPONSE_ERROR(500, "Serialization error");
+      return;
+    }
+
+    uint32_t now = hal.clock->now();
+    bool saved;
+    {
+      SettingsLock lock;
+      saved = savePlants(json, settings->plant);
+      if (saved) {
+        touchSettings(settings, now);
+        saveSettings(settings);
+      }
+    }
+    if (!saved) {
+      SERVER_RESPONSE_ERROR(500, "Serialization error");
+      return;
+    }
+
+    sendCachedResponse(getCachedResponse(CACHE_PLANTS, writePlantsResponse));
+  } else {
+    SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
+  }
+  return;
+}
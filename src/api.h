@@ -0,0 +1,82 @@
+/**
+ * @file         : api.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "httpserver.h"
+#include "jsonwriter.h"
+#include "contentformat.h"
+#include "responsecache.h"
+#include "settings.h"
+
+#define API_ENCODED_MAX_LENGTH            8192    /* Largest JSON body re-encoded as MessagePack or CBOR */
+
+// Bodies are written as JSON and re-encoded when the client accepts MessagePack or CBOR
+#define SERVER_RESPONSE_OK(...)  sendNegotiatedResponse(200, __VA_ARGS__)
+#define SERVER_RESPONSE_SUCCESS()  SERVER_RESPONSE_OK("{\"success\":true}")
+#define SERVER_RESPONSE_ERROR(code, error)  sendErrorResponse(code, error)
+
+/**
+ * REST API handlers that only need the server, the settings and the HAL, so
+ * the firmware and the native load test serve the same code. Routes are
+ * registered by the caller after setupApi().
+ */
+void setupApi(HttpServer* server, Settings* settings);
+
+/**
+ * Response helpers
+ */
+void sendBodyChunk(const char* data, size_t length, void* context);
+void sendJsonChunk(const char* data, size_t length, void* context);
+void sendEncodedResponse(int code, const char* json, size_t length, ContentFormat format);
+void sendNegotiatedResponse(int code, const String& json);
+void sendErrorResponse(int code, const char* reason);
+void sendErrorResponse(int code, const String& reason);
+DeserializationError deserializeRequest(JsonDocument& json);
+void beginJsonResponse(int code);
+void endJsonResponse(JsonWriter& writer);
+void sendCachedResponse(const CachedResponse& response);
+void writeAlarmsResponse(JsonWriter& writer);
+void writePlantsResponse(JsonWriter& writer);
+void writeSettingsResponse(JsonWriter& writer);
+
+/**
+ * Handlers
+ */
+void handleSystemInfo();
+void handleAlarm();
+void handlePlants();
+void handleLogs();
@@ -0,0 +1,120 @@
+/**
+ * @file         : bootprofile.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "bootprofile.h"
+#include <Arduino.h>
+#include "constants.h"
+#include "metrics.h"
+#include "tracer.h"
+
+static BootStage stages[BOOT_PROFILE_MAX_STAGES];
+static std::atomic<uint8_t> stageCount(0);
+
+static uint8_t currentCore() {
+#if defined(ARDUINO)
+  return xPortGetCoreID();
+#else
+  return 0;
+#endif
+}
+
+int beginBootStage(const char* name) {
+  uint8_t index = stageCount.fetch_add(1, std::memory_order_relaxed);
+  if (index >= BOOT_PROFILE_MAX_STAGES) {
+    stageCount.store(BOOT_PROFILE_MAX_STAGES, std::memory_order_relaxed);
+    return BOOT_STAGE_NONE;
+  }
+  BootStage& stage = stages[index];
+  stage.name = name;
+  stage.core = currentCore();
+  stage.ok = true;
+  stage.start = metricsMicros();
+  stage.end.store(0, std::memory_order_release);
+  TRACE_BEGIN(TRACE_CAT_SYSTEM, TRACE_BOOT_STAGE, traceString(name), 0);
+  return index;
+}
+
+void endBootStage(int index, bool ok) {
+  if (index < 0 || index >= BOOT_PROFILE_MAX_STAGES) {
+    return;
+  }
+  BootStage& stage = stages[index];
+  stage.ok = ok;
+  // A stage that began at 0 still has to read as ended
+  uint32_t end = metricsMicros();
+  stage.end.store(end ? end : 1, std::memory_order_release);
+  TRACE_END(TRACE_CAT_SYSTEM, TRACE_BOOT_STAGE, traceString(stage.name), ok);
+  TRACE("Boot %s: %u ms at %u ms%s\n", stage.name, (end - stage.start) / 1000, end / 1000, ok ? "" : " (failed)");
+}
+
+void markBootMilestone(const char* name) {
+  endBootStage(beginBootStage(name));
+}
+
+bool bootFinished() {
+  uint8_t count = stageCount.load(std::memory_order_relaxed);
+  for (uint8_t i = 0; i < count && i < BOOT_PROFILE_MAX_STAGES; i++) {
+    if (stages[i].end.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void writeBootProfile(JsonWriter& json) {
+  uint8_t count = stageCount.load(std::memory_order_relaxed);
+  if (count > BOOT_PROFILE_MAX_STAGES) {
+    count = BOOT_PROFILE_MAX_STAGES;
+  }
+  json.beginObject();
+  json.field("finished", bootFinished());
+  json.key("stages").beginArray();
+  for (uint8_t i = 0; i < count; i++) {
+    const BootStage& stage = stages[i];
+    uint32_t end = stage.end.load(std::memory_order_acquire);
+    json.beginObject();
+    json.field("name", stage.name ? stage.name : "");
+    json.field("core", stage.core);
+    json.field("start", stage.start);
+    if (end) {
+      json.field("end", end);
+      json.field("duration", end - stage.start);
+      json.field("ok", stage.ok);
+    }
+    json.endObject();
+  }
+  json.endArray();
+  json.endObject();
+}
@@ -0,0 +1,64 @@
+/**
+ * @file         : bootprofile.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "jsonwriter.h"
+
+#define BOOT_PROFILE_MAX_STAGES           12      /* Boot stages and milestones kept, later ones are dropped */
+#define BOOT_STAGE_NONE                   -1      /* Returned when the stage table is full */
+
+// One boot stage, times in microseconds since the application started
+struct BootStage {
+  const char* name;                       // Static string, stages are named by literals
+  uint32_t start;
+  std::atomic<uint32_t> end;              // 0 while the stage is still running
+  uint8_t core;
+  bool ok;
+};
+
+/**
+ * Boot profile. setup() only runs the critical stages, the rest of the
+ * peripherals come up in background tasks, so stages may run on both
+ * cores at the same time. Each stage is timed from the application start,
+ * a milestone is a stage without duration, e.g. the first schedule check.
+ */
+int beginBootStage(const char* name);
+void endBootStage(int stage, bool ok = true);
+void markBootMilestone(const char* name);
+bool bootFinished();                      // Every stage begun so far has ended
+void writeBootProfile(JsonWriter& json);
@@ -0,0 +1,135 @@
+/**
+ * @file         : broadcastring.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#define BROADCAST_RING_READ_RETRIES       4       /* Reads racing with a writer give up after this */
+
+/**
+ * Lock-free broadcast ring. Producers never wait: they
+ * overwrite the oldest slot. Every reader owns its cursor, so any number of
+ * subscribers can follow the stream. A reader that falls more than N items
+ * behind skips ahead and is told how many items it missed, which keeps a
+ * slow subscriber from ever holding back the producer. T must be trivially
+ * copyable and the capacity must be a power of two.
+ */
+template <typename T, uint32_t N>
+class BroadcastRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "BroadcastRing capacity must be a power of two");
+
+public:
+  BroadcastRing() : head(0) {
+    for (uint32_t i = 0; i < N; i++) {
+      slots[i].version.store(0, std::memory_order_relaxed);
+      // Nothing published yet, any position a reader asks for is in the future
+      slots[i].position = i - N;
+    }
+  }
+
+  // Safe from several producers as long as they do not lap each other
+  uint32_t publish(const T& item) {
+    uint32_t position = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[position & (N - 1)];
+    slot.version.fetch_add(1, std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.data = item;
+    slot.position = position;
+    slot.version.fetch_add(1, std::memory_order_release);
+    return position;
+  }
+
+  /**
+   * Copy the item at *cursor and advance it. Returns false when the reader is
+   * up to date. *skipped is set to the amount of items lost to lag.
+   */
+  bool read(uint32_t* cursor, T* item, uint32_t* skipped) {
+    *skipped = 0;
+    for (uint8_t attempt = 0; attempt < BROADCAST_RING_READ_RETRIES; attempt++) {
+      uint32_t published = head.load(std::memory_order_acquire);
+      if (published == *cursor) {
+        return false;
+      }
+      if (published - *cursor > N) {
+        // Lapped, restart from the oldest item that can not be overwritten right now
+        uint32_t oldest = published - N + 1;
+        *skipped += oldest - *cursor;
+        *cursor = oldest;
+      }
+      Slot& slot = slots[*cursor & (N - 1)];
+      uint32_t before = slot.version.load(std::memory_order_acquire);
+      if (before & 1) {
+        // A writer is filling the slot, either ours or a lapping one
+        continue;
+      }
+      uint32_t position = slot.position;
+      T copy = slot.data;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.version.load(std::memory_order_relaxed) != before) {
+        continue;
+      }
+      int32_t distance = (int32_t)(position - *cursor);
+      if (distance < 0) {
+        // Claimed but not written yet
+        return false;
+      }
+      if (distance > 0) {
+        // Overwritten under us, the next attempt skips ahead
+        continue;
+      }
+      *item = copy;
+      (*cursor)++;
+      return true;
+    }
+    return false;
+  }
+
+  // Position of the next item, a new reader starting here only sees future items
+  uint32_t position() const {
+    return head.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> version;
+    uint32_t position;
+    T data;
+  };
+
+  Slot slots[N];
+  std::atomic<uint32_t> head;
+};
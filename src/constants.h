@@ -45,8 +45,15 @@
 #define I2C_MCP_PINCOUNT            16
 #define EEPROM_ADDRESS              0x57
 #define EEPROM_SIZE                 4096
-// TRACE output simplified, can be deactivated here
-#define TRACE(...)                  Serial.printf(__VA_ARGS__)
+// TRACE output simplified, can be deactivated here, timing sensitive paths record tracer.h events instead
+#ifndef TRACE_SERIAL
+  #define TRACE_SERIAL              1
+#endif
+#if TRACE_SERIAL
+  #define TRACE(...)                Serial.printf(__VA_ARGS__)
+#else
+  #define TRACE(...)                do {} while (0)
+#endif
 #define PRINT(...)                  Serial.print(__VA_ARGS__)
 #define PRINTLN(...)                Serial.println(__VA_ARGS__)
 #define JSONBOOL(value)             value ? F("true") : F("false")
@@ -0,0 +1,503 @@
+/**
+ * @file         : contentformat.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "contentformat.h"
+
+struct MediaType {
+  const char* name;
+  ContentFormat format;
+  bool wildcard;
+};
+
+static const MediaType mediaTypes[] = {
+  { "application/json", FORMAT_JSON, false },
+  { "application/msgpack", FORMAT_MSGPACK, false },
+  { "application/x-msgpack", FORMAT_MSGPACK, false },
+  { "application/vnd.msgpack", FORMAT_MSGPACK, false },
+  { "application/cbor", FORMAT_CBOR, false },
+  { "application/*", FORMAT_JSON, true },
+  { "*/*", FORMAT_JSON, true }
+};
+
+// Matches the media type of a header element, surrounding whitespace is ignored
+static const MediaType* findMediaType(const char* start, size_t length) {
+  while (length > 0 && (*start == ' ' || *start == '\t')) {
+    start++;
+    length--;
+  }
+  while (length > 0 && (start[length - 1] == ' ' || start[length - 1] == '\t')) {
+    length--;
+  }
+  for (size_t i = 0; i < sizeof(mediaTypes) / sizeof(mediaTypes[0]); i++) {
+    if (strlen(mediaTypes[i].name) == length && strncasecmp(mediaTypes[i].name, start, length) == 0) {
+      return &mediaTypes[i];
+    }
+  }
+  return NULL;
+}
+
+ContentFormat negotiateFormat(const char* accept) {
+  const MediaType* best = NULL;
+  float bestQuality = 0;
+  const char* element = accept;
+
+  while (element != NULL && *element != '\0') {
+    const char* next = strchr(element, ',');
+    const char* end = next != NULL ? next : element + strlen(element);
+    const char* parameters = (const char*)memchr(element, ';', end - element);
+
+    float quality = 1;
+    for (const char* q = parameters; q != NULL && q < end; q = (const char*)memchr(q + 1, ';', end - q - 1)) {
+      const char* name = q + 1;
+      while (name < end && *name == ' ') {
+        name++;
+      }
+      if (end - name > 2 && (name[0] == 'q' || name[0] == 'Q') && name[1] == '=') {
+        quality = strtof(name + 2, NULL);
+        break;
+      }
+    }
+
+    // An explicit type beats a wildcard of the same quality
+    const MediaType* type = findMediaType(element, (parameters != NULL ? parameters : end) - element);
+    if (type != NULL && (quality > bestQuality || (quality == bestQuality && best != NULL && best->wildcard && !type->wildcard))) {
+      best = type;
+      bestQuality = quality;
+    }
+    element = next != NULL ? next + 1 : NULL;
+  }
+  return best != NULL ? best->format : FORMAT_JSON;
+}
+
+ContentFormat requestFormat(const char* contentType) {
+  if (contentType == NULL) {
+    return FORMAT_JSON;
+  }
+  // Anything that is not a known binary type keeps being parsed as JSON
+  const char* parameters = strchr(contentType, ';');
+  const MediaType* type = findMediaType(contentType, parameters != NULL ? (size_t)(parameters - contentType) : strlen(contentType));
+  return type != NULL ? type->format : FORMAT_JSON;
+}
+
+const char* contentFormatType(ContentFormat format) {
+  switch (format) {
+    case FORMAT_MSGPACK: return "application/msgpack";
+    case FORMAT_CBOR: return "application/cbor";
+    default: return "application/json; charset=utf-8";
+  }
+}
+
+const char* contentFormatName(ContentFormat format) {
+  switch (format) {
+    case FORMAT_MSGPACK: return "msgpack";
+    case FORMAT_CBOR: return "cbor";
+    default: return "json";
+  }
+}
+
+/**
+ * Writer handed to the ArduinoJson serializers, output is staged and passed
+ * on to the sink in blocks like the JsonWriter does.
+ */
+class BodyWriter {
+public:
+  BodyWriter(JsonSink sink, void* context) : length(0), sink(sink), context(context) {}
+  ~BodyWriter() { flush(); }
+
+  size_t write(uint8_t c) {
+    if (length == sizeof(buffer)) {
+      flush();
+    }
+    buffer[length++] = (char)c;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      write(data[i]);
+    }
+    return count;
+  }
+
+  void flush() {
+    if (length > 0) {
+      sink(buffer, length, context);
+      length = 0;
+    }
+  }
+
+private:
+  char buffer[CONTENT_FORMAT_BUFFER_SIZE];
+  size_t length;
+  JsonSink sink;
+  void* context;
+};
+
+// CBOR (RFC 8949) head: major type in the top 3 bits, argument in the shortest form
+static void writeCborHead(BodyWriter& out, uint8_t major, uint64_t argument) {
+  major <<= 5;
+  if (argument < 24) {
+    out.write(major | (uint8_t)argument);
+    return;
+  }
+  uint8_t bytes;
+  if (argument <= 0xFF) {
+    out.write(major | 24);
+    bytes = 1;
+  } else if (argument <= 0xFFFF) {
+    out.write(major | 25);
+    bytes = 2;
+  } else if (argument <= 0xFFFFFFFFULL) {
+    out.write(major | 26);
+    bytes = 4;
+  } else {
+    out.write(major | 27);
+    bytes = 8;
+  }
+  while (bytes-- > 0) {
+    out.write((uint8_t)(argument >> (bytes * 8)));
+  }
+}
+
+static void writeCborString(BodyWriter& out, const char* string, size_t length) {
+  writeCborHead(out, 3, length);
+  out.write((const uint8_t*)string, length);
+}
+
+static void writeCbor(BodyWriter& out, JsonVariantConst value) {
+  if (value.is<JsonObjectConst>()) {
+    JsonObjectConst object = value.as<JsonObjectConst>();
+    writeCborHead(out, 5, object.size());
+    for (JsonPairConst member : object) {
+      writeCborString(out, member.key().c_str(), strlen(member.key().c_str()));
+      writeCbor(out, member.value());
+    }
+  } else if (value.is<JsonArrayConst>()) {
+    JsonArrayConst array = value.as<JsonArrayConst>();
+    writeCborHead(out, 4, array.size());
+    for (JsonVariantConst element : array) {
+      writeCbor(out, element);
+    }
+  } else if (value.is<const char*>()) {
+    const char* string = value.as<const char*>();
+    writeCborString(out, string, strlen(string));
+  } else if (value.is<bool>()) {
+    out.write(value.as<bool>() ? 0xF5 : 0xF4);
+  } else if (value.is<long long>()) {
+    long long number = value.as<long long>();
+    if (number >= 0) {
+      writeCborHead(out, 0, (uint64_t)number);
+    } else {
+      writeCborHead(out, 1, (uint64_t)(-1 - number));
+    }
+  } else if (value.is<unsigned long long>()) {
+    writeCborHead(out, 0, value.as<unsigned long long>());
+  } else if (value.is<double>()) {
+    // Single precision when it round trips, the flow figures mostly do
+    double number = value.as<double>();
+    float single = (float)number;
+    uint64_t bits;
+    uint8_t bytes;
+    if ((double)single == number) {
+      uint32_t singleBits;
+      memcpy(&singleBits, &single, sizeof(singleBits));
+      bits = singleBits;
+      bytes = 4;
+      out.write(0xFA);
+    } else {
+      memcpy(&bits, &number, sizeof(bits));
+      bytes = 8;
+      out.write(0xFB);
+    }
+    while (bytes-- > 0) {
+      out.write((uint8_t)(bits >> (bytes * 8)));
+    }
+  } else {
+    out.write(0xF6);
+  }
+}
+
+void serializeBody(JsonVariantConst document, ContentFormat format, JsonSink sink, void* context) {
+  BodyWriter out(sink, context);
+  switch (format) {
+    case FORMAT_MSGPACK:
+      serializeMsgPack(document, out);
+      break;
+    case FORMAT_CBOR:
+      writeCbor(out, document);
+      break;
+    default:
+      serializeJson(document, out);
+      break;
+  }
+  out.flush();
+}
+
+/**
+ * Minimal CBOR decoder covering what maps onto JSON: integers, text, arrays,
+ * maps with text keys, simple values and floats. Byte strings are rejected,
+ * tags are skipped and indefinite length arrays and maps are accepted.
+ */
+class CborReader {
+public:
+  CborReader(const uint8_t* data, size_t length) : data(data), length(length), position(0) {}
+
+  bool atEnd() const { return position == length; }
+
+  bool peek(uint8_t* byte) const {
+    if (position >= length) {
+      return false;
+    }
+    *byte = data[position];
+    return true;
+  }
+
+  bool readBytes(size_t count, const uint8_t** bytes) {
+    if (count > length - position) {
+      return false;
+    }
+    *bytes = data + position;
+    position += count;
+    return true;
+  }
+
+  bool readUnsigned(uint8_t count, uint64_t* value) {
+    const uint8_t* bytes;
+    if (!readBytes(count, &bytes)) {
+      return false;
+    }
+    *value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      *value = (*value << 8) | bytes[i];
+    }
+    return true;
+  }
+
+  // Reads the initial byte and its argument, indefinite lengths report info 31
+  bool readHead(uint8_t* major, uint8_t* info, uint64_t* argument) {
+    const uint8_t* initial;
+    if (!readBytes(1, &initial)) {
+      return false;
+    }
+    *major = *initial >> 5;
+    *info = *initial & 0x1F;
+    if (*info < 24) {
+      *argument = *info;
+      return true;
+    }
+    if (*info >= 24 && *info <= 27) {
+      return readUnsigned(1 << (*info - 24), argument);
+    }
+    *argument = 0;
+    return *info == 31;
+  }
+
+private:
+  const uint8_t* data;
+  size_t length;
+  size_t position;
+};
+
+static double halfToDouble(uint16_t half) {
+  int exponent = (half >> 10) & 0x1F;
+  int mantissa = half & 0x3FF;
+  double value;
+  if (exponent == 0) {
+    value = ldexp(mantissa, -24);
+  } else if (exponent != 31) {
+    value = ldexp(mantissa + 1024, exponent - 25);
+  } else {
+    value = mantissa == 0 ? INFINITY : NAN;
+  }
+  return (half & 0x8000) ? -value : value;
+}
+
+static DeserializationError readCbor(CborReader& in, JsonVariant target, uint8_t depth);
+
+static DeserializationError readCborText(CborReader& in, uint8_t info, uint64_t length, String* text) {
+  const uint8_t* bytes;
+  if (info == 31 || length > SIZE_MAX) {
+    return DeserializationError::InvalidInput;
+  }
+  if (!in.readBytes(length, &bytes)) {
+    return DeserializationError::IncompleteInput;
+  }
+  if (!text->concat((const char*)bytes, length)) {
+    return DeserializationError::NoMemory;
+  }
+  return DeserializationError::Ok;
+}
+
+// Containers of indefinite length end with a break byte instead of a count
+static bool readCborBreak(CborReader& in, bool indefinite, uint64_t* remaining) {
+  if (!indefinite) {
+    return (*remaining)-- == 0;
+  }
+  uint8_t byte;
+  if (in.peek(&byte) && byte == 0xFF) {
+    const uint8_t* skipped;
+    in.readBytes(1, &skipped);
+    return true;
+  }
+  return false;
+}
+
+static DeserializationError readCbor(CborReader& in, JsonVariant target, uint8_t depth) {
+  uint8_t major;
+  uint8_t info = 0;
+  uint64_t argument;
+  // Tags only annotate the item that follows, they are skipped here rather than
+  // recursed into so a body made of tags can not exhaust the stack
+  do {
+    if (!in.readHead(&major, &info, &argument)) {
+      // Reserved additional information, otherwise out of input before or inside the argument
+      return info >= 28 && info <= 30 ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput;
+    }
+    if (info == 31 && major != 4 && major != 5 && major != 3) {
+      return DeserializationError::InvalidInput;
+    }
+  } while (major == 6);
+
+  switch (major) {
+    case 0:
+      target.set((unsigned long long)argument);
+      break;
+    case 1:
+      if (argument > (uint64_t)INT64_MAX) {
+        return DeserializationError::InvalidInput;
+      }
+      target.set(-1 - (long long)argument);
+      break;
+    case 3: {
+      String text;
+      DeserializationError error = readCborText(in, info, argument, &text);
+      if (error) {
+        return error;
+      }
+      target.set(text);
+      break;
+    }
+    case 4: {
+      if (depth >= CONTENT_FORMAT_MAX_DEPTH) {
+        return DeserializationError::TooDeep;
+      }
+      JsonArray array = target.to<JsonArray>();
+      uint64_t remaining = argument;
+      while (!readCborBreak(in, info == 31, &remaining)) {
+        DeserializationError error = readCbor(in, array.add<JsonVariant>(), depth + 1);
+        if (error) {
+          return error;
+        }
+      }
+      break;
+    }
+    case 5: {
+      if (depth >= CONTENT_FORMAT_MAX_DEPTH) {
+        return DeserializationError::TooDeep;
+      }
+      JsonObject object = target.to<JsonObject>();
+      uint64_t remaining = argument;
+      while (!readCborBreak(in, info == 31, &remaining)) {
+        uint8_t keyMajor;
+        uint8_t keyInfo;
+        uint64_t keyLength;
+        if (!in.readHead(&keyMajor, &keyInfo, &keyLength)) {
+          return DeserializationError::IncompleteInput;
+        }
+        // JSON objects only have text keys
+        if (keyMajor != 3) {
+          return DeserializationError::InvalidInput;
+        }
+        String key;
+        DeserializationError error = readCborText(in, keyInfo, keyLength, &key);
+        if (!error) {
+          error = readCbor(in, object[key].to<JsonVariant>(), depth + 1);
+        }
+        if (error) {
+          return error;
+        }
+      }
+      break;
+    }
+    case 7:
+      if (info == 20 || info == 21) {
+        target.set(info == 21);
+      } else if (info == 22 || info == 23) {
+        target.clear();
+      } else if (info == 25) {
+        target.set(halfToDouble((uint16_t)argument));
+      } else if (info == 26) {
+        uint32_t bits = (uint32_t)argument;
+        float single;
+        memcpy(&single, &bits, sizeof(single));
+        target.set(single);
+      } else if (info == 27) {
+        double number;
+        memcpy(&number, &argument, sizeof(number));
+        target.set(number);
+      } else {
+        return DeserializationError::InvalidInput;
+      }
+      break;
+    default:
+      // Byte strings have no JSON counterpart
+      return DeserializationError::InvalidInput;
+  }
+  return DeserializationError::Ok;
+}
+
+DeserializationError deserializeBody(JsonDocument& document, const char* body, size_t length, ContentFormat format) {
+  switch (format) {
+    case FORMAT_MSGPACK:
+      return deserializeMsgPack(document, body, length);
+    case FORMAT_CBOR: {
+      document.clear();
+      if (length == 0) {
+        return DeserializationError::EmptyInput;
+      }
+      CborReader in((const uint8_t*)body, length);
+      DeserializationError error = readCbor(in, document.to<JsonVariant>(), 0);
+      if (!error && !in.atEnd()) {
+        error = DeserializationError::InvalidInput;
+      }
+      if (!error && document.overflowed()) {
+        error = DeserializationError::NoMemory;
+      }
+      return error;
+    }
+    default:
+      return deserializeJson(document, body, length);
+  }
+}
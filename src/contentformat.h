@@ -0,0 +1,60 @@
+/**
+ * @file         : contentformat.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "jsonwriter.h"
+
+#define CONTENT_FORMAT_BUFFER_SIZE        256     /* Encoded output is staged here before going to the sink */
+#define CONTENT_FORMAT_MAX_DEPTH          10      /* Max nesting accepted when decoding CBOR */
+
+/**
+ * Wire formats of the REST API, JSON stays the default whenever the client
+ * does not ask for one of the binary encodings.
+ */
+enum ContentFormat {
+  FORMAT_JSON = 0,
+  FORMAT_MSGPACK,
+  FORMAT_CBOR
+};
+
+ContentFormat negotiateFormat(const char* accept);
+ContentFormat requestFormat(const char* contentType);
+const char* contentFormatType(ContentFormat format);
+const char* contentFormatName(ContentFormat format);
+
+DeserializationError deserializeBody(JsonDocument& document, const char* body, size_t length, ContentFormat format);
+void serializeBody(JsonVariantConst document, ContentFormat format, JsonSink sink, void* context);
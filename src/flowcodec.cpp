@@ -0,0 +1,172 @@
+/**
+ * @file         : flowcodec.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "flowcodec.h"
+#include <string.h>
+
+size_t writeVarint(uint8_t* buffer, uint32_t value) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    buffer[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buffer[length++] = (uint8_t)value;
+  return length;
+}
+
+size_t readVarint(const uint8_t* buffer, size_t size, uint32_t* value) {
+  uint32_t result = 0;
+  for (size_t i = 0; i < size && i < FLOW_VARINT_MAX_SIZE; i++) {
+    result |= (uint32_t)(buffer[i] & 0x7F) << (7 * i);
+    if ((buffer[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+  // Truncated or malformed
+  return 0;
+}
+
+uint32_t zigzagEncode(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t zigzagDecode(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+FlowEncoder::FlowEncoder() {
+  begin(0, 0);
+}
+
+void FlowEncoder::begin(uint8_t plant, uint32_t baseTime) {
+  memset(&header, 0, sizeof(FlowBlockHeader));
+  header.magic = FLOW_BLOCK_MAGIC;
+  header.version = FLOW_BLOCK_VERSION;
+  header.plant = plant;
+  header.baseTime = baseTime;
+  timesLength = 0;
+  valuesLength = 0;
+  samples = 0;
+  previousTime = 0;
+  previousDelta = 0;
+  previousValue = 0;
+}
+
+bool FlowEncoder::append(uint32_t time, int32_t value) {
+  if (timesLength + FLOW_VARINT_MAX_SIZE > FLOW_COLUMN_SIZE || valuesLength + FLOW_VARINT_MAX_SIZE > FLOW_COLUMN_SIZE || samples == UINT16_MAX) {
+    return false;
+  }
+  if (samples == 0) {
+    // The first sample is stored as is
+    timesLength += writeVarint(times + timesLength, time);
+    valuesLength += writeVarint(values + valuesLength, zigzagEncode(value));
+  } else {
+    int32_t delta = (int32_t)(time - previousTime);
+    timesLength += writeVarint(times + timesLength, zigzagEncode(delta - previousDelta));
+    valuesLength += writeVarint(values + valuesLength, zigzagEncode(value - previousValue));
+    previousDelta = delta;
+  }
+  previousTime = time;
+  previousValue = value;
+  samples++;
+  return true;
+}
+
+bool FlowEncoder::seal(FlowBlock* block) {
+  if (samples == 0) {
+    return false;
+  }
+  header.count = samples;
+  header.timesLength = timesLength;
+  header.valuesLength = valuesLength;
+  memcpy(block->data, &header, sizeof(FlowBlockHeader));
+  memcpy(block->data + sizeof(FlowBlockHeader), times, timesLength);
+  memcpy(block->data + sizeof(FlowBlockHeader) + timesLength, values, valuesLength);
+  block->length = sizeof(FlowBlockHeader) + timesLength + valuesLength;
+  // Following samples go into a new block of the same series
+  begin(header.plant, header.baseTime);
+  return true;
+}
+
+FlowDecoder::FlowDecoder() : times(NULL), values(NULL), timesPosition(0), valuesPosition(0), decoded(0), previousTime(0), previousDelta(0), previousValue(0) {
+  memset(&header, 0, sizeof(FlowBlockHeader));
+}
+
+bool FlowDecoder::begin(const uint8_t* data, size_t size) {
+  if (size < sizeof(FlowBlockHeader)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(FlowBlockHeader));
+  if (header.magic != FLOW_BLOCK_MAGIC || header.version != FLOW_BLOCK_VERSION || blockLength() > size) {
+    return false;
+  }
+  times = data + sizeof(FlowBlockHeader);
+  values = times + header.timesLength;
+  timesPosition = 0;
+  valuesPosition = 0;
+  decoded = 0;
+  previousTime = 0;
+  previousDelta = 0;
+  previousValue = 0;
+  return true;
+}
+
+bool FlowDecoder::next(uint32_t* time, int32_t* value) {
+  if (decoded >= header.count) {
+    return false;
+  }
+  uint32_t encodedTime, encodedValue;
+  size_t timeLength = readVarint(times + timesPosition, header.timesLength - timesPosition, &encodedTime);
+  size_t valueLength = readVarint(values + valuesPosition, header.valuesLength - valuesPosition, &encodedValue);
+  if (timeLength == 0 || valueLength == 0) {
+    return false;
+  }
+  timesPosition += timeLength;
+  valuesPosition += valueLength;
+
+  if (decoded == 0) {
+    previousTime = encodedTime;
+    previousValue = zigzagDecode(encodedValue);
+  } else {
+    previousDelta += zigzagDecode(encodedTime);
+    previousTime += previousDelta;
+    previousValue += zigzagDecode(encodedValue);
+  }
+  decoded++;
+  *time = previousTime;
+  *value = previousValue;
+  return true;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file         : flowcodec.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLOW_BLOCK_MAGIC                  0x4653  /* "SF" */
+#define FLOW_BLOCK_VERSION                1
+#define FLOW_BLOCK_SIZE                   256     /* Max encoded block size, header included */
+#define FLOW_COLUMN_SIZE                  ((FLOW_BLOCK_SIZE - sizeof(FlowBlockHeader)) / 2)
+#define FLOW_VARINT_MAX_SIZE              5       /* A 32 bit varint never takes more than 5 bytes */
+
+/**
+ * Flow time series are stored as independent blocks. Each block holds two
+ * columns: sample times in milliseconds since baseTime encoded as delta of
+ * deltas, and sample values encoded as deltas, both zigzag varints. Regular
+ * one second samples with a steady flow take about two bytes per sample.
+ */
+struct FlowBlockHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t plant;
+  uint32_t baseTime;      // Unix time the sample times are relative to
+  uint16_t count;         // Amount of samples
+  uint16_t timesLength;   // Bytes of the time column
+  uint16_t valuesLength;  // Bytes of the value column
+} __attribute__((packed));
+
+struct FlowBlock {
+  uint16_t length;        // Encoded length, header included
+  uint8_t data[FLOW_BLOCK_SIZE];
+};
+
+/**
+ * Varint helpers
+ */
+size_t writeVarint(uint8_t* buffer, uint32_t value);
+size_t readVarint(const uint8_t* buffer, size_t size, uint32_t* value);
+uint32_t zigzagEncode(int32_t value);
+int32_t zigzagDecode(uint32_t value);
+
+/**
+ * Streaming encoder, samples are appended one at a time and the block is
+ * sealed when full or when the run ends.
+ */
+class FlowEncoder {
+public:
+  FlowEncoder();
+  void begin(uint8_t plant, uint32_t baseTime);
+  bool append(uint32_t time, int32_t value);
+  bool seal(FlowBlock* block);
+  uint16_t count() const { return samples; }
+  uint8_t plant() const { return header.plant; }
+  uint32_t baseTime() const { return header.baseTime; }
+
+private:
+  FlowBlockHeader header;
+  uint8_t times[FLOW_COLUMN_SIZE];
+  uint8_t values[FLOW_COLUMN_SIZE];
+  size_t timesLength;
+  size_t valuesLength;
+  uint16_t samples;
+  uint32_t previousTime;
+  int32_t previousDelta;
+  int32_t previousValue;
+};
+
+/**
+ * Block decoder, works in place over the encoded bytes
+ */
+class FlowDecoder {
+public:
+  FlowDecoder();
+  bool begin(const uint8_t* data, size_t size);
+  bool next(uint32_t* time, int32_t* value);
+  const FlowBlockHeader& blockHeader() const { return header; }
+  size_t blockLength() const { return sizeof(FlowBlockHeader) + header.timesLength + header.valuesLength; }
+
+private:
+  FlowBlockHeader header;
+  const uint8_t* times;
+  const uint8_t* values;
+  size_t timesPosition;
+  size_t valuesPosition;
+  uint16_t decoded;
+  uint32_t previousTime;
+  int32_t previousDelta;
+  int32_t previousValue;
+};
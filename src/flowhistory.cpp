@@ -0,0 +1,133 @@
+/**
+ * @file         : flowhistory.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "flowhistory.h"
+#include <string.h>
+
+FlowHistory::FlowHistory() : latestTime(0) {
+  memset(seconds, 0, sizeof(seconds));
+  memset(minutes, 0, sizeof(minutes));
+  memset(hours, 0, sizeof(hours));
+  const uint32_t resolutions[FLOW_HISTORY_TIERS] = { 1, 60, 3600 };
+  const uint32_t capacities[FLOW_HISTORY_TIERS] = { FLOW_HISTORY_SECONDS_CAPACITY, FLOW_HISTORY_MINUTES_CAPACITY, FLOW_HISTORY_HOURS_CAPACITY };
+  FlowBucket* buckets[FLOW_HISTORY_TIERS] = { seconds, minutes, hours };
+  for (uint8_t i = 0; i < FLOW_HISTORY_TIERS; i++) {
+    tiers[i].resolution = resolutions[i];
+    tiers[i].capacity = capacities[i];
+    tiers[i].buckets = buckets[i];
+    tiers[i].sequence.store(0, std::memory_order_relaxed);
+  }
+}
+
+void FlowHistory::insert(uint32_t time, uint32_t millilitres) {
+  for (uint8_t i = 0; i < FLOW_HISTORY_TIERS; i++) {
+    FlowTier& tier = tiers[i];
+    uint32_t start = time - time % tier.resolution;
+    FlowBucket& bucket = tier.buckets[(time / tier.resolution) % tier.capacity];
+
+    tier.sequence.fetch_add(1, std::memory_order_acq_rel);
+    if (bucket.start != start) {
+      bucket.start = start;
+      bucket.millilitres = 0;
+      bucket.peak = 0;
+      bucket.samples = 0;
+    }
+    bucket.millilitres += millilitres;
+    if (millilitres > bucket.peak) {
+      bucket.peak = millilitres > UINT16_MAX ? UINT16_MAX : millilitres;
+    }
+    if (bucket.samples < UINT16_MAX) {
+      bucket.samples++;
+    }
+    tier.sequence.fetch_add(1, std::memory_order_release);
+  }
+  if (time > latestTime) {
+    latestTime = time;
+  }
+}
+
+bool FlowHistory::readBucket(const FlowTier& tier, uint32_t start, FlowBucket* bucket) const {
+  const FlowBucket& slot = tier.buckets[(start / tier.resolution) % tier.capacity];
+  // Bounded retries, a reader must never spin on a writer it preempted
+  for (uint8_t attempt = 0; attempt < FLOW_HISTORY_READ_RETRIES; attempt++) {
+    uint32_t sequence = tier.sequence.load(std::memory_order_acquire);
+    *bucket = slot;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!(sequence & 1) && sequence == tier.sequence.load(std::memory_order_relaxed)) {
+      return bucket->start == start && bucket->samples > 0;
+    }
+  }
+  return false;
+}
+
+// Finest tier at least as coarse as requested that still covers from
+const FlowTier* FlowHistory::selectTier(uint32_t from, uint32_t resolution) const {
+  for (uint8_t i = 0; i < FLOW_HISTORY_TIERS; i++) {
+    const FlowTier& tier = tiers[i];
+    uint32_t span = tier.resolution * tier.capacity;
+    uint32_t oldest = latestTime > span ? latestTime - span : 0;
+    if (tier.resolution >= resolution && from >= oldest) {
+      return &tier;
+    }
+  }
+  return &tiers[FLOW_HISTORY_TIERS - 1];
+}
+
+size_t FlowHistory::query(uint32_t from, uint32_t to, uint32_t resolution, FlowBucket* points, size_t maxPoints, uint32_t* usedResolution) const {
+  const FlowTier* tier = selectTier(from, resolution);
+  if (usedResolution != NULL) {
+    *usedResolution = tier->resolution;
+  }
+  if (to > latestTime) {
+    to = latestTime;
+  }
+  // Never walk further back than the tier retains
+  uint32_t span = tier->resolution * tier->capacity;
+  uint32_t oldest = latestTime > span ? latestTime - span + tier->resolution : 0;
+  if (from < oldest) {
+    from = oldest;
+  }
+
+  size_t count = 0;
+  for (uint32_t start = from - from % tier->resolution; start <= to && count < maxPoints; start += tier->resolution) {
+    if (readBucket(*tier, start, &points[count])) {
+      count++;
+    }
+    if (start > UINT32_MAX - tier->resolution) {
+      break;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file         : flowhistory.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#define FLOW_HISTORY_TIERS                3
+#define FLOW_HISTORY_SECONDS_CAPACITY     600     /* 1 second buckets, 10 minutes */
+#define FLOW_HISTORY_MINUTES_CAPACITY     1440    /* 1 minute buckets, 24 hours */
+#define FLOW_HISTORY_HOURS_CAPACITY       720     /* 1 hour buckets, 30 days */
+#define FLOW_HISTORY_MAX_POINTS           FLOW_HISTORY_MINUTES_CAPACITY
+#define FLOW_HISTORY_READ_RETRIES         16      /* Attempts to read a bucket while it is being written */
+
+struct FlowBucket {
+  uint32_t start;         // Unix time of the first second covered by the bucket
+  uint32_t millilitres;   // Millilitres accumulated in the bucket
+  uint16_t peak;          // Highest single sample in the bucket
+  uint16_t samples;       // Amount of samples accumulated
+};
+
+struct FlowTier {
+  uint32_t resolution;    // Seconds covered by a bucket
+  uint32_t capacity;      // Amount of buckets
+  FlowBucket* buckets;
+  std::atomic<uint32_t> sequence;  // Odd while the tier is being written
+};
+
+/**
+ * Fixed memory flow store with one ring of buckets per resolution. A sample
+ * lands in the bucket its time maps to in every tier so inserts are O(1);
+ * stale buckets are recognised by their start time and recycled in place.
+ * There is a single writer (the watering task), readers retry when they
+ * race with it.
+ */
+class FlowHistory {
+public:
+  FlowHistory();
+  void insert(uint32_t time, uint32_t millilitres);
+  size_t query(uint32_t from, uint32_t to, uint32_t resolution, FlowBucket* points, size_t maxPoints, uint32_t* usedResolution = NULL) const;
+  uint32_t latest() const { return latestTime; }
+
+private:
+  const FlowTier* selectTier(uint32_t from, uint32_t resolution) const;
+  bool readBucket(const FlowTier& tier, uint32_t start, FlowBucket* bucket) const;
+
+  FlowBucket seconds[FLOW_HISTORY_SECONDS_CAPACITY];
+  FlowBucket minutes[FLOW_HISTORY_MINUTES_CAPACITY];
+  FlowBucket hours[FLOW_HISTORY_HOURS_CAPACITY];
+  FlowTier tiers[FLOW_HISTORY_TIERS];
+  uint32_t latestTime;
+};
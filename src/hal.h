@@ -0,0 +1,109 @@
+/**
+ * @file         : hal.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <FS.h>
+
+/**
+ * Hardware abstraction layer. Watering, scheduling and persistence only talk
+ * to the peripherals through these interfaces so the same code runs on the
+ * device (hal_esp32) and on a Linux host against in-memory fakes (hal_fake).
+ */
+
+// DS3231 wall clock plus the monotonic millisecond timer
+class HalClock {
+public:
+  virtual ~HalClock() {}
+  virtual uint32_t now() = 0;                 // Unix time
+  virtual void adjust(uint32_t unixTime) = 0;
+  virtual float temperature() = 0;
+  virtual uint32_t millis() = 0;
+  virtual void delay(uint32_t ms) = 0;        // Yields to other tasks on the device
+};
+
+// MCP23017 port extender driving the valves and the pump, outputs are active low
+class HalGpioExpander {
+public:
+  virtual ~HalGpioExpander() {}
+  virtual void pinMode(uint8_t pin, uint8_t mode) = 0;
+  virtual void digitalWrite(uint8_t pin, uint8_t value) = 0;
+  virtual uint16_t readGPIOAB() = 0;
+  virtual void writeGPIOAB(uint16_t value) = 0;
+};
+
+// Hall effect flow meter, pulses are counted in the background between begin() and end()
+class HalFlowSensor {
+public:
+  virtual ~HalFlowSensor() {}
+  virtual void begin() = 0;
+  virtual void end() = 0;
+  virtual uint32_t takePulses() = 0;          // Pulses since the previous call, resets the count
+  virtual uint32_t totalPulses() = 0;         // Pulses since boot
+};
+
+// 128x32 text display
+class HalDisplay {
+public:
+  virtual ~HalDisplay() {}
+  virtual void clear() = 0;                   // Blank the buffer and move to the top left corner
+  virtual void print(const char* text) = 0;
+  virtual void show() = 0;                    // Push the buffer to the panel
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Byte addressable persistent storage, writes are buffered until commit()
+class HalStore {
+public:
+  virtual ~HalStore() {}
+  virtual size_t size() = 0;
+  virtual bool read(size_t address, void* data, size_t length) = 0;
+  virtual bool write(size_t address, const void* data, size_t length) = 0;
+  virtual bool commit() = 0;
+  template <typename T> bool get(size_t address, T& value) { return read(address, &value, sizeof(T)); }
+  template <typename T> bool put(size_t address, const T& value) { return write(address, &value, sizeof(T)); }
+};
+
+struct Hal {
+  HalClock* clock;
+  HalGpioExpander* expander;
+  HalFlowSensor* flow;
+  HalDisplay* display;                        // NULL when no display answered
+  HalStore* store;
+  fs::FS* files;                              // SD card on the device, kept in memory on the host
+};
+
+extern Hal hal;
@@ -0,0 +1,123 @@
+/**
+ * @file         : hal_esp32.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "hal_esp32.h"
+
+Esp32FlowSensor* Esp32FlowSensor::attached = NULL;
+// Guards the pulse counts between the interrupt and the watering task
+static portMUX_TYPE flowMux = portMUX_INITIALIZER_UNLOCKED;
+
+Esp32FlowSensor::Esp32FlowSensor(uint8_t pin, uint8_t interrupt, MetricCounter* interrupts, MetricCounter* edges)
+  : pin(pin), interrupt(interrupt), interrupts(interrupts), edges(edges), pulses(0), total(0), state(HIGH) {}
+
+void Esp32FlowSensor::onInterrupt() {
+  Esp32FlowSensor* sensor = attached;
+  if (sensor == NULL) {
+    return;
+  }
+  if (sensor->interrupts != NULL) {
+    sensor->interrupts->add();
+  }
+  int value = digitalRead(sensor->pin);
+  if (sensor->state != value) {
+    if (sensor->edges != NULL) {
+      sensor->edges->add();
+    }
+    portENTER_CRITICAL_ISR(&flowMux);
+    sensor->pulses++;
+    sensor->total++;
+    portEXIT_CRITICAL_ISR(&flowMux);
+    sensor->state = value;
+    if (sensorCapturing.load(std::memory_order_relaxed)) {
+      captureSensorEvent(SENSOR_EVENT_EDGE, micros());
+    }
+  }
+}
+
+void Esp32FlowSensor::begin() {
+  pinMode(pin, INPUT);
+  pinMode(pin, INPUT_PULLUP);
+  attached = this;
+  attachInterrupt(interrupt, onInterrupt, FALLING);
+  portENTER_CRITICAL(&flowMux);
+  pulses = 0;
+  portEXIT_CRITICAL(&flowMux);
+}
+
+void Esp32FlowSensor::end() {
+  detachInterrupt(interrupt);
+  attached = NULL;
+  portENTER_CRITICAL(&flowMux);
+  pulses = 0;
+  portEXIT_CRITICAL(&flowMux);
+}
+
+uint32_t Esp32FlowSensor::takePulses() {
+  portENTER_CRITICAL(&flowMux);
+  uint32_t count = pulses;
+  pulses = 0;
+  portEXIT_CRITICAL(&flowMux);
+  return count;
+}
+
+uint32_t Esp32FlowSensor::totalPulses() {
+  return total;
+}
+
+void Esp32Display::clear() {
+  display->clearDisplay();
+  display->setTextSize(1);
+  display->setTextColor(SSD1306_WHITE);
+  display->setCursor(0, 0);
+}
+
+void Esp32Display::show() {
+  display->setCursor(0, 0);
+  display->display();
+}
+
+bool Esp32Store::read(size_t address, void* data, size_t length) {
+  if (address + length > EEPROM.length()) {
+    return false;
+  }
+  return EEPROM.readBytes(address, data, length) == length;
+}
+
+bool Esp32Store::write(size_t address, const void* data, size_t length) {
+  if (address + length > EEPROM.length()) {
+    return false;
+  }
+  return EEPROM.writeBytes(address, data, length) == length;
+}
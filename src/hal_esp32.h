@@ -0,0 +1,123 @@
+/**
+ * @file         : hal_esp32.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <RTClib.h>
+#include <Adafruit_SSD1306.h>
+#include <Adafruit_MCP23X17.h>
+#include "hal.h"
+#include "metrics.h"
+#include "sensortrace.h"
+
+/**
+ * Device side of the HAL, thin wrappers over the drivers already in use.
+ */
+class Esp32Clock : public HalClock {
+public:
+  Esp32Clock(RTC_DS3231* rtc) : rtc(rtc) {}
+  uint32_t now() { return rtc->now().unixtime(); }
+  void adjust(uint32_t unixTime) { rtc->adjust(DateTime(unixTime)); }
+  float temperature() { return rtc->getTemperature(); }
+  uint32_t millis() { return ::millis(); }
+  void delay(uint32_t ms) { vTaskDelay(ms / portTICK_PERIOD_MS); }
+
+private:
+  RTC_DS3231* rtc;
+};
+
+class Esp32GpioExpander : public HalGpioExpander {
+public:
+  Esp32GpioExpander(Adafruit_MCP23X17* mcp) : mcp(mcp) {}
+  void pinMode(uint8_t pin, uint8_t mode) { mcp->pinMode(pin, mode); }
+  void digitalWrite(uint8_t pin, uint8_t value) {
+    mcp->digitalWrite(pin, value);
+    captureSensorEvent(SENSOR_EVENT_PIN, micros(), (pin << 1) | (value ? 1 : 0));
+  }
+  uint16_t readGPIOAB() { return mcp->readGPIOAB(); }
+  void writeGPIOAB(uint16_t value) {
+    mcp->writeGPIOAB(value);
+    captureSensorEvent(SENSOR_EVENT_PORT, micros(), value);
+  }
+
+private:
+  Adafruit_MCP23X17* mcp;
+};
+
+/**
+ * Counts level changes on the flow meter pin from its interrupt, only one
+ * sensor can be attached at a time.
+ */
+class Esp32FlowSensor : public HalFlowSensor {
+public:
+  Esp32FlowSensor(uint8_t pin, uint8_t interrupt, MetricCounter* interrupts = NULL, MetricCounter* edges = NULL);
+  void begin();
+  void end();
+  uint32_t takePulses();
+  uint32_t totalPulses();
+
+private:
+  static void onInterrupt();
+  static Esp32FlowSensor* attached;
+
+  uint8_t pin;
+  uint8_t interrupt;
+  MetricCounter* interrupts;
+  MetricCounter* edges;
+  volatile uint32_t pulses;
+  volatile uint32_t total;
+  volatile uint8_t state;
+};
+
+class Esp32Display : public HalDisplay {
+public:
+  Esp32Display(Adafruit_SSD1306* display) : display(display) {}
+  void clear();
+  void print(const char* text) { display->print(text); }
+  void show();
+
+private:
+  Adafruit_SSD1306* display;
+};
+
+// Emulated EEPROM, EEPROM.begin() has to succeed before it is used
+class Esp32Store : public HalStore {
+public:
+  size_t size() { return EEPROM.length(); }
+  bool read(size_t address, void* data, size_t length);
+  bool write(size_t address, const void* data, size_t length);
+  bool commit() { return EEPROM.commit(); }
+};
@@ -0,0 +1,158 @@
+/**
+ * @file         : hal_fake.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "hal_fake.h"
+#include <string.h>
+#include "constants.h"
+
+FakeClock::FakeClock(uint32_t unixTime, uint32_t readCost)
+  : elapsed(0), offset(unixTime), readCost(readCost), celsius(25.0), observer(NULL), context(NULL) {}
+
+uint32_t FakeClock::now() {
+  return offset + elapsed / 1000000;
+}
+
+void FakeClock::adjust(uint32_t unixTime) {
+  offset = (int64_t)unixTime - (int64_t)(elapsed / 1000000);
+}
+
+uint32_t FakeClock::millis() {
+  uint32_t value = elapsed / 1000;
+  advance(readCost);
+  return value;
+}
+
+void FakeClock::delay(uint32_t ms) {
+  advance((uint64_t)ms * 1000);
+}
+
+void FakeClock::advance(uint64_t micros) {
+  elapsed += micros;
+  if (observer != NULL) {
+    observer(elapsed, context);
+  }
+}
+
+void FakeGpioExpander::pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= I2C_MCP_PINCOUNT) {
+    return;
+  }
+  if (mode == OUTPUT) {
+    modes |= (1 << pin);
+  } else {
+    modes &= ~(1 << pin);
+  }
+}
+
+void FakeGpioExpander::digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= I2C_MCP_PINCOUNT) {
+    return;
+  }
+  uint16_t next = value == LOW ? outputs & ~(1 << pin) : outputs | (1 << pin);
+  writeGPIOAB(next);
+}
+
+void FakeGpioExpander::writeGPIOAB(uint16_t value) {
+  uint16_t previous = outputs;
+  outputs = value;
+  writes++;
+  if (observer != NULL && previous != value) {
+    observer(previous, value, context);
+  }
+}
+
+uint32_t FakeFlowSensor::takePulses() {
+  uint32_t count = pulses;
+  pulses = 0;
+  return count;
+}
+
+void FakeFlowSensor::inject(uint32_t count) {
+  if (counting) {
+    pulses += count;
+    total += count;
+  }
+}
+
+void FakeDisplay::print(const char* value) {
+  size_t available = sizeof(text) - 1 - length;
+  size_t count = strlen(value);
+  if (count > available) {
+    count = available;
+  }
+  memcpy(text + length, value, count);
+  length += count;
+  text[length] = '\0';
+}
+
+void FakeDisplay::show() {
+  memcpy(frame, text, length + 1);
+  frames++;
+}
+
+FakeStore::FakeStore(size_t size) : capacity(size), commits(0) {
+  working = new uint8_t[size];
+  image = new uint8_t[size];
+  // Erased flash reads back as 0xFF
+  memset(working, 0xFF, size);
+  memset(image, 0xFF, size);
+}
+
+FakeStore::~FakeStore() {
+  delete[] working;
+  delete[] image;
+}
+
+bool FakeStore::read(size_t address, void* data, size_t length) {
+  if (address + length > capacity) {
+    return false;
+  }
+  memcpy(data, working + address, length);
+  return true;
+}
+
+bool FakeStore::write(size_t address, const void* data, size_t length) {
+  if (address + length > capacity) {
+    return false;
+  }
+  memcpy(working + address, data, length);
+  return true;
+}
+
+bool FakeStore::commit() {
+  memcpy(image, working, capacity);
+  commits++;
+  return true;
+}
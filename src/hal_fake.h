@@ -0,0 +1,152 @@
+/**
+ * @file         : hal_fake.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include "hal.h"
+
+#define FAKE_CLOCK_READ_COST_US           20      /* Virtual time charged per millis() read, keeps polling loops moving */
+#define FAKE_DISPLAY_TEXT_LENGTH          128     /* Characters kept from the last frame */
+
+/**
+ * In-memory peripherals for host builds. Time is virtual: it only moves when
+ * the code delays, reads the clock or the owner calls advance().
+ */
+class FakeClock : public HalClock {
+public:
+  typedef void (*Observer)(uint64_t micros, void* context);
+
+  FakeClock(uint32_t unixTime = 0, uint32_t readCost = FAKE_CLOCK_READ_COST_US);
+  uint32_t now();
+  void adjust(uint32_t unixTime);
+  float temperature() { return celsius; }
+  uint32_t millis();
+  void delay(uint32_t ms);
+
+  void advance(uint64_t micros);
+  uint64_t micros() const { return elapsed; }
+  void setTemperature(float value) { celsius = value; }
+  // Called after time moved, e.g. to feed the flow sensor while the pump runs
+  void setObserver(Observer callback, void* callbackContext) { observer = callback; context = callbackContext; }
+
+private:
+  uint64_t elapsed;       // Virtual microseconds since the fake was created
+  int64_t offset;         // Unix time at elapsed 0
+  uint32_t readCost;
+  float celsius;
+  Observer observer;
+  void* context;
+};
+
+class FakeGpioExpander : public HalGpioExpander {
+public:
+  typedef void (*Observer)(uint16_t previous, uint16_t current, void* context);
+
+  FakeGpioExpander() : outputs(0xFFFF), modes(0), writes(0), observer(NULL), context(NULL) {}
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t value);
+  uint16_t readGPIOAB() { return outputs; }
+  void writeGPIOAB(uint16_t value);
+
+  // Called after every change of the outputs, e.g. to model what the pins drive
+  void setObserver(Observer callback, void* callbackContext) { observer = callback; context = callbackContext; }
+  bool isLow(uint8_t pin) const { return (outputs & (1 << pin)) == 0; }
+  uint32_t writeCount() const { return writes; }
+
+private:
+  uint16_t outputs;
+  uint16_t modes;         // Set bits are outputs
+  uint32_t writes;
+  Observer observer;
+  void* context;
+};
+
+class FakeFlowSensor : public HalFlowSensor {
+public:
+  FakeFlowSensor() : counting(false), pulses(0), total(0) {}
+  void begin() { counting = true; pulses = 0; }
+  void end() { counting = false; pulses = 0; }
+  uint32_t takePulses();
+  uint32_t totalPulses() { return total; }
+
+  // Pulses arriving while the sensor is not counting are dropped like on the device
+  void inject(uint32_t count);
+  bool isCounting() const { return counting; }
+
+private:
+  bool counting;
+  uint32_t pulses;
+  uint32_t total;
+};
+
+class FakeDisplay : public HalDisplay {
+public:
+  FakeDisplay() : length(0), frames(0) { text[0] = '\0'; frame[0] = '\0'; }
+  void clear() { length = 0; text[0] = '\0'; }
+  void print(const char* value);
+  void show();
+
+  const char* lastFrame() const { return frame; }
+  uint32_t frameCount() const { return frames; }
+
+private:
+  char text[FAKE_DISPLAY_TEXT_LENGTH];
+  char frame[FAKE_DISPLAY_TEXT_LENGTH];
+  size_t length;
+  uint32_t frames;
+};
+
+// Keeps the working copy and the committed image apart so lost commits show up
+class FakeStore : public HalStore {
+public:
+  FakeStore(size_t size);
+  ~FakeStore();
+  size_t size() { return capacity; }
+  bool read(size_t address, void* data, size_t length);
+  bool write(size_t address, const void* data, size_t length);
+  bool commit();
+
+  const uint8_t* committed() const { return image; }
+  uint32_t commitCount() const { return commits; }
+
+private:
+  FakeStore(const FakeStore&);
+  FakeStore& operator=(const FakeStore&);
+
+  size_t capacity;
+  uint8_t* working;
+  uint8_t* image;
+  uint32_t commits;
+};
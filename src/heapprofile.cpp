@@ -0,0 +1,400 @@
+/**
+ * @file         : heapprofile.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "heapprofile.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include <Arduino.h>
+  #include <esp_heap_caps.h>
+#else
+  #include <malloc.h>
+  #include <time.h>
+  #include <new>
+  #include <mutex>
+#endif
+
+static std::atomic<bool> profiling(false);
+static std::atomic<uint32_t> allocationCount(0);
+static std::atomic<uint32_t> freeCount(0);
+static std::atomic<uint32_t> failureCount(0);
+static std::atomic<int32_t> liveBytes(0);
+static std::atomic<int32_t> peakBytes(0);
+
+static HeapTagStats tags[HEAP_PROFILE_MAX_TAGS];
+static uint8_t tagCount = 0;
+static HeapSample samples[HEAP_PROFILE_SAMPLES];
+static uint32_t sampleCount = 0;
+static uint32_t lowestFree = UINT32_MAX;
+// Guards the tag names and the samples, never held while allocating. Taken by every
+// HeapScope and the telemetry task, so a critical section on the device like tracer.cpp
+#if defined(ARDUINO)
+static portMUX_TYPE profileMux = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::mutex profileMutex;
+#endif
+
+// Innermost scope of the running task, plain pointer so it needs no dynamic initialisation
+static thread_local HeapScope* currentScope = NULL;
+
+static void lock() {
+#if defined(ARDUINO)
+  portENTER_CRITICAL(&profileMux);
+#else
+  profileMutex.lock();
+#endif
+}
+
+static void unlock() {
+#if defined(ARDUINO)
+  portEXIT_CRITICAL(&profileMux);
+#else
+  profileMutex.unlock();
+#endif
+}
+
+static uint32_t heapMillis() {
+#if defined(ARDUINO)
+  return millis();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000ULL + now.tv_nsec / 1000000);
+#endif
+}
+
+// Interrupt handlers run on the stack of whatever task they interrupted, they only count globally
+static bool inInterrupt() {
+#if defined(ARDUINO)
+  return xPortInIsrContext();
+#else
+  return false;
+#endif
+}
+
+static HeapTagStats* findTag(const char* name) {
+  lock();
+  HeapTagStats* stats = NULL;
+  for (uint8_t i = 0; i < tagCount && stats == NULL; i++) {
+    if (strncmp(tags[i].name, name, HEAP_PROFILE_TAG_LENGTH - 1) == 0) {
+      stats = &tags[i];
+    }
+  }
+  if (stats == NULL) {
+    stats = &tags[tagCount < HEAP_PROFILE_MAX_TAGS ? tagCount : HEAP_PROFILE_MAX_TAGS - 1];
+    if (tagCount < HEAP_PROFILE_MAX_TAGS - 1) {
+      strncpy(stats->name, name, HEAP_PROFILE_TAG_LENGTH - 1);
+      tagCount++;
+    } else if (tagCount == HEAP_PROFILE_MAX_TAGS - 1) {
+      strncpy(stats->name, "other", HEAP_PROFILE_TAG_LENGTH - 1);
+      tagCount++;
+    }
+  }
+  unlock();
+  return stats;
+}
+
+static void raise(std::atomic<uint32_t>& value, uint32_t candidate) {
+  uint32_t current = value.load(std::memory_order_relaxed);
+  while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+  }
+}
+
+HeapScope::HeapScope(const char* tag) : parent(currentScope), stats(findTag(tag != NULL ? tag : "untagged")), current(0), highest(0) {
+  currentScope = this;
+}
+
+HeapScope::~HeapScope() {
+  currentScope = parent;
+  uint32_t growth = highest > 0 ? highest : 0;
+  stats->scopes.fetch_add(1, std::memory_order_relaxed);
+  stats->lastPeak.store(growth, std::memory_order_relaxed);
+  raise(stats->peak, growth);
+  // The outer scope peaked with this one, and what this scope kept alive stays on its books
+  if (parent != NULL) {
+    if (parent->current + highest > parent->highest) {
+      parent->highest = parent->current + highest;
+    }
+    parent->current += current;
+  }
+}
+
+void beginHeapProfile() {
+  profiling.store(true, std::memory_order_relaxed);
+}
+
+bool isHeapProfiling() {
+  return profiling.load(std::memory_order_relaxed);
+}
+
+void heapProfileAllocated(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  int32_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+  int32_t peak = peakBytes.load(std::memory_order_relaxed);
+  while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+  HeapScope* scope = inInterrupt() ? NULL : currentScope;
+  if (scope != NULL) {
+    scope->stats->allocations.fetch_add(1, std::memory_order_relaxed);
+    scope->stats->bytes.fetch_add(size, std::memory_order_relaxed);
+    scope->current += size;
+    if (scope->current > scope->highest) {
+      scope->highest = scope->current;
+    }
+  }
+}
+
+void heapProfileFreed(size_t size) {
+  freeCount.fetch_add(1, std::memory_order_relaxed);
+  liveBytes.fetch_sub(size, std::memory_order_relaxed);
+  HeapScope* scope = inInterrupt() ? NULL : currentScope;
+  if (scope != NULL) {
+    scope->stats->frees.fetch_add(1, std::memory_order_relaxed);
+    scope->current -= size;
+  }
+}
+
+void heapProfileFailed() {
+  failureCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void sampleHeap() {
+  HeapSample sample;
+  sample.at = heapMillis();
+#if defined(ARDUINO)
+  sample.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  sample.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  sample.minFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+#else
+  // glibc has no largest block query, the releasable top chunk is the closest it reports
+  struct mallinfo2 info = mallinfo2();
+  sample.freeBytes = info.fordblks;
+  sample.largestBlock = info.keepcost;
+  sample.minFree = sample.freeBytes < lowestFree ? sample.freeBytes : lowestFree;
+#endif
+  sample.fragmentation = sample.freeBytes > 0 ? 1000 - (uint16_t)((uint64_t)sample.largestBlock * 1000 / sample.freeBytes) : 0;
+
+  lock();
+  lowestFree = sample.minFree;
+  samples[sampleCount % HEAP_PROFILE_SAMPLES] = sample;
+  sampleCount++;
+  unlock();
+}
+
+bool getLatestHeapSample(HeapSample* sample) {
+  lock();
+  bool found = sampleCount > 0;
+  if (found) {
+    *sample = samples[(sampleCount - 1) % HEAP_PROFILE_SAMPLES];
+  }
+  unlock();
+  return found;
+}
+
+void getHeapTotals(HeapTotals* totals) {
+  totals->allocations = allocationCount.load(std::memory_order_relaxed);
+  totals->frees = freeCount.load(std::memory_order_relaxed);
+  totals->failures = failureCount.load(std::memory_order_relaxed);
+  totals->live = liveBytes.load(std::memory_order_relaxed);
+  totals->peak = peakBytes.load(std::memory_order_relaxed);
+}
+
+void writeHeapProfile(JsonWriter& json) {
+  HeapTotals totals;
+  getHeapTotals(&totals);
+  json.beginObject();
+  json.field("profiling", isHeapProfiling());
+  json.field("allocations", totals.allocations);
+  json.field("frees", totals.frees);
+  json.field("failures", totals.failures);
+  json.field("live", totals.live);
+  json.field("peak", totals.peak);
+
+  lock();
+  uint8_t count = tagCount;
+  unlock();
+  json.key("tags").beginArray();
+  for (uint8_t i = 0; i < count; i++) {
+    json.beginObject();
+    json.field("name", tags[i].name);
+    json.field("allocations", tags[i].allocations.load(std::memory_order_relaxed));
+    json.field("frees", tags[i].frees.load(std::memory_order_relaxed));
+    json.field("bytes", tags[i].bytes.load(std::memory_order_relaxed));
+    json.field("scopes", tags[i].scopes.load(std::memory_order_relaxed));
+    json.field("peak", tags[i].peak.load(std::memory_order_relaxed));
+    json.field("lastPeak", tags[i].lastPeak.load(std::memory_order_relaxed));
+    json.endObject();
+  }
+  json.endArray();
+
+  // Oldest first, copied out one at a time so the lock is never held across the sink
+  json.key("samples").beginArray();
+  lock();
+  uint32_t last = sampleCount;
+  unlock();
+  uint32_t first = last > HEAP_PROFILE_SAMPLES ? last - HEAP_PROFILE_SAMPLES : 0;
+  for (uint32_t i = first; i < last; i++) {
+    lock();
+    HeapSample sample = samples[i % HEAP_PROFILE_SAMPLES];
+    unlock();
+    json.beginArray().value(sample.at).value(sample.freeBytes).value(sample.largestBlock).value(sample.minFree).value(sample.fragmentation).endArray();
+  }
+  json.endArray();
+  json.endObject();
+}
+
+#if defined(ARDUINO)
+/**
+ * Link time wrappers, enabled with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free.
+ * operator new of the static libstdc++ goes through malloc as well.
+ */
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* block, size_t size);
+void __real_free(void* block);
+
+void* __wrap_malloc(size_t size) {
+  void* block = __real_malloc(size);
+  if (profiling.load(std::memory_order_relaxed)) {
+    if (block != NULL) {
+      heapProfileAllocated(heap_caps_get_allocated_size(block));
+    } else if (size > 0) {
+      heapProfileFailed();
+    }
+  }
+  return block;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void* block = __real_calloc(count, size);
+  if (profiling.load(std::memory_order_relaxed)) {
+    if (block != NULL) {
+      heapProfileAllocated(heap_caps_get_allocated_size(block));
+    } else if (count * size > 0) {
+      heapProfileFailed();
+    }
+  }
+  return block;
+}
+
+void* __wrap_realloc(void* block, size_t size) {
+  if (!profiling.load(std::memory_order_relaxed)) {
+    return __real_realloc(block, size);
+  }
+  size_t before = block != NULL ? heap_caps_get_allocated_size(block) : 0;
+  void* resized = __real_realloc(block, size);
+  if (resized == NULL && size > 0) {
+    // The original block is still valid
+    heapProfileFailed();
+    return NULL;
+  }
+  if (before > 0) {
+    heapProfileFreed(before);
+  }
+  if (resized != NULL) {
+    heapProfileAllocated(heap_caps_get_allocated_size(resized));
+  }
+  return resized;
+}
+
+void __wrap_free(void* block) {
+  if (block != NULL && profiling.load(std::memory_order_relaxed)) {
+    heapProfileFreed(heap_caps_get_allocated_size(block));
+  }
+  __real_free(block);
+}
+}
+#else
+/**
+ * The host libstdc++ is shared and calls its own malloc, so the replaceable
+ * operator new and delete are used instead. Direct malloc calls, e.g. the
+ * ArduinoJson pool, are not seen on the host.
+ */
+static void* allocate(size_t size) {
+  void* block = malloc(size > 0 ? size : 1);
+  if (profiling.load(std::memory_order_relaxed)) {
+    if (block != NULL) {
+      heapProfileAllocated(malloc_usable_size(block));
+    } else {
+      heapProfileFailed();
+    }
+  }
+  return block;
+}
+
+static void release(void* block) {
+  if (block != NULL && profiling.load(std::memory_order_relaxed)) {
+    heapProfileFreed(malloc_usable_size(block));
+  }
+  free(block);
+}
+
+void* operator new(size_t size) {
+  void* block = allocate(size);
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void* block) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block) noexcept {
+  release(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+  release(block);
+}
+#endif
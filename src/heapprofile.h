@@ -0,0 +1,111 @@
+/**
+ * @file         : heapprofile.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "jsonwriter.h"
+
+#define HEAP_PROFILE_MAX_TAGS             40      /* Distinct tags, the last slot collects everything past it */
+#define HEAP_PROFILE_TAG_LENGTH           28      /* Tag names are copied, longer ones are truncated */
+#define HEAP_PROFILE_SAMPLES              64      /* Free heap samples kept, one per telemetry heap refresh */
+
+// Allocations made inside a scope with this tag, cumulative since boot
+struct HeapTagStats {
+  char name[HEAP_PROFILE_TAG_LENGTH];
+  std::atomic<uint32_t> allocations;
+  std::atomic<uint32_t> frees;
+  std::atomic<uint32_t> bytes;            // Allocated, frees do not subtract
+  std::atomic<uint32_t> scopes;           // Times a scope with the tag ended
+  std::atomic<uint32_t> peak;             // Highest net growth of a single scope
+  std::atomic<uint32_t> lastPeak;
+};
+
+struct HeapSample {
+  uint32_t at;                            // millis()
+  uint32_t freeBytes;
+  uint32_t largestBlock;                  // Largest single allocation that would still succeed
+  uint32_t minFree;                       // Low water mark since boot
+  uint16_t fragmentation;                 // Per mille of the free heap not in the largest block
+};
+
+struct HeapTotals {
+  uint32_t allocations;
+  uint32_t frees;
+  uint32_t failures;
+  int32_t live;                           // Bytes allocated and not freed since profiling started
+  int32_t peak;
+};
+
+/**
+ * Attributes every allocation made by the current task to the innermost
+ * scope until it goes out of scope. Scopes nest, the net growth of an
+ * inner scope also counts towards the peak of the outer ones.
+ */
+class HeapScope {
+public:
+  HeapScope(const char* tag);
+  ~HeapScope();
+  int32_t live() const { return current; }
+  int32_t peak() const { return highest; }
+
+private:
+  HeapScope(const HeapScope&);
+  HeapScope& operator=(const HeapScope&);
+
+  friend void heapProfileAllocated(size_t size);
+  friend void heapProfileFreed(size_t size);
+
+  HeapScope* parent;
+  HeapTagStats* stats;
+  int32_t current;
+  int32_t highest;
+};
+
+/**
+ * Profiler, the allocator interception calls the two hooks. On the device
+ * malloc, calloc, realloc and free are wrapped at link time, on the host
+ * operator new and delete are replaced.
+ */
+void beginHeapProfile();
+bool isHeapProfiling();
+void heapProfileAllocated(size_t size);
+void heapProfileFreed(size_t size);
+void heapProfileFailed();
+void sampleHeap();
+bool getLatestHeapSample(HeapSample* sample);
+void getHeapTotals(HeapTotals* totals);
+void writeHeapProfile(JsonWriter& json);
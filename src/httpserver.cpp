@@ -0,0 +1,916 @@
+/**
+ * @file         : httpserver.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "httpserver.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(ARDUINO)
+  #include <lwip/sockets.h>
+#else
+  #include <sys/socket.h>
+  #include <sys/select.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <time.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+#endif
+
+// Event streams have neither a length nor chunked framing, the body ends when the socket closes
+#define CONTENT_LENGTH_STREAM             ((size_t)-3)
+
+static uint32_t httpMillis() {
+#if defined(ARDUINO)
+  return millis();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+#endif
+}
+
+static uint32_t httpMicros() {
+#if defined(ARDUINO)
+  return micros();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000000ULL + now.tv_nsec / 1000);
+#endif
+}
+
+static const char* statusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 406: return "Not Acceptable";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 412: return "Precondition Failed";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+static bool setNonBlocking(int socket) {
+  int flags = fcntl(socket, F_GETFL, 0);
+  return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+// Offset right after the blank line ending the headers, 0 while incomplete
+static size_t findHeaderEnd(const char* data, size_t length) {
+  for (size_t i = 3; i < length; i++) {
+    if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r') {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// Non destructive header lookup, used before the request is known to be complete
+static const char* findHeader(const char* data, size_t length, const char* name) {
+  size_t nameLength = strlen(name);
+  const char* end = data + length;
+  const char* line = (const char*)memchr(data, '\n', length);
+  while (line != NULL && ++line < end) {
+    if ((size_t)(end - line) > nameLength && line[nameLength] == ':' && strncasecmp(line, name, nameLength) == 0) {
+      const char* value = line + nameLength + 1;
+      while (value < end && *value == ' ') {
+        value++;
+      }
+      return value;
+    }
+    line = (const char*)memchr(line, '\n', end - line);
+  }
+  return NULL;
+}
+
+static void urlDecode(char* text) {
+  char* out = text;
+  for (char* in = text; *in != '\0'; in++) {
+    if (*in == '+') {
+      *out++ = ' ';
+    } else if (*in == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+      char hex[3] = { in[1], in[2], '\0' };
+      *out++ = (char)strtoul(hex, NULL, 16);
+      in += 2;
+    } else {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
+}
+
+static bool containsToken(const char* value, const char* token) {
+  size_t length = strlen(token);
+  for (; *value != '\0'; value++) {
+    if (strncasecmp(value, token, length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static HTTPMethod parseMethod(const char* method) {
+  if (strcmp(method, "GET") == 0) return HTTP_GET;
+  if (strcmp(method, "POST") == 0) return HTTP_POST;
+  if (strcmp(method, "DELETE") == 0) return HTTP_DELETE;
+  if (strcmp(method, "PUT") == 0) return HTTP_PUT;
+  if (strcmp(method, "PATCH") == 0) return HTTP_PATCH;
+  if (strcmp(method, "HEAD") == 0) return HTTP_HEAD;
+  if (strcmp(method, "OPTIONS") == 0) return HTTP_OPTIONS;
+  return HTTP_ANY;
+}
+
+HttpServer::HttpServer(uint16_t port)
+  : listenPort(port), listenSocket(-1), cors(false), current(NULL), routeCount(0), droppedRouteCount(0), notFoundHandler(NULL), requestObserver(NULL), handlerInvoker(NULL), progressHook(NULL),
+    collectedHeaderCount(0), requestMethod(HTTP_ANY), requestUri(NULL), requestBody(NULL), requestBodyLength(0),
+    keepAlive(false), argCount(0), pathArgCount(0), responseHeaderCount(0), contentLength(CONTENT_LENGTH_NOT_SET),
+    responseCode(0), headersSent(false), chunked(false), chunkTerminated(false), responseFailed(false), responseWriting(false), responseStarted(0), outputLength(0) {
+  for (uint8_t i = 0; i < HTTP_MAX_CLIENTS; i++) {
+    connections[i].socket = -1;
+    connections[i].length = 0;
+  }
+  for (uint8_t i = 0; i < HTTP_MAX_EVENT_STREAMS; i++) {
+    streams[i].socket = -1;
+  }
+}
+
+HttpServer::~HttpServer() {
+  stop();
+}
+
+bool HttpServer::begin() {
+  listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenSocket < 0) {
+    return false;
+  }
+  int enable = 1;
+  setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(listenPort);
+  if (bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+      listen(listenSocket, HTTP_MAX_CLIENTS) < 0 || !setNonBlocking(listenSocket)) {
+    stop();
+    return false;
+  }
+  // Port 0 picks a free port, report the one we got
+  socklen_t addressLength = sizeof(address);
+  if (getsockname(listenSocket, (struct sockaddr*)&address, &addressLength) == 0) {
+    listenPort = ntohs(address.sin_port);
+  }
+  return true;
+}
+
+void HttpServer::stop() {
+  for (uint8_t i = 0; i < HTTP_MAX_CLIENTS; i++) {
+    closeConnection(connections[i]);
+  }
+  for (uint8_t i = 0; i < HTTP_MAX_EVENT_STREAMS; i++) {
+    closeEventStream(streams[i]);
+  }
+  if (listenSocket >= 0) {
+    ::close(listenSocket);
+    listenSocket = -1;
+  }
+}
+
+bool HttpServer::on(const char* uri, HttpHandler handler) {
+  return on(uri, HTTP_ANY, handler);
+}
+
+bool HttpServer::on(const char* uri, HTTPMethod method, HttpHandler handler) {
+  if (routeCount >= HTTP_MAX_ROUTES) {
+    droppedRouteCount++;
+    return false;
+  }
+  routes[routeCount].uri = uri;
+  routes[routeCount].method = method;
+  routes[routeCount].handler = handler;
+  routeCount++;
+  return true;
+}
+
+void HttpServer::onNotFound(HttpHandler handler) {
+  notFoundHandler = handler;
+}
+
+void HttpServer::collectHeaders(const char* headerKeys[], size_t count) {
+  collectedHeaderCount = 0;
+  for (size_t i = 0; i < count && i < HTTP_MAX_COLLECTED_HEADERS; i++) {
+    collectedHeaderNames[collectedHeaderCount++] = headerKeys[i];
+  }
+}
+
+/**
+ * Sleep in select() until the listening socket or a client has data, or the
+ * timeout expires. Returns true when handleClient() has work to do.
+ */
+bool HttpServer::waitForClient(uint32_t timeoutMs) {
+  if (listenSocket < 0) {
+    return false;
+  }
+  fd_set readable;
+  fd_set writable;
+  FD_ZERO(&readable);
+  FD_ZERO(&writable);
+  FD_SET(listenSocket, &readable);
+  int maxSocket = listenSocket;
+  for (uint8_t i = 0; i < HTTP_MAX_CLIENTS; i++) {
+    if (connections[i].socket >= 0) {
+      FD_SET(connections[i].socket, &readable);
+      if (connections[i].socket > maxSocket) {
+        maxSocket = connections[i].socket;
+      }
+    }
+  }
+  // Subscribers are fed from memory, poll for new events and wait for room on the lagging ones
+  for (uint8_t i = 0; i < HTTP_MAX_EVENT_STREAMS; i++) {
+    if (streams[i].socket >= 0) {
+      FD_SET(streams[i].socket, &readable);
+      if (streams[i].pendingLength > 0) {
+        FD_SET(streams[i].socket, &writable);
+      }
+      if (streams[i].socket > maxSocket) {
+        maxSocket = streams[i].socket;
+      }
+      if (timeoutMs > HTTP_EVENT_POLL_MS) {
+        timeoutMs = HTTP_EVENT_POLL_MS;
+      }
+    }
+  }
+  struct timeval timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_usec = (timeoutMs % 1000) * 1000;
+  return select(maxSocket + 1, &readable, &writable, NULL, &timeout) > 0;
+}
+
+void HttpServer::handleClient() {
+  if (listenSocket < 0) {
+    return;
+  }
+  acceptClients();
+  for (uint8_t i = 0; i < HTTP_MAX_CLIENTS; i++) {
+    HttpConnection& connection = connections[i];
+    if (connection.socket < 0) {
+      continue;
+    }
+    receive(connection);
+    if (connection.socket >= 0 && httpMillis() - connection.lastActivity > HTTP_KEEP_ALIVE_TIMEOUT_MS) {
+      closeConnection(connection);
+    }
+  }
+  serviceEventStreams();
+}
+
+void HttpServer::acceptClients() {
+  for (;;) {
+    int client = accept(listenSocket, NULL, NULL);
+    if (client < 0) {
+      return;
+    }
+    setNonBlocking(client);
+    int enable = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    // Take a free slot, or recycle the connection that has been idle the longest
+    HttpConnection* slot = NULL;
+    for (uint8_t i = 0; i < HTTP_MAX_CLIENTS; i++) {
+      HttpConnection& connection = connections[i];
+      if (connection.socket < 0) {
+        slot = &connection;
+        break;
+      }
+      if (connection.length == 0 && (slot == NULL || connection.lastActivity < slot->lastActivity)) {
+        slot = &connection;
+      }
+    }
+    if (slot == NULL) {
+      HttpConnection overflow;
+      overflow.socket = client;
+      overflow.length = 0;
+      sendError(overflow, 503);
+      continue;
+    }
+    closeConnection(*slot);
+    slot->socket = client;
+    slot->length = 0;
+    slot->requests = 0;
+    slot->lastActivity = httpMillis();
+  }
+}
+
+void HttpServer::receive(HttpConnection& connection) {
+  size_t room = HTTP_REQUEST_BUFFER_SIZE - connection.length;
+  if (room == 0) {
+    return;
+  }
+  ssize_t received = recv(connection.socket, connection.buffer + connection.length, room, 0);
+  if (received == 0 || (received < 0 && errno != EWOULDBLOCK && errno != EAGAIN)) {
+    closeConnection(connection);
+    return;
+  }
+  if (received > 0) {
+    connection.length += received;
+    connection.lastActivity = httpMillis();
+    process(connection);
+  }
+}
+
+// Serves every complete request in the buffer, pipelined ones are answered in order
+void HttpServer::process(HttpConnection& connection) {
+  while (connection.socket >= 0 && connection.length > 0) {
+    size_t headerLength = findHeaderEnd(connection.buffer, connection.length);
+    if (headerLength == 0) {
+      if (connection.length == HTTP_REQUEST_BUFFER_SIZE) {
+        sendError(connection, 431);
+      }
+      return;
+    }
+    if (findHeader(connection.buffer, headerLength, "Transfer-Encoding") != NULL) {
+      sendError(connection, 411);
+      return;
+    }
+    const char* lengthHeader = findHeader(connection.buffer, headerLength, "Content-Length");
+    size_t bodyLength = lengthHeader != NULL ? strtoul(lengthHeader, NULL, 10) : 0;
+    // Keep one byte to terminate the body in place
+    if (bodyLength >= HTTP_REQUEST_BUFFER_SIZE - headerLength) {
+      sendError(connection, 413);
+      return;
+    }
+    size_t total = headerLength + bodyLength;
+    if (connection.length < total) {
+      return;
+    }
+
+    // The terminator overwrites the first byte of the next pipelined request
+    char next = connection.buffer[total];
+    connection.buffer[total] = '\0';
+    requestBody = connection.buffer + headerLength;
+    requestBodyLength = bodyLength;
+    if (!parseRequest(connection.buffer, headerLength)) {
+      sendError(connection, 400);
+      return;
+    }
+    // Announce the recycle on the last response instead of dropping the connection silently
+    if (connection.requests + 1 >= HTTP_MAX_KEEP_ALIVE_REQUESTS) {
+      keepAlive = false;
+    }
+    current = &connection;
+    dispatch();
+    current = NULL;
+    connection.buffer[total] = next;
+
+    connection.length -= total;
+    memmove(connection.buffer, connection.buffer + total, connection.length);
+    connection.requests++;
+    connection.lastActivity = httpMillis();
+    if (!keepAlive || responseFailed) {
+      closeConnection(connection);
+    }
+  }
+}
+
+bool HttpServer::parseRequest(char* request, size_t headerLength) {
+  request[headerLength - 2] = '\0';
+  argCount = 0;
+  pathArgCount = 0;
+  for (uint8_t i = 0; i < collectedHeaderCount; i++) {
+    collectedHeaderValues[i] = NULL;
+  }
+
+  // Request line: METHOD SP URI SP VERSION
+  char* lineEnd = strstr(request, "\r\n");
+  if (lineEnd == NULL) {
+    return false;
+  }
+  *lineEnd = '\0';
+  char* uri = strchr(request, ' ');
+  if (uri == NULL) {
+    return false;
+  }
+  *uri++ = '\0';
+  char* version = strchr(uri, ' ');
+  if (version == NULL) {
+    return false;
+  }
+  *version++ = '\0';
+  requestMethod = parseMethod(request);
+  keepAlive = strcmp(version, "HTTP/1.1") == 0;
+
+  char* query = strchr(uri, '?');
+  if (query != NULL) {
+    *query++ = '\0';
+    parseQuery(query);
+  }
+  urlDecode(uri);
+  requestUri = uri;
+
+  // Headers, values are terminated in place
+  char* line = lineEnd + 2;
+  while (*line != '\0') {
+    char* end = strstr(line, "\r\n");
+    if (end != NULL) {
+      *end = '\0';
+    }
+    char* value = strchr(line, ':');
+    if (value != NULL) {
+      *value++ = '\0';
+      while (*value == ' ') {
+        value++;
+      }
+      if (strcasecmp(line, "Connection") == 0) {
+        if (containsToken(value, "close")) {
+          keepAlive = false;
+        } else if (containsToken(value, "keep-alive")) {
+          keepAlive = true;
+        }
+      }
+      for (uint8_t i = 0; i < collectedHeaderCount; i++) {
+        if (strcasecmp(line, collectedHeaderNames[i]) == 0) {
+          collectedHeaderValues[i] = value;
+        }
+      }
+    }
+    if (end == NULL) {
+      break;
+    }
+    line = end + 2;
+  }
+  return requestMethod != HTTP_ANY;
+}
+
+void HttpServer::parseQuery(char* query) {
+  while (query != NULL && *query != '\0' && argCount < HTTP_MAX_ARGS) {
+    char* next = strchr(query, '&');
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+    char* value = strchr(query, '=');
+    if (value != NULL) {
+      *value++ = '\0';
+      urlDecode(value);
+    } else {
+      value = query + strlen(query);
+    }
+    urlDecode(query);
+    args[argCount].name = query;
+    args[argCount].value = value;
+    argCount++;
+    query = next;
+  }
+}
+
+bool HttpServer::matchRoute(const HttpRoute& route, const char* path) {
+  const char* pattern = route.uri;
+  size_t used = 0;
+  pathArgCount = 0;
+  while (*pattern != '\0' && *path != '\0') {
+    if (pattern[0] == '{' && pattern[1] == '}') {
+      // Capture up to the next separator
+      const char* end = strchr(path, '/');
+      size_t length = end != NULL ? (size_t)(end - path) : strlen(path);
+      if (pathArgCount == HTTP_MAX_PATH_ARGS || used + length + 1 > sizeof(pathArgBuffer)) {
+        return false;
+      }
+      memcpy(pathArgBuffer + used, path, length);
+      pathArgBuffer[used + length] = '\0';
+      pathArgs[pathArgCount++] = pathArgBuffer + used;
+      used += length + 1;
+      path += length;
+      pattern += 2;
+    } else if (*pattern++ != *path++) {
+      return false;
+    }
+  }
+  return *pattern == '\0' && *path == '\0';
+}
+
+void HttpServer::dispatch() {
+  uint32_t start = httpMicros();
+  responseHeaderCount = 0;
+  responseCode = 0;
+  contentLength = CONTENT_LENGTH_NOT_SET;
+  headersSent = false;
+  chunked = false;
+  chunkTerminated = false;
+  responseFailed = false;
+  responseWriting = false;
+  outputLength = 0;
+
+  HttpHandler handler = notFoundHandler;
+  const char* route = NULL;
+  for (uint8_t i = 0; i < routeCount; i++) {
+    if ((routes[i].method == HTTP_ANY || routes[i].method == requestMethod) && matchRoute(routes[i], requestUri)) {
+      handler = routes[i].handler;
+      route = routes[i].uri;
+      break;
+    }
+  }
+  if (handler != NULL && handlerInvoker != NULL) {
+    handlerInvoker(handler, route);
+  } else if (handler != NULL) {
+    handler();
+  }
+  if (!headersSent) {
+    send(handler == NULL ? 404 : 500);
+  }
+  // An unterminated chunked body leaves the connection unusable
+  if (chunked && !chunkTerminated) {
+    keepAlive = false;
+  }
+  flush();
+  if (requestObserver != NULL) {
+    requestObserver(requestMethod, responseCode, httpMicros() - start);
+  }
+}
+
+bool HttpServer::hasArg(const char* name) const {
+  if (strcmp(name, "plain") == 0) {
+    return requestBodyLength > 0;
+  }
+  for (uint8_t i = 0; i < argCount; i++) {
+    if (strcmp(args[i].name, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Like WebServer, the "plain" argument is the request body
+const char* HttpServer::argValue(const char* name) const {
+  if (strcmp(name, "plain") == 0) {
+    return requestBody != NULL ? requestBody : "";
+  }
+  for (uint8_t i = 0; i < argCount; i++) {
+    if (strcmp(args[i].name, name) == 0) {
+      return args[i].value;
+    }
+  }
+  return "";
+}
+
+const char* HttpServer::pathArgValue(unsigned int index) const {
+  return index < pathArgCount ? pathArgs[index] : "";
+}
+
+const char* HttpServer::headerValue(const char* name) const {
+  for (uint8_t i = 0; i < collectedHeaderCount; i++) {
+    if (strcasecmp(collectedHeaderNames[i], name) == 0) {
+      return collectedHeaderValues[i] != NULL ? collectedHeaderValues[i] : "";
+    }
+  }
+  return "";
+}
+
+bool HttpServer::hasHeader(const char* name) const {
+  for (uint8_t i = 0; i < collectedHeaderCount; i++) {
+    if (strcasecmp(collectedHeaderNames[i], name) == 0) {
+      return collectedHeaderValues[i] != NULL;
+    }
+  }
+  return false;
+}
+
+void HttpServer::sendHeader(const char* name, const char* value) {
+  if (responseHeaderCount < HTTP_MAX_RESPONSE_HEADERS) {
+    snprintf(responseHeaderNames[responseHeaderCount], HTTP_HEADER_NAME_LENGTH, "%s", name);
+    snprintf(responseHeaderValues[responseHeaderCount], HTTP_HEADER_VALUE_LENGTH, "%s", value);
+    responseHeaderCount++;
+  }
+}
+
+void HttpServer::send(int code, const char* contentType, const char* content) {
+  send(code, contentType, content, content != NULL ? strlen(content) : 0);
+}
+
+void HttpServer::send(int code, const char* contentType, const char* content, size_t length) {
+  if (current == NULL || headersSent) {
+    return;
+  }
+  if (contentLength == CONTENT_LENGTH_UNKNOWN) {
+    chunked = true;
+    writeHeaders(code, contentType, CONTENT_LENGTH_UNKNOWN);
+    if (length > 0) {
+      sendContent(content, length);
+    }
+    return;
+  }
+  // A length set up front means the body follows through sendContent()
+  writeHeaders(code, contentType, contentLength != CONTENT_LENGTH_NOT_SET ? contentLength : length);
+  if (length > 0 && requestMethod != HTTP_HEAD) {
+    write(content, length);
+  }
+}
+
+void HttpServer::sendContent(const char* content) {
+  sendContent(content, strlen(content));
+}
+
+void HttpServer::sendContent(const char* content, size_t length) {
+  if (current == NULL || !headersSent) {
+    return;
+  }
+  if (!chunked) {
+    write(content, length);
+    return;
+  }
+  if (chunkTerminated) {
+    return;
+  }
+  char size[12];
+  if (length == 0) {
+    write("0\r\n\r\n", 5);
+    chunkTerminated = true;
+    return;
+  }
+  write(size, snprintf(size, sizeof(size), "%x\r\n", (unsigned int)length));
+  write(content, length);
+  write("\r\n", 2);
+}
+
+void HttpServer::writeHeaders(int code, const char* contentType, size_t length) {
+  char line[HTTP_HEADER_NAME_LENGTH + HTTP_HEADER_VALUE_LENGTH + 8];
+  headersSent = true;
+  responseCode = code;
+  write(line, snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", code, statusText(code)));
+  if (contentType != NULL) {
+    write(line, snprintf(line, sizeof(line), "Content-Type: %s\r\n", contentType));
+  }
+  if (length == CONTENT_LENGTH_UNKNOWN) {
+    write("Transfer-Encoding: chunked\r\n", 28);
+  } else if (length != CONTENT_LENGTH_STREAM && code != 204 && code != 304) {
+    write(line, snprintf(line, sizeof(line), "Content-Length: %u\r\n", (unsigned int)length));
+  }
+  if (cors) {
+    write("Access-Control-Allow-Origin: *\r\n", 32);
+  }
+  for (uint8_t i = 0; i < responseHeaderCount; i++) {
+    write(line, snprintf(line, sizeof(line), "%s: %s\r\n", responseHeaderNames[i], responseHeaderValues[i]));
+  }
+  if (keepAlive) {
+    write("Connection: keep-alive\r\n\r\n", 26);
+  } else {
+    write("Connection: close\r\n\r\n", 21);
+  }
+}
+
+void HttpServer::write(const char* data, size_t length) {
+  if (outputLength + length > HTTP_RESPONSE_BUFFER_SIZE) {
+    flush();
+  }
+  if (length > HTTP_RESPONSE_BUFFER_SIZE) {
+    sendAll(data, length);
+    return;
+  }
+  memcpy(output + outputLength, data, length);
+  outputLength += length;
+}
+
+void HttpServer::flush() {
+  if (outputLength > 0) {
+    sendAll(output, outputLength);
+    outputLength = 0;
+  }
+}
+
+// The socket is non blocking, wait for room instead of failing on a full send window,
+// but never longer than HTTP_RESPONSE_TIMEOUT_MS for the whole response
+bool HttpServer::sendAll(const char* data, size_t length) {
+  if (current == NULL || current->socket < 0 || responseFailed) {
+    return false;
+  }
+  if (!responseWriting) {
+    responseWriting = true;
+    responseStarted = httpMillis();
+  }
+  while (length > 0) {
+    if (progressHook != NULL) {
+      progressHook();
+    }
+    // A response cut short can not be told apart from a complete one, drop the connection
+    if (httpMillis() - responseStarted > HTTP_RESPONSE_TIMEOUT_MS) {
+      responseFailed = true;
+      keepAlive = false;
+      return false;
+    }
+    ssize_t sent = ::send(current->socket, data, length, MSG_NOSIGNAL);
+    if (sent > 0) {
+      data += sent;
+      length -= sent;
+      continue;
+    }
+    if (sent < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+      fd_set writable;
+      FD_ZERO(&writable);
+      FD_SET(current->socket, &writable);
+      struct timeval timeout;
+      timeout.tv_sec = HTTP_SEND_TIMEOUT_MS / 1000;
+      timeout.tv_usec = (HTTP_SEND_TIMEOUT_MS % 1000) * 1000;
+      if (select(current->socket + 1, NULL, &writable, NULL, &timeout) > 0) {
+        continue;
+      }
+    }
+    responseFailed = true;
+    return false;
+  }
+  return true;
+}
+
+// Answers with a bare error and drops the connection, used when a request can not be parsed
+void HttpServer::sendError(HttpConnection& connection, int code) {
+  char body[48];
+  current = &connection;
+  keepAlive = false;
+  responseHeaderCount = 0;
+  contentLength = CONTENT_LENGTH_NOT_SET;
+  headersSent = false;
+  chunked = false;
+  responseFailed = false;
+  responseWriting = false;
+  outputLength = 0;
+  requestMethod = HTTP_ANY;
+  send(code, "application/json; charset=utf-8", body, snprintf(body, sizeof(body), "{\"error\":\"%s\"}", statusText(code)));
+  flush();
+  current = NULL;
+  closeConnection(connection);
+}
+
+/**
+ * Turn the current request into a Server-Sent Events subscription. The
+ * socket leaves the request pool and is fed from source, starting at
+ * cursor, every time handleClient() runs. Returns false when all the
+ * subscriber slots are taken, the handler can still answer normally then.
+ */
+bool HttpServer::beginEventStream(HttpEventSource source, uint32_t cursor) {
+  if (current == NULL || headersSent) {
+    return false;
+  }
+  HttpEventStream* stream = NULL;
+  for (uint8_t i = 0; i < HTTP_MAX_EVENT_STREAMS; i++) {
+    if (streams[i].socket < 0) {
+      stream = &streams[i];
+      break;
+    }
+  }
+  if (stream == NULL) {
+    return false;
+  }
+
+  keepAlive = false;
+  sendHeader("Cache-Control", "no-cache");
+  writeHeaders(200, "text/event-stream", CONTENT_LENGTH_STREAM);
+  write("retry: 2000\n\n", 13);
+  flush();
+  if (responseFailed) {
+    return false;
+  }
+
+  stream->socket = current->socket;
+  stream->cursor = cursor;
+  stream->lastWrite = httpMillis();
+  stream->source = source;
+  stream->pendingOffset = 0;
+  stream->pendingLength = 0;
+  // The request pool lets go of the socket, anything pipelined after this request is dropped
+  current->socket = -1;
+  return true;
+}
+
+uint8_t HttpServer::eventStreamCount() const {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < HTTP_MAX_EVENT_STREAMS; i++) {
+    if (streams[i].socket >= 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// Non blocking, whatever the socket does not take stays pending for the next pass
+bool HttpServer::sendPending(HttpEventStream& stream) {
+  while (stream.pendingLength > 0) {
+    ssize_t sent = ::send(stream.socket, stream.pending + stream.pendingOffset, stream.pendingLength, MSG_NOSIGNAL);
+    if (sent > 0) {
+      stream.pendingOffset += sent;
+      stream.pendingLength -= sent;
+      stream.lastWrite = httpMillis();
+      continue;
+    }
+    return sent < 0 && (errno == EWOULDBLOCK || errno == EAGAIN);
+  }
+  stream.pendingOffset = 0;
+  return true;
+}
+
+/**
+ * Feed every subscriber from its own cursor. A subscriber that can not keep
+ * up just stops pulling events, its source reports the gap once it catches
+ * up, so a slow client never holds back the others or the producer.
+ */
+void HttpServer::serviceEventStreams() {
+  for (uint8_t i = 0; i < HTTP_MAX_EVENT_STREAMS; i++) {
+    HttpEventStream& stream = streams[i];
+    if (stream.socket < 0) {
+      continue;
+    }
+    // Subscribers never send anything, readable means closed
+    char discard[32];
+    ssize_t received = recv(stream.socket, discard, sizeof(discard), 0);
+    if (received == 0 || (received < 0 && errno != EWOULDBLOCK && errno != EAGAIN)) {
+      closeEventStream(stream);
+      continue;
+    }
+    bool healthy = sendPending(stream);
+    for (uint8_t sent = 0; healthy && stream.pendingLength == 0 && sent < HTTP_EVENT_BATCH; sent++) {
+      size_t length = stream.source(&stream.cursor, stream.pending, HTTP_EVENT_BUFFER_SIZE);
+      if (length == 0) {
+        break;
+      }
+      stream.pendingLength = length;
+      healthy = sendPending(stream);
+    }
+    if (healthy && httpMillis() - stream.lastWrite > HTTP_EVENT_KEEP_ALIVE_MS) {
+      // A subscriber that took nothing for this long is gone
+      if (stream.pendingLength > 0) {
+        healthy = false;
+      } else {
+        memcpy(stream.pending, ": ping\n\n", 8);
+        stream.pendingLength = 8;
+        healthy = sendPending(stream);
+      }
+    }
+    if (!healthy) {
+      closeEventStream(stream);
+    }
+  }
+}
+
+void HttpServer::closeEventStream(HttpEventStream& stream) {
+  if (stream.socket >= 0) {
+    ::close(stream.socket);
+    stream.socket = -1;
+  }
+  stream.pendingLength = 0;
+  stream.pendingOffset = 0;
+}
+
+void HttpServer::closeConnection(HttpConnection& connection) {
+  if (connection.socket >= 0) {
+    ::close(connection.socket);
+    connection.socket = -1;
+  }
+  connection.length = 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file         : httpserver.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+// The native build defines HTTP_ARDUINO_STRING to get the String accessors from its Arduino shim
+#if defined(ARDUINO) || defined(HTTP_ARDUINO_STRING)
+  #include <Arduino.h>
+#endif
+
+#define HTTP_MAX_CLIENTS                  4       /* Connections served concurrently */
+#define HTTP_REQUEST_BUFFER_SIZE          3072    /* Per connection, bounds request line, headers and body */
+#define HTTP_RESPONSE_BUFFER_SIZE         1024    /* Coalesces status line, headers and small bodies */
+#define HTTP_MAX_ROUTES                   40      /* Registered handlers, dashboard assets included */
+#define HTTP_MAX_ARGS                     16      /* Query arguments per request */
+#define HTTP_MAX_PATH_ARGS                4       /* {} captures per route */
+#define HTTP_MAX_COLLECTED_HEADERS        6       /* Request headers exposed to handlers */
+#define HTTP_MAX_RESPONSE_HEADERS         8       /* Headers queued with sendHeader() */
+#define HTTP_KEEP_ALIVE_TIMEOUT_MS        5000    /* Idle connections are closed after this */
+#define HTTP_MAX_KEEP_ALIVE_REQUESTS      100     /* Requests served before a connection is recycled */
+#define HTTP_SEND_TIMEOUT_MS              2000    /* Gives up on clients that stop reading */
+#define HTTP_RESPONSE_TIMEOUT_MS          10000   /* Whole response, a slow reader is cut off well before the task watchdog */
+#define HTTP_HEADER_NAME_LENGTH           32      /* Response header name including terminator */
+#define HTTP_HEADER_VALUE_LENGTH          96      /* Response header value including terminator */
+#define HTTP_PATH_ARGS_LENGTH             64      /* Storage shared by the {} captures */
+#define HTTP_MAX_EVENT_STREAMS            4       /* Server-Sent Events subscribers */
+#define HTTP_EVENT_BUFFER_SIZE            512     /* Per subscriber, holds what the socket did not take yet */
+#define HTTP_EVENT_POLL_MS                100     /* select() timeout while subscribers are connected */
+#define HTTP_EVENT_BATCH                  8       /* Events sent to one subscriber per pass */
+#define HTTP_EVENT_KEEP_ALIVE_MS          15000   /* Comment line sent to idle subscribers to detect dead peers */
+
+#define CONTENT_LENGTH_UNKNOWN            ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET            ((size_t)-2)
+
+enum HTTPMethod : uint8_t {
+  HTTP_ANY = 0,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_PATCH,
+  HTTP_DELETE,
+  HTTP_OPTIONS
+};
+
+typedef void (*HttpHandler)();
+
+// Called after every dispatched request with the status sent and the time spent in the handler
+typedef void (*HttpRequestObserver)(HTTPMethod method, int code, uint32_t micros);
+
+// Runs the handler matched for a request, route is its registered uri or NULL when none matched
+typedef void (*HttpHandlerInvoker)(HttpHandler handler, const char* route);
+
+// Called while a response is written to the socket, e.g. to feed the task watchdog
+typedef void (*HttpProgressHook)();
+
+// Formats the next event after *cursor into buffer and advances the cursor, 0 when there is none
+typedef size_t (*HttpEventSource)(uint32_t* cursor, char* buffer, size_t size);
+
+struct HttpRoute {
+  const char* uri;        // May contain {} captures, exposed through pathArg()
+  HTTPMethod method;
+  HttpHandler handler;
+};
+
+struct HttpArg {
+  const char* name;
+  const char* value;
+};
+
+// One socket plus the bytes received on it, pipelined requests queue up in the buffer
+struct HttpConnection {
+  int socket;
+  size_t length;
+  uint32_t lastActivity;
+  uint16_t requests;
+  char buffer[HTTP_REQUEST_BUFFER_SIZE];
+};
+
+// Long lived text/event-stream response, written without ever blocking the server
+struct HttpEventStream {
+  int socket;
+  uint32_t cursor;
+  uint32_t lastWrite;
+  HttpEventSource source;
+  size_t pendingOffset;
+  size_t pendingLength;
+  char pending[HTTP_EVENT_BUFFER_SIZE];
+};
+
+/**
+ * Event driven HTTP/1.1 server. A select() loop multiplexes the listening
+ * socket and up to HTTP_MAX_CLIENTS keep-alive connections, and requests are
+ * dispatched to the same kind of handlers the Arduino WebServer uses, in
+ * arrival order per connection so pipelined requests are answered in order.
+ */
+class HttpServer {
+public:
+  HttpServer(uint16_t port);
+  ~HttpServer();
+
+  bool begin();
+  void stop();
+  bool waitForClient(uint32_t timeoutMs);
+  void handleClient();
+  uint16_t port() const { return listenPort; }
+
+  // Returns false when the route table is full, the route is then not served
+  bool on(const char* uri, HttpHandler handler);
+  bool on(const char* uri, HTTPMethod method, HttpHandler handler);
+  uint8_t droppedRoutes() const { return droppedRouteCount; }
+  void onNotFound(HttpHandler handler);
+  void onRequest(HttpRequestObserver observer) { requestObserver = observer; }
+  void onInvoke(HttpHandlerInvoker invoker) { handlerInvoker = invoker; }
+  void onProgress(HttpProgressHook hook) { progressHook = hook; }
+  void enableCORS(bool enable) { cors = enable; }
+  void collectHeaders(const char* headerKeys[], size_t count);
+
+  // Request
+  HTTPMethod method() const { return requestMethod; }
+  const char* uri() const { return requestUri; }
+  bool hasArg(const char* name) const;
+  const char* argValue(const char* name) const;
+  const char* pathArgValue(unsigned int index) const;
+  const char* headerValue(const char* name) const;
+  bool hasHeader(const char* name) const;
+  const char* body() const { return requestBody; }
+  size_t bodyLength() const { return requestBodyLength; }
+
+  // Response
+  void sendHeader(const char* name, const char* value);
+  void setContentLength(size_t length) { contentLength = length; }
+  void send(int code, const char* contentType = NULL, const char* content = "");
+  void send(int code, const char* contentType, const char* content, size_t length);
+  void sendContent(const char* content);
+  void sendContent(const char* content, size_t length);
+  bool beginEventStream(HttpEventSource source, uint32_t cursor);
+  uint8_t eventStreamCount() const;
+
+#if defined(ARDUINO) || defined(HTTP_ARDUINO_STRING)
+  // WebServer compatible accessors so the handlers keep their String based code
+  String arg(const char* name) const { return String(argValue(name)); }
+  String header(const char* name) const { return String(headerValue(name)); }
+  String pathArg(unsigned int index) const { return String(pathArgValue(index)); }
+  void sendHeader(const char* name, const String& value) { sendHeader(name, value.c_str()); }
+  void send(int code, const char* contentType, const String& content) { send(code, contentType, content.c_str(), content.length()); }
+#endif
+
+private:
+  void acceptClients();
+  void receive(HttpConnection& connection);
+  void process(HttpConnection& connection);
+  bool parseRequest(char* request, size_t headerLength);
+  void parseQuery(char* query);
+  void dispatch();
+  bool matchRoute(const HttpRoute& route, const char* path);
+  void closeConnection(HttpConnection& connection);
+  void serviceEventStreams();
+  bool sendPending(HttpEventStream& stream);
+  void closeEventStream(HttpEventStream& stream);
+  void sendError(HttpConnection& connection, int code);
+  void beginResponse();
+  void writeHeaders(int code, const char* contentType, size_t length);
+  void write(const char* data, size_t length);
+  void flush();
+  bool sendAll(const char* data, size_t length);
+
+  uint16_t listenPort;
+  int listenSocket;
+  bool cors;
+  HttpConnection connections[HTTP_MAX_CLIENTS];
+  HttpConnection* current;
+  HttpEventStream streams[HTTP_MAX_EVENT_STREAMS];
+
+  HttpRoute routes[HTTP_MAX_ROUTES];
+  uint8_t routeCount;
+  uint8_t droppedRouteCount;
+  HttpHandler notFoundHandler;
+  HttpRequestObserver requestObserver;
+  HttpHandlerInvoker handlerInvoker;
+  HttpProgressHook progressHook;
+  const char* collectedHeaderNames[HTTP_MAX_COLLECTED_HEADERS];
+  uint8_t collectedHeaderCount;
+
+  // Current request, strings point into the connection buffer
+  HTTPMethod requestMethod;
+  char* requestUri;
+  char* requestBody;
+  size_t requestBodyLength;
+  bool keepAlive;
+  HttpArg args[HTTP_MAX_ARGS];
+  uint8_t argCount;
+  const char* pathArgs[HTTP_MAX_PATH_ARGS];
+  char pathArgBuffer[HTTP_PATH_ARGS_LENGTH];
+  uint8_t pathArgCount;
+  const char* collectedHeaderValues[HTTP_MAX_COLLECTED_HEADERS];
+
+  // Current response
+  char responseHeaderNames[HTTP_MAX_RESPONSE_HEADERS][HTTP_HEADER_NAME_LENGTH];
+  char responseHeaderValues[HTTP_MAX_RESPONSE_HEADERS][HTTP_HEADER_VALUE_LENGTH];
+  uint8_t responseHeaderCount;
+  size_t contentLength;
+  int responseCode;
+  bool headersSent;
+  bool chunked;
+  bool chunkTerminated;
+  bool responseFailed;
+  bool responseWriting;                   // A byte of the response went to the socket
+  uint32_t responseStarted;               // httpMillis() of the first write, HTTP_RESPONSE_TIMEOUT_MS runs from here
+  char output[HTTP_RESPONSE_BUFFER_SIZE];
+  size_t outputLength;
+};
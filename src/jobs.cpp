@@ -0,0 +1,210 @@
+/**
+ * @file         : jobs.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "jobs.h"
+
+struct JobSlot {
+  Job job;
+  JobFunction function;
+};
+
+static JobSlot jobs[JOBS_MAX];
+static uint32_t nextJobId = 1;
+static portMUX_TYPE jobsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* jobStateNames[] = { "queued", "running", "done", "failed", "cancelled" };
+
+// Callers must hold jobsMux
+static JobSlot* findSlot(uint32_t id) {
+  if (id == 0) {
+    return NULL;
+  }
+  for (uint8_t i = 0; i < JOBS_MAX; i++) {
+    if (jobs[i].job.id == id) {
+      return &jobs[i];
+    }
+  }
+  return NULL;
+}
+
+bool isJobActive(const Job& job) {
+  return job.id != 0 && (job.state == JOB_QUEUED || job.state == JOB_RUNNING);
+}
+
+const char* jobStateName(uint8_t state) {
+  return state <= JOB_CANCELLED ? jobStateNames[state] : "unknown";
+}
+
+// Runs a single job and records how it ended, the task deletes itself afterwards
+static void jobTask(void* parameter) {
+  uint32_t id = (uint32_t)parameter;
+  JobFunction function = NULL;
+
+  portENTER_CRITICAL(&jobsMux);
+  JobSlot* slot = findSlot(id);
+  if (slot != NULL) {
+    slot->job.state = JOB_RUNNING;
+    slot->job.startedAt = millis();
+    function = slot->function;
+  }
+  portEXIT_CRITICAL(&jobsMux);
+
+  bool success = function != NULL && function(id);
+
+  portENTER_CRITICAL(&jobsMux);
+  slot = findSlot(id);
+  if (slot != NULL) {
+    slot->job.state = slot->job.cancelRequested ? JOB_CANCELLED : (success ? JOB_DONE : JOB_FAILED);
+    if (slot->job.state == JOB_DONE) {
+      slot->job.progress = 100;
+    }
+    slot->job.finishedAt = millis();
+  }
+  portEXIT_CRITICAL(&jobsMux);
+  TRACE("Job %u finished: %s\n", id, success ? "success" : "failure");
+  vTaskDelete(NULL);
+}
+
+/**
+ * Queue a job on its own task and return its id right away, 0 when the
+ * table is full of active jobs or the task could not be created.
+ */
+uint32_t submitJob(const char* name, JobFunction function, UBaseType_t priority, BaseType_t core, uint32_t stackSize) {
+  JobSlot* slot = NULL;
+  uint32_t id = 0;
+
+  portENTER_CRITICAL(&jobsMux);
+  // Prefer a free slot, otherwise recycle the job that finished first
+  for (uint8_t i = 0; i < JOBS_MAX; i++) {
+    if (jobs[i].job.id == 0) {
+      slot = &jobs[i];
+      break;
+    }
+    if (!isJobActive(jobs[i].job) && (slot == NULL || jobs[i].job.finishedAt < slot->job.finishedAt)) {
+      slot = &jobs[i];
+    }
+  }
+  if (slot != NULL) {
+    id = nextJobId++;
+    memset(&slot->job, 0, sizeof(Job));
+    slot->job.id = id;
+    strncpy(slot->job.name, name, JOB_NAME_LENGTH - 1);
+    slot->job.state = JOB_QUEUED;
+    slot->job.submittedAt = millis();
+    slot->function = function;
+  }
+  portEXIT_CRITICAL(&jobsMux);
+
+  if (slot == NULL) {
+    return 0;
+  }
+
+  if (xTaskCreatePinnedToCore(jobTask, name, stackSize, (void*)id, priority, NULL, core) != pdPASS) {
+    portENTER_CRITICAL(&jobsMux);
+    slot->job.state = JOB_FAILED;
+    slot->job.finishedAt = millis();
+    portEXIT_CRITICAL(&jobsMux);
+    return 0;
+  }
+  return id;
+}
+
+uint32_t findActiveJob(const char* name) {
+  uint32_t id = 0;
+  portENTER_CRITICAL(&jobsMux);
+  for (uint8_t i = 0; i < JOBS_MAX; i++) {
+    if (isJobActive(jobs[i].job) && strncmp(jobs[i].job.name, name, JOB_NAME_LENGTH) == 0) {
+      id = jobs[i].job.id;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&jobsMux);
+  return id;
+}
+
+bool getJob(uint32_t id, Job* job) {
+  portENTER_CRITICAL(&jobsMux);
+  JobSlot* slot = findSlot(id);
+  if (slot != NULL) {
+    memcpy(job, &slot->job, sizeof(Job));
+  }
+  portEXIT_CRITICAL(&jobsMux);
+  return slot != NULL;
+}
+
+uint8_t getJobs(Job* list, uint8_t max) {
+  uint8_t count = 0;
+  portENTER_CRITICAL(&jobsMux);
+  for (uint8_t i = 0; i < JOBS_MAX && count < max; i++) {
+    if (jobs[i].job.id != 0) {
+      memcpy(&list[count++], &jobs[i].job, sizeof(Job));
+    }
+  }
+  portEXIT_CRITICAL(&jobsMux);
+  return count;
+}
+
+// Cancellation is cooperative, the job stops the next time it polls
+bool cancelJob(uint32_t id) {
+  bool cancelled = false;
+  portENTER_CRITICAL(&jobsMux);
+  JobSlot* slot = findSlot(id);
+  if (slot != NULL && isJobActive(slot->job)) {
+    slot->job.cancelRequested = true;
+    cancelled = true;
+  }
+  portEXIT_CRITICAL(&jobsMux);
+  return cancelled;
+}
+
+bool isJobCancelled(uint32_t id) {
+  bool cancelled = false;
+  portENTER_CRITICAL(&jobsMux);
+  JobSlot* slot = findSlot(id);
+  if (slot != NULL) {
+    cancelled = slot->job.cancelRequested;
+  }
+  portEXIT_CRITICAL(&jobsMux);
+  return cancelled;
+}
+
+void setJobProgress(uint32_t id, uint8_t progress) {
+  portENTER_CRITICAL(&jobsMux);
+  JobSlot* slot = findSlot(id);
+  if (slot != NULL) {
+    slot->job.progress = progress > 100 ? 100 : progress;
+  }
+  portEXIT_CRITICAL(&jobsMux);
+}
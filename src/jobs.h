@@ -0,0 +1,76 @@
+/**
+ * @file         : jobs.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include "constants.h"
+
+#define JOBS_MAX                          8       /* Jobs kept in the table, finished ones are recycled oldest first */
+#define JOB_NAME_LENGTH                   16      /* Max job name length including terminator */
+
+enum JobState : uint8_t {
+  JOB_QUEUED = 0,
+  JOB_RUNNING,
+  JOB_DONE,
+  JOB_FAILED,
+  JOB_CANCELLED
+};
+
+struct Job {
+  uint32_t id;                // 0 marks a free slot
+  char name[JOB_NAME_LENGTH];
+  uint8_t state;
+  uint8_t progress;           // Percent, reported by the job itself
+  bool cancelRequested;
+  uint32_t submittedAt;       // millis()
+  uint32_t startedAt;
+  uint32_t finishedAt;
+};
+
+// Long running work, returns false on failure. Polls isJobCancelled() to stop early
+typedef bool (*JobFunction)(uint32_t id);
+
+/**
+ * Background jobs
+ */
+uint32_t submitJob(const char* name, JobFunction function, UBaseType_t priority, BaseType_t core, uint32_t stackSize);
+uint32_t findActiveJob(const char* name);
+bool getJob(uint32_t id, Job* job);
+uint8_t getJobs(Job* jobs, uint8_t max);
+bool cancelJob(uint32_t id);
+bool isJobCancelled(uint32_t id);
+void setJobProgress(uint32_t id, uint8_t progress);
+bool isJobActive(const Job& job);
+const char* jobStateName(uint8_t state);
@@ -0,0 +1,227 @@
+/**
+ * @file         : jsonwriter.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "jsonwriter.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+JsonWriter::JsonWriter(char* buffer, size_t size, JsonSink sink, void* context)
+  : buffer(buffer), capacity(size), length(0), written(0), sink(sink), context(context), depth(0), firstMask(1), afterKey(false) {
+}
+
+JsonWriter::~JsonWriter() {
+  flush();
+}
+
+void JsonWriter::flush() {
+  if (length > 0) {
+    sink(buffer, length, context);
+    written += length;
+    length = 0;
+  }
+}
+
+void JsonWriter::write(const char* data, size_t count) {
+  while (count > 0) {
+    if (length == capacity) {
+      flush();
+    }
+    size_t chunk = capacity - length < count ? capacity - length : count;
+    memcpy(buffer + length, data, chunk);
+    length += chunk;
+    data += chunk;
+    count -= chunk;
+  }
+}
+
+void JsonWriter::write(char character) {
+  if (length == capacity) {
+    flush();
+  }
+  buffer[length++] = character;
+}
+
+// Comma before every element but the first one of the current container
+void JsonWriter::separate() {
+  if (afterKey) {
+    afterKey = false;
+    return;
+  }
+  uint32_t bit = 1UL << depth;
+  if (firstMask & bit) {
+    firstMask &= ~bit;
+  } else {
+    write(',');
+  }
+}
+
+void JsonWriter::writeString(const char* string) {
+  static const char hex[] = "0123456789abcdef";
+  write('"');
+  const char* start = string;
+  for (const char* cursor = string; *cursor; cursor++) {
+    unsigned char character = *cursor;
+    if (character >= 0x20 && character != '"' && character != '\\') {
+      continue;
+    }
+    write(start, cursor - start);
+    start = cursor + 1;
+    switch (character) {
+      case '"':  write("\\\"", 2); break;
+      case '\\': write("\\\\", 2); break;
+      case '\n': write("\\n", 2); break;
+      case '\r': write("\\r", 2); break;
+      case '\t': write("\\t", 2); break;
+      default: {
+        char escaped[6] = { '\\', 'u', '0', '0', hex[character >> 4], hex[character & 0x0F] };
+        write(escaped, sizeof(escaped));
+      }
+    }
+  }
+  write(start, strlen(start));
+  write('"');
+}
+
+void JsonWriter::writeUnsigned(unsigned long long number, bool negative) {
+  char digits[21];
+  size_t position = sizeof(digits);
+  do {
+    digits[--position] = '0' + (number % 10);
+    number /= 10;
+  } while (number > 0);
+  if (negative) {
+    digits[--position] = '-';
+  }
+  write(digits + position, sizeof(digits) - position);
+}
+
+JsonWriter& JsonWriter::beginObject() {
+  separate();
+  write('{');
+  if (depth < JSON_WRITER_MAX_DEPTH - 1) {
+    depth++;
+  }
+  firstMask |= 1UL << depth;
+  return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+  if (depth > 0) {
+    depth--;
+  }
+  write('}');
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+  separate();
+  write('[');
+  if (depth < JSON_WRITER_MAX_DEPTH - 1) {
+    depth++;
+  }
+  firstMask |= 1UL << depth;
+  return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+  if (depth > 0) {
+    depth--;
+  }
+  write(']');
+  return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* name) {
+  separate();
+  writeString(name);
+  write(':');
+  afterKey = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* string) {
+  if (string == NULL) {
+    return null();
+  }
+  separate();
+  writeString(string);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(bool boolean) {
+  separate();
+  if (boolean) {
+    write("true", 4);
+  } else {
+    write("false", 5);
+  }
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(long long number) {
+  separate();
+  writeUnsigned(number < 0 ? (unsigned long long)(-(number + 1)) + 1 : (unsigned long long)number, number < 0);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(unsigned long long number) {
+  separate();
+  writeUnsigned(number, false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(double number) {
+  if (isnan(number) || isinf(number)) {
+    return null();
+  }
+  separate();
+  char digits[24];
+  int count = snprintf(digits, sizeof(digits), "%.6g", number);
+  write(digits, count > 0 ? count : 0);
+  return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+  separate();
+  write("null", 4);
+  return *this;
+}
+
+JsonWriter& JsonWriter::raw(const char* json) {
+  separate();
+  write(json, strlen(json));
+  return *this;
+}
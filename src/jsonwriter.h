@@ -0,0 +1,98 @@
+/**
+ * @file         : jsonwriter.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define JSON_WRITER_BUFFER_SIZE           512     /* Scratch buffer flushed to the sink when full */
+#define JSON_WRITER_MAX_DEPTH             32      /* Max nesting of objects and arrays */
+
+typedef void (*JsonSink)(const char* data, size_t length, void* context);
+
+/**
+ * Streaming JSON serializer. Output is staged in a caller provided scratch
+ * buffer and handed to the sink every time the buffer fills up, so memory
+ * use is bounded by the buffer whatever the size of the document.
+ */
+class JsonWriter {
+public:
+  JsonWriter(char* buffer, size_t size, JsonSink sink, void* context);
+  ~JsonWriter();
+
+  JsonWriter& beginObject();
+  JsonWriter& endObject();
+  JsonWriter& beginArray();
+  JsonWriter& endArray();
+  JsonWriter& key(const char* name);
+
+  JsonWriter& value(const char* string);
+  JsonWriter& value(bool boolean);
+  // Fundamental types so fixed width integers resolve on every toolchain
+  JsonWriter& value(int number) { return value((long long)number); }
+  JsonWriter& value(unsigned int number) { return value((unsigned long long)number); }
+  JsonWriter& value(long number) { return value((long long)number); }
+  JsonWriter& value(unsigned long number) { return value((unsigned long long)number); }
+  JsonWriter& value(long long number);
+  JsonWriter& value(unsigned long long number);
+  JsonWriter& value(double number);
+  JsonWriter& null();
+  JsonWriter& raw(const char* json);
+
+  template <typename T>
+  JsonWriter& field(const char* name, T fieldValue) {
+    return key(name).value(fieldValue);
+  }
+
+  void flush();
+  size_t size() const { return written + length; }
+
+private:
+  void separate();
+  void write(const char* data, size_t count);
+  void write(char character);
+  void writeString(const char* string);
+  void writeUnsigned(unsigned long long number, bool negative);
+
+  char* buffer;
+  size_t capacity;
+  size_t length;
+  size_t written;
+  JsonSink sink;
+  void* context;
+  uint8_t depth;
+  uint32_t firstMask;     // Bit per depth, set while no element was written yet
+  bool afterKey;
+};
@@ -0,0 +1,367 @@
+/**
+ * @file         : logcompactor.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "logcompactor.h"
+#include "settings.h"
+#include "logger.h"
+#include "hal.h"
+
+enum SegmentAction : uint8_t {
+  SEGMENT_COPY,
+  SEGMENT_DROP,
+  SEGMENT_COMPACT
+};
+
+struct PlantAggregate {
+  uint32_t timestamp;
+  uint32_t runs;
+  uint32_t millilitres;
+  uint32_t duration;
+  uint8_t plant;
+};
+
+struct UsageContext {
+  String folder;
+  uint32_t usedBytes;
+  uint32_t newest;
+  uint32_t oldestRaw;
+  uint32_t segment;
+  int16_t flags;
+};
+
+struct CompactionContext {
+  String folder;
+  File rewrite;
+  File raw;
+  uint32_t remainingBytes;
+  uint32_t retentionBytes;
+  uint32_t compactBefore;
+  uint32_t segment;
+  int16_t flags;
+  SegmentAction action;
+  PlantAggregate aggregates[LOG_AGGREGATE_MAX_PLANTS];
+  uint8_t aggregateCount;
+  bool success;
+};
+
+static LogCompactionStats compactionStats = {};
+
+static String segmentPath(const String& folder, uint32_t segment, uint8_t flags) {
+  return folder + "/" + logSegmentName(segment, flags);
+}
+
+static uint32_t segmentSize(const String& folder, uint32_t segment, uint8_t flags) {
+  File file = hal.files->open(segmentPath(folder, segment, flags));
+  if (!file) {
+    return 0;
+  }
+  uint32_t size = file.size();
+  file.close();
+  return size;
+}
+
+// Delete a segment and the month and year directories once they are empty
+static void removeSegment(const String& folder, uint32_t segment, uint8_t flags) {
+  String path = segmentPath(folder, segment, flags);
+  hal.files->remove(path);
+  for (uint8_t i = 0; i < 2; i++) {
+    path = path.substring(0, path.lastIndexOf('/'));
+    if (!hal.files->rmdir(path)) {
+      break;
+    }
+  }
+}
+
+static bool measureSegment(const LogIndexEntry& entry, void* context) {
+  UsageContext* usage = (UsageContext*)context;
+  if (entry.segment != usage->segment || entry.flags != usage->flags) {
+    usage->segment = entry.segment;
+    usage->flags = entry.flags;
+    usage->usedBytes += segmentSize(usage->folder, entry.segment, entry.flags);
+  }
+  if (entry.flags == 0 && entry.segment < usage->oldestRaw) {
+    usage->oldestRaw = entry.segment;
+  }
+  if (entry.timestamp > usage->newest) {
+    usage->newest = entry.timestamp;
+  }
+  return true;
+}
+
+static bool readRecordLine(File& segmentFile, const LogIndexEntry& entry, char* line, size_t size) {
+  size_t length = entry.length < size ? entry.length : size - 1;
+  if (!segmentFile.seek(entry.offset) || segmentFile.read((uint8_t*)line, length) != length) {
+    return false;
+  }
+  line[length] = '\0';
+  return true;
+}
+
+static void aggregateRecord(CompactionContext* context, const LogIndexEntry& entry) {
+  char line[LOG_LINE_LENGTH];
+  unsigned long timestamp;
+  int id, millilitres, duration;
+  char name[LOGGER_NAME_LENGTH];
+  if (!readRecordLine(context->raw, entry, line, sizeof(line)) ||
+      sscanf(line, "%lu,%d,%15[^,],%d,%d", &timestamp, &id, name, &millilitres, &duration) != 5) {
+    TRACE("Skipping unreadable log record at %lu\n", (unsigned long)entry.offset);
+    return;
+  }
+
+  PlantAggregate* aggregate = NULL;
+  for (uint8_t i = 0; i < context->aggregateCount; i++) {
+    if (context->aggregates[i].plant == entry.plant) {
+      aggregate = &context->aggregates[i];
+      break;
+    }
+  }
+  if (aggregate == NULL) {
+    if (context->aggregateCount >= LOG_AGGREGATE_MAX_PLANTS) {
+      TRACE("Too many plants to aggregate, skipping plant %d\n", entry.plant);
+      return;
+    }
+    aggregate = &context->aggregates[context->aggregateCount++];
+    memset(aggregate, 0, sizeof(PlantAggregate));
+    aggregate->plant = entry.plant;
+    aggregate->timestamp = entry.timestamp;
+  }
+  aggregate->runs++;
+  aggregate->millilitres += millilitres;
+  aggregate->duration += duration;
+}
+
+// Replace a raw day with one aggregate line per plant
+static bool writeAggregates(CompactionContext* context) {
+  context->raw.close();
+
+  // Keep the index sorted, aggregates are stamped with the first run of the day
+  for (uint8_t i = 1; i < context->aggregateCount; i++) {
+    PlantAggregate aggregate = context->aggregates[i];
+    int8_t j = i - 1;
+    while (j >= 0 && context->aggregates[j].timestamp > aggregate.timestamp) {
+      context->aggregates[j + 1] = context->aggregates[j];
+      j--;
+    }
+    context->aggregates[j + 1] = aggregate;
+  }
+
+  File sum = hal.files->open(segmentPath(context->folder, context->segment, LOG_ENTRY_AGGREGATE), FILE_WRITE);
+  if (!sum) {
+    TRACE("Failed to create aggregate segment\n");
+    return false;
+  }
+  size_t offset = sum.printf("%s,%s,%s,%s,%s,%s\n", "timestamp", "id", "name", "runs", "milliliters", "duration");
+  for (uint8_t i = 0; i < context->aggregateCount; i++) {
+    PlantAggregate& aggregate = context->aggregates[i];
+    LogIndexEntry entry;
+    memset(&entry, 0, sizeof(LogIndexEntry));
+    entry.timestamp = aggregate.timestamp;
+    entry.segment = context->segment;
+    entry.plant = aggregate.plant;
+    entry.flags = LOG_ENTRY_AGGREGATE;
+    entry.offset = offset;
+    entry.length = sum.printf("%lu,%d,%s,%lu,%lu,%lu\n", (unsigned long)aggregate.timestamp, aggregate.plant, "daily",
+      (unsigned long)aggregate.runs, (unsigned long)aggregate.millilitres, (unsigned long)aggregate.duration);
+    offset += entry.length;
+    if (!logIndexRewriteEntry(context->rewrite, entry)) {
+      sum.close();
+      return false;
+    }
+  }
+  sum.close();
+
+  context->remainingBytes -= segmentSize(context->folder, context->segment, 0);
+  context->remainingBytes += offset;
+  removeSegment(context->folder, context->segment, 0);
+  compactionStats.compactedDays++;
+  return true;
+}
+
+static void finishSegment(CompactionContext* context) {
+  if (context->action == SEGMENT_COMPACT) {
+    if (context->success) {
+      context->success = writeAggregates(context);
+    } else {
+      context->raw.close();
+    }
+  }
+  context->action = SEGMENT_COPY;
+}
+
+static void startSegment(CompactionContext* context, const LogIndexEntry& entry) {
+  context->segment = entry.segment;
+  context->flags = entry.flags;
+  uint32_t size = segmentSize(context->folder, entry.segment, entry.flags);
+
+  if (context->remainingBytes > context->retentionBytes) {
+    // Oldest first, drop whole days until the budget is met
+    context->action = SEGMENT_DROP;
+    context->remainingBytes -= size < context->remainingBytes ? size : context->remainingBytes;
+    removeSegment(context->folder, entry.segment, entry.flags);
+    compactionStats.deletedDays++;
+  } else if (entry.flags == 0 && entry.segment < context->compactBefore) {
+    // Only raw records are downsampled, flow blocks and aggregates are kept as is
+    context->action = SEGMENT_COMPACT;
+    context->aggregateCount = 0;
+    context->raw = hal.files->open(segmentPath(context->folder, entry.segment, entry.flags));
+    if (!context->raw) {
+      TRACE("Failed to open raw segment\n");
+      context->success = false;
+    }
+  } else {
+    context->action = SEGMENT_COPY;
+  }
+}
+
+static bool compactEntry(const LogIndexEntry& entry, void* context) {
+  CompactionContext* compaction = (CompactionContext*)context;
+  if (entry.segment != compaction->segment || entry.flags != compaction->flags) {
+    finishSegment(compaction);
+    startSegment(compaction, entry);
+  }
+  switch (compaction->action) {
+    case SEGMENT_COPY:
+      compaction->success = compaction->success && logIndexRewriteEntry(compaction->rewrite, entry);
+      break;
+    case SEGMENT_COMPACT:
+      aggregateRecord(compaction, entry);
+      break;
+    case SEGMENT_DROP:
+      break;
+  }
+  return compaction->success;
+}
+
+bool compactLogs(const char* folder, uint32_t rawRetentionDays, uint32_t retentionBytes) {
+  compactionStats.lastRun = millis();
+
+  // First pass, measure what is stored. Age is relative to the newest record
+  // so compaction does not depend on the clock being set.
+  UsageContext usage;
+  usage.folder = folder;
+  usage.usedBytes = 0;
+  usage.newest = 0;
+  usage.oldestRaw = UINT32_MAX;
+  usage.segment = 0;
+  usage.flags = -1;
+  if (!logIndexForEach(folder, measureSegment, &usage)) {
+    return false;
+  }
+
+  uint32_t newestSegment = logSegmentOf(usage.newest);
+  uint32_t compactBefore = newestSegment > rawRetentionDays ? newestSegment - rawRetentionDays : 0;
+  compactionStats.usedBytes = usage.usedBytes;
+  if (usage.usedBytes <= retentionBytes && usage.oldestRaw >= compactBefore) {
+    return true;
+  }
+
+  // Second pass, stream the index into a new one dropping and downsampling
+  // old days on the way
+  CompactionContext* context = new CompactionContext();
+  context->folder = folder;
+  context->rewrite = logIndexBeginRewrite(folder);
+  context->remainingBytes = usage.usedBytes;
+  context->retentionBytes = retentionBytes;
+  context->compactBefore = compactBefore;
+  context->segment = 0;
+  context->flags = -1;
+  context->action = SEGMENT_COPY;
+  context->aggregateCount = 0;
+  context->success = (bool)context->rewrite;
+
+  if (context->success) {
+    logIndexForEach(folder, compactEntry, context);
+    finishSegment(context);
+  }
+
+  bool success = context->success && logIndexCommitRewrite(folder, context->rewrite);
+  if (!success) {
+    // Files may already be gone, the segments on disk are the source of truth
+    TRACE("Log compaction failed, rebuilding index\n");
+    if (context->rewrite) {
+      context->rewrite.close();
+    }
+    logIndexRebuild(folder);
+  }
+  compactionStats.usedBytes = context->remainingBytes;
+  delete context;
+  return success;
+}
+
+uint32_t migrateLegacyLogs(const char* folder, uint32_t maxFiles) {
+  File root = hal.files->open(folder);
+  if (!root) {
+    return 0;
+  }
+
+  uint32_t migrated = 0;
+  char line[LOG_LINE_LENGTH];
+  while (migrated < maxFiles) {
+    File entry = root.openNextFile();
+    if (!entry) {
+      break;
+    }
+    String fileName = entry.name();
+    if (entry.isDirectory() || !fileName.startsWith("log-") || !fileName.endsWith(".csv")) {
+      entry.close();
+      continue;
+    }
+
+    // Legacy files hold a header and a single "id,name,milliliters,duration" line
+    uint32_t timestamp = strtoul(fileName.c_str() + 4, NULL, 10);
+    int id, millilitres, duration;
+    char name[LOGGER_NAME_LENGTH];
+    entry.readStringUntil('\n');
+    size_t length = entry.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+    String path = String(folder) + "/" + fileName;
+    entry.close();
+
+    if (sscanf(line, "%d,%15[^,],%d,%d", &id, name, &millilitres, &duration) == 4) {
+      if (!writeLog(DateTime(timestamp), name, id, millilitres, duration, folder)) {
+        break;
+      }
+    }
+    hal.files->remove(path);
+    migrated++;
+  }
+  root.close();
+  compactionStats.migratedLogs += migrated;
+  return migrated;
+}
+
+LogCompactionStats getLogCompactionStats() {
+  return compactionStats;
+}
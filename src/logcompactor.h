@@ -0,0 +1,62 @@
+/**
+ * @file         : logcompactor.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include "constants.h"
+#include "logindex.h"
+
+#define LOG_RAW_RETENTION_DAYS            30                          /* Days of raw records kept before downsampling */
+#define LOG_RETENTION_BYTES               (64UL * 1024UL * 1024UL)    /* Storage budget for log segments */
+#define FLOW_RETENTION_BYTES              (256UL * 1024UL * 1024UL)   /* Storage budget for flow segments */
+#define LOG_COMPACT_INTERVAL_MS           (60UL * 60UL * 1000UL)      /* Compaction runs once an hour */
+#define LOG_MIGRATE_BATCH_SIZE            32                          /* Legacy flat log files migrated per run */
+#define LOG_AGGREGATE_MAX_PLANTS          16                          /* Plants aggregated per day */
+#define LOG_LINE_LENGTH                   96                          /* Max length of a log line */
+
+struct LogCompactionStats {
+  uint32_t lastRun;         // millis() of the last compaction
+  uint32_t usedBytes;       // Bytes used by log segments after the last compaction
+  uint32_t compactedDays;   // Raw days downsampled into daily aggregates
+  uint32_t deletedDays;     // Days deleted to honour the retention budget
+  uint32_t migratedLogs;    // Legacy flat log files moved into the sharded layout
+};
+
+/**
+ * Background maintenance, only to be called from the logger task
+ */
+uint32_t migrateLegacyLogs(const char* folder, uint32_t maxFiles = LOG_MIGRATE_BATCH_SIZE);
+bool compactLogs(const char* folder, uint32_t rawRetentionDays = LOG_RAW_RETENTION_DAYS, uint32_t retentionBytes = LOG_RETENTION_BYTES);
+LogCompactionStats getLogCompactionStats();
@@ -0,0 +1,186 @@
+/**
+ * @file         : logger.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "logger.h"
+#include "settings.h"
+#include "logcompactor.h"
+#include "sensortrace.h"
+
+static RingBuffer<LogRecord, LOGGER_QUEUE_LENGTH> logQueue;
+static RingBuffer<FlowBlock, LOGGER_FLOW_QUEUE_LENGTH> flowQueue;
+static std::atomic<uint32_t> queuedRecords(0);
+static std::atomic<uint32_t> droppedRecords(0);
+static std::atomic<uint32_t> lastDroppedTimestamp(0);
+static uint32_t writtenRecords = 0;
+static uint32_t failedRecords = 0;
+static const char* logFolder = "/logs";
+static TaskHandle_t loggerTaskHandle = NULL;
+// Not on the watchdog, compacting a full card blocks for longer than its timeout
+TaskMonitor loggerMonitor("logger", LOGGER_BUDGET_MS, false);
+
+/**
+ * Enqueue a record for the writer task, never blocks. When the queue is full
+ * the record is dropped and accounted for so the writer can report it.
+ */
+bool logRecord(const LogRecord& record) {
+  if (!logQueue.push(record)) {
+    lastDroppedTimestamp.store(record.timestamp, std::memory_order_relaxed);
+    droppedRecords.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  queuedRecords.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool logWatering(uint32_t timestamp, const char* name, uint8_t plant, uint32_t millilitres, uint32_t duration) {
+  LogRecord record;
+  memset(&record, 0, sizeof(LogRecord));
+  record.type = LOG_RECORD_WATERING;
+  record.timestamp = timestamp;
+  record.plant = plant;
+  record.millilitres = millilitres;
+  record.duration = duration;
+  strncpy(record.name, name, LOGGER_NAME_LENGTH - 1);
+  return logRecord(record);
+}
+
+bool logFlowBlock(const FlowBlock& block) {
+  if (!flowQueue.push(block)) {
+    lastDroppedTimestamp.store(((const FlowBlockHeader*)block.data)->baseTime, std::memory_order_relaxed);
+    droppedRecords.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  queuedRecords.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+LoggerStats getLoggerStats() {
+  LoggerStats stats;
+  stats.queued = queuedRecords.load(std::memory_order_relaxed);
+  stats.dropped = droppedRecords.load(std::memory_order_relaxed);
+  stats.written = writtenRecords;
+  stats.failed = failedRecords;
+  stats.depth = logQueue.size() + flowQueue.size();
+  return stats;
+}
+
+static bool writeFlowBlock(const FlowBlock& block) {
+  if (writeFlowLog(block, LOGGER_FLOW_FOLDER)) {
+    writtenRecords++;
+    return true;
+  }
+  failedRecords++;
+  return false;
+}
+
+static bool writeRecord(const LogRecord& record) {
+  if (writeLog(DateTime(record.timestamp), record.name, record.plant, record.millilitres, record.duration, logFolder)) {
+    writtenRecords++;
+    return true;
+  }
+  failedRecords++;
+  return false;
+}
+
+// Low priority task, the only one that touches the SD card for logging
+static void loggerTask(void* parameter) {
+  uint32_t reportedDrops = 0;
+  unsigned long lastCompaction = 0;
+  bool compacted = false;
+  LogRecord record;
+  FlowBlock block;
+  loggerMonitor.attach();
+  for (;;) {
+    loggerMonitor.beginPass();
+    loggerMonitor.delay(LOGGER_PERIOD_MS);
+
+    uint32_t dropped = droppedRecords.load(std::memory_order_relaxed);
+    if (logQueue.size() == 0 && flowQueue.size() == 0 && !hasSensorCapturePending() && dropped == reportedDrops) {
+      // Idle, use the time for maintenance
+      if (!compacted || millis() - lastCompaction >= LOG_COMPACT_INTERVAL_MS) {
+        if (initSDCard()) {
+          migrateLegacyLogs(logFolder);
+          compactLogs(logFolder);
+          compactLogs(LOGGER_FLOW_FOLDER, LOG_RAW_RETENTION_DAYS, FLOW_RETENTION_BYTES);
+          compacted = true;
+        }
+        lastCompaction = millis();
+      }
+      continue;
+    }
+
+    // Mount once per batch instead of once per record
+    if (!initSDCard()) {
+      continue;
+    }
+
+    for (uint8_t i = 0; i < LOGGER_BATCH_SIZE && logQueue.pop(record); i++) {
+      writeRecord(record);
+    }
+    for (uint8_t i = 0; i < LOGGER_BATCH_SIZE && flowQueue.pop(block); i++) {
+      writeFlowBlock(block);
+    }
+    drainSensorCapture();
+
+    // Leave a trace of the records lost since the last report
+    if (dropped != reportedDrops) {
+      TRACE("Log queue overflow, %u records dropped\n", dropped - reportedDrops);
+      memset(&record, 0, sizeof(LogRecord));
+      record.type = LOG_RECORD_OVERFLOW;
+      record.timestamp = lastDroppedTimestamp.load(std::memory_order_relaxed);
+      record.millilitres = dropped - reportedDrops;
+      strncpy(record.name, "overflow", LOGGER_NAME_LENGTH - 1);
+      if (writeRecord(record)) {
+        reportedDrops = dropped;
+      }
+    }
+  }
+}
+
+bool startLogger(const char* folder, UBaseType_t priority, BaseType_t core) {
+  if (loggerTaskHandle != NULL) {
+    return true;
+  }
+  logFolder = folder;
+  return xTaskCreatePinnedToCore(
+    loggerTask,           // Task function
+    "LoggerTask",         // Name of the task
+    LOGGER_STACK_SIZE,    // Stack size
+    NULL,                 // Task input parameter
+    priority,             // Priority of the task
+    &loggerTaskHandle,    // Task handle
+    core                  // Core where the task should run
+  ) == pdPASS;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file         : logger.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include "constants.h"
+#include "ringbuffer.h"
+#include "flowcodec.h"
+#include "taskmonitor.h"
+
+#define LOGGER_QUEUE_LENGTH               32      /* Records buffered between producers and the writer (power of two) */
+#define LOGGER_FLOW_QUEUE_LENGTH          8       /* Encoded flow blocks buffered for the writer (power of two) */
+#define LOGGER_FLOW_FOLDER                "/flow" /* Folder holding the flow time series */
+#define LOGGER_BATCH_SIZE                 8       /* Max records written per storage session */
+#define LOGGER_PERIOD_MS                  1000    /* Writer task wake up interval */
+#define LOGGER_BUDGET_MS                  5000    /* Longest writer pass period, compaction included */
+#define LOGGER_STACK_SIZE                 8192    /* Writer task stack size */
+#define LOGGER_NAME_LENGTH                16      /* Max record name length including terminator */
+
+enum LogRecordType : uint8_t {
+  LOG_RECORD_WATERING = 1,
+  LOG_RECORD_OVERFLOW = 2
+};
+
+// Fixed size record, copied by value into the log queue
+struct LogRecord {
+  uint32_t timestamp;
+  uint32_t millilitres;
+  uint32_t duration;
+  uint8_t type;
+  uint8_t plant;
+  char name[LOGGER_NAME_LENGTH];
+};
+
+struct LoggerStats {
+  uint32_t queued;      // Records accepted by the queue
+  uint32_t written;     // Records persisted
+  uint32_t dropped;     // Records rejected because the queue was full
+  uint32_t failed;      // Records lost to storage errors
+  uint32_t depth;       // Records currently waiting in the queue
+};
+
+extern TaskMonitor loggerMonitor;
+
+/**
+ * Logging pipeline
+ */
+bool startLogger(const char* folder, UBaseType_t priority, BaseType_t core);
+bool logRecord(const LogRecord& record);
+bool logWatering(uint32_t timestamp, const char* name, uint8_t plant, uint32_t millilitres, uint32_t duration);
+bool logFlowBlock(const FlowBlock& block);
+LoggerStats getLoggerStats();
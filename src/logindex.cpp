@@ -0,0 +1,485 @@
+/**
+ * @file         : logindex.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "logindex.h"
+#include "settings.h"
+#include "flowcodec.h"
+#include "hal.h"
+
+static const size_t LOG_INDEX_HEADER_SIZE = sizeof(LogIndexHeader);
+static SemaphoreHandle_t logIndexMutex = NULL;
+
+// Serializes index access between the logger task and the web server
+class LogIndexLock {
+public:
+  LogIndexLock() {
+    if (logIndexMutex != NULL) {
+      xSemaphoreTakeRecursive(logIndexMutex, portMAX_DELAY);
+    }
+  }
+  ~LogIndexLock() {
+    if (logIndexMutex != NULL) {
+      xSemaphoreGiveRecursive(logIndexMutex);
+    }
+  }
+};
+
+void logIndexBegin() {
+  if (logIndexMutex == NULL) {
+    logIndexMutex = xSemaphoreCreateRecursiveMutex();
+  }
+}
+
+String logIndexPath(const char* folder) {
+  return String(folder) + "/" + LOG_INDEX_FILENAME;
+}
+
+uint32_t logSegmentOf(uint32_t timestamp) {
+  return timestamp / LOG_SECONDS_PER_DAY;
+}
+
+void formatLogSegmentName(char* name, size_t size, uint32_t segment, uint8_t flags) {
+  DateTime day(segment * LOG_SECONDS_PER_DAY);
+  const char* extension = (flags & LOG_ENTRY_FLOW) ? ".flw" : (flags & LOG_ENTRY_AGGREGATE) ? ".sum.csv" : ".csv";
+  snprintf(name, size, "%04d/%02d/%02d%s", day.year(), day.month(), day.day(), extension);
+}
+
+String logSegmentName(uint32_t segment, uint8_t flags) {
+  char name[LOG_SEGMENT_NAME_LENGTH];
+  formatLogSegmentName(name, sizeof(name), segment, flags);
+  return String(name);
+}
+
+bool createSegmentDirectories(const char* folder, uint32_t segment) {
+  DateTime day(segment * LOG_SECONDS_PER_DAY);
+  char path[16];
+  if (!createDirectoryIfNotExists(folder)) {
+    return false;
+  }
+  snprintf(path, sizeof(path), "/%04d", day.year());
+  if (!createDirectoryIfNotExists((String(folder) + path).c_str())) {
+    return false;
+  }
+  snprintf(path, sizeof(path), "/%04d/%02d", day.year(), day.month());
+  return createDirectoryIfNotExists((String(folder) + path).c_str());
+}
+
+static bool readIndexEntry(File& index, unsigned long position, LogIndexEntry* entry) {
+  if (!index.seek(LOG_INDEX_HEADER_SIZE + position * sizeof(LogIndexEntry))) {
+    return false;
+  }
+  return index.read((uint8_t*)entry, sizeof(LogIndexEntry)) == sizeof(LogIndexEntry);
+}
+
+static bool writeIndexEntry(File& index, unsigned long position, const LogIndexEntry& entry) {
+  if (!index.seek(LOG_INDEX_HEADER_SIZE + position * sizeof(LogIndexEntry))) {
+    return false;
+  }
+  return index.write((const uint8_t*)&entry, sizeof(LogIndexEntry)) == sizeof(LogIndexEntry);
+}
+
+static unsigned long countIndexEntries(File& index) {
+  size_t size = index.size();
+  if (size < LOG_INDEX_HEADER_SIZE) {
+    return 0;
+  }
+  return (size - LOG_INDEX_HEADER_SIZE) / sizeof(LogIndexEntry);
+}
+
+static bool isIndexValid(File& index) {
+  LogIndexHeader header;
+  if (!index.seek(0) || index.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+    return false;
+  }
+  return header.magic == LOG_INDEX_MAGIC && header.version == LOG_INDEX_VERSION && header.entrySize == sizeof(LogIndexEntry);
+}
+
+/**
+ * Insert an entry keeping the index sorted. Records are appended in time order
+ * so this is a plain append, only an RTC adjustment makes it shift a few entries.
+ */
+static bool insertIndexEntry(File& index, const LogIndexEntry& entry) {
+  unsigned long position = countIndexEntries(index);
+  LogIndexEntry previous;
+  while (position > 0 && readIndexEntry(index, position - 1, &previous) && previous.timestamp > entry.timestamp) {
+    if (!writeIndexEntry(index, position, previous)) {
+      return false;
+    }
+    position--;
+  }
+  // The entry may already be there if the index was just rebuilt from the segments
+  if (position > 0 && readIndexEntry(index, position - 1, &previous) &&
+      previous.timestamp == entry.timestamp && previous.segment == entry.segment && previous.offset == entry.offset) {
+    return writeIndexEntry(index, position - 1, entry);
+  }
+  return writeIndexEntry(index, position, entry);
+}
+
+/**
+ * Find the first entry with a timestamp greater or equal than the given one.
+ */
+static unsigned long lowerBound(File& index, unsigned long count, uint32_t timestamp) {
+  unsigned long low = 0;
+  unsigned long high = count;
+  LogIndexEntry entry;
+  while (low < high) {
+    unsigned long middle = low + (high - low) / 2;
+    if (!readIndexEntry(index, middle, &entry)) {
+      break;
+    }
+    if (entry.timestamp < timestamp) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ * Find the run of entries within [from, to], returns the first position and
+ * stores the length of the run in count.
+ */
+static unsigned long findRange(File& index, uint32_t from, uint32_t to, unsigned long* count) {
+  unsigned long entries = countIndexEntries(index);
+  unsigned long first = lowerBound(index, entries, from);
+  unsigned long last = to == UINT32_MAX ? entries : lowerBound(index, entries, to + 1);
+  *count = last > first ? last - first : 0;
+  return first;
+}
+
+/**
+ * Open the index, building it from the log segments if it is missing or was
+ * written by a different version.
+ */
+static File openIndex(const char* folder, const char* mode) {
+  String path = logIndexPath(folder);
+  if (!hal.files->exists(path) && !logIndexRebuild(folder)) {
+    return File();
+  }
+  File index = hal.files->open(path, mode);
+  if (index && !isIndexValid(index)) {
+    index.close();
+    if (!logIndexRebuild(folder)) {
+      return File();
+    }
+    index = hal.files->open(path, mode);
+  }
+  return index;
+}
+
+bool logIndexAppend(const char* folder, const LogIndexEntry& entry) {
+  LogIndexLock lock;
+  File index = openIndex(folder, "r+");
+  if (!index) {
+    TRACE("Failed to open log index\n");
+    return false;
+  }
+  bool success = insertIndexEntry(index, entry);
+  index.close();
+  return success;
+}
+
+/**
+ * Index every record of a segment file, both raw and aggregate lines start
+ * with the timestamp and the plant id.
+ */
+static bool indexSegmentFile(File& index, File& segmentFile, uint32_t segment, uint8_t flags) {
+  // Skip the csv header
+  segmentFile.readStringUntil('\n');
+  while (segmentFile.available()) {
+    LogIndexEntry entry;
+    memset(&entry, 0, sizeof(LogIndexEntry));
+    entry.segment = segment;
+    entry.flags = flags;
+    entry.offset = segmentFile.position();
+    String line = segmentFile.readStringUntil('\n');
+    if (line.length() == 0) {
+      continue;
+    }
+    entry.length = line.length() + 1;
+    entry.timestamp = strtoul(line.c_str(), NULL, 10);
+    int separator = line.indexOf(',');
+    entry.plant = separator > 0 ? line.substring(separator + 1).toInt() : 0;
+    if (!insertIndexEntry(index, entry)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Index every block of a flow segment, blocks are self describing so the
+ * segment can be walked header to header.
+ */
+static bool indexFlowFile(File& index, File& segmentFile, uint32_t segment) {
+  FlowBlock block;
+  FlowDecoder decoder;
+  uint32_t offset = 0;
+  while (segmentFile.available()) {
+    size_t length = segmentFile.read(block.data, sizeof(FlowBlockHeader));
+    if (length != sizeof(FlowBlockHeader) || !segmentFile.seek(offset)) {
+      break;
+    }
+    const FlowBlockHeader* header = (const FlowBlockHeader*)block.data;
+    size_t blockLength = sizeof(FlowBlockHeader) + header->timesLength + header->valuesLength;
+    if (blockLength > FLOW_BLOCK_SIZE || segmentFile.read(block.data, blockLength) != blockLength || !decoder.begin(block.data, blockLength)) {
+      TRACE("Corrupted flow segment at %lu\n", (unsigned long)offset);
+      break;
+    }
+    uint32_t time;
+    int32_t value;
+    LogIndexEntry entry;
+    memset(&entry, 0, sizeof(LogIndexEntry));
+    entry.timestamp = decoder.blockHeader().baseTime + (decoder.next(&time, &value) ? time / 1000 : 0);
+    entry.segment = segment;
+    entry.offset = offset;
+    entry.length = blockLength;
+    entry.plant = decoder.blockHeader().plant;
+    entry.flags = LOG_ENTRY_FLOW;
+    if (!insertIndexEntry(index, entry)) {
+      return false;
+    }
+    offset += blockLength;
+  }
+  return true;
+}
+
+bool logIndexRebuild(const char* folder) {
+  LogIndexLock lock;
+  TRACE("Rebuilding log index: %s\n", folder);
+  File root = hal.files->open(folder);
+  if (!root) {
+    TRACE("Failed to open directory\n");
+    return false;
+  }
+
+  // Built aside and renamed once complete, a failed or interrupted rebuild never leaves a truncated index behind
+  String rebuildPath = String(folder) + "/" + LOG_INDEX_REBUILD_FILENAME;
+  File index = hal.files->open(rebuildPath, "w+");
+  if (!index) {
+    TRACE("Failed to create log index\n");
+    root.close();
+    return false;
+  }
+
+  LogIndexHeader header = { LOG_INDEX_MAGIC, LOG_INDEX_VERSION, sizeof(LogIndexEntry) };
+  bool success = index.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+
+  // Walk <folder>/YYYY/MM/DD[.sum].csv
+  for (File year = root.openNextFile(); success && year; year = root.openNextFile()) {
+    int yearNumber = String(year.name()).toInt();
+    if (year.isDirectory() && yearNumber >= 2000) {
+      for (File month = year.openNextFile(); success && month; month = year.openNextFile()) {
+        int monthNumber = String(month.name()).toInt();
+        if (month.isDirectory() && monthNumber >= 1 && monthNumber <= 12) {
+          for (File day = month.openNextFile(); success && day; day = month.openNextFile()) {
+            String fileName = day.name();
+            int dayNumber = fileName.toInt();
+            uint32_t segment = logSegmentOf(DateTime(yearNumber, monthNumber, dayNumber).unixtime());
+            if (!day.isDirectory() && dayNumber >= 1 && fileName.endsWith(".csv")) {
+              uint8_t flags = fileName.endsWith(".sum.csv") ? LOG_ENTRY_AGGREGATE : 0;
+              success = indexSegmentFile(index, day, segment, flags);
+            } else if (!day.isDirectory() && dayNumber >= 1 && fileName.endsWith(".flw")) {
+              success = indexFlowFile(index, day, segment);
+            }
+            day.close();
+          }
+        }
+        month.close();
+      }
+    }
+    year.close();
+  }
+
+  index.close();
+  root.close();
+  if (!success) {
+    TRACE("Log index rebuild failed\n");
+    hal.files->remove(rebuildPath);
+    return false;
+  }
+  String path = logIndexPath(folder);
+  hal.files->remove(path);
+  return hal.files->rename(rebuildPath, path);
+}
+
+bool logIndexForEach(const char* folder, LogIndexVisitor visitor, void* context) {
+  LogIndexLock lock;
+  File index = openIndex(folder, FILE_READ);
+  if (!index) {
+    return false;
+  }
+  unsigned long count = countIndexEntries(index);
+  LogIndexEntry entry;
+  bool success = index.seek(LOG_INDEX_HEADER_SIZE);
+  for (unsigned long i = 0; success && i < count; i++) {
+    success = index.read((uint8_t*)&entry, sizeof(LogIndexEntry)) == sizeof(LogIndexEntry) && visitor(entry, context);
+  }
+  index.close();
+  return success;
+}
+
+bool logIndexForRange(const char* folder, uint32_t from, uint32_t to, LogIndexVisitor visitor, void* context) {
+  LogIndexLock lock;
+  File index = openIndex(folder, FILE_READ);
+  if (!index) {
+    return false;
+  }
+  unsigned long count = 0;
+  unsigned long first = findRange(index, from, to, &count);
+  LogIndexEntry entry;
+  bool success = true;
+  for (unsigned long i = 0; success && i < count; i++) {
+    success = readIndexEntry(index, first + i, &entry) && visitor(entry, context);
+  }
+  index.close();
+  return success;
+}
+
+File logIndexBeginRewrite(const char* folder) {
+  File rewrite = hal.files->open(String(folder) + "/" + LOG_INDEX_REWRITE_FILENAME, FILE_WRITE);
+  if (rewrite) {
+    LogIndexHeader header = { LOG_INDEX_MAGIC, LOG_INDEX_VERSION, sizeof(LogIndexEntry) };
+    rewrite.write((const uint8_t*)&header, sizeof(header));
+  }
+  return rewrite;
+}
+
+bool logIndexRewriteEntry(File& rewrite, const LogIndexEntry& entry) {
+  return rewrite.write((const uint8_t*)&entry, sizeof(LogIndexEntry)) == sizeof(LogIndexEntry);
+}
+
+bool logIndexCommitRewrite(const char* folder, File& rewrite) {
+  LogIndexLock lock;
+  rewrite.close();
+  String path = logIndexPath(folder);
+  hal.files->remove(path);
+  return hal.files->rename(String(folder) + "/" + LOG_INDEX_REWRITE_FILENAME, path);
+}
+
+unsigned long logIndexSize(const char* folder) {
+  LogIndexLock lock;
+  File index = openIndex(folder, FILE_READ);
+  if (!index) {
+    return 0;
+  }
+  unsigned long count = countIndexEntries(index);
+  index.close();
+  return count;
+}
+
+unsigned long logIndexCount(const char* folder, uint32_t from, uint32_t to) {
+  LogIndexLock lock;
+  File index = openIndex(folder, FILE_READ);
+  if (!index) {
+    return 0;
+  }
+  unsigned long count = 0;
+  findRange(index, from, to, &count);
+  index.close();
+  return count;
+}
+
+unsigned long logIndexRead(const char* folder, uint32_t from, uint32_t to, unsigned long offset, LogIndexEntry* entries, unsigned long size, unsigned long* total) {
+  LogIndexLock lock;
+  File index = openIndex(folder, FILE_READ);
+  if (!index) {
+    TRACE("Failed to open log index\n");
+    if (total != NULL) {
+      *total = 0;
+    }
+    return 0;
+  }
+
+  unsigned long count = 0;
+  unsigned long first = findRange(index, from, to, &count);
+  if (total != NULL) {
+    *total = count;
+  }
+  unsigned long read = 0;
+  for (unsigned long i = offset; i < count && read < size; i++) {
+    if (!readIndexEntry(index, first + i, &entries[read])) {
+      break;
+    }
+    read++;
+  }
+  index.close();
+  return read;
+}
+
+void writeLogIndexQuery(JsonWriter& json, const char* folder, uint32_t from, uint32_t to, unsigned long offset, unsigned long limit, unsigned long* total) {
+  LogIndexEntry entries[LOG_INDEX_READ_BATCH];
+  char name[LOG_SEGMENT_NAME_LENGTH];
+  unsigned long matched = 0;
+  if (limit > LOG_INDEX_MAX_PAGE_SIZE) {
+    limit = LOG_INDEX_MAX_PAGE_SIZE;
+  }
+
+  json.beginArray();
+  // The index is only locked while a batch is copied, not while it is sent
+  for (unsigned long written = 0; written < limit; ) {
+    unsigned long batch = limit - written < LOG_INDEX_READ_BATCH ? limit - written : LOG_INDEX_READ_BATCH;
+    unsigned long count = logIndexRead(folder, from, to, offset + written, entries, batch, written == 0 ? &matched : NULL);
+    for (unsigned long i = 0; i < count; i++) {
+      formatLogSegmentName(name, sizeof(name), entries[i].segment, entries[i].flags);
+      json.beginObject();
+      json.field("timestamp", entries[i].timestamp);
+      json.field("file", name);
+      json.field("offset", entries[i].offset);
+      json.field("length", entries[i].length);
+      json.field("plant", entries[i].plant);
+      json.field("aggregate", (entries[i].flags & LOG_ENTRY_AGGREGATE) != 0);
+      json.endObject();
+    }
+    if (count < batch) {
+      break;
+    }
+    written += count;
+  }
+  json.endArray();
+  if (total != NULL) {
+    *total = matched;
+  }
+}
+
+String logIndexQuery(const char* folder, uint32_t from, uint32_t to, unsigned long offset, unsigned long limit, unsigned long* total) {
+  String result;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &result);
+  writeLogIndexQuery(json, folder, from, to, offset, limit, total);
+  json.flush();
+  return result;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file         : logindex.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <SD.h>
+#include "constants.h"
+#include "jsonwriter.h"
+
+#define LOG_INDEX_FILENAME                "index.idx"   /* Sidecar index file name inside the log folder */
+#define LOG_INDEX_MAGIC                   0x494C4753    /* "SGLI" */
+#define LOG_INDEX_VERSION                 2             /* Bump when the entry layout changes, forces a rebuild */
+#define LOG_INDEX_REWRITE_FILENAME        "index.tmp"   /* Scratch index used while compacting */
+#define LOG_INDEX_REBUILD_FILENAME        "index.new"   /* Scratch index used while rebuilding, renamed once complete */
+#define LOG_SECONDS_PER_DAY               86400         /* Segments hold one day of records */
+#define LOG_ENTRY_AGGREGATE               0x01          /* Entry points to a daily aggregate instead of a raw record */
+#define LOG_ENTRY_FLOW                    0x02          /* Entry points to an encoded flow block */
+#define LOG_INDEX_PAGE_SIZE               100           /* Default amount of entries returned by a query */
+#define LOG_INDEX_MAX_PAGE_SIZE           500           /* Hard limit of entries returned by a query */
+#define LOG_INDEX_READ_BATCH              32            /* Entries copied per lock when streaming a query */
+#define LOG_SEGMENT_NAME_LENGTH           20            /* YYYY/MM/DD.sum.csv and the terminator */
+#define LOG_SEGMENT_PATH_LENGTH           48            /* Folder, separator and segment name */
+
+struct LogIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entrySize;
+};
+
+/**
+ * Fixed size index entry, entries are kept sorted by timestamp so a time
+ * range maps to a contiguous run of entries that can be found by bisection.
+ */
+struct LogIndexEntry {
+  uint32_t timestamp;   // Unix time of the record
+  uint32_t segment;     // Day (days since epoch) of the segment holding the record
+  uint32_t offset;      // Byte offset of the record inside the segment
+  uint16_t length;      // Record length in bytes
+  uint8_t plant;        // Plant / valve id
+  uint8_t flags;        // LOG_ENTRY_* flags
+};
+
+typedef bool (*LogIndexVisitor)(const LogIndexEntry& entry, void* context);
+
+/**
+ * Segment layout, records are sharded as <folder>/YYYY/MM/DD.csv, daily
+ * aggregates as <folder>/YYYY/MM/DD.sum.csv and flow blocks as
+ * <folder>/YYYY/MM/DD.flw
+ */
+uint32_t logSegmentOf(uint32_t timestamp);
+void formatLogSegmentName(char* name, size_t size, uint32_t segment, uint8_t flags = 0);
+String logSegmentName(uint32_t segment, uint8_t flags = 0);
+bool createSegmentDirectories(const char* folder, uint32_t segment);
+
+/**
+ * Index maintenance
+ */
+void logIndexBegin();
+String logIndexPath(const char* folder);
+bool logIndexAppend(const char* folder, const LogIndexEntry& entry);
+bool logIndexRebuild(const char* folder);
+bool logIndexForEach(const char* folder, LogIndexVisitor visitor, void* context);
+bool logIndexForRange(const char* folder, uint32_t from, uint32_t to, LogIndexVisitor visitor, void* context);
+File logIndexBeginRewrite(const char* folder);
+bool logIndexRewriteEntry(File& rewrite, const LogIndexEntry& entry);
+bool logIndexCommitRewrite(const char* folder, File& rewrite);
+
+/**
+ * Index queries
+ */
+unsigned long logIndexSize(const char* folder);
+unsigned long logIndexCount(const char* folder, uint32_t from, uint32_t to);
+unsigned long logIndexRead(const char* folder, uint32_t from, uint32_t to, unsigned long offset, LogIndexEntry* entries, unsigned long size, unsigned long* total = NULL);
+void writeLogIndexQuery(JsonWriter& json, const char* folder, uint32_t from, uint32_t to, unsigned long offset, unsigned long limit, unsigned long* total = NULL);
+String logIndexQuery(const char* folder, uint32_t from, uint32_t to, unsigned long offset, unsigned long limit, unsigned long* total = NULL);
@@ -36,22 +36,29 @@
 #include "main.h"
 
 /**
- * Hardware setup
+ * Hardware setup, only the critical stages run here: valves safe-off,
+ * settings, clock and the schedule. Display, storage, the serial port and
+ * networking come up in the boot task on the service core while loop()
+ * already checks the schedule.
  */
 void setup() {
   // put your setup code here, to run once:
   Serial.begin(115200);
+  beginHeapProfile();
+  // The UART is always ready, no wait for a native USB host here
 
-  while (!Serial) {
-    vTaskDelay(100 / portTICK_PERIOD_MS); // wait for serial port to connect. Needed for native USB
-  }
-
+  // Valves safe-off first, the expander keeps whatever the last reset left on its outputs
+  int stage = beginBootStage("valves");
   Wire.begin();
   i2cMutex = xSemaphoreCreateMutex();
   if (i2cMutex == NULL) {
     TRACE("Error insufficient heap memory to create i2cMutex mutex\n");
   }
+  bool mcpReady = setupMcp();
+  endBootStage(stage, mcpReady);
 
+  stage = beginBootStage("settings");
+  beginSettings();
   // Check if EEPROM is ready
   Wire.beginTransmission(EEPROM_ADDRESS);
   if (Wire.endTransmission() != 0) {
@@ -76,10 +83,17 @@ void setup() {
       ESP.restart();
     };
   }
+  // The stored settings carry the flags too, the probe results win
+  if (!mcpReady) {
+    settings.hasMCP = false;
+    TRACE("MCP not Working\n");
+  }
+  endBootStage(stage);
 
+  stage = beginBootStage("clock");
   if (!rtc.begin()) {
     TRACE("Couldn't find RTC\n");
-    beep(2, 250);
+    bootBeeps = 2;
     settings.hasRTC = false;
     // Serial.flush();
     // abort();
@@ -91,79 +105,99 @@ void setup() {
     // This line sets the RTC with an explicit date & time, for example to set
     // January 21, 2014 at 3am you would call:
     // rtc.adjust(DateTime(2014, 1, 21, 3, 0, 0));
-    beep(2);
+    bootBeeps = 2;
   }
+  endBootStage(stage, settings.hasRTC);
 
-  // Setup i2c port extender
-  
-  if(!setupMcp()) {
-    settings.hasMCP = false;
-    TRACE("MCP not Working\n");
-  }
+  TRACE("settings.hostname %s\n", settings.hostname);
 
-  printI2cDevices();
+  stage = beginBootStage("schedule");
+  controlQueue = xQueueCreate(CONTROL_QUEUE_LENGTH, sizeof(ControlCommand));
+  logIndexBegin();
+  setupMetrics();
+  setupWatering();
+  endBootStage(stage);
+
+  xTaskCreatePinnedToCore(
+    handleBootTask,        // Task function
+    "BootTask",            // Name of the task
+    46000,                 // Stack size
+    NULL,                  // Task input parameter
+    PRIORITY_MEDIUM,       // Priority of the task
+    NULL,                  // Task handle
+    service_cpu            // Core where the task should run
+  );
+  // setup() and loop() share the Arduino loop task
+  loopMonitor.attach();
+}
 
-  // if(!initSDCard()) {
-  //   TRACE("SD not working\n");
-  //   beep(4, 150);
-  // }
-
-  // JsonDocument config = readConfig();
-
-  // if (!config["updatedOn"].isNull()) { // Math.floor(Date.now() / 1000) & 0xFFFFFFFF
-  //   // Config is newer
-  //   uint32_t updatedOn = config["updatedOn"];
-  //   TRACE("rtc update: %u\n", rtc.now().unixtime());
-  //   TRACE("new update: %u\n", updatedOn);
-  //   TRACE("old update: %u\n", settings.updatedOn);
-  //   if(settings.updatedOn < updatedOn) {
-  //     TRACE("Flashing new config!\n");
-  //     savePlants(config, settings.plant);
-  //     saveAlarms(config, settings.alarm);
-  //     settings.updatedOn = updatedOn;
-  //     EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-  //     EEPROM.commit();
-  //     beep(4, 50);
-  //   }
-  // } else {
-  //   TRACE("updatedOn is Null!\n");
-  // }
+/**
+ * The deferred boot stages, one after the other on the service core. The
+ * display and the SD card share nothing with the schedule, networking
+ * comes last since the Wi-Fi association alone takes seconds.
+ */
+void handleBootTask(void * parameter) {
+  // Serial commander task
+#if defined(ENABLE_SERIAL_COMMANDS)
+  xTaskCreatePinnedToCore(
+    serialPortHandler,     // Task function
+    "SerialPort",          // Name of the task (for debugging)
+    89000,                 // Stack size (in words, not bytes)
+    NULL,                  // Task input parameter
+    PRIORITY_HIGH,         // Priority of the task
+    &serialTaskHandle,     // Task handle
+    service_cpu            // Core where the task should run
+  );
+#endif
 
+  int stage = beginBootStage("display");
+  // loop() may already read the clock or a watering may already run
+  xSemaphoreTake(i2cMutex, portMAX_DELAY);
   if(!display.begin(SSD1306_SWITCHCAPVCC, DISPLAY_ADDRESSS)) {; // Address 0x3C for 128x32
     TRACE("Display not working\n");
     settings.hasDisplay = false;
+    hal.display = NULL;
   } else {
     // Clear display
     TRACE("Display ok!\n");
     display.clearDisplay();
     display.display();
   }
+  printI2cDevices();
+  xSemaphoreGive(i2cMutex);
+  endBootStage(stage, settings.hasDisplay);
+  if (settings.hasDisplay) {
+    xTaskCreatePinnedToCore(
+      handleDisplayTask,     // Task function
+      "DisplayTask",         // Name of the task
+      8192,                  // Stack size
+      NULL,                  // Task input parameter
+      PRIORITY_LOW,          // Priority of the task
+      &displayTaskHandle,    // Task handle
+      service_cpu            // Core where the task should run
+    );
+  }
 
-  TRACE("settings.hostname %s\n", settings.hostname);
-
-  // Create a queue capable of holding 10 strings of up to 100 characters each
-  wateringStatusQueue = xQueueCreate(wateringStatusQueueLength, sizeof(WateringStatus));
-    // Serial commander task
-#if defined(ENABLE_SERIAL_COMMANDS)
-  xTaskCreatePinnedToCore(
-    serialPortHandler,     // Task function
-    "SerialPort",          // Name of the task (for debugging)
-    89000,                 // Stack size (in words, not bytes)
-    NULL,                  // Task input parameter
-    PRIORITY_HIGH,         // Priority of the task
-    &serialTaskHandle,     // Task handle
-    1                      // Core where the task should run
-  );
+  stage = beginBootStage("storage");
+  bool sdReady = initSDCard();
+#if defined(ENABLE_LOGGING)
+  if (!startLogger("/logs", PRIORITY_LOW, service_cpu)) {
+    TRACE("Logger task creation failed\n");
+  }
 #endif
+  endBootStage(stage, sdReady);
 
 #if defined(WIFI_ENABLED)
+  stage = beginBootStage("network");
+  JsonDocument config = readConfig();
   String ssid = config["network"]["ssid"].isNull() ? WIFI_SSID : config["network"]["ssid"].as<String>();
   String password = config["network"]["password"].isNull() ? WIFI_PASSWORD : config["network"]["password"].as<String>();
   bool enabled = config["network"]["enabled"].isNull() ? WIFI_ENABLED : config["network"]["enabled"].as<bool>();
   TRACE("ssid: %s\n", ssid.c_str());
   TRACE("password: %s\n", password.c_str());
   TRACE("config: %s\n", config.as<String>().c_str());
-  if (enabled && connectToWiFi(ssid.c_str(), password.c_str())) {
+  bool connected = enabled && connectToWiFi(ssid.c_str(), password.c_str());
+  if (connected) {
     IPAddress ip = WiFi.localIP();
     TRACE("\n");
     TRACE("Wifi Connected: IP: %s - Hostname: %s\n", WiFi.localIP().toString().c_str(), WiFi.getHostname());
@@ -182,11 +216,15 @@ void setup() {
       NULL,                   // Task input parameter
       PRIORITY_LOW,           // Priority of the task
       &otaTaskHandle,         // Task handle
-      1                       // Core where the task should run
+      service_cpu             // Core where the task should run
     );
 #endif
     // Create a task for handling Web Server
 #if defined(ENABLE_HTTP)
+    TelemetrySources telemetrySources = { &settings, &rtc, &mcp, i2cMutex, &i2cLatencyMetric };
+    if (!startTelemetry(telemetrySources, PRIORITY_LOW, service_cpu)) {
+      TRACE("Telemetry task creation failed\n");
+    }
     xTaskCreatePinnedToCore(
       handleWebServerTask,    // Function to implement the task
       "WebServerTask",        // Name of the task
@@ -194,22 +232,27 @@ void setup() {
       NULL,                   // Task input parameter
       PRIORITY_MEDIUM,        // Priority of the task
       &webServerTaskHandle,   // Task handle
-      1                       // Core where the task should run
+      service_cpu             // Core where the task should run
     );
 #endif
 
-  } else if (config["network"]["enabled"].as<bool>()) {
+  } else if (enabled) {
     TRACE("Wifi not connected!\n");  
-    beep(2);
-    handleWifiConnectionError("WiFi connection error", settings);
+    bootBeeps = 2;
   } else {
     TRACE("Wifi disabled!\n");
   }
+  endBootStage(stage, connected);
 #endif
 
-  // Good To Go!
-  beep(1);
-  vTaskDelay(100 / portTICK_PERIOD_MS);
+  // The alerts of the critical stages, or Good To Go!
+  beep(bootBeeps ? bootBeeps : 1, bootBeeps ? 250 : 500);
+#if defined(WIFI_ENABLED)
+  if (enabled && !connected) {
+    handleWifiConnectionError("WiFi connection error", settings);
+  }
+#endif
+  vTaskDelete(NULL);
 }
 
 /**
@@ -229,110 +272,6 @@ bool setupMcp() {
   return true;
 }
 
-/**
- * Pulse counter interrupt service
- */
-void pulseCounter() {
-  // Increment the pulse counter
-  int value = digitalRead(FLOW_METER_PIN);
-  if (FLOW_SENSOR_STATE != value) {
-    FLOW_METER_PULSE_COUNT++;
-    FLOW_METER_TOTAL_PULSE_COUNT++;
-    FLOW_SENSOR_STATE = value;
-  }
-}
-
-void calcFlow() {
-  // Note the time this processing pass was executed. Note that because we've
-  // disabled interrupts the millis() function won't actually be incrementing right
-  // at this point, but it will still return the value it was set to just before
-  // interrupts went away.
-  OLD_INT_TIME = millis();
-
-  while((millis() - OLD_INT_TIME) < 1000) { 
-    // Disable the interrupt while calculating flow rate and sending the value to the host
-    detachInterrupt(FLOW_METER_INTERRUPT);
-
-    // Because this loop may not complete in exactly 1 second intervals we calculate the 
-    // number of milliseconds that have passed since the last execution and use that to 
-    // scale the output. We also apply the calibrationFactor to scale the output based on 
-    // the number of pulses per second per units of measure (litres/minute in this case) 
-    // coming from the sensor.
-    FLOW_RATE = ((1000.0 / (millis() - OLD_INT_TIME)) * FLOW_METER_PULSE_COUNT) / FLOW_CALIBRATION_FACTOR;
-
-    // Divide the flow rate in litres/minute by 60 to determine how many litres have
-    // passed through the sensor in this 1 second interval, then multiply by 1000 to
-    // convert to millilitres.
-    FLOW_MILLILITRES = FLOW_METER_PULSE_COUNT == 0 ? 0 : (FLOW_RATE / 60) * 1000;
-
-    // Add the millilitres passed in this second to the cumulative total
-    TOTAL_MILLILITRES += FLOW_MILLILITRES;
-
-    // Display flow
-    displayFlow();
-
-    // Reset the pulse counter so we can start incrementing again
-    FLOW_METER_PULSE_COUNT = 0;
-    // Enable the interrupt again now that we've finished sending output
-    attachInterrupt(FLOW_METER_INTERRUPT, pulseCounter, FALLING);
-  }
-  // yield 
-  vTaskDelay(10 / portTICK_PERIOD_MS);
-}
-
-void calcFlowGpt() {
-  // Note the time this processing pass was executed.
-  unsigned long startTime = millis();
-  unsigned long elapsedTime = 0;
-
-  while (elapsedTime < 1000) {
-    // Disable the interrupt while calculating flow rate and sending the value to the host
-    detachInterrupt(FLOW_METER_INTERRUPT);
-
-    // Calculate elapsed time
-    elapsedTime = millis() - startTime;
-
-    // Calculate flow rate considering the elapsed time
-    FLOW_RATE = ((1000.0 / elapsedTime) * FLOW_METER_PULSE_COUNT) / FLOW_CALIBRATION_FACTOR;
-
-    // Calculate millilitres passed in this interval
-    FLOW_MILLILITRES = FLOW_METER_PULSE_COUNT == 0 ? 0 : (FLOW_RATE / 60) * 1000;
-
-    // Add the millilitres passed in this interval to the cumulative total
-    TOTAL_MILLILITRES += FLOW_MILLILITRES;
-
-    // Display flow
-    displayFlow();
-
-    // Reset the pulse counter so we can start incrementing again
-    FLOW_METER_PULSE_COUNT = 0;
-
-    // Enable the interrupt again now that we've finished sending output
-    attachInterrupt(FLOW_METER_INTERRUPT, pulseCounter, FALLING);
-
-    // Yield and delay
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-
-    // Recalculate elapsed time for the next loop iteration
-    elapsedTime = millis() - startTime;
-  }
-}
-
-void displayFlow() {
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setTextColor(SSD1306_WHITE);
-  display.setCursor(0, 0);
-
-  display.printf("Raw: %.5f\n", FLOW_RATE);
-  display.printf("Flow: %.2fmL/s\n", FLOW_MILLILITRES);
-  display.printf("Total: %lumL\n", TOTAL_MILLILITRES);
-  display.printf("Secs: %d\n", (millis() - START_INT_TIME) / 1000);
-  
-  display.setCursor(0, 0);
-  display.display(); // actually display all of the above
-}
-
 void setTimezone(String timezone) {
   TRACE("Setting Timezone to: %s\n", timezone.c_str());
   setenv("TZ", timezone.c_str(),1);  //  Now adjust the TZ.  Clock settings are adjusted to show the new local time
@@ -405,6 +344,15 @@ void displayTime() {
   display.display(); // actually display all of the above
 }
 
+void displayWatering(const WateringEvent& event) {
+  hal.display->clear();
+  hal.display->printf("Raw: %.5f\n", event.rate);
+  hal.display->printf("Flow: %umL/s\n", (unsigned int)event.millilitres);
+  hal.display->printf("Total: %umL\n", (unsigned int)event.flow);
+  hal.display->printf("Secs: %u\n", (unsigned int)(event.duration / 1000));
+  hal.display->show();
+}
+
 bool connectToWiFi(const char* ssid, const char* password, int max_tries, int pause) {
   int i = 0;
   // allow to address the device by the given name e.g. http://webserver
@@ -427,7 +375,7 @@ bool connectToWiFi(const char* ssid, const char* password, int max_tries, int pa
     vTaskDelay(pause / portTICK_PERIOD_MS);
     TRACE(".");
     i++;
-  } while (!WiFi.status() == WL_CONNECTED && i < max_tries);
+  } while (WiFi.status() != WL_CONNECTED && i < max_tries);
   WiFi.setAutoReconnect(true);
   WiFi.persistent(true);
 
@@ -460,208 +408,359 @@ void syncRTC() {
 
   // Set RTC time
   DateTime dateTime = DateTime(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+  // Runs from the boot task while loop() and a watering cycle already use the bus and the settings
+  xSemaphoreTake(i2cMutex, portMAX_DELAY);
   rtc.adjust(dateTime);
-  settings.lastDateTimeSync = rtc.now().unixtime();
-  // settings.updatedOn = rtc.now().unixtime();
-  EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-  EEPROM.commit();
+  uint32_t synced = rtc.now().unixtime();
+  xSemaphoreGive(i2cMutex);
+  {
+    SettingsLock lock;
+    settings.lastDateTimeSync = synced;
+    // settings.updatedOn = rtc.now().unixtime();
+    saveSettings(&settings);
+  }
   TRACE("RTC synced with NTP time\n");
 }
 
-// This function is called when the sysInfo service was requested.
-void handleSystemInfo() {
-  String result;
-
-  result += "{\n";
-  result += "  \"chipModel\": \"" + String(ESP.getChipModel()) + "\",\n";
-  result += "  \"chipCores\": " + String(ESP.getChipCores()) + ",\n";
-  result += "  \"chipRevision\": " + String(ESP.getChipRevision()) + ",\n";
-  result += "  \"flashSize\": " + String(ESP.getFlashChipSize()) + ",\n";
-  result += "  \"freeHeap\": " + String(ESP.getFreeHeap()) + ",\n";
-  result += "  \"heapSize\": " + String(esp_get_free_heap_size()) + ",\n";
-  result += "  \"SSID\": \"" + String(WIFI_SSID) + "\",\n";
-  // result += "  \"hotspots\": " + scanWifiNetworks() + ",\n";
-  result += "  \"signalDbm\": " + String(WiFi.RSSI()) + ",\n";
-  if (settings.hasRTC) {
-    result += "  \"temperature\": " + String(rtc.getTemperature()) + ",\n";
-    result += "  \"timestamp\": " + String(rtc.now().unixtime()) + ",\n";
-    result += "  \"offset\": " + String(getRtcOffset()) + ",\n";
-    
-  } else {
-    tm timeInfo;
-    if(!getLocalTime(&timeInfo)){
-      TRACE("Failed to obtain time\n");
-    } else {
-      time_t now = mktime(&timeInfo);
-      result += "  \"timestamp\": " + String(now) + ",\n";
-    }
-  }
-  result += "  \"uptime\": \"" + uptimeStr() + "\",\n";
-  result += "  \"resetReason\": \"" + String(getResetReason()) + "\",\n";
-  result += "  \"timezone\": \"" + String(TIMEZONE) + "\",\n";
-  // result += "  \"i2cBusDevices:\": " + String(getI2cDeviceList()) + ",\n";
-  if (settings.hasMCP) {
-    result += "  \"mcp\": " + String(mcp.readGPIOAB()) + ",\n";
-  }
-  result += "  \"watering\": {\n";
-  result += "    \"totalMillilitres\": " + String(TOTAL_MILLILITRES) + ",\n";
-  result += "    \"totalFlowPulses\": " + String(FLOW_METER_TOTAL_PULSE_COUNT) + "\n";
-  result += "  },\n";
-  result += "  \"sdcard\": {\n";
-  result += "    \"cardType\": " + String(SD.cardType()) + ",\n";
-  result += "    \"cardSize\": " + String((uint32_t)SD.cardSize() / (1024 * 1024)) + ",\n";
-  result += "    \"freeSize\": " + String((uint32_t)SD.cardSize() / (1024 * 1024) - (uint32_t)(SD.usedBytes() / (1024 * 1024))) + ",\n";
-  result += "    \"logCount\": " + String(getLogCount("/logs")) + "\n";
-  result += "  },\n";
-  JsonDocument config = readConfig();
-  if(!config.isNull()) {
-    result += "  \"config\": {\n";
-    result += "    \"network\": {\n";
-    result += "      \"enabled\": \"" + String(config["network"]["enabled"].as<bool>() ? "true" : "false") + "\",\n";
-    result += "      \"ssid\": \"" + config["network"]["ssid"].as<String>() + "\",\n";
-    result += "      \"password\": \"" + config["network"]["password"].as<String>() + "\"\n";
-    result += "    }\n";
-    result += "  },\n";
-  }
-  result += "  \"settings\":" + settingsToJson(settings) + ",\n";
-  result += "  \"env\": {\n";
-  uint32_t minTimeToNextAlarm = getNextAlarmTime(settings, rtc.now());
-  result += "    \"nextAlarmSecs\":" + String(minTimeToNextAlarm) + ",\n";
-  result += "    \"nextAlarm\": \"" + addTimeInterval(minTimeToNextAlarm, rtc.now()) + "\",\n";
-  result += "  }\n";
-  result += "}";
+// Only the serial task writes here, a trace dump at 115200 baud outlasts the watchdog timeout
+void serialSink(const char* data, size_t length, void* context) {
+  serialMonitor.feed();
+  Serial.write((const uint8_t*)data, length);
+}
 
-  TOTAL_MILLILITRES = 0;
-  FLOW_METER_TOTAL_PULSE_COUNT = 0;
+// Large streamed bodies (/api/trace, /api/logs) to a slow client, the server caps the response time too
+void feedWebServerWatchdog() {
+  webServerMonitor.feed();
+}
 
+// Prometheus text exposition, scraped during soak tests
+void handleMetrics() {
   server.sendHeader("Cache-Control", "no-cache");
-  SERVER_RESPONSE_OK(result);
-  return;
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4; charset=utf-8", "");
+  writeMetrics(sendBodyChunk, NULL);
+  server.sendContent("");
 }
 
-void handleRoot() {
-  // Send the HTML page
-  String html = "<!DOCTYPE html><html><body>";
-  html += "<h1>ESP Web Server Example</h1>";
-  html += "<button onclick=\"fetchData()\">Fetch Data</button>";
-  html += "<pre id=\"data\"></pre>";
-  html += "<script>function fetchData() { fetch('/api/systeminfo').then(response => response.json()).then(data => document.getElementById('data').innerText = JSON.stringify(data)); }</script>";
-  html += "</body></html>";
-  
-  server.send(200, "text/html", html);
+// Every request gets a heap scope named after its route, its peak shows up per route in /api/heap
+void invokeProfiled(HttpHandler handler, const char* route) {
+  const char* name = route != NULL ? route : "notFound";
+  HeapScope scope(name);
+  TRACE_BEGIN(TRACE_CAT_HTTP, TRACE_HTTP_REQUEST, traceString(name), server.method());
+  handler();
+  TRACE_END(TRACE_CAT_HTTP, TRACE_HTTP_REQUEST, traceString(name), server.method());
 }
 
-void handleAlarm() {
-  if (server.method() == HTTP_GET) {
-    String result;
+void handleHeapProfile() {
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+  beginJsonResponse(200);
+  writeHeapProfile(writer);
+  endJsonResponse(writer);
+}
 
-    result += "{\n";
-    result += "  \"alarm\": " + getAlarms(settings) + "\n";
-    result += "}";
+// Chrome trace JSON of the tracer rings, ?clear=1 starts the next capture after this dump
+void handleTrace() {
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendBodyChunk, NULL);
+  server.sendHeader("Cache-Control", "no-cache");
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  writeChromeTrace(writer);
+  writer.flush();
+  server.sendContent("");
+  if (server.arg("clear") == "1") {
+    clearTrace();
+  }
+}
 
-    server.sendHeader("Cache-Control", "no-cache");
-    SERVER_RESPONSE_OK(result);
-  } else if (server.method() == HTTP_POST) {
+void writeCaptureStats(JsonWriter& writer) {
+  SensorCaptureStats stats = getSensorCaptureStats();
+  writer.beginObject();
+  writer.field("enabled", stats.enabled);
+  writer.field("capturing", stats.capturing);
+  writer.field("sessions", stats.sessions);
+  writer.field("events", stats.events);
+  writer.field("dropped", stats.dropped);
+  writer.field("bytes", stats.bytes);
+  writer.endObject();
+}
+
+// Raw sensor capture of the next watering cycles into /traces, POST {"enabled":true} arms it
+void handleCapture() {
+  if (server.method() == HTTP_POST) {
     JsonDocument json;
-    DeserializationError error = deserializeJson(json, server.arg("plain"));
-    
-    if (error) {
-      TRACE("deserializeJson() failed:\n");
-      TRACE(error.c_str());
-      SERVER_RESPONSE_ERROR(500, "Serialization error");
+    if (deserializeRequest(json) || !json["enabled"].is<bool>()) {
+      SERVER_RESPONSE_ERROR(400, "Invalid JSON");
       return;
     }
+    setSensorCaptureEnabled(json["enabled"].as<bool>());
+  } else if (server.method() != HTTP_GET) {
+    SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
+    return;
+  }
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+  beginJsonResponse(200);
+  writeCaptureStats(writer);
+  endJsonResponse(writer);
+}
 
-    if(!saveAlarms(json, settings.alarm)) {
-      SERVER_RESPONSE_ERROR(500, "Serialization error");
-      return;
-    };
-      
-    settings.updatedOn = rtc.now().unixtime();
-    EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-    EEPROM.commit();
+// Per-stage timings of the last boot
+void handleBoot() {
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+  beginJsonResponse(200);
+  writeBootProfile(writer);
+  endJsonResponse(writer);
+}
 
-    String result;
+// Wake up latency, loop period jitter and budget overruns of every monitored task
+void handleTasks() {
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+  beginJsonResponse(200);
+  writeTaskMonitors(writer);
+  endJsonResponse(writer);
+}
 
-    result += "{\n";
-    result += "  \"alarm\": " + getAlarms(settings) + "\n";
-    result += "}";
+void observeRequest(HTTPMethod method, int code, uint32_t micros) {
+  httpHandlerMetric.observe(micros);
+  if (code >= 100 && code < 600) {
+    httpResponsesMetric[code / 100 - 1].add();
+  }
+}
 
-    server.sendHeader("Cache-Control", "no-cache");
-    SERVER_RESPONSE_OK(result);
-  } else {
-    SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
+// Gauges are sampled when scraped instead of being kept up to date by every task
+void collectMetrics() {
+  loggerQueueDepthMetric.set(getLoggerStats().depth);
+  eventStreamsMetric.set(server.eventStreamCount());
+  freeHeapMetric.set(ESP.getFreeHeap());
+  minFreeHeapMetric.set(ESP.getMinFreeHeap());
+  HeapSample sample;
+  if (getLatestHeapSample(&sample)) {
+    largestFreeBlockMetric.set(sample.largestBlock);
+    heapFragmentationMetric.set(sample.fragmentation);
   }
-  return;
 }
 
-void handleLogs() {
-  if (server.method() == HTTP_GET) {
-    String result;
-    String contents = "";
+void setupMetrics() {
+  static const char* responseLabels[] = { "code=\"1xx\"", "code=\"2xx\"", "code=\"3xx\"", "code=\"4xx\"", "code=\"5xx\"" };
+  static char valveLabels[SETTINGS_MAX_PLANTS][12];
 
-    if(!initSDCard()) {
-      SERVER_RESPONSE_ERROR(500, "SD not working");
-    };
-    
-    File file = SD.open("/HelloWorld.txt");
-      
-    if (!file) {
-      SERVER_RESPONSE_ERROR(404, "Failed to open file");
+  registerHistogram("smartgreen_loop_duration_seconds", "Time spent in one loop() iteration", &loopDurationMetric);
+  registerHistogram("smartgreen_i2c_transaction_seconds", "Duration of I2C bus transactions", &i2cLatencyMetric);
+  registerHistogram("smartgreen_eeprom_commit_seconds", "Duration of settings EEPROM commits", &settingsCommitMetric);
+  registerHistogram("smartgreen_http_handler_seconds", "Time spent handling an HTTP request", &httpHandlerMetric);
+  for (uint8_t i = 0; i < 5; i++) {
+    registerCounter("smartgreen_http_responses_total", "HTTP responses by status class", &httpResponsesMetric[i], responseLabels[i]);
+  }
+  registerCounter("smartgreen_flow_interrupts_total", "Flow meter interrupts serviced", &flowInterruptsMetric);
+  registerCounter("smartgreen_flow_pulses_total", "Flow meter pulses counted", &flowPulsesMetric);
+  for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    snprintf(valveLabels[i], sizeof(valveLabels[i]), "valve=\"%u\"", i);
+    registerCounter("smartgreen_valve_millilitres_total", "Water delivered per valve", &valveMillilitresMetric[i], valveLabels[i]);
+  }
+  for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    registerCounter("smartgreen_valve_open_seconds_total", "Time each valve spent open", &valveSecondsMetric[i], valveLabels[i]);
+  }
+  registerGauge("smartgreen_logger_queue_depth", "Log records waiting for the SD card", &loggerQueueDepthMetric);
+  registerGauge("smartgreen_event_streams", "Open Server-Sent Event subscribers", &eventStreamsMetric);
+  registerGauge("smartgreen_heap_free_bytes", "Free heap", &freeHeapMetric);
+  registerGauge("smartgreen_heap_min_free_bytes", "Lowest free heap since boot", &minFreeHeapMetric);
+  registerGauge("smartgreen_heap_largest_free_block_bytes", "Largest allocatable block", &largestFreeBlockMetric);
+  registerGauge("smartgreen_heap_fragmentation_permille", "Free heap outside the largest block", &heapFragmentationMetric);
+  static TaskMonitor* taskMonitors[] = { &loopMonitor, &serialMonitor, &webServerMonitor, &otaMonitor, &displayMonitor, &loggerMonitor, &telemetryMonitor, &wateringMonitor };
+  registerTaskMonitors(taskMonitors, sizeof(taskMonitors) / sizeof(taskMonitors[0]));
+  setMetricsCollector(collectMetrics);
+}
+
+// Serves the bundled dashboard straight from flash, the assets are already gzipped
+void handleDashboard() {
+  const DashboardAsset* asset = findDashboardAsset(server.uri());
+  if (asset == NULL) {
+    handleNotFound();
+    return;
+  }
+  const char* acceptEncoding = server.headerValue("Accept-Encoding");
+  if (strstr(acceptEncoding, "gzip") == NULL && strchr(acceptEncoding, '*') == NULL) {
+    SERVER_RESPONSE_ERROR(406, "gzip encoding required");
+    return;
+  }
+  server.sendHeader("Cache-Control", asset->immutable ? DASHBOARD_CACHE_IMMUTABLE : "no-cache");
+  server.sendHeader("ETag", asset->etag);
+  server.sendHeader("Vary", "Accept-Encoding");
+  if (cachedResponseMatches(asset->etag, server.header("If-None-Match"))) {
+    server.send(304);
+    return;
+  }
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send(200, asset->contentType, (const char*)asset->data, asset->length);
+}
+
+void handleFlowLog() {
+  uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), NULL, 10) : 0;
+  uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), NULL, 10) : UINT32_MAX;
+  int plant = server.hasArg("plant") ? server.arg("plant").toInt() : -1;
+  unsigned long limit = server.hasArg("limit") ? strtoul(server.arg("limit").c_str(), NULL, 10) : FLOW_QUERY_MAX_SAMPLES;
+
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+
+  beginJsonResponse(200);
+  writer.beginObject();
+  writer.key("samples");
+  writeFlowLogQuery(writer, LOGGER_FLOW_FOLDER, from, to, plant, limit);
+  writer.endObject();
+  endJsonResponse(writer);
+}
+
+void handleFlowHistory() {
+  // Defaults to the last 10 minutes at full resolution
+  uint32_t latest = flowHistory.latest();
+  uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), NULL, 10) : latest;
+  uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), NULL, 10) : (to > FLOW_HISTORY_SECONDS_CAPACITY ? to - FLOW_HISTORY_SECONDS_CAPACITY : 0);
+  uint32_t resolution = server.hasArg("resolution") ? strtoul(server.arg("resolution").c_str(), NULL, 10) : 1;
+
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+
+  beginJsonResponse(200);
+  writeFlowHistory(writer, flowHistory, from, to, resolution);
+  endJsonResponse(writer);
+}
+
+// Runs a manual watering cycle as a background job
+bool wateringJob(uint32_t id) {
+  if (IS_ALARM_ON.exchange(true)) {
+    return false;
+  }
+  wateringMonitor.attach();
+  waterPlants(&settings, id);
+  wateringMonitor.detach();
+  IS_ALARM_ON = false;
+  return true;
+}
+
+void writeJob(JsonWriter& writer, const Job& job) {
+  writer.beginObject();
+  writer.field("id", job.id);
+  writer.field("name", job.name);
+  writer.field("state", jobStateName(job.state));
+  writer.field("progress", job.progress);
+  writer.field("cancelRequested", job.cancelRequested);
+  writer.field("submittedAt", job.submittedAt);
+  writer.field("startedAt", job.startedAt);
+  writer.field("finishedAt", job.finishedAt);
+  writer.endObject();
+}
+
+void handleTestAlarm() {
+  // Clients asking while a cycle runs get the id of that run
+  uint32_t id = findActiveJob("WateringJob");
+  if (id == 0) {
+    if (IS_ALARM_ON) {
+      SERVER_RESPONSE_ERROR(409, "Watering in progress");
       return;
     }
-    
-    while (file.available()) {
-      contents += file.readString();
-    }
-    
-    file.close();
+    id = submitJob("WateringJob", wateringJob, PRIORITY_HIGH, control_cpu, 46000);
+  }
+  if (id == 0) {
+    SERVER_RESPONSE_ERROR(503, "Job queue full");
+    return;
+  }
+  Job job;
+  getJob(id, &job);
 
-    DateTime now = rtc.now();
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
 
-    result += "{\n";
-    result += "  \"files\": " + listDirectory2("/logs") + ",\n";
-    result += "  \"count\": " + String(getLogCount("/logs")) + ",\n";
-    result += "  \"content\":  \"" + contents + "\"\n";
-    result += "}";
+  server.sendHeader("Location", String("/api/jobs/") + id);
+  beginJsonResponse(202);
+  writeJob(writer, job);
+  endJsonResponse(writer);
+  return;
+}
 
-    saveLog(now, contents, 1234, 1000, 3);
-    server.sendHeader("Cache-Control", "no-cache");
-    SERVER_RESPONSE_OK(result);
-    return;
-  } else if (server.method() == HTTP_POST) {
+// Formats the next watering event as a Server-Sent Event, status 4 updates go out as flow samples
+size_t readWateringEvent(uint32_t* cursor, char* buffer, size_t size) {
+  WateringEvent event;
+  uint32_t skipped = 0;
+  if (!wateringEvents.read(cursor, &event, &skipped)) {
+    return 0;
+  }
+  int length = 0;
+  if (skipped > 0) {
+    length = snprintf(buffer, size, "event: lag\ndata: {\"skipped\":%u}\n\n", skipped);
+  }
+  length += snprintf(buffer + length, size - length,
+    "id: %u\nevent: %s\ndata: {\"time\":%u,\"plant\":%u,\"status\":%u,\"flow\":%u,\"pulses\":%u,\"duration\":%u,\"millilitres\":%u}\n\n",
+    *cursor - 1, event.status == 4 ? "flow" : "status", event.time, event.plant, event.status, event.flow, event.pulses, event.duration, event.millilitres);
+  return length;
+}
 
-    String result;
-    // String alarm = printAlarm(settings);
+void handleWateringEvents() {
+  uint32_t position = wateringEvents.position();
+  uint32_t cursor = position;
+  // Resume after the last event the client saw, ids from another boot are ignored
+  if (server.hasHeader("Last-Event-ID")) {
+    uint32_t resume = strtoul(server.header("Last-Event-ID").c_str(), NULL, 10) + 1;
+    if ((int32_t)(position - resume) >= 0) {
+      cursor = resume;
+    }
+  }
+  if (!server.beginEventStream(readWateringEvent, cursor)) {
+    SERVER_RESPONSE_ERROR(503, "Too many subscribers");
+  }
+}
 
-    result += "{\n";
-    result += "  \"files\": " + listDirectory("/logs") + "\n";
-    result += "}";
+void handleJobs() {
+  Job jobs[JOBS_MAX];
+  uint8_t count = getJobs(jobs, JOBS_MAX);
 
-    server.sendHeader("Cache-Control", "no-cache");
-    SERVER_RESPONSE_OK(result);
-    return;
-  } else if (server.method() == HTTP_DELETE) {
-    String result;
-    // String alarm = printAlarm(settings);
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
 
-    result += "{\n";
-    result += "  \"files\": " + listDirectory("/logs") + "\n";
-    result += "}";
-  
-    server.sendHeader("Cache-Control", "no-cache");
-    SERVER_RESPONSE_OK(result);
-  } else {
+  beginJsonResponse(200);
+  writer.beginObject();
+  writer.key("jobs").beginArray();
+  for (uint8_t i = 0; i < count; i++) {
+    writeJob(writer, jobs[i]);
+  }
+  writer.endArray();
+  writer.endObject();
+  endJsonResponse(writer);
+}
+
+void handleJob() {
+  uint32_t id = strtoul(server.pathArg(0).c_str(), NULL, 10);
+  if (server.method() == HTTP_DELETE) {
+    if (!cancelJob(id)) {
+      Job job;
+      if (!getJob(id, &job)) {
+        SERVER_RESPONSE_ERROR(404, "Not Found");
+      } else {
+        SERVER_RESPONSE_ERROR(409, "Job already finished");
+      }
+      return;
+    }
+  } else if (server.method() != HTTP_GET) {
     SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
     return;
   }
-  return;
-}
 
-void handleTestAlarm() {
-  waterPlants();
-  SERVER_RESPONSE_OK("{\"success\":true}");
-  return;
+  Job job;
+  if (!getJob(id, &job)) {
+    SERVER_RESPONSE_ERROR(404, "Not Found");
+    return;
+  }
+
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+
+  beginJsonResponse(200);
+  writeJob(writer, job);
+  endJsonResponse(writer);
 }
 
 void handleNotFound() {
@@ -675,98 +774,132 @@ void handleSaveSettings() {
       SERVER_RESPONSE_ERROR(400, "Invalid value");
     }
     JsonDocument json;
-    DeserializationError error = deserializeJson(json, server.arg("plain"));
+    DeserializationError error = deserializeRequest(json);
     
     if (error) {
       SERVER_RESPONSE_ERROR(400, "Invalid JSON");
       return;
     }
 
+    uint32_t now = rtc.now().unixtime();
     String hostname = json["hostname"];
+    SettingsLock lock;
     if (!hostname.isEmpty()) {
       TRACE("Setting hostname %s", hostname.c_str());
       memcpy(settings.hostname, hostname.c_str(), HOSTNAME_MAX_LENGTH);
       WiFi.setHostname(hostname.c_str());
     }
     settings.id = json["id"];
-    settings.updatedOn = rtc.now().unixtime();
-    EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-    EEPROM.commit();
+    touchSettings(&settings, now);
+    saveSettings(&settings);
     SERVER_RESPONSE_OK("{\"success\":true}");
   } else {
     SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
   }
 }
 
-void handlePlants() {
-  if (server.method() == HTTP_GET) {
-    String result;
-
-    result += "{\n";
-    result += "  \"plants\": " + getPlants(settings) + "\n";
-    result += "}";
+// Applies a JSON merge patch (RFC 7386) to the settings, all or nothing: the
+// patch is validated against a staged copy and persisted with a single commit
+void handlePatchSettings() {
+  String ifMatch = server.hasHeader("If-Match") ? server.header("If-Match") : String();
 
-    server.sendHeader("Cache-Control", "no-cache");
-    SERVER_RESPONSE_OK(result);
-  } else if (server.method() == HTTP_POST) {
-
-    JsonDocument json;
-    DeserializationError error = deserializeJson(json, server.arg("plain"));
+  JsonDocument json;
+  DeserializationError error = deserializeRequest(json);
+  if (error) {
+    SERVER_RESPONSE_ERROR(400, "Invalid JSON");
+    return;
+  }
 
-    if (error) {
-      TRACE("deserializeJson() failed:\n");
-      TRACE(error.c_str());
-      SERVER_RESPONSE_ERROR(500, "Serialization error");
-      return;
+  // Staged and applied under the lock, a task log update of a running cycle is never overwritten
+  uint32_t now = rtc.now().unixtime();
+  static Settings staged;
+  String reason;
+  bool current = true;
+  bool applied = false;
+  bool hostnameChanged = false;
+  uint32_t version = 0;
+  char etag[16];                            // Quoted settings version, updatedOn
+  {
+    SettingsLock lock;
+    // The version only changes on edits, a task log save or a clock sync in between does not fail the request
+    snprintf(etag, sizeof(etag), "\"%lu\"", (unsigned long)settings.updatedOn);
+    current = ifMatch.isEmpty() || entityTagMatches(etag, ifMatch);
+    if (current) {
+      staged = settings;
+      applied = applySettingsPatch(json.as<JsonVariantConst>(), &staged, &reason);
+    }
+    if (applied) {
+      hostnameChanged = strcmp(staged.hostname, settings.hostname) != 0;
+      touchSettings(&staged, now);
+      settings = staged;
+      saveSettings(&settings);
+      version = settings.updatedOn;
+      snprintf(etag, sizeof(etag), "\"%lu\"", (unsigned long)version);
     }
-
-    if(!savePlants(json, settings.plant)) {
-      SERVER_RESPONSE_ERROR(500, "Serialization error");
-      return;
-    };
-      
-    settings.updatedOn = rtc.now().unixtime();
-    EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-    EEPROM.commit();
-
-    String result;
-
-    result += "{\n";
-    result += "  \"plants\": " + getPlants(settings) + "\n";
-    result += "}";
-
-    server.sendHeader("Cache-Control", "no-cache");
-    SERVER_RESPONSE_OK(result);
-  } else {
-    SERVER_RESPONSE_ERROR(405, "Method Not Allowed");
   }
-  return;
+  if (!current) {
+    SERVER_RESPONSE_ERROR(412, "Settings version changed");
+    return;
+  }
+  if (!applied) {
+    SERVER_RESPONSE_ERROR(400, reason);
+    return;
+  }
+  if (hostnameChanged) {
+    TRACE("Setting hostname %s", settings.hostname);
+    WiFi.setHostname(settings.hostname);
+  }
+
+  const CachedResponse& body = getCachedResponse(CACHE_SETTINGS, writeSettingsResponse);
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter writer(buffer, sizeof(buffer), sendJsonChunk, NULL);
+  server.sendHeader("ETag", etag);
+  beginJsonResponse(200);
+  writer.beginObject();
+  writer.field("version", version);
+  writer.key("settings").raw(body.body.c_str());
+  writer.endObject();
+  endJsonResponse(writer);
 }
 
 void loop() {
+  loopMonitor.beginPass();
+  uint32_t start = metricsMicros();
   TaskHandle_t alarmTask;
-  if (settings.hasRTC) {
-    int activateAlarm = getActiveAlarmId(settings, rtc.now());
-
-    if (activateAlarm > -1 && !IS_ALARM_ON) {
-      IS_ALARM_ON = true;
-      xTaskCreate(
-        pumpWater,            // Task function
-        "AlarmTask",          // Task name
-        46000,                // Stack size (bytes)
-        NULL,                 // Task parameter
-        PRIORITY_HIGH,        // Task priority (high)
-        &alarmTask            // Task handle
-      );
-    } else if (settings.hasDisplay && activateAlarm <= -1 || !IS_ALARM_ON) {
-      if (xSemaphoreTake(i2cMutex, portMAX_DELAY) == pdTRUE) { 
-        displayTime();
-        vTaskDelay(500 / portTICK_PERIOD_MS);
-      }
-      xSemaphoreGive(i2cMutex);
+  // Only the schedule runs here, the clock display moved to the display task on the service core
+  uint32_t now = settings.hasRTC ? rtc.now().unixtime() : 0;
+  LoopAction action;
+  {
+    SettingsLock lock;
+    action = nextLoopAction(settings, now, IS_ALARM_ON);
+  }
+  static bool firstCheck = true;
+  if (firstCheck) {
+    markBootMilestone("firstCheck");
+    firstCheck = false;
+  }
+  ControlCommand command;
+  while (xQueueReceive(controlQueue, &command, 0) == pdTRUE) {
+    if (command == CONTROL_START_CYCLE) {
+      action = LOOP_START_WATERING;
+    }
+  }
+  if (action == LOOP_START_WATERING && !IS_ALARM_ON.exchange(true)) {
+    if (xTaskCreatePinnedToCore(
+      pumpWater,            // Task function
+      "AlarmTask",          // Task name
+      46000,                // Stack size (bytes)
+      NULL,                 // Task parameter
+      PRIORITY_HIGH,        // Task priority (high)
+      &alarmTask,           // Task handle
+      control_cpu           // Core where the task should run
+    ) != pdPASS) {
+      TRACE("Alarm task creation failed\n");
+      IS_ALARM_ON = false;
     }
   }
-  vTaskDelay(500 / portTICK_PERIOD_MS);
+  loopDurationMetric.observe(metricsMicros() - start);
+  loopMonitor.delay(WATERING_LOOP_MS);
 }
 
 // Task for handling OTA
@@ -782,9 +915,11 @@ void handleOTATask(void * parameter) {
   ArduinoOTA.setHostname(settings.hostname);
   // Initialize OTA
   ArduinoOTA.begin();
+  otaMonitor.attach();
   for(;;) {
+    otaMonitor.beginPass();
     ArduinoOTA.handle();
-    vTaskDelay(10 / portTICK_PERIOD_MS ); // Give some time for the other tasks
+    otaMonitor.delay(10); // Give some time for the other tasks
   }
 }
 
@@ -792,9 +927,19 @@ void handleOTATask(void * parameter) {
 void handleWebServerTask(void * parameter) {
   // Enable CORS header in webserver results
   server.enableCORS(true);
+  // Needed to answer conditional requests with 304
+  const char* collectedHeaders[] = { "If-None-Match", "Last-Event-ID", "If-Match", "Accept", "Content-Type", "Accept-Encoding" };
+  server.collectHeaders(collectedHeaders, 6);
   // REST Endpoint (Only if Connected)
+  setupApi(&server, &settings);
   server.onNotFound(handleNotFound);
-  server.on("/", handleRoot);
+  server.onRequest(observeRequest);
+  server.onInvoke(invokeProfiled);
+  server.onProgress(feedWebServerWatchdog);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  for (uint8_t i = 0; i < getDashboardAssetCount(); i++) {
+    server.on(getDashboardAsset(i)->path, HTTP_GET, handleDashboard);
+  }
   server.on("/api/plants", handlePlants);
   server.on("/api/beep", []{
     beep(2, 150);
@@ -802,143 +947,171 @@ void handleWebServerTask(void * parameter) {
   });
   server.on("/api/alarm", handleAlarm);
   server.on("/api/systeminfo", HTTP_GET, handleSystemInfo);
+  server.on("/api/heap", HTTP_GET, handleHeapProfile);
+  server.on("/api/trace", HTTP_GET, handleTrace);
+  server.on("/api/capture", handleCapture);
+  server.on("/api/tasks", HTTP_GET, handleTasks);
+  server.on("/api/boot", HTTP_GET, handleBoot);
   server.on("/api/settings", HTTP_POST, handleSaveSettings);
+  server.on("/api/settings", HTTP_PATCH, handlePatchSettings);
   server.on("/api/test-alarm", HTTP_GET, handleTestAlarm);
-  server.on("/api/logs", HTTP_GET, handleLogs);
+  server.on("/api/jobs", HTTP_GET, handleJobs);
+  server.on("/api/watering/events", HTTP_GET, handleWateringEvents);
+  server.on("/api/jobs/{}", handleJob);
+  server.on("/api/logs", handleLogs);
+  server.on("/api/flow-log", HTTP_GET, handleFlowLog);
+  server.on("/api/flow", HTTP_GET, handleFlowHistory);
+  if (server.droppedRoutes() > 0) {
+    TRACE("Route table full, %u routes not served, raise HTTP_MAX_ROUTES\n", server.droppedRoutes());
+  }
 
   // Start Server
   server.begin();
 
   TRACE("open <http://%s> or <http://%s>\n", WiFi.getHostname(), WiFi.localIP().toString().c_str());
   
+  webServerMonitor.attach();
+  for(;;) {
+    webServerMonitor.beginPass();
+    // Sleep in select() until a client has data instead of polling, timeouts
+    // still go through handleClient() so idle keep-alive connections get closed
+    server.waitForClient(HTTP_KEEP_ALIVE_TIMEOUT_MS);
+    // Handlers only do single clock reads on the bus, a slow client no longer holds i2cMutex
+    server.handleClient();
+  }
+}
+
+// Service core, shows the flow of the running cycle from its events and the clock otherwise
+void handleDisplayTask(void * parameter) {
+  uint32_t cursor = wateringEvents.position();
+  uint32_t skipped;
+  WateringEvent event;
+  WateringEvent sample;
+  bool watering = false;
+  displayMonitor.attach();
   for(;;) {
-    if (xSemaphoreTake(i2cMutex, portMAX_DELAY) == pdTRUE) {
-      server.handleClient();
+    displayMonitor.beginPass();
+    bool sampled = false;
+    while (wateringEvents.read(&cursor, &event, &skipped)) {
+      watering = event.status != WATERING_STATUS_COMPLTE;
+      if (event.status == WATERING_STATUS_WATERING) {
+        sample = event;
+        sampled = true;
+      }
     }
-    xSemaphoreGive(i2cMutex);
-    vTaskDelay(150 / portTICK_PERIOD_MS); // Give some time for the other tasks
+    // i2cMutex only orders the service tasks, valve writes from the control core take the Wire driver lock per transaction
+    if ((sampled || !watering) && xSemaphoreTake(i2cMutex, portMAX_DELAY) == pdTRUE) {
+      uint32_t displayStart = metricsMicros();
+      if (watering) {
+        displayWatering(sample);
+      } else {
+        displayTime();
+      }
+      i2cLatencyMetric.observe(metricsMicros() - displayStart);
+      xSemaphoreGive(i2cMutex);
+    }
+    displayMonitor.delay(DISPLAY_PERIOD_MS);
   }
 }
 
 void pumpWater(void *parameter) {
   TRACE("pumpWater thread started\n");
-  waterPlants();
-  while(getActiveAlarmId(settings, rtc.now()) > -1) {
-    displayTime();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-  }
+  wateringMonitor.attach();
+  runAlarmCycle(&settings);
+  wateringMonitor.detach();
   IS_ALARM_ON = false;
   vTaskDelete(NULL);
 }
 
 void setWateringStatus(WateringStatus *status) {
-  // WateringStatus wateringStatus;
-  // wateringStatus.status = status->status;
-  // Try to add item to queue for 10 ticks, fail if queue is full
-  if (xQueueSend(wateringStatusQueue, status, portMAX_DELAY) != pdPASS) {
-    TRACE("wateringStatus queue full\n");
+  if (status != NULL) {
+    // Never blocks, subscribers that fall behind skip ahead on their own
+    WateringEvent event;
+    event.time = millis();
+    event.plant = status->plant;
+    event.status = status->status;
+    event.flow = status->flow;
+    event.pulses = status->pulses;
+    event.duration = status->duration;
+    event.millilitres = status->status == WATERING_STATUS_WATERING ? flowState.millilitres : 0;
+    event.rate = status->status == WATERING_STATUS_WATERING ? flowState.rate : 0;
+    wateringEvents.publish(event);
   }
 }
 
-void stopWatering() {
-  // TOTAL_MILLILITRES = 0;
-  FLOW_METER_PULSE_COUNT = 0;
-  detachInterrupt(FLOW_METER_INTERRUPT);
-  // Turn Pump Off
-  mcp.writeGPIOAB(0b1111111111111111);
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  setWateringStatus(0);
+// The cycle itself lives in watering.cpp, these hooks tie it to events, jobs, logs and metrics
+void setupWatering() {
+  WateringHooks hooks = {
+    setWateringStatus,
+    isJobCancelled,
+    setJobProgress,
+    wateringStarted,
+    wateringSample,
+    wateringFinished,
+    wateringPower
+  };
+  setWateringHooks(hooks);
 }
 
-/*
- * unsigned int duration in seconds
- */
-void waterPlant(uint8_t valve, unsigned int duration, unsigned long millilitres) {
-  struct WateringStatus wateringStatus;
-  memset(&wateringStatus, 0, sizeof(WateringStatus));
-  wateringStatus.plant = valve;
-  // Open Valve
-  mcp.pinMode(valve, OUTPUT);
-  mcp.digitalWrite(valve, LOW);
-  // Wait time to avoid current surge
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  wateringStatus.status = 2;
-  setWateringStatus(&wateringStatus);
-  // Start the pump
-  mcp.pinMode(PUMP1_PIN, OUTPUT);
-  mcp.digitalWrite(PUMP1_PIN, LOW);
-
-  pinMode(FLOW_METER_PIN, INPUT);
-  pinMode(FLOW_METER_PIN, INPUT_PULLUP);
-  wateringStatus.status = 3;
-  setWateringStatus(&wateringStatus);
-  /*The Hall-effect sensor is connected to pin 
-  2 which uses interrupt 0. Configured to trigger on a FALLING state change (transition from HIGH
-  (state to LOW state)*/
-  TOTAL_MILLILITRES = 0;
-  START_INT_TIME = millis();
-  attachInterrupt(FLOW_METER_INTERRUPT, pulseCounter, FALLING);
-  FLOW_METER_PULSE_COUNT = 0;
-  for(uint8_t i = 0; i < duration; i++) {
-    calcFlow();
-    noInterrupts(); // disable interrups
-    wateringStatus.flow = TOTAL_MILLILITRES;
-    wateringStatus.pulses = FLOW_METER_PULSE_COUNT;
-    interrupts(); // Enable interrupts
-    wateringStatus.duration = millis() - START_INT_TIME;
-    wateringStatus.status = 4;
-    // wateringStatus.message = String("plant: " + String(valve) + " pulses: " + String(FLOW_METER_PULSE_COUNT) + " milliliters: " + String(TOTAL_MILLILITRES) + " duration: " + String((millis() - START_INT_TIME) / 1000));
-    setWateringStatus(&wateringStatus);
-    // TRACE("plant: %d pulses: %d milliliters: %d cpy: %d second: %d =>", valve, FLOW_METER_PULSE_COUNT, TOTAL_MILLILITRES, wateringStatus.flow, i);
-    // if (TOTAL_MILLILITRES > millilitres) {
-    //   break;
-    // }
-  }
-  END_INT_TIME = millis();
+void wateringStarted(uint8_t valve, uint32_t unixTime) {
 #if defined(ENABLE_LOGGING)
-  saveLog(rtc.now(), "water", valve, TOTAL_MILLILITRES, duration);
+  flowEncoder.begin(valve, unixTime);
 #endif
-  // TOTAL_MILLILITRES = 0;
-  FLOW_METER_PULSE_COUNT = 0;
-  detachInterrupt(FLOW_METER_INTERRUPT);
-  // Turn Pump Off
-  mcp.digitalWrite(PUMP1_PIN, HIGH);
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  // Turn Valve Off
-  mcp.digitalWrite(valve, HIGH);
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  wateringStatus.status = 5;
-  wateringStatus.duration = END_INT_TIME - START_INT_TIME;
-  setWateringStatus(&wateringStatus);
-  settings.taskLog.flow[valve] += wateringStatus.flow;
 }
 
-void waterPlants() {
-  struct WateringStatus wateringStatus;
-  memset(&wateringStatus, 0, sizeof(WateringStatus));
-  wateringStatus.status = 1;
-  setWateringStatus(&wateringStatus);
-  
-  int activeAlarmId = getActiveAlarmId(settings, rtc.now());
-  settings.taskLog.lastExecutionId = activeAlarmId;
-  WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0); //disable brownout detector
-  for(uint8_t plantIndex = 0; plantIndex < SETTINGS_MAX_PLANTS; plantIndex++) {
-    Plant plant = settings.plant[plantIndex];
-    if (plant.status == 1) {
-      waterPlant(plantIndex, calculateWateringDuration(plant.size), (((plant.size * 1000) / 10 ) / 4));
+void wateringSample(uint8_t valve, uint32_t startTime, uint32_t elapsed, uint32_t millilitres) {
+  flowHistory.insert(startTime + elapsed / 1000, millilitres);
+#if defined(ENABLE_LOGGING)
+  recordFlowSample(elapsed, millilitres);
+#endif
+}
+
+void wateringFinished(uint8_t valve, uint32_t unixTime, uint32_t millilitres, uint32_t duration, uint32_t elapsed) {
+#if defined(ENABLE_LOGGING)
+  // Never touch the SD card while the pump is running, the logger task persists it
+  flushFlowSamples();
+  logWatering(unixTime, "water", valve, millilitres, duration);
+#endif
+  captureSensorEvent(SENSOR_EVENT_RESULT, micros(), millilitres);
+  if (valve < SETTINGS_MAX_PLANTS) {
+    valveMillilitresMetric[valve].add(millilitres);
+    valveSecondsMetric[valve].add(elapsed / 1000);
+  }
+}
+
+void wateringPower(bool pumping) {
+  WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, pumping ? 0 : 1); // brownout detector off while pumping
+#if defined(ENABLE_LOGGING)
+  // One capture per cycle, the logger task is the one draining it onto the SD card
+  if (pumping) {
+    uint8_t sizes[SETTINGS_MAX_PLANTS];
+    for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+      sizes[i] = settings.plant[i].status == 1 ? settings.plant[i].size : 0;
     }
+    beginSensorCapture(rtc.now().unixtime(), micros(), FLOW_CALIBRATION_FACTOR, sizes);
+  } else {
+    endSensorCapture(micros());
   }
-  WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 1); //enable brownout
-  wateringStatus.status = WATERING_STATUS_COMPLTE;
-  setWateringStatus(&wateringStatus);
-  // Wait till alarm is off before saving
-  while(isAlarmOn(settings, rtc.now())) { vTaskDelay(1000 / portTICK_PERIOD_MS); }
-  int nextAlarmId = getNextAlarmId(settings, rtc.now());
-  settings.taskLog.nextExecutionId = nextAlarmId;
-  EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-  EEPROM.commit();
+#endif
 }
 
+#if defined(ENABLE_LOGGING)
+void recordFlowSample(uint32_t time, int32_t millilitres) {
+  if (!flowEncoder.append(time, millilitres)) {
+    // Block is full, hand it over to the logger and start a new one
+    flushFlowSamples();
+    flowEncoder.append(time, millilitres);
+  }
+}
+
+void flushFlowSamples() {
+  FlowBlock block;
+  if (flowEncoder.seal(&block)) {
+    logFlowBlock(block);
+  }
+}
+#endif
+
 void serialLog(String message) {
   DateTime now = rtc.now();
   message.replace('\n', ' ');
@@ -948,22 +1121,29 @@ void serialLog(String message) {
 // Function to handle serial communication in a FreeRTOS task
 void serialPortHandler(void *pvParameters) {
   uint8_t timer = 0;
-  TaskHandle_t alarmTask = NULL;
-  uint8_t status;
   Serial.flush();
-  struct WateringStatus wateringStatus;
-  memset(&wateringStatus, 0, sizeof(WateringStatus));
+  // Follows the watering cycle through its event ring, the control core never waits on this task
+  WateringEvent wateringStatus;
+  WateringEvent event;
+  memset(&wateringStatus, 0, sizeof(WateringEvent));
+  uint32_t cursor = wateringEvents.position();
+  uint32_t skipped;
+  serialMonitor.attach();
   while (true) {
-    if (xQueueReceive(wateringStatusQueue, (void *)&wateringStatus, 0) == pdTRUE) {
-      if (status != wateringStatus.status) {
-        status = wateringStatus.status;
-      }
+    serialMonitor.beginPass();
+    while (wateringEvents.read(&cursor, &event, &skipped)) {
+      wateringStatus = event;
     }
 
     if (Serial.available() > 0) {
       String command = Serial.readStringUntil('\n');
       Serial.flush();
       command.trim();
+      // Tagged with the command name, arguments left out
+      char tag[HEAP_PROFILE_TAG_LENGTH];
+      int nameLength = command.indexOf(':');
+      snprintf(tag, sizeof(tag), "serial %.*s", nameLength > -1 ? nameLength : (int)command.length(), command.c_str());
+      HeapScope scope(tag);
       if (command.equals("ping")) {
         serialLog(String("pong!"));
       } else if (command.startsWith("beep")) {
@@ -971,7 +1151,10 @@ void serialPortHandler(void *pvParameters) {
         serialLog(String("beep!"));
       } else if (command.startsWith("set-rtc:")) {
         String isoDate = command.substring(8);
-        if (setRTCFromISODate(isoDate, rtc)) {
+        xSemaphoreTake(i2cMutex, portMAX_DELAY);
+        bool adjusted = setRTCFromISODate(isoDate, rtc);
+        xSemaphoreGive(i2cMutex);
+        if (adjusted) {
           Serial.println("RTC set successfully.");
         } else {
           Serial.println("Failed to set RTC.");
@@ -983,10 +1166,16 @@ void serialPortHandler(void *pvParameters) {
         if (error) {
           serialLog(String("deserializeJson() failed:" + String(error.c_str()) + " \n"));
         }
-        savePlants(doc, settings.plant);
-        EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-        EEPROM.commit();
-        serialLog(getPlants(settings));
+        String saved;
+        uint32_t now = rtc.now().unixtime();
+        {
+          SettingsLock lock;
+          savePlants(doc, settings.plant);
+          touchSettings(&settings, now);
+          saveSettings(&settings);
+          saved = getPlants(settings);
+        }
+        serialLog(saved);
       } else if (command.startsWith("set-alarms:")) {
         String jsonString = command.substring(11);
         JsonDocument doc;
@@ -994,28 +1183,30 @@ void serialPortHandler(void *pvParameters) {
         if (error) {
           serialLog(String("deserializeJson() failed:" + String(error.c_str()) + " \n"));
         }
-        saveAlarms(doc, settings.alarm);
-        EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-        EEPROM.commit();
-        serialLog(getAlarms(settings));
+        String saved;
+        uint32_t now = rtc.now().unixtime();
+        {
+          SettingsLock lock;
+          saveAlarms(doc, settings.alarm);
+          touchSettings(&settings, now);
+          saveSettings(&settings);
+          saved = getAlarms(settings);
+        }
+        serialLog(saved);
       } else if (command.equals("water")) {
-        serialLog(String("Start watering plants!"));
-        if(xTaskCreate(
-          pumpWater,            // Task function
-          "AlarmTask",          // Task name
-          46000,                // Stack size (bytes)
-          NULL,                 // Task parameter
-          PRIORITY_HIGH,        // Task priority (very high)
-          &alarmTask            // Task handle
-        ) != pdPASS) {
-          serialLog(String("Task creation failed!"));
+        // The cycle is started by loop() on the control core
+        ControlCommand request = CONTROL_START_CYCLE;
+        if (IS_ALARM_ON) {
+          serialLog(String("Watering in progress!"));
+        } else if (xQueueSend(controlQueue, &request, 0) != pdTRUE) {
+          serialLog(String("Control queue full!"));
+        } else {
+          serialLog(String("Start watering plants!"));
         }
-        serialLog(String("Started watering plants!"));
       } else if (command.equals("watering-status")) {
-        serialLog(String("plant: " + String(wateringStatus.plant) + " status: " + String(status) + " flow: " + String(wateringStatus.flow) + " duration: " + String(wateringStatus.duration / 1000)));
-        if (wateringStatus.status == 128) {
-          memset(&wateringStatus, 0, sizeof(WateringStatus));
-          setWateringStatus(&wateringStatus);
+        serialLog(String("plant: " + String(wateringStatus.plant) + " status: " + String(wateringStatus.status) + " flow: " + String(wateringStatus.flow) + " duration: " + String(wateringStatus.duration / 1000)));
+        if (wateringStatus.status == WATERING_STATUS_COMPLTE) {
+          memset(&wateringStatus, 0, sizeof(WateringEvent));
         }
       } else if (command.equals("read-task")) {
         String flow = "flow: [ ";
@@ -1028,9 +1219,11 @@ void serialPortHandler(void *pvParameters) {
         flow += " ]";
         serialLog("lastExecutionId: " + String(settings.taskLog.lastExecutionId) + " nextExecutionId: " + String(settings.taskLog.nextExecutionId) + " " + flow);
       } else if (command.equals("reset-task")) {
-        settings.taskLog = {0};
-        EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-        EEPROM.commit();
+        {
+          SettingsLock lock;
+          settings.taskLog = {0};
+          saveSettings(&settings);
+        }
         serialLog("Task reset");
       } else if (command.equals("get-watering-time")) {
         uint32_t totalWateringTime = getTotalWateringTime(settings);
@@ -1038,6 +1231,40 @@ void serialPortHandler(void *pvParameters) {
       } else if (command.equals("time")) {
         DateTime now = rtc.now();
         Serial.printf("%04d/%02d/%02d %02d:%02d:%02d\n", now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second());
+      } else if (command.equals("heap")) {
+        char buffer[JSON_WRITER_BUFFER_SIZE];
+        JsonWriter writer(buffer, sizeof(buffer), serialSink, NULL);
+        writeHeapProfile(writer);
+        writer.flush();
+        Serial.println();
+      } else if (command.equals("tasks")) {
+        char buffer[JSON_WRITER_BUFFER_SIZE];
+        JsonWriter writer(buffer, sizeof(buffer), serialSink, NULL);
+        writeTaskMonitors(writer);
+        writer.flush();
+        Serial.println();
+      } else if (command.equals("boot")) {
+        char buffer[JSON_WRITER_BUFFER_SIZE];
+        JsonWriter writer(buffer, sizeof(buffer), serialSink, NULL);
+        writeBootProfile(writer);
+        writer.flush();
+        Serial.println();
+      } else if (command.equals("trace") || command.equals("trace-clear")) {
+        char buffer[JSON_WRITER_BUFFER_SIZE];
+        JsonWriter writer(buffer, sizeof(buffer), serialSink, NULL);
+        writeChromeTrace(writer);
+        writer.flush();
+        Serial.println();
+        if (command.equals("trace-clear")) {
+          clearTrace();
+        }
+      } else if (command.equals("capture-on") || command.equals("capture-off")) {
+        setSensorCaptureEnabled(command.equals("capture-on"));
+        char buffer[JSON_WRITER_BUFFER_SIZE];
+        JsonWriter writer(buffer, sizeof(buffer), serialSink, NULL);
+        writeCaptureStats(writer);
+        writer.flush();
+        Serial.println();
       } else if (command.equals("alarm")) {
         serialLog(getAlarms(settings));
       } else if (command.equals("plants")) {
@@ -1051,6 +1278,8 @@ void serialPortHandler(void *pvParameters) {
         DateTime alarmTime_start = now + TimeSpan(0, 0, 2, 0); // Adding 2 minutes (120 seconds)
         DateTime alarmTime_end = now + TimeSpan(0, 0, 3, 0); // Adding 2 minutes (120 seconds)
 
+        // Not saved, the response cache still notices since it is keyed on the settings content
+        SettingsLock lock;
         for (uint8_t i = 0; i < 1; i++) {
           settings.alarm[i][0].id = 0;
           settings.alarm[i][0].weekday = 1 << alarmTime_start.dayOfTheWeek();
@@ -1072,7 +1301,23 @@ void serialPortHandler(void *pvParameters) {
         serialLog(String("Alarm set to 1 minute"));
       } else if (command.equals("logs")) {
         initSDCard();
-        serialLog(String("Log count: " + String(getLogCount("/logs"))));
+        LoggerStats loggerStats = getLoggerStats();
+        serialLog(String("Log count: " + String(getLogCount("/logs")) + " queued: " + String(loggerStats.queued) + " written: " + String(loggerStats.written) + " dropped: " + String(loggerStats.dropped) + " failed: " + String(loggerStats.failed)));
+      } else if (command.startsWith("flow-history")) {
+        // flow-history[:from,to,resolution]
+        uint32_t to = flowHistory.latest();
+        uint32_t from = to > FLOW_HISTORY_SECONDS_CAPACITY ? to - FLOW_HISTORY_SECONDS_CAPACITY : 0;
+        uint32_t resolution = 1;
+        int separator = command.indexOf(':');
+        if (separator > 0) {
+          unsigned long fromArg, toArg, resolutionArg;
+          if (sscanf(command.c_str() + separator + 1, "%lu,%lu,%lu", &fromArg, &toArg, &resolutionArg) == 3) {
+            from = fromArg;
+            to = toArg;
+            resolution = resolutionArg;
+          }
+        }
+        serialLog(getFlowHistory(flowHistory, from, to, resolution));
       } else if (command.startsWith("next-alarm")) {
         time_t futureTime;
         DateTime now = rtc.now();
@@ -1096,6 +1341,6 @@ void serialPortHandler(void *pvParameters) {
       timer += 1;
     }
     Serial.flush();
-    vTaskDelay(10 / portTICK_PERIOD_MS);  // Small delay to yield task
+    serialMonitor.delay(10);  // Small delay to yield task
   }
 }
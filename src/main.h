@@ -43,17 +43,36 @@
 #include <SD.h>
 #include <EEPROM.h>
 #include <time.h>
+#include <atomic>
 #include <RTClib.h> // Date and time functions using a DS3231 RTC connected via I2C and Wire lib
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <Adafruit_MCP23X17.h>
 #include <ArduinoOTA.h>
-#include <WebServer.h>
 #include <ArduinoJson.h>
 #include "soc/soc.h"            // For WRITE_PERI_REG
 #include "soc/rtc_cntl_reg.h"   // For RTC_CNTL_BROWN_OUT_REG
 #include "constants.h"
 #include "settings.h"
+#include "logger.h"
+#include "logcompactor.h"
+#include "responsecache.h"
+#include "contentformat.h"
+#include "dashboard.h"
+#include "metrics.h"
+#include "telemetry.h"
+#include "jobs.h"
+#include "httpserver.h"
+#include "api.h"
+#include "broadcastring.h"
+#include "hal.h"
+#include "hal_esp32.h"
+#include "watering.h"
+#include "heapprofile.h"
+#include "tracer.h"
+#include "sensortrace.h"
+#include "taskmonitor.h"
+#include "bootprofile.h"
 
 // Settings
 Settings settings = {
@@ -93,38 +112,81 @@ Adafruit_SSD1306 display = Adafruit_SSD1306(128, 32, &Wire); // Address 0x3C
 // i2c Port extender
 Adafruit_MCP23X17 mcp; // Address 0x20
 
-// Need a WebServer for http access on port 80.
-WebServer server(80);
+// Need a HttpServer for http access on port 80.
+HttpServer server(80);
 
-// Watering process status
-struct WateringStatus {
-  uint8_t id;
-  uint8_t plant;
-  volatile uint32_t flow;
-  volatile uint32_t pulses;
+// Plain copy of a WateringStatus transition, what the service core sees of the cycle
+struct WateringEvent {
+  uint32_t time;
+  uint32_t flow;
+  uint32_t pulses;
   uint32_t duration;
+  uint32_t millilitres;     // Flow sample of the last second while watering
+  float rate;               // Litres per minute of the last poll while watering
+  uint8_t plant;
   uint8_t status;
-  String message;
 };
-QueueHandle_t wateringStatusQueue;
-static const uint8_t wateringStatusQueueLength = 10;
-
-// Need a WebServer for http access on port 80.
-#ifndef server
-  #define SERVER_RESPONSE_OK(...)  server.send(200, "application/jsont; charset=utf-8", __VA_ARGS__)
-  #define SERVER_RESPONSE_SUCCESS()  SERVER_RESPONSE_OK("{\"success\":true}")
-  // #define SERVER_RESPONSE_ERROR(code, ...)  server.send(code, "application/jsont; charset=utf-8", __VA_ARGS__)
-  #define SERVER_RESPONSE_ERROR(code, error)  server.send(code, "application/json; charset=utf-8", String("{\"error\":\"") + error + "\"}")
-#endif
+#define WATERING_EVENTS_LENGTH      64      /* Events a subscriber can lag behind before it skips ahead */
+BroadcastRing<WateringEvent, WATERING_EVENTS_LENGTH> wateringEvents;
+
+// In RAM flow history fed by the watering cycle
+FlowHistory flowHistory;
+
+// Runtime metrics scraped from /metrics
+MetricHistogram loopDurationMetric(METRICS_LATENCY_BUCKETS, METRICS_MAX_BUCKETS);
+MetricHistogram i2cLatencyMetric(METRICS_LATENCY_BUCKETS, METRICS_MAX_BUCKETS);
+MetricHistogram httpHandlerMetric(METRICS_LATENCY_BUCKETS, METRICS_MAX_BUCKETS);
+MetricCounter httpResponsesMetric[5];                       // 1xx to 5xx
+MetricCounter flowInterruptsMetric;
+MetricCounter flowPulsesMetric;
+MetricCounter valveMillilitresMetric[SETTINGS_MAX_PLANTS];
+MetricCounter valveSecondsMetric[SETTINGS_MAX_PLANTS];
+MetricGauge loggerQueueDepthMetric;
+MetricGauge eventStreamsMetric;
+MetricGauge freeHeapMetric;
+MetricGauge minFreeHeapMetric;
+MetricGauge largestFreeBlockMetric;
+MetricGauge heapFragmentationMetric;
+
+// Peripherals as seen by the watering and persistence code
+Esp32Clock halClock(&rtc);
+Esp32GpioExpander halExpander(&mcp);
+Esp32FlowSensor halFlow(FLOW_METER_PIN, FLOW_METER_INTERRUPT, &flowInterruptsMetric, &flowPulsesMetric);
+Esp32Display halDisplay(&display);
+Esp32Store halStore;
+Hal hal = { &halClock, &halExpander, &halFlow, &halDisplay, &halStore, &SD };
 
 TaskHandle_t webServerTaskHandle;
 TaskHandle_t otaTaskHandle;
 TaskHandle_t serialTaskHandle;
-// Use only core
+TaskHandle_t displayTaskHandle;
+
+#define DISPLAY_PERIOD_MS           500     /* Display task refresh, the clock shows seconds */
+
+// Scheduling latency and loop budgets of the long running tasks, the budget is the longest acceptable loop period
+TaskMonitor loopMonitor("loop", WATERING_LOOP_MS * 2);
+TaskMonitor serialMonitor("serial", 1500);   // readStringUntil() waits up to a second for the end of a line
+TaskMonitor webServerMonitor("webserver", HTTP_KEEP_ALIVE_TIMEOUT_MS * 2);
+// Not on the watchdog, an update is flashed from inside ArduinoOTA.handle()
+TaskMonitor otaMonitor("ota", 500, false);
+TaskMonitor displayMonitor("display", DISPLAY_PERIOD_MS * 4);
+// Core partition. Flow sampling, valve sequencing and the schedule own the control core
+// (the Arduino loop task already runs there), networking, storage, display and serial
+// share the other one with the Wi-Fi stack. What still crosses between the two:
+// - data out of the control core goes through lock-free rings: wateringEvents, the
+//   logger queues and the sensor capture queue
+// - requests into it go through controlQueue, loop() acts on them
+// - settings are shared, writers and consistent readers hold SettingsLock
+// - IS_ALARM_ON is claimed atomically by whoever starts a cycle, loop() or a watering job
+// - the I2C bus: i2cMutex orders the multi transaction sequences of the service side
+//   (display frames, telemetry), single RTC and expander transactions of either core
+//   only rely on the Wire driver lock
 #if CONFIG_FREERTOS_UNICORE
-  static const BaseType_t app_cpu = 0;
+  static const BaseType_t control_cpu = 0;
+  static const BaseType_t service_cpu = 0;
 #else
-  static const BaseType_t app_cpu = 1;
+  static const BaseType_t control_cpu = 1;
+  static const BaseType_t service_cpu = 0;
 #endif
 
 // Define custom priority levels
@@ -136,21 +198,18 @@ TaskHandle_t serialTaskHandle;
 BaseType_t result = pdFALSE;
 
 #ifndef IS_ALARM_ON
-  volatile bool IS_ALARM_ON = false;
+  std::atomic<bool> IS_ALARM_ON(false);
 #endif
 
-#ifndef ENABLE_FLOW
-  #define ENABLE_FLOW
-  volatile byte FLOW_METER_PULSE_COUNT                  = 0;
-  volatile unsigned long FLOW_METER_TOTAL_PULSE_COUNT   = 0;
-  volatile unsigned long OLD_INT_TIME                   = 0;
-  unsigned long START_INT_TIME                          = 0;
-  unsigned long END_INT_TIME                            = 0;
-  volatile float FLOW_RATE                              = 0.0;
-  unsigned int FLOW_MILLILITRES                         = 0;
-  volatile uint32_t TOTAL_MILLILITRES                   = 0;
-  volatile uint8_t FLOW_SENSOR_STATE                    = HIGH;
-#endif
+// Requests from the service core, loop() executes them on the control core
+enum ControlCommand : uint8_t {
+  CONTROL_START_CYCLE                   // Manual watering cycle, ignored while one runs
+};
+#define CONTROL_QUEUE_LENGTH        4
+QueueHandle_t controlQueue;
+
+// Alert beeps raised while booting, the boot task plays them instead of the single ready beep
+volatile uint8_t bootBeeps = 0;
 
 #ifndef DISPLAY_INFO
   #define DISPLAY_INFO
@@ -179,12 +238,16 @@ BaseType_t result = pdFALSE;
 
 SemaphoreHandle_t i2cMutex;
 
+#if defined(ENABLE_LOGGING)
+// Full resolution flow samples of the running watering cycle
+FlowEncoder flowEncoder;
+#endif
+
 /**
  * Hardware Setup
  */
 bool setupMcp();
-void pulseCounter();
-void calcFlow();
+void setupWatering();
 
 /**
  * Wireless functions
@@ -203,34 +266,55 @@ long int getRtcOffset();
 /**
  * API Handlers
  */
-void handleSystemInfo();
+void serialSink(const char* data, size_t length, void* context);
+void feedWebServerWatchdog();
 void handleValve();
 void handleSaveSettings();
+void handlePatchSettings();
 void handlePump();
-void handleAlarm();
-void handlePlants();
-void handleLogs();
-void handleRoot();
+void handleFlowLog();
+void handleFlowHistory();
+void handleDashboard();
+void handleMetrics();
+void setupMetrics();
+void collectMetrics();
+void observeRequest(HTTPMethod method, int code, uint32_t micros);
+void invokeProfiled(HttpHandler handler, const char* route);
+void handleHeapProfile();
+void handleTrace();
+void handleCapture();
+void handleTasks();
+void handleBoot();
+void writeCaptureStats(JsonWriter& writer);
 void handleNotFound();
 void handleTestAlarm();
+void handleJobs();
+void handleWateringEvents();
+size_t readWateringEvent(uint32_t* cursor, char* buffer, size_t size);
+void handleJob();
+void writeJob(JsonWriter& writer, const Job& job);
 
 /**
  * LCD Display & Serial debug functions
  */
 void printLocalTime();
 void printRtcTime();
-void displayFlow();
 void displayTime();
+void displayWatering(const WateringEvent& event);
 void serialLog(String message);
 void setWateringStatus(WateringStatus *wateringStatus);
 
 /**
  * IO
  */
-void waterPlants();
-void waterPlant(uint8_t valve, unsigned int duration, unsigned long millilitres);
+bool wateringJob(uint32_t id);
+void wateringStarted(uint8_t valve, uint32_t unixTime);
+void wateringSample(uint8_t valve, uint32_t startTime, uint32_t elapsed, uint32_t millilitres);
+void wateringFinished(uint8_t valve, uint32_t unixTime, uint32_t millilitres, uint32_t duration, uint32_t elapsed);
+void wateringPower(bool pumping);
+void recordFlowSample(uint32_t time, int32_t millilitres);
+void flushFlowSamples();
 void serialPortHandler(void *pvParameters);
-void stopWatering();
 uint32_t calculateWateringDuration(uint8_t potSize);
 /**
  * Threads
@@ -238,3 +322,5 @@ uint32_t calculateWateringDuration(uint8_t potSize);
 void pumpWater(void *parameter);
 void handleOTATask(void * parameter);
 void handleWebServerTask(void * parameter);
+void handleDisplayTask(void * parameter);
+void handleBootTask(void * parameter);
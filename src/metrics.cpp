@@ -0,0 +1,217 @@
+/**
+ * @file         : metrics.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include <Arduino.h>
+#else
+  #include <time.h>
+#endif
+
+const uint32_t METRICS_LATENCY_BUCKETS[METRICS_MAX_BUCKETS] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+};
+
+enum MetricType {
+  METRIC_COUNTER = 0,
+  METRIC_GAUGE,
+  METRIC_HISTOGRAM
+};
+
+struct MetricEntry {
+  const char* name;
+  const char* help;
+  const char* labels;
+  MetricType type;
+  void* metric;
+};
+
+static const char* metricTypeNames[] = { "counter", "gauge", "histogram" };
+
+// Written during setup only, scrapes just read it
+static MetricEntry registry[METRICS_MAX];
+static uint8_t registryCount = 0;
+static MetricsCollector metricsCollector = NULL;
+
+MetricHistogram::MetricHistogram(const uint32_t* bounds, uint8_t boundCount)
+  : bounds(bounds), boundCount(boundCount < METRICS_MAX_BUCKETS ? boundCount : METRICS_MAX_BUCKETS), total(0) {
+  for (uint8_t i = 0; i <= METRICS_MAX_BUCKETS; i++) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void MetricHistogram::observe(uint32_t micros) {
+  uint8_t bucket = 0;
+  while (bucket < boundCount && micros > bounds[bucket]) {
+    bucket++;
+  }
+  buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(micros, std::memory_order_relaxed);
+}
+
+uint32_t metricsMicros() {
+#if defined(ARDUINO)
+  return micros();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000000ULL + now.tv_nsec / 1000);
+#endif
+}
+
+static bool registerMetric(const char* name, const char* help, const char* labels, MetricType type, void* metric) {
+  if (registryCount >= METRICS_MAX || metric == NULL) {
+    return false;
+  }
+  registry[registryCount].name = name;
+  registry[registryCount].help = help;
+  registry[registryCount].labels = labels != NULL ? labels : "";
+  registry[registryCount].type = type;
+  registry[registryCount].metric = metric;
+  registryCount++;
+  return true;
+}
+
+bool registerCounter(const char* name, const char* help, MetricCounter* counter, const char* labels) {
+  return registerMetric(name, help, labels, METRIC_COUNTER, counter);
+}
+
+bool registerGauge(const char* name, const char* help, MetricGauge* gauge, const char* labels) {
+  return registerMetric(name, help, labels, METRIC_GAUGE, gauge);
+}
+
+bool registerHistogram(const char* name, const char* help, MetricHistogram* histogram, const char* labels) {
+  return registerMetric(name, help, labels, METRIC_HISTOGRAM, histogram);
+}
+
+void setMetricsCollector(MetricsCollector collector) {
+  metricsCollector = collector;
+}
+
+/**
+ * Line oriented formatter for the Prometheus text exposition format, lines
+ * are staged in a fixed buffer and handed to the sink when it fills up.
+ */
+class MetricsWriter {
+public:
+  MetricsWriter(JsonSink sink, void* context) : length(0), sink(sink), context(context) {}
+
+  void print(const char* format, ...) {
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+      va_list args;
+      va_start(args, format);
+      int written = vsnprintf(buffer + length, sizeof(buffer) - length, format, args);
+      va_end(args);
+      if (written < 0) {
+        return;
+      }
+      if (length + written < sizeof(buffer)) {
+        length += written;
+        return;
+      }
+      // Did not fit, send what is staged and format again into the empty buffer
+      flush();
+    }
+  }
+
+  void flush() {
+    if (length > 0) {
+      sink(buffer, length, context);
+      length = 0;
+    }
+  }
+
+private:
+  char buffer[METRICS_BUFFER_SIZE];
+  size_t length;
+  JsonSink sink;
+  void* context;
+};
+
+static void writeSeconds(MetricsWriter& out, uint64_t micros) {
+  out.print("%llu.%06llu", (unsigned long long)(micros / 1000000), (unsigned long long)(micros % 1000000));
+}
+
+static void writeHistogram(MetricsWriter& out, const MetricEntry& entry) {
+  const MetricHistogram* histogram = (const MetricHistogram*)entry.metric;
+  const char* separator = entry.labels[0] != '\0' ? "," : "";
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < histogram->bucketCount(); i++) {
+    cumulative += histogram->bucket(i);
+    out.print("%s_bucket{%s%sle=\"", entry.name, entry.labels, separator);
+    writeSeconds(out, histogram->bound(i));
+    out.print("\"} %lu\n", (unsigned long)cumulative);
+  }
+  // Count is derived from the buckets so both agree even while observations land
+  cumulative += histogram->bucket(histogram->bucketCount());
+  out.print("%s_bucket{%s%sle=\"+Inf\"} %lu\n", entry.name, entry.labels, separator, (unsigned long)cumulative);
+  out.print("%s_sum%s%s%s ", entry.name, separator[0] ? "{" : "", entry.labels, separator[0] ? "}" : "");
+  writeSeconds(out, histogram->sum());
+  out.print("\n%s_count%s%s%s %lu\n", entry.name, separator[0] ? "{" : "", entry.labels, separator[0] ? "}" : "", (unsigned long)cumulative);
+}
+
+void writeMetrics(JsonSink sink, void* context) {
+  if (metricsCollector != NULL) {
+    metricsCollector();
+  }
+
+  MetricsWriter out(sink, context);
+  const char* family = NULL;
+  for (uint8_t i = 0; i < registryCount; i++) {
+    const MetricEntry& entry = registry[i];
+    if (family == NULL || strcmp(family, entry.name) != 0) {
+      family = entry.name;
+      out.print("# HELP %s %s\n# TYPE %s %s\n", entry.name, entry.help, entry.name, metricTypeNames[entry.type]);
+    }
+    bool labelled = entry.labels[0] != '\0';
+    switch (entry.type) {
+      case METRIC_COUNTER:
+        out.print("%s%s%s%s %lu\n", entry.name, labelled ? "{" : "", entry.labels, labelled ? "}" : "",
+          (unsigned long)((const MetricCounter*)entry.metric)->get());
+        break;
+      case METRIC_GAUGE:
+        out.print("%s%s%s%s %ld\n", entry.name, labelled ? "{" : "", entry.labels, labelled ? "}" : "",
+          (long)((const MetricGauge*)entry.metric)->get());
+        break;
+      case METRIC_HISTOGRAM:
+        writeHistogram(out, entry);
+        break;
+    }
+  }
+  out.flush();
+}
@@ -0,0 +1,108 @@
+/**
+ * @file         : metrics.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "jsonwriter.h"
+
+#define METRICS_MAX                       64      /* Registered series, a labelled family takes one per label set */
+#define METRICS_MAX_BUCKETS               12      /* Histogram buckets besides +Inf */
+#define METRICS_BUFFER_SIZE               512     /* Exposition text is staged here before going to the sink */
+
+/**
+ * Monotonic counter, safe to bump from any task or ISR.
+ */
+class MetricCounter {
+public:
+  MetricCounter() : value(0) {}
+  void add(uint32_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+  // For totals kept elsewhere, copied in right before a scrape
+  void set(uint32_t total) { value.store(total, std::memory_order_relaxed); }
+  uint32_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint32_t> value;
+};
+
+class MetricGauge {
+public:
+  MetricGauge() : value(0) {}
+  void set(int32_t current) { value.store(current, std::memory_order_relaxed); }
+  void add(int32_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+  int32_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<int32_t> value;
+};
+
+/**
+ * Fixed bucket histogram of durations in microseconds, exported in seconds.
+ * Bucket bounds are ascending and must outlive the histogram.
+ */
+class MetricHistogram {
+public:
+  MetricHistogram(const uint32_t* bounds, uint8_t boundCount);
+  void observe(uint32_t micros);
+  uint8_t bucketCount() const { return boundCount; }
+  uint32_t bound(uint8_t bucket) const { return bounds[bucket]; }
+  // Bucket boundCount is +Inf, counts are per bucket and not cumulative
+  uint32_t bucket(uint8_t bucket) const { return buckets[bucket].load(std::memory_order_relaxed); }
+  uint64_t sum() const { return total.load(std::memory_order_relaxed); }
+
+private:
+  const uint32_t* bounds;
+  uint8_t boundCount;
+  std::atomic<uint32_t> buckets[METRICS_MAX_BUCKETS + 1];
+  // 64 bit so the sum does not wrap after an hour of loop time, Xtensa emulates it with a short critical section
+  std::atomic<uint64_t> total;
+};
+
+// 100us to 1s, covers everything from an I2C read to an SD card write
+extern const uint32_t METRICS_LATENCY_BUCKETS[METRICS_MAX_BUCKETS];
+
+typedef void (*MetricsCollector)();
+
+/**
+ * Registry, series of a family have to be registered back to back and
+ * labels are preformatted, e.g. plant="3". Register before the first scrape.
+ */
+bool registerCounter(const char* name, const char* help, MetricCounter* counter, const char* labels = NULL);
+bool registerGauge(const char* name, const char* help, MetricGauge* gauge, const char* labels = NULL);
+bool registerHistogram(const char* name, const char* help, MetricHistogram* histogram, const char* labels = NULL);
+void setMetricsCollector(MetricsCollector collector);
+void writeMetrics(JsonSink sink, void* context);
+uint32_t metricsMicros();
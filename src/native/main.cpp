@@ -0,0 +1,123 @@
+/**
+ * @file         : main.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Host entry point of the native build, runs one watering cycle against the
+ * fake peripherals and prints what the firmware would have persisted.
+ */
+#include <Arduino.h>
+#include <SD.h>
+#include "constants.h"
+#include "settings.h"
+#include "hal.h"
+#include "hal_fake.h"
+#include "watering.h"
+#include "heapprofile.h"
+
+#define NATIVE_START_TIME                 1719676800  /* 2024-06-29 16:00:00 UTC, a Saturday */
+#define NATIVE_PULSES_PER_SECOND          40          /* Flow meter output while the pump runs */
+
+FakeClock fakeClock(NATIVE_START_TIME);
+FakeGpioExpander fakeExpander;
+FakeFlowSensor fakeFlow;
+FakeDisplay fakeDisplay;
+FakeStore fakeStore(EEPROM_SIZE);
+Hal hal = { &fakeClock, &fakeExpander, &fakeFlow, &fakeDisplay, &fakeStore, &SD };
+
+static uint32_t fakeMillis() { return fakeClock.millis(); }
+static void fakeDelay(uint32_t ms) { fakeClock.delay(ms); }
+static uint32_t fakeNow() { return fakeClock.now(); }
+static void fakeAdjust(uint32_t unixTime) { fakeClock.adjust(unixTime); }
+
+// Pulses owed for the time the pump ran, fractions carry over to the next advance
+static void feedFlow(uint64_t micros, void* context) {
+  static uint64_t last = 0;
+  static uint64_t owed = 0;
+  if (fakeExpander.isLow(PUMP1_PIN)) {
+    owed += (micros - last) * NATIVE_PULSES_PER_SECOND;
+    fakeFlow.inject(owed / 1000000);
+    owed %= 1000000;
+  }
+  last = micros;
+}
+
+static void printStatus(WateringStatus* status) {
+  if (status != NULL && status->status != WATERING_STATUS_WATERING) {
+    TRACE("[%7.2fs] plant: %d status: %d flow: %u\n", fakeClock.micros() / 1e6, status->plant, status->status, (unsigned int)status->flow);
+  }
+}
+
+static void printChunk(const char* data, size_t length, void* context) {
+  fwrite(data, 1, length, stdout);
+}
+
+int main(int argc, char** argv) {
+  beginHeapProfile();
+  NativeClock clock = { fakeMillis, fakeDelay, fakeNow, fakeAdjust };
+  setNativeClock(clock);
+  fakeClock.setObserver(feedFlow, NULL);
+
+  WateringHooks hooks = { printStatus };
+  setWateringHooks(hooks);
+
+  Settings settings;
+  memset(&settings, 0, sizeof(Settings));
+  strncpy(settings.hostname, "native", HOSTNAME_MAX_LENGTH - 1);
+  settings.maxPlants = SETTINGS_MAX_PLANTS;
+  for (uint8_t i = 0; i < 3; i++) {
+    settings.plant[i].id = i;
+    settings.plant[i].size = i == 0 ? 10 : 18;
+    settings.plant[i].status = 1;
+  }
+
+  {
+    HeapScope scope("waterPlants");
+    waterPlants(&settings);
+  }
+  sampleHeap();
+
+  TRACE("pulses: %u store commits: %u\n", fakeFlow.totalPulses(), fakeStore.commitCount());
+  TRACE("settings: %s\n", settingsToJson(settings).c_str());
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter heap(buffer, sizeof(buffer), printChunk, NULL);
+  TRACE("heap: ");
+  writeHeapProfile(heap);
+  heap.flush();
+  TRACE("\n");
+
+  bool watered = settings.taskLog.flow[0] > 0 && settings.taskLog.flow[1] > 0 && settings.taskLog.flow[2] > 0;
+  bool persisted = memcmp(fakeStore.committed() + EEPROM_SETTINGS_ADDRESS, &settings, sizeof(Settings)) == 0;
+  return watered && persisted ? 0 : 1;
+}
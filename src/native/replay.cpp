@@ -0,0 +1,349 @@
+/**
+ * @file         : replay.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Replay driver of the native build. Feeds flow meter edges captured on the
+ * device (see sensortrace.h) back into the watering cycle under the fake
+ * clock, so a change to the flow path can be checked against real pump runs.
+ * Prints one CSV row per pump run and fails when the replayed volume drifts
+ * from the recorded one by more than the tolerance.
+ *
+ *   replay [--tolerance=5] trace.sgt...
+ *
+ * Each recorded pump run is bound to the valve that was open when the pump
+ * started, its edges are injected at the same offset from the replayed pump
+ * start, so whatever the firmware counts from them is what it would count on
+ * the device.
+ */
+#include <Arduino.h>
+#include <SD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "constants.h"
+#include "settings.h"
+#include "hal.h"
+#include "hal_fake.h"
+#include "watering.h"
+#include "sensortrace.h"
+
+#define REPLAY_MAX_RUNS                   64      /* Pump runs per capture, one per plant and cycle */
+#define REPLAY_TOLERANCE_PCT              5
+#define REPLAY_STOPPED                    UINT64_MAX
+
+// One pump run of the capture and of its replay
+struct PumpRun {
+  uint8_t valve;
+  uint64_t recordedOn;                    // Capture micros
+  uint64_t recordedOff;
+  uint32_t firstEdge;                     // Offsets from recordedOn in the shared edge array
+  uint32_t edgeCount;
+  uint32_t recordedMl;
+  bool hasResult;
+  uint64_t replayOn;                      // Virtual micros
+  uint64_t replayOff;
+  uint32_t replayed;
+  uint32_t replayMl;
+};
+
+struct Capture {
+  SensorTraceHeader header;
+  PumpRun runs[REPLAY_MAX_RUNS];
+  uint32_t runCount;
+  uint32_t* edges;
+  uint32_t edgeCount;
+  uint32_t dropped;
+  uint32_t strayEdges;                    // Edges while the pump was off
+};
+
+FakeClock fakeClock;
+FakeGpioExpander fakeExpander;
+FakeFlowSensor fakeFlow;
+FakeStore fakeStore(EEPROM_SIZE);
+// The display belongs to the service core, the replayed cycle never draws
+Hal hal = { &fakeClock, &fakeExpander, &fakeFlow, NULL, &fakeStore, &SD };
+
+static Capture capture;
+static PumpRun* active = NULL;
+static uint32_t nextRun = 0;
+
+static uint32_t fakeMillis() { return fakeClock.millis(); }
+static void fakeDelay(uint32_t ms) { fakeClock.delay(ms); }
+static uint32_t fakeNow() { return fakeClock.now(); }
+static void fakeAdjust(uint32_t unixTime) { fakeClock.adjust(unixTime); }
+
+static uint8_t* readFile(const char* path, size_t* size) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    TRACE("Failed to open %s\n", path);
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* data = length > 0 ? (uint8_t*)malloc(length) : NULL;
+  if (data == NULL || fread(data, 1, length, file) != (size_t)length) {
+    TRACE("Failed to read %s\n", path);
+    free(data);
+    fclose(file);
+    return NULL;
+  }
+  fclose(file);
+  *size = length;
+  return data;
+}
+
+// First valve driven low, valves sit on the first pins and are active low
+static uint8_t openValve(uint16_t outputs) {
+  for (uint8_t valve = 0; valve < SETTINGS_MAX_PLANTS; valve++) {
+    if ((outputs & (1 << valve)) == 0) {
+      return valve;
+    }
+  }
+  return SETTINGS_MAX_PLANTS;
+}
+
+/**
+ * Splits the capture into pump runs. Walked twice, the first pass only counts
+ * the edges so they can live in one allocation.
+ */
+static bool loadCapture(const uint8_t* data, size_t size) {
+  SensorTraceReader reader;
+  if (!reader.begin(data, size)) {
+    TRACE("Not a sensor trace\n");
+    return false;
+  }
+  memset(&capture, 0, sizeof(Capture));
+  capture.header = reader.traceHeader();
+  SensorTraceRecord record;
+  uint32_t edges = 0;
+  while (reader.next(&record)) {
+    edges += record.type == SENSOR_EVENT_EDGE ? 1 : 0;
+  }
+  capture.edges = (uint32_t*)malloc((edges > 0 ? edges : 1) * sizeof(uint32_t));
+  if (capture.edges == NULL) {
+    return false;
+  }
+
+  reader.begin(data, size);
+  uint16_t outputs = 0xFFFF;
+  PumpRun* run = NULL;
+  while (reader.next(&record)) {
+    uint16_t previous = outputs;
+    switch (record.type) {
+      case SENSOR_EVENT_EDGE:
+        if (run != NULL) {
+          capture.edges[capture.edgeCount++] = (uint32_t)(record.micros - run->recordedOn);
+          run->edgeCount++;
+        } else {
+          capture.strayEdges++;
+        }
+        break;
+      case SENSOR_EVENT_PIN:
+        outputs = (record.value & 1) ? outputs | (1 << (record.value >> 1)) : outputs & ~(1 << (record.value >> 1));
+        break;
+      case SENSOR_EVENT_PORT:
+        outputs = record.value;
+        break;
+      case SENSOR_EVENT_RESULT:
+        if (run != NULL) {
+          run->recordedMl = record.value;
+          run->hasResult = true;
+        }
+        break;
+      case SENSOR_EVENT_DROPPED:
+        capture.dropped += record.value;
+        break;
+    }
+    bool wasPumping = (previous & (1 << PUMP1_PIN)) == 0;
+    bool pumping = (outputs & (1 << PUMP1_PIN)) == 0;
+    if (!wasPumping && pumping && capture.runCount < REPLAY_MAX_RUNS) {
+      run = &capture.runs[capture.runCount++];
+      run->valve = openValve(outputs);
+      run->recordedOn = record.micros;
+      run->recordedOff = record.micros;
+      run->firstEdge = capture.edgeCount;
+      run->replayOn = REPLAY_STOPPED;
+    } else if (wasPumping && !pumping && run != NULL) {
+      run->recordedOff = record.micros;
+      run = NULL;
+    }
+  }
+  return true;
+}
+
+// Injects the edges the recorded run had produced by now
+static void replayEdges(uint64_t micros, void* context) {
+  if (active == NULL || micros < active->replayOn) {
+    return;
+  }
+  uint64_t offset = micros - active->replayOn;
+  uint32_t due = 0;
+  const uint32_t* edges = capture.edges + active->firstEdge;
+  while (active->replayed + due < active->edgeCount && edges[active->replayed + due] <= offset) {
+    due++;
+  }
+  if (due > 0) {
+    fakeFlow.inject(due);
+    active->replayed += due;
+  }
+}
+
+// The replayed pump start picks up the next recorded run of the open valve
+static void switchOutputs(uint16_t previous, uint16_t current, void* context) {
+  bool wasPumping = (previous & (1 << PUMP1_PIN)) == 0;
+  bool pumping = (current & (1 << PUMP1_PIN)) == 0;
+  if (!wasPumping && pumping) {
+    uint8_t valve = openValve(current);
+    active = NULL;
+    for (uint32_t i = nextRun; i < capture.runCount; i++) {
+      if (capture.runs[i].valve == valve) {
+        active = &capture.runs[i];
+        active->replayOn = fakeClock.micros();
+        nextRun = i + 1;
+        break;
+      }
+    }
+  } else if (wasPumping && !pumping && active != NULL) {
+    replayEdges(fakeClock.micros(), NULL);
+    active->replayOff = fakeClock.micros();
+    active = NULL;
+  }
+}
+
+static void wateringFinished(uint8_t valve, uint32_t unixTime, uint32_t millilitres, uint32_t duration, uint32_t elapsed) {
+  if (active != NULL && active->valve == valve) {
+    active->replayMl = millilitres;
+  }
+}
+
+// Runs the cycle the capture was taken from, with the plants it had enabled
+static void replayCapture() {
+  Settings settings;
+  memset(&settings, 0, sizeof(Settings));
+  strncpy(settings.hostname, "replay", HOSTNAME_MAX_LENGTH - 1);
+  settings.maxPlants = SETTINGS_MAX_PLANTS;
+  settings.hasRTC = true;
+  settings.hasEEPROM = true;
+  settings.hasMCP = true;
+  for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    uint8_t size = i < capture.header.plantCount ? capture.header.sizes[i] : 0;
+    settings.plant[i] = { i, size, (uint8_t)(size > 0 ? 1 : 0) };
+  }
+  fakeClock.adjust(capture.header.startTime);
+  active = NULL;
+  nextRun = 0;
+  waterPlants(&settings, 0);
+}
+
+static bool option(const char* arg, const char* name, uint32_t* value) {
+  size_t length = strlen(name);
+  if (strncmp(arg, name, length) != 0) {
+    return false;
+  }
+  *value = strtoul(arg + length, NULL, 10);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  uint32_t tolerance = REPLAY_TOLERANCE_PCT;
+  int files = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--", 2) != 0) {
+      files++;
+    } else if (!option(argv[i], "--tolerance=", &tolerance)) {
+      TRACE("Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (files == 0) {
+    TRACE("Usage: replay [--tolerance=5] trace.sgt...\n");
+    return 2;
+  }
+
+  NativeClock nativeClock = { fakeMillis, fakeDelay, fakeNow, fakeAdjust };
+  setNativeClock(nativeClock);
+  fakeClock.setObserver(replayEdges, NULL);
+  fakeExpander.setObserver(switchOutputs, NULL);
+  WateringHooks hooks = {};
+  hooks.finished = wateringFinished;
+  setWateringHooks(hooks);
+
+  uint32_t runs = 0;
+  uint32_t failed = 0;
+  uint64_t edges = 0;
+  clock_t wall = clock();
+  TRACE("trace,run,valve,recorded_edges,replayed_edges,recorded_ml,replay_ml,delta_pct,recorded_s,replay_s\n");
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--", 2) == 0) {
+      continue;
+    }
+    size_t size = 0;
+    uint8_t* data = readFile(argv[i], &size);
+    if (data == NULL || !loadCapture(data, size)) {
+      free(data);
+      failed++;
+      continue;
+    }
+    if (capture.header.calibration != FLOW_CALIBRATION_FACTOR) {
+      TRACE("# %s was captured with calibration %u, firmware uses %u\n", argv[i], capture.header.calibration, FLOW_CALIBRATION_FACTOR);
+    }
+    replayCapture();
+
+    for (uint32_t r = 0; r < capture.runCount; r++) {
+      PumpRun& run = capture.runs[r];
+      double delta = run.recordedMl > 0 ? ((double)run.replayMl - run.recordedMl) * 100 / run.recordedMl : 0.0;
+      bool missing = run.replayOn == REPLAY_STOPPED;
+      if (missing || !run.hasResult || delta > tolerance || -delta > tolerance) {
+        failed++;
+      }
+      TRACE("%s,%u,%u,%u,%u,%u,%u,%.2f,%.2f,%.2f\n", argv[i], r, run.valve, run.edgeCount, run.replayed,
+        run.recordedMl, run.replayMl, delta, (run.recordedOff - run.recordedOn) / 1e6,
+        missing ? 0.0 : (run.replayOff - run.replayOn) / 1e6);
+      edges += run.replayed;
+    }
+    if (capture.dropped > 0 || capture.strayEdges > 0) {
+      TRACE("# %s dropped: %u stray_edges: %u\n", argv[i], capture.dropped, capture.strayEdges);
+    }
+    runs += capture.runCount;
+    free(capture.edges);
+    free(data);
+  }
+  double host = (double)(clock() - wall) / CLOCKS_PER_SEC;
+  TRACE("# runs: %u failed: %u edges: %llu host_s: %.3f edges_per_s: %.0f\n",
+    runs, failed, (unsigned long long)edges, host, host > 0 ? edges / host : 0.0);
+  return failed == 0 && runs > 0 ? 0 : 1;
+}
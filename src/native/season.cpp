@@ -0,0 +1,329 @@
+/**
+ * @file         : season.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Season simulator of the native build. Runs the alarm dispatch of loop() and
+ * the alarm task under the fake clock for a number of days, modelling the pump,
+ * the valves and the flow meter, and prints one CSV row per alarm run.
+ *
+ *   season [--days=365] [--start=unixtime] [--config=file.json] [--loop-ms=500]
+ *          [--pump-ml-min=575] [--pump-ramp-ms=300] [--valve-ms=150]
+ *          [--pulses-per-litre=24600]
+ *
+ * The config file holds the "alarm" and "plants" arrays of the set-alarms and
+ * set-plants commands, without one the schedule from the README is used.
+ */
+#include <Arduino.h>
+#include <SD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "constants.h"
+#include "settings.h"
+#include "hal.h"
+#include "hal_fake.h"
+#include "watering.h"
+
+#define SEASON_START_TIME                 1704067200  /* 2024-01-01 00:00:00 UTC, a Monday */
+#define SEASON_DAYS                       365
+#define SEASON_PUMP_RAMP_MS               300     /* Pump spin up to its nominal throughput */
+#define SEASON_VALVE_MS                   150     /* Solenoid travel from closed to fully open */
+#define SEASON_PULSES_PER_LITRE           (FLOW_CALIBRATION_FACTOR * 60)  /* Meter the firmware is calibrated for */
+#define SEASON_CLOSED                     UINT64_MAX
+
+// What the simulated hardware does, set from the command line
+struct Rig {
+  uint32_t pumpMlPerMinute;
+  uint32_t pumpRampMs;
+  uint32_t valveMs;
+  uint32_t pulsesPerLitre;
+  uint32_t loopMs;
+};
+
+// What the simulated hardware did, in virtual microseconds and true millilitres
+struct RigState {
+  uint64_t last;
+  uint64_t pumpOn;
+  uint64_t valveOpen[SETTINGS_MAX_PLANTS];
+  uint64_t pumpMicros;
+  uint64_t deadheadMicros;                // Pump running against closed valves
+  double pulses;                          // Fraction owed to the next advance
+  double millilitres[SETTINGS_MAX_PLANTS];
+};
+
+// One alarm run as seen by the watering hooks
+struct Run {
+  uint32_t plants;
+  uint32_t measured;
+  uint32_t lastFinished;
+  uint32_t measuredByPlant[SETTINGS_MAX_PLANTS];
+};
+
+FakeClock fakeClock(SEASON_START_TIME);
+FakeGpioExpander fakeExpander;
+FakeFlowSensor fakeFlow;
+FakeStore fakeStore(EEPROM_SIZE);
+// The display belongs to the service core, nothing simulated here draws
+Hal hal = { &fakeClock, &fakeExpander, &fakeFlow, NULL, &fakeStore, &SD };
+
+static Rig rig = {
+  WATER_PUMP_ML_PER_MINUTE, SEASON_PUMP_RAMP_MS, SEASON_VALVE_MS, SEASON_PULSES_PER_LITRE, WATERING_LOOP_MS
+};
+static RigState rigState;
+static Run run;
+
+static uint32_t fakeMillis() { return fakeClock.millis(); }
+static void fakeDelay(uint32_t ms) { fakeClock.delay(ms); }
+static uint32_t fakeNow() { return fakeClock.now(); }
+static void fakeAdjust(uint32_t unixTime) { fakeClock.adjust(unixTime); }
+
+// Linear travel, 0 while closed and 1 once the element reached its nominal state
+static double travel(uint64_t since, uint64_t at, uint32_t ms) {
+  if (since == SEASON_CLOSED || at <= since) {
+    return 0;
+  }
+  if (ms == 0 || at - since >= (uint64_t)ms * 1000) {
+    return 1;
+  }
+  return (double)(at - since) / ((double)ms * 1000);
+}
+
+// Integrates the water moved since the previous advance and feeds the meter with it
+static void moveWater(uint64_t micros, void* context) {
+  uint64_t span = micros - rigState.last;
+  uint64_t middle = rigState.last + span / 2;
+  rigState.last = micros;
+  if (rigState.pumpOn == SEASON_CLOSED || span == 0) {
+    return;
+  }
+  rigState.pumpMicros += span;
+
+  double open = 0;
+  double valves[SETTINGS_MAX_PLANTS];
+  for (uint8_t valve = 0; valve < SETTINGS_MAX_PLANTS; valve++) {
+    valves[valve] = travel(rigState.valveOpen[valve], middle, rig.valveMs);
+    open += valves[valve];
+  }
+  if (open == 0) {
+    rigState.deadheadMicros += span;
+    return;
+  }
+
+  double pumped = rig.pumpMlPerMinute / 60e6 * span * travel(rigState.pumpOn, middle, rig.pumpRampMs);
+  double delivered = pumped * (open > 1 ? 1 : open);
+  for (uint8_t valve = 0; valve < SETTINGS_MAX_PLANTS; valve++) {
+    rigState.millilitres[valve] += delivered * valves[valve] / open;
+  }
+  rigState.pulses += delivered * rig.pulsesPerLitre / 1000;
+  uint32_t whole = (uint32_t)rigState.pulses;
+  rigState.pulses -= whole;
+  fakeFlow.inject(whole);
+}
+
+// Outputs are active low, valves sit on the first pins and the pump on PUMP1_PIN
+static void switchOutputs(uint16_t previous, uint16_t current, void* context) {
+  uint64_t now = fakeClock.micros();
+  uint16_t changed = previous ^ current;
+  for (uint8_t valve = 0; valve < SETTINGS_MAX_PLANTS; valve++) {
+    if (changed & (1 << valve)) {
+      rigState.valveOpen[valve] = (current & (1 << valve)) ? SEASON_CLOSED : now;
+    }
+  }
+  if (changed & (1 << PUMP1_PIN)) {
+    rigState.pumpOn = (current & (1 << PUMP1_PIN)) ? SEASON_CLOSED : now;
+  }
+}
+
+static void wateringFinished(uint8_t valve, uint32_t unixTime, uint32_t millilitres, uint32_t duration, uint32_t elapsed) {
+  run.plants++;
+  run.measured += millilitres;
+  run.lastFinished = unixTime;
+  if (valve < SETTINGS_MAX_PLANTS) {
+    run.measuredByPlant[valve] += millilitres;
+  }
+}
+
+static void defaultSchedule(Settings* settings) {
+  const uint8_t weekdays[] = { 1, 8, 64 };
+  for (uint8_t i = 0; i < sizeof(weekdays); i++) {
+    settings->alarm[i][0] = { i, weekdays[i], 19, 30, 1 };
+    settings->alarm[i][1] = { i, weekdays[i], 19, 31, 1 };
+  }
+  for (uint8_t i = 0; i < SETTINGS_MAX_PLANTS; i++) {
+    settings->plant[i] = { i, (uint8_t)(i == 0 ? 10 : 18), 1 };
+  }
+}
+
+static bool loadSchedule(const char* path, Settings* settings) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    TRACE("Failed to open %s\n", path);
+    return false;
+  }
+  String text = "";
+  char buffer[512];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer) - 1, file)) > 0) {
+    buffer[length] = '\0';
+    text += buffer;
+  }
+  fclose(file);
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, text);
+  if (error) {
+    TRACE("deserializeJson() failed: %s\n", error.c_str());
+    return false;
+  }
+  return saveAlarms(doc, settings->alarm) && savePlants(doc, settings->plant);
+}
+
+// Window bounds of an alarm on the day it fired
+static void alarmWindow(const Settings& settings, int id, const DateTime& day, uint32_t* opens, uint32_t* closes) {
+  *opens = *closes = day.unixtime();
+  for (uint8_t i = 0; i < SETTINGS_MAX_ALARMS; i++) {
+    if (settings.alarm[i][0].status == 1 && settings.alarm[i][0].id == id) {
+      *opens = DateTime(day.year(), day.month(), day.day(), settings.alarm[i][0].hour, settings.alarm[i][0].minute, 0).unixtime();
+      *closes = DateTime(day.year(), day.month(), day.day(), settings.alarm[i][1].hour, settings.alarm[i][1].minute, 0).unixtime();
+      return;
+    }
+  }
+}
+
+static bool option(const char* arg, const char* name, uint32_t* value) {
+  size_t length = strlen(name);
+  if (strncmp(arg, name, length) != 0) {
+    return false;
+  }
+  *value = strtoul(arg + length, NULL, 10);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  uint32_t days = SEASON_DAYS;
+  uint32_t start = SEASON_START_TIME;
+  const char* config = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--config=", 9) == 0) {
+      config = argv[i] + 9;
+    } else if (!option(argv[i], "--days=", &days) && !option(argv[i], "--start=", &start)
+      && !option(argv[i], "--loop-ms=", &rig.loopMs) && !option(argv[i], "--pump-ml-min=", &rig.pumpMlPerMinute)
+      && !option(argv[i], "--pump-ramp-ms=", &rig.pumpRampMs) && !option(argv[i], "--valve-ms=", &rig.valveMs)
+      && !option(argv[i], "--pulses-per-litre=", &rig.pulsesPerLitre)) {
+      TRACE("Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  NativeClock nativeClock = { fakeMillis, fakeDelay, fakeNow, fakeAdjust };
+  setNativeClock(nativeClock);
+  fakeClock.adjust(start);
+  rigState = {};
+  rigState.pumpOn = SEASON_CLOSED;
+  for (uint8_t valve = 0; valve < SETTINGS_MAX_PLANTS; valve++) {
+    rigState.valveOpen[valve] = SEASON_CLOSED;
+  }
+  fakeClock.setObserver(moveWater, NULL);
+  fakeExpander.setObserver(switchOutputs, NULL);
+
+  WateringHooks hooks = {};
+  hooks.finished = wateringFinished;
+  setWateringHooks(hooks);
+
+  Settings settings;
+  memset(&settings, 0, sizeof(Settings));
+  strncpy(settings.hostname, "season", HOSTNAME_MAX_LENGTH - 1);
+  settings.maxPlants = SETTINGS_MAX_PLANTS;
+  settings.hasRTC = true;
+  settings.hasEEPROM = true;
+  settings.hasMCP = true;
+  if (config != NULL ? !loadSchedule(config, &settings) : (defaultSchedule(&settings), false)) {
+    return 2;
+  }
+
+  double trueByPlant[SETTINGS_MAX_PLANTS] = {0};
+  uint32_t measuredByPlant[SETTINGS_MAX_PLANTS] = {0};
+  uint32_t runs = 0;
+  uint32_t late = 0;
+  clock_t wall = clock();
+  uint64_t end = fakeClock.micros() + (uint64_t)days * 86400 * 1000000;
+
+  TRACE("run,alarm,date,latency_s,watering_s,cycle_s,late_s,plants,true_ml,measured_ml,error_pct,pump_s,deadhead_s\n");
+  while (fakeClock.micros() < end) {
+    LoopAction action = nextLoopAction(settings, fakeClock.now(), false);
+    if (action == LOOP_START_WATERING) {
+      DateTime triggered(fakeClock.now());
+      int id = getActiveAlarmId(settings, triggered);
+      uint32_t opens, closes;
+      alarmWindow(settings, id, triggered, &opens, &closes);
+
+      RigState before = rigState;
+      run = {};
+      run.lastFinished = triggered.unixtime();
+      runAlarmCycle(&settings);
+
+      double delivered = 0;
+      for (uint8_t valve = 0; valve < SETTINGS_MAX_PLANTS; valve++) {
+        double millilitres = rigState.millilitres[valve] - before.millilitres[valve];
+        trueByPlant[valve] += millilitres;
+        measuredByPlant[valve] += run.measuredByPlant[valve];
+        delivered += millilitres;
+      }
+      int32_t overrun = (int32_t)(run.lastFinished - closes);
+      late += overrun > 0 ? 1 : 0;
+      TRACE("%u,%d,%04d-%02d-%02dT%02d:%02d:%02d,%u,%u,%u,%d,%u,%.1f,%u,%.2f,%.1f,%.1f\n",
+        ++runs, id, triggered.year(), triggered.month(), triggered.day(), triggered.hour(), triggered.minute(), triggered.second(),
+        (unsigned int)(triggered.unixtime() - opens), (unsigned int)(run.lastFinished - triggered.unixtime()),
+        (unsigned int)(fakeClock.now() - triggered.unixtime()), overrun > 0 ? overrun : 0, run.plants,
+        delivered, run.measured, delivered > 0 ? (run.measured - delivered) * 100 / delivered : 0.0,
+        (rigState.pumpMicros - before.pumpMicros) / 1e6, (rigState.deadheadMicros - before.deadheadMicros) / 1e6);
+    }
+    fakeClock.delay(rig.loopMs);
+  }
+
+  double trueTotal = 0;
+  uint32_t measuredTotal = 0;
+  for (uint8_t valve = 0; valve < SETTINGS_MAX_PLANTS; valve++) {
+    TRACE("# plant %u true_ml: %.1f measured_ml: %u\n", valve, trueByPlant[valve], measuredByPlant[valve]);
+    trueTotal += trueByPlant[valve];
+    measuredTotal += measuredByPlant[valve];
+  }
+  TRACE("# days: %u runs: %u late: %u true_ml: %.1f measured_ml: %u pump_s: %.1f deadhead_s: %.1f\n",
+    days, runs, late, trueTotal, measuredTotal, rigState.pumpMicros / 1e6, rigState.deadheadMicros / 1e6);
+  TRACE("# store commits: %u host_s: %.2f\n",
+    fakeStore.commitCount(), (double)(clock() - wall) / CLOCKS_PER_SEC);
+  return runs > 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file         : responsecache.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "responsecache.h"
+#include "settings.h"
+
+// Only the web server task reads the cache
+static CachedResponse cachedResponses[CACHE_ENDPOINTS];
+static const Settings* cachedSettings = NULL;
+
+// FNV-1a, the ETag follows the content so it stays valid across reboots
+static uint32_t hashBytes(const uint8_t* data, size_t length) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+void setCachedSettings(const Settings* settings) {
+  cachedSettings = settings;
+}
+
+const CachedResponse& getCachedResponse(CachedEndpoint endpoint, CachedSerializer serializer) {
+  CachedResponse& response = cachedResponses[endpoint];
+  String body;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &body);
+  {
+    // Keyed on the settings content, so edits that never reach saveSettings() invalidate it too.
+    // Settings are serialized into memory only, the response is sent after the lock is released
+    SettingsLock lock;
+    uint32_t fingerprint = cachedSettings != NULL ? hashBytes((const uint8_t*)cachedSettings, sizeof(Settings)) : 0;
+    if (cachedSettings != NULL && response.valid && response.fingerprint == fingerprint) {
+      return response;
+    }
+    serializer(json);
+    response.fingerprint = fingerprint;
+  }
+  json.flush();
+
+  response.body = body;
+  response.valid = true;
+  snprintf(response.etag, sizeof(response.etag), "\"%08lx\"", (unsigned long)hashBytes((const uint8_t*)response.body.c_str(), response.body.length()));
+  return response;
+}
+
+bool cachedResponseMatches(const char* etag, const String& ifNoneMatch) {
+  if (ifNoneMatch.isEmpty()) {
+    return false;
+  }
+  if (ifNoneMatch == "*") {
+    return true;
+  }
+  // The header may carry a list of tags, weak ones compare equal for GET
+  return ifNoneMatch.indexOf(etag) >= 0;
+}
+
+
+bool entityTagMatches(const char* etag, const String& ifMatch) {
+  int start = 0;
+  while (start < (int)ifMatch.length()) {
+    int end = ifMatch.indexOf(',', start);
+    if (end < 0) {
+      end = ifMatch.length();
+    }
+    String tag = ifMatch.substring(start, end);
+    tag.trim();
+    if (tag == "*" || tag == etag) {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file         : responsecache.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include "jsonwriter.h"
+
+#define RESPONSE_CACHE_ETAG_LENGTH        12      /* Quoted 8 digit hex hash plus terminator */
+
+enum CachedEndpoint {
+  CACHE_ALARMS = 0,
+  CACHE_PLANTS,
+  CACHE_SETTINGS,
+  CACHE_ENDPOINTS
+};
+
+/**
+ * Serialized body of a read mostly endpoint, valid while the settings it
+ * was built from hash to the same fingerprint.
+ */
+struct CachedResponse {
+  uint32_t fingerprint;
+  bool valid;
+  char etag[RESPONSE_CACHE_ETAG_LENGTH];
+  String body;
+};
+
+typedef void (*CachedSerializer)(JsonWriter& json);
+
+struct Settings;
+// The settings the serializers read, without them nothing is cached
+void setCachedSettings(const Settings* settings);
+
+const CachedResponse& getCachedResponse(CachedEndpoint endpoint, CachedSerializer serializer);
+bool cachedResponseMatches(const char* etag, const String& ifNoneMatch);
+// If-Match uses the strong comparison, weak tags never match
+bool entityTagMatches(const char* etag, const String& ifMatch);
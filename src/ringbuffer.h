@@ -0,0 +1,124 @@
+/**
+ * @file         : ringbuffer.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * Bounded lock-free multi producer / multi consumer queue of fixed size items.
+ * Every slot carries a sequence number so producers and consumers only
+ * contend on their own cursor, push and pop never block and fail instead
+ * when the queue is full or empty. The capacity must be a power of two.
+ */
+template <typename T, uint32_t N>
+class RingBuffer {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+public:
+  RingBuffer() : enqueuePosition(0), dequeuePosition(0) {
+    for (uint32_t i = 0; i < N; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(const T& item) {
+    Cell* cell;
+    uint32_t position = enqueuePosition.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells[position & (N - 1)];
+      uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(sequence - position);
+      if (diff == 0) {
+        if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // Full
+        return false;
+      } else {
+        position = enqueuePosition.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = item;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item) {
+    Cell* cell;
+    uint32_t position = dequeuePosition.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells[position & (N - 1)];
+      uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(sequence - (position + 1));
+      if (diff == 0) {
+        if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // Empty
+        return false;
+      } else {
+        position = dequeuePosition.load(std::memory_order_relaxed);
+      }
+    }
+    item = cell->data;
+    cell->sequence.store(position + N, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate amount of queued items, exact when producers and consumers are idle
+  uint32_t size() const {
+    uint32_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+    uint32_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+    return enqueued - dequeued;
+  }
+
+  uint32_t capacity() const {
+    return N;
+  }
+
+private:
+  struct Cell {
+    std::atomic<uint32_t> sequence;
+    T data;
+  };
+
+  Cell cells[N];
+  std::atomic<uint32_t> enqueuePosition;
+  std::atomic<uint32_t> dequeuePosition;
+};
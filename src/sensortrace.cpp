@@ -0,0 +1,258 @@
+/**
+ * @file         : sensortrace.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "sensortrace.h"
+#include <stdio.h>
+#include <string.h>
+#include "flowcodec.h"
+#include "settings.h"
+#include "hal.h"
+
+static_assert(SENSOR_TRACE_PLANTS == SETTINGS_MAX_PLANTS, "Sensor traces carry one size per plant");
+
+std::atomic<bool> sensorCapturing(false);
+static std::atomic<bool> captureEnabled(false);
+static RingBuffer<SensorEvent, SENSOR_TRACE_QUEUE_LENGTH> captureQueue;
+static std::atomic<uint32_t> capturedEvents(0);
+static std::atomic<uint32_t> droppedEvents(0);
+static std::atomic<uint32_t> captureSessions(0);
+
+// Written by beginSensorCapture() before the start event is queued, read by the writer when it pops it
+static SensorTraceHeader pendingHeader;
+
+// Writer side, only touched by the task draining the queue
+static char capturePath[40];
+static bool captureOpen = false;
+static uint32_t previousMicros = 0;
+static uint32_t reportedDrops = 0;
+static uint32_t writtenBytes = 0;
+
+void setSensorCaptureEnabled(bool enabled) {
+  captureEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool isSensorCaptureEnabled() {
+  return captureEnabled.load(std::memory_order_relaxed);
+}
+
+bool beginSensorCapture(uint32_t unixTime, uint32_t micros, uint16_t calibration, const uint8_t sizes[SENSOR_TRACE_PLANTS]) {
+  if (!isSensorCaptureEnabled() || sensorCapturing.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  memset(&pendingHeader, 0, sizeof(SensorTraceHeader));
+  pendingHeader.magic = SENSOR_TRACE_MAGIC;
+  pendingHeader.version = SENSOR_TRACE_VERSION;
+  pendingHeader.plantCount = SENSOR_TRACE_PLANTS;
+  pendingHeader.startTime = unixTime;
+  pendingHeader.startMicros = micros;
+  pendingHeader.calibration = calibration;
+  memcpy(pendingHeader.sizes, sizes, SENSOR_TRACE_PLANTS);
+  SensorEvent event = { micros, unixTime, SENSOR_EVENT_START };
+  if (!captureQueue.push(event)) {
+    droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  captureSessions.fetch_add(1, std::memory_order_relaxed);
+  sensorCapturing.store(true, std::memory_order_release);
+  return true;
+}
+
+void endSensorCapture(uint32_t micros) {
+  if (!sensorCapturing.exchange(false, std::memory_order_acq_rel)) {
+    return;
+  }
+  // The writer closes the file on this one, retry rather than leave the session open
+  SensorEvent event = { micros, 0, SENSOR_EVENT_STOP };
+  while (!captureQueue.push(event)) {
+    hal.clock->delay(1);
+  }
+}
+
+void captureSensorEvent(SensorEventType type, uint32_t micros, uint32_t value) {
+  if (!sensorCapturing.load(std::memory_order_acquire)) {
+    return;
+  }
+  SensorEvent event = { micros, value, type };
+  if (captureQueue.push(event)) {
+    capturedEvents.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    droppedEvents.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool hasSensorCapturePending() {
+  return captureQueue.size() > 0;
+}
+
+SensorCaptureStats getSensorCaptureStats() {
+  SensorCaptureStats stats;
+  stats.enabled = isSensorCaptureEnabled();
+  stats.capturing = sensorCapturing.load(std::memory_order_relaxed);
+  stats.sessions = captureSessions.load(std::memory_order_relaxed);
+  stats.events = capturedEvents.load(std::memory_order_relaxed);
+  stats.dropped = droppedEvents.load(std::memory_order_relaxed);
+  stats.bytes = writtenBytes;
+  return stats;
+}
+
+static bool appendCapture(const uint8_t* data, size_t length) {
+  if (length == 0) {
+    return true;
+  }
+  File file = hal.files->open(capturePath, FILE_APPEND);
+  if (!file) {
+    TRACE("Failed to open %s\n", capturePath);
+    return false;
+  }
+  size_t written = file.write(data, length);
+  file.close();
+  writtenBytes += written;
+  return written == length;
+}
+
+static bool openCapture(const char* folder, uint32_t unixTime) {
+  if (!createDirectoryIfNotExists(folder)) {
+    TRACE("Failed to create %s\n", folder);
+    return false;
+  }
+  snprintf(capturePath, sizeof(capturePath), "%s/%lu.sgt", folder, (unsigned long)unixTime);
+  if (hal.files->exists(capturePath)) {
+    hal.files->remove(capturePath);
+  }
+  previousMicros = pendingHeader.startMicros;
+  return appendCapture((const uint8_t*)&pendingHeader, sizeof(SensorTraceHeader));
+}
+
+static size_t encodeRecord(uint8_t* buffer, uint8_t type, uint32_t micros, uint32_t value) {
+  uint32_t delta = micros - previousMicros;
+  if ((int32_t)delta < 0) {
+    // Producers on the other core can land slightly out of order
+    delta = 0;
+  } else {
+    previousMicros = micros;
+  }
+  size_t length = 0;
+  if (delta >= (1UL << SENSOR_TRACE_DELTA_BITS)) {
+    length += writeVarint(buffer, SENSOR_EVENT_GAP);
+    length += writeVarint(buffer + length, delta);
+    delta = 0;
+  }
+  length += writeVarint(buffer + length, (delta << 3) | type);
+  if (type != SENSOR_EVENT_EDGE) {
+    length += writeVarint(buffer + length, value);
+  }
+  return length;
+}
+
+/**
+ * Moves the queued events into the capture file, runs on the logger task so
+ * the SD card is only ever written from one place.
+ */
+size_t drainSensorCapture(const char* folder) {
+  uint8_t buffer[SENSOR_TRACE_WRITE_SIZE];
+  size_t length = 0;
+  size_t total = 0;
+  SensorEvent event;
+  while (captureQueue.pop(event)) {
+    if (length + 4 * FLOW_VARINT_MAX_SIZE > sizeof(buffer) || event.type == SENSOR_EVENT_START || event.type == SENSOR_EVENT_STOP) {
+      if (captureOpen && !appendCapture(buffer, length)) {
+        captureOpen = false;
+      }
+      total += length;
+      length = 0;
+    }
+    if (event.type == SENSOR_EVENT_START) {
+      captureOpen = openCapture(folder, event.value);
+    } else if (event.type == SENSOR_EVENT_STOP) {
+      captureOpen = false;
+    } else if (captureOpen) {
+      length += encodeRecord(buffer + length, event.type, event.micros, event.value);
+    }
+  }
+  uint32_t dropped = droppedEvents.load(std::memory_order_relaxed);
+  if (captureOpen && dropped != reportedDrops) {
+    length += encodeRecord(buffer + length, SENSOR_EVENT_DROPPED, previousMicros, dropped - reportedDrops);
+    reportedDrops = dropped;
+  }
+  if (captureOpen && !appendCapture(buffer, length)) {
+    captureOpen = false;
+  }
+  return total + length;
+}
+
+bool SensorTraceReader::begin(const uint8_t* traceData, size_t traceSize) {
+  if (traceSize < sizeof(SensorTraceHeader)) {
+    return false;
+  }
+  memcpy(&header, traceData, sizeof(SensorTraceHeader));
+  if (header.magic != SENSOR_TRACE_MAGIC || header.version != SENSOR_TRACE_VERSION) {
+    return false;
+  }
+  data = traceData;
+  size = traceSize;
+  position = sizeof(SensorTraceHeader);
+  time = 0;
+  return true;
+}
+
+bool SensorTraceReader::next(SensorTraceRecord* record) {
+  while (position < size) {
+    uint32_t word;
+    size_t used = readVarint(data + position, size - position, &word);
+    if (used == 0) {
+      return false;
+    }
+    position += used;
+    uint8_t type = word & 0x07;
+    time += word >> 3;
+    uint32_t value = 0;
+    if (type != SENSOR_EVENT_EDGE) {
+      used = readVarint(data + position, size - position, &value);
+      if (used == 0) {
+        return false;
+      }
+      position += used;
+    }
+    if (type == SENSOR_EVENT_GAP) {
+      time += value;
+      continue;
+    }
+    record->micros = time;
+    record->value = value;
+    record->type = type;
+    return true;
+  }
+  return false;
+}
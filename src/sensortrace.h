@@ -0,0 +1,132 @@
+/**
+ * @file         : sensortrace.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "ringbuffer.h"
+
+#define SENSOR_TRACE_MAGIC                0x5453  /* "ST" */
+#define SENSOR_TRACE_VERSION              1
+#define SENSOR_TRACE_FOLDER               "/traces"
+#define SENSOR_TRACE_PLANTS               11      /* SETTINGS_MAX_PLANTS */
+#define SENSOR_TRACE_QUEUE_LENGTH         1024    /* Events between the interrupt and the writer, a few logger periods of pulses (power of two) */
+#define SENSOR_TRACE_WRITE_SIZE           512     /* Encoded bytes staged per SD append */
+#define SENSOR_TRACE_DELTA_BITS           29      /* Microseconds a record header can carry, longer pauses get a gap record */
+
+/**
+ * Raw sensor capture. Records are a varint header of (delta << 3 | type),
+ * delta in microseconds since the previous record, followed by a varint
+ * value for every type but edges. A flow meter edge takes 2 to 3 bytes.
+ */
+enum SensorEventType : uint8_t {
+  SENSOR_EVENT_EDGE = 0,                  // Flow meter pulse
+  SENSOR_EVENT_PIN = 1,                   // Expander pin write, value is pin << 1 | level
+  SENSOR_EVENT_PORT = 2,                  // Expander port write, value is the 16 outputs
+  SENSOR_EVENT_RESULT = 3,                // Millilitres the firmware measured for the plant that just finished
+  SENSOR_EVENT_GAP = 4,                   // Value is a delta too long for the header
+  SENSOR_EVENT_DROPPED = 5,               // Value is the amount of events lost to a full queue
+  SENSOR_EVENT_START = 6,                 // Queue only, opens a capture file
+  SENSOR_EVENT_STOP = 7                   // Queue only, closes it
+};
+
+struct SensorTraceHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t plantCount;
+  uint32_t startTime;                     // Unix time of the capture start
+  uint32_t startMicros;                   // Reference for the first delta
+  uint16_t calibration;                   // FLOW_CALIBRATION_FACTOR of the capturing firmware
+  uint8_t sizes[SENSOR_TRACE_PLANTS];     // Pot size per plant, 0 when disabled
+  uint8_t reserved;
+} __attribute__((packed));
+
+struct SensorEvent {
+  uint32_t micros;
+  uint32_t value;
+  uint8_t type;
+};
+
+// Decoded record, time is relative to the capture start
+struct SensorTraceRecord {
+  uint64_t micros;
+  uint32_t value;
+  uint8_t type;
+};
+
+struct SensorCaptureStats {
+  bool enabled;
+  bool capturing;
+  uint32_t sessions;
+  uint32_t events;
+  uint32_t dropped;
+  uint32_t bytes;
+};
+
+/**
+ * Capture, producers are safe to call from the flow meter interrupt. A
+ * session runs from beginSensorCapture() to endSensorCapture() and the
+ * logger task drains the queue into one file per session.
+ */
+void setSensorCaptureEnabled(bool enabled);
+bool isSensorCaptureEnabled();
+bool beginSensorCapture(uint32_t unixTime, uint32_t micros, uint16_t calibration, const uint8_t sizes[SENSOR_TRACE_PLANTS]);
+void endSensorCapture(uint32_t micros);
+void captureSensorEvent(SensorEventType type, uint32_t micros, uint32_t value = 0);
+bool hasSensorCapturePending();
+size_t drainSensorCapture(const char* folder = SENSOR_TRACE_FOLDER);
+SensorCaptureStats getSensorCaptureStats();
+
+// Cheap enough for the interrupt, the producers check it before taking a timestamp
+extern std::atomic<bool> sensorCapturing;
+
+/**
+ * Decoder over a whole capture file
+ */
+class SensorTraceReader {
+public:
+  SensorTraceReader() : data(NULL), size(0), position(0), time(0) {}
+  bool begin(const uint8_t* data, size_t size);
+  bool next(SensorTraceRecord* record);
+  const SensorTraceHeader& traceHeader() const { return header; }
+
+private:
+  SensorTraceHeader header;
+  const uint8_t* data;
+  size_t size;
+  size_t position;
+  uint64_t time;
+};
@@ -34,21 +34,63 @@
  **/
 
 #include "settings.h"
+#include <Wire.h>
+#include <WiFi.h>
+#include "hal.h"
+#include "tracer.h"
 
-void saveSettings(Settings* settings) {
-  EEPROM.put(EEPROM_SETTINGS_ADDRESS, settings);
-  EEPROM.commit();
+// Counts saves, shown on the saveSettings trace events
+static volatile uint32_t settingsGeneration = 1;
+static SemaphoreHandle_t settingsMutex = NULL;
+
+// Time spent in the store commit, flash erase and write of the whole settings block
+MetricHistogram settingsCommitMetric(METRICS_LATENCY_BUCKETS, METRICS_MAX_BUCKETS);
+
+void beginSettings() {
+  if (settingsMutex == NULL) {
+    settingsMutex = xSemaphoreCreateRecursiveMutex();
+  }
+}
+
+SettingsLock::SettingsLock() {
+  if (settingsMutex != NULL) {
+    xSemaphoreTakeRecursive(settingsMutex, portMAX_DELAY);
+  }
+}
+
+SettingsLock::~SettingsLock() {
+  if (settingsMutex != NULL) {
+    xSemaphoreGiveRecursive(settingsMutex);
+  }
+}
+
+uint32_t saveSettings(Settings* settings) {
+  // Both cores save, put and commit of one save never interleave with another
+  SettingsLock lock;
+  TRACE_BEGIN(TRACE_CAT_STORAGE, TRACE_SETTINGS_SAVE, settingsGeneration, 0);
+  hal.store->put(EEPROM_SETTINGS_ADDRESS, *settings);
+  uint32_t start = metricsMicros();
+  hal.store->commit();
+  settingsCommitMetric.observe(metricsMicros() - start);
+  TRACE_END(TRACE_CAT_STORAGE, TRACE_SETTINGS_SAVE, settingsGeneration + 1, 0);
+  return ++settingsGeneration;
+}
+
+uint32_t touchSettings(Settings* settings, uint32_t unixTime) {
+  // Two edits within a second, or a clock set back, still get distinct versions
+  settings->updatedOn = unixTime > settings->updatedOn ? unixTime : settings->updatedOn + 1;
+  return settings->updatedOn;
 }
 
 void readSettings(Settings* settings) {
-  EEPROM.get(EEPROM_SETTINGS_ADDRESS, settings);
+  hal.store->get(EEPROM_SETTINGS_ADDRESS, *settings);
 }
 
 void printI2cDevices(byte* devices) {
   byte error, address;
   int nDevices;
  
-  TRACE("Scanning...\n");
+  TRACE_BEGIN(TRACE_CAT_I2C, TRACE_I2C_SCAN, 0, 0);
  
   nDevices = 0;
   for(address = 1; address < 127; address++ )
@@ -61,57 +103,50 @@ void printI2cDevices(byte* devices) {
  
     if (error == 0)
     {
-      TRACE("I2C device found at address 0x");
+      TRACE_INSTANT(TRACE_CAT_I2C, TRACE_I2C_DEVICE, address, error);
       if (devices != NULL) {
         devices[nDevices] = address;
       }
-      if (address<16)
-        TRACE("0");
-      PRINT(address, HEX);
-      TRACE("  !\n");
       nDevices++;
     }
     else if (error==4)
     {
-      TRACE("Unknown error at address 0x");
-      if (address < 16)
-        TRACE("0");
-      PRINTLN(address, HEX);
+      TRACE_INSTANT(TRACE_CAT_I2C, TRACE_I2C_DEVICE, address, error);
     }    
   }
-  if (nDevices == 0)
-    TRACE("No I2C devices found\n");
-  else
-    TRACE("done\n");
+  TRACE_END(TRACE_CAT_I2C, TRACE_I2C_SCAN, nDevices, 0);
+  // One line instead of one per address, the addresses are in the trace
+  TRACE("I2C devices found: %d\n", nDevices);
 }
 
-String getAlarms(Settings settings) {
-  String result = "[";
+void stringSink(const char* data, size_t length, void* context) {
+  ((String*)context)->concat(data, length);
+}
 
+void writeAlarms(JsonWriter& json, const Settings& settings) {
+  json.beginArray();
   for (int i = 0; i < SETTINGS_MAX_ALARMS; i++) {
-    result += "[";
+    json.beginArray();
     for (int j = 0; j < SETTINGS_ALARM_STATES; j++) {
-      result += "{";
-      
-        result += "  \"id\": " + String(settings.alarm[i][j].id) + ",\n";
-        result += "  \"weekday\": " + String(settings.alarm[i][j].weekday) + ",\n";
-        result += "  \"hour\": " + String(settings.alarm[i][j].hour) + ",\n";
-        result += "  \"minute\": " + String(settings.alarm[i][j].minute) + ",\n";
-        result += "  \"status\": " + String(settings.alarm[i][j].status) + "\n";
-
-      result += "}";
-      if (j < SETTINGS_ALARM_STATES - 1) {
-        result += ",";
-      }
-    }
-    result += "]";
-    if (i < SETTINGS_MAX_ALARMS - 1) {
-      result += ",";
+      json.beginObject();
+      json.field("id", settings.alarm[i][j].id);
+      json.field("weekday", settings.alarm[i][j].weekday);
+      json.field("hour", settings.alarm[i][j].hour);
+      json.field("minute", settings.alarm[i][j].minute);
+      json.field("status", settings.alarm[i][j].status);
+      json.endObject();
     }
+    json.endArray();
   }
+  json.endArray();
+}
 
-  result += "]";
-
+String getAlarms(Settings settings) {
+  String result;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &result);
+  writeAlarms(json, settings);
+  json.flush();
   return result;
 }
 
@@ -129,20 +164,24 @@ uint32_t getTotalWateringTime(Settings settings) {
   return result;
 }
 
-String getPlants(Settings settings) {
-  String result = "[";
-
+void writePlants(JsonWriter& json, const Settings& settings) {
+  json.beginArray();
   for (int i = 0; i < SETTINGS_MAX_PLANTS; i++) {
-      result += "{";
-      result += "  \"id\": " + String(settings.plant[i].id) + ",\n";
-      result += "  \"size\": " + String(settings.plant[i].size) + ",\n";
-      result += "  \"status\": " + String(settings.plant[i].status) + "\n";
-      result += "}";
-    if (i < SETTINGS_MAX_PLANTS - 1) {
-      result += ",";
-    }
+    json.beginObject();
+    json.field("id", settings.plant[i].id);
+    json.field("size", settings.plant[i].size);
+    json.field("status", settings.plant[i].status);
+    json.endObject();
   }
-  result += "]";
+  json.endArray();
+}
+
+String getPlants(Settings settings) {
+  String result;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &result);
+  writePlants(json, settings);
+  json.flush();
   return result;
 }
 
@@ -171,48 +210,19 @@ bool initSDCard() {
   }
   uint64_t cardSize = SD.cardSize() / (1024 * 1024);
   uint64_t freeSize = cardSize - (SD.usedBytes() / (1024 * 1024));
-  TRACE("SD Card Size: %lluMB\n", cardSize);
-  TRACE("SD Free Size: %lluMB\n", freeSize);
+  TRACE("SD Card Size: %lluMB\n", (unsigned long long)cardSize);
+  TRACE("SD Free Size: %lluMB\n", (unsigned long long)freeSize);
   return true;
 }
 
-String listDirectory(const char* directory, unsigned long from, unsigned long to) {
-  String fileList = "[";
-
-  File root = SD.open(directory);
-  if (root) {
-    int count = 0;
-    while (true) {
-      File entry = root.openNextFile();
-      if (!entry || count >= 1000) {
-        break;
-      }
-      String fileName = entry.name();
-      if (fileName.startsWith("log-") && fileName.endsWith(".csv")) {
-        int timestamp = fileName.substring(4, fileName.length() - 4).toInt();
-        if (timestamp >= from && timestamp <= to) {
-          if (fileList != "[") {
-            fileList += ",";
-          }
-          fileList += "\"" + fileName + "\"";
-          count++;
-        }
-      }
-      entry.close();
-    }
-    root.close();
-  } else {
-    TRACE("Failed to open directory\n");
-  }
-
-  fileList += "]";
-  return fileList;
+String listDirectory(const char* directory, uint32_t from, uint32_t to, unsigned long offset, unsigned long limit) {
+  return logIndexQuery(directory, from, to, offset, limit);
 }
 
 String listDirectory2(const char* directory) {
   String fileList = "[";
 
-  File root = SD.open(directory);
+  File root = hal.files->open(directory);
   if (root) {
     while (true) {
       File entry = root.openNextFile();
@@ -234,37 +244,44 @@ String listDirectory2(const char* directory) {
   return fileList;
 }
 
-String listLogFiles(const char* directory, int from, int to) {
-  String fileList = "[";
-
-  File root = SD.open(directory);
-  if (root) {
-    int count = 0;
-    while (true) {
-      File entry = root.openNextFile();
-      if (!entry || count >= 1000) {
-        break;
-      }
-      String fileName = entry.name();
-      if (fileName.startsWith("log-") && fileName.endsWith(".csv")) {
-        int timestamp = fileName.substring(4, fileName.length() - 4).toInt();
-        if (timestamp >= from && timestamp <= to) {
-          if (fileList != "[") {
-            fileList += ",";
-          }
-          fileList += "\"" + fileName + "\"";
-          count++;
-        }
-      }
-      entry.close();
+void writeFlowHistory(JsonWriter& json, const FlowHistory& history, uint32_t from, uint32_t to, uint32_t resolution) {
+  FlowBucket points[32];
+  uint32_t usedResolution = resolution;
+  size_t total = 0;
+
+  json.beginObject();
+  json.key("points").beginArray();
+  // Walk the range in small chunks to keep the stack usage flat. The tier picked
+  // for the first chunk is kept, later chunks would otherwise pick a finer one
+  // as from moves forward and mix resolutions in one response
+  while (from <= to && total < FLOW_HISTORY_MAX_POINTS) {
+    size_t chunk = FLOW_HISTORY_MAX_POINTS - total < 32 ? FLOW_HISTORY_MAX_POINTS - total : 32;
+    size_t count = history.query(from, to, total == 0 ? resolution : usedResolution, points, chunk, &usedResolution);
+    for (size_t i = 0; i < count; i++) {
+      json.beginArray().value(points[i].start).value(points[i].millilitres).value(points[i].peak).endArray();
+      total++;
     }
-    root.close();
-  } else {
-    TRACE("Failed to open directory\n");
+    if (count < chunk) {
+      break;
+    }
+    from = points[count - 1].start + usedResolution;
   }
+  json.endArray();
+  json.field("resolution", usedResolution);
+  json.endObject();
+}
 
-  fileList += "]";
-  return fileList;
+String getFlowHistory(const FlowHistory& history, uint32_t from, uint32_t to, uint32_t resolution) {
+  String result;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &result);
+  writeFlowHistory(json, history, from, to, resolution);
+  json.flush();
+  return result;
+}
+
+String listLogFiles(const char* directory, int from, int to) {
+  return logIndexQuery(directory, from, to, 0, LOG_INDEX_PAGE_SIZE);
 }
 
 
@@ -272,31 +289,152 @@ bool saveLog(DateTime now, String name, int id, int milliliters, int duration, c
   if(!initSDCard()) {
     return false;
   }
-  if (!createDirectoryIfNotExists(destinationFolder)) {
+  return writeLog(now, name, id, milliliters, duration, destinationFolder);
+}
+
+bool writeLog(DateTime now, String name, int id, int milliliters, int duration, const char* destinationFolder) {
+  TRACE_BEGIN(TRACE_CAT_STORAGE, TRACE_LOG_WRITE, id, milliliters);
+  uint32_t segment = logSegmentOf(now.unixtime());
+  if (!createSegmentDirectories(destinationFolder, segment)) {
+    TRACE("Failed to create log directories\n");
+    TRACE_END(TRACE_CAT_STORAGE, TRACE_LOG_WRITE, id, 0);
     return false;
   }
-  if (!SD.exists(destinationFolder)) {
-    TRACE("Creating directory: %s\n", destinationFolder);
-    SD.mkdir(destinationFolder);
-  }
-  String fileName = String(destinationFolder) + "/log-" + String(now.unixtime()) + ".csv";
-  File file = SD.open(fileName, FILE_WRITE);
+  String fileName = String(destinationFolder) + "/" + logSegmentName(segment);
+  File file = hal.files->open(fileName, FILE_APPEND);
   
   if (!file) {
     TRACE("Failed to open file for writing\n");
+    TRACE_END(TRACE_CAT_STORAGE, TRACE_LOG_WRITE, id, 0);
     return false;
   }
   
-  file.printf("%s,%s,%s,%s\n", "id", "name", "milliliters", "duration");
-  file.printf("%d,%s,%d,%d\n", id, name.c_str(), milliliters, duration);
+  LogIndexEntry entry;
+  memset(&entry, 0, sizeof(LogIndexEntry));
+  entry.timestamp = now.unixtime();
+  entry.segment = segment;
+  entry.plant = id;
+
+  // Offsets come from the byte counts, buffered append mode positions are not reliable
+  size_t offset = file.size();
+  if (offset == 0) {
+    offset += file.printf("%s,%s,%s,%s,%s\n", "timestamp", "id", "name", "milliliters", "duration");
+  }
+  entry.offset = offset;
+  entry.length = file.printf("%lu,%d,%s,%d,%d\n", (unsigned long)now.unixtime(), id, name.c_str(), milliliters, duration);
   
   file.close();
-  return true;
+  bool indexed = logIndexAppend(destinationFolder, entry);
+  TRACE_END(TRACE_CAT_STORAGE, TRACE_LOG_WRITE, id, milliliters);
+  return indexed;
+}
+
+bool writeFlowLog(const FlowBlock& block, const char* destinationFolder) {
+  FlowDecoder decoder;
+  uint32_t time;
+  int32_t value;
+  if (!decoder.begin(block.data, block.length) || !decoder.next(&time, &value)) {
+    TRACE("Invalid flow block\n");
+    return false;
+  }
+
+  LogIndexEntry entry;
+  memset(&entry, 0, sizeof(LogIndexEntry));
+  entry.timestamp = decoder.blockHeader().baseTime + time / 1000;
+  entry.segment = logSegmentOf(entry.timestamp);
+  entry.plant = decoder.blockHeader().plant;
+  entry.flags = LOG_ENTRY_FLOW;
+  entry.length = block.length;
+
+  if (!createSegmentDirectories(destinationFolder, entry.segment)) {
+    TRACE("Failed to create flow directories\n");
+    return false;
+  }
+  File file = hal.files->open(String(destinationFolder) + "/" + logSegmentName(entry.segment, LOG_ENTRY_FLOW), FILE_APPEND);
+  if (!file) {
+    TRACE("Failed to open file for writing\n");
+    return false;
+  }
+  entry.offset = file.size();
+  bool written = file.write(block.data, block.length) == block.length;
+  file.close();
+  return written && logIndexAppend(destinationFolder, entry);
+}
+
+struct FlowQuery {
+  JsonWriter* json;
+  const char* folder;
+  int plant;
+  uint32_t from;
+  uint32_t to;
+  unsigned long limit;
+  unsigned long samples;
+};
+
+static bool writeFlowSamples(const LogIndexEntry& entry, FlowQuery* query) {
+  if (!(entry.flags & LOG_ENTRY_FLOW) || (query->plant >= 0 && entry.plant != query->plant)) {
+    return true;
+  }
+
+  FlowBlock block;
+  char path[LOG_SEGMENT_PATH_LENGTH];
+  char name[LOG_SEGMENT_NAME_LENGTH];
+  formatLogSegmentName(name, sizeof(name), entry.segment, entry.flags);
+  snprintf(path, sizeof(path), "%s/%s", query->folder, name);
+  File file = hal.files->open(path);
+  if (!file || entry.length > FLOW_BLOCK_SIZE || !file.seek(entry.offset) || file.read(block.data, entry.length) != entry.length) {
+    file.close();
+    return true;
+  }
+  file.close();
+
+  FlowDecoder decoder;
+  if (!decoder.begin(block.data, entry.length)) {
+    return true;
+  }
+  uint32_t time;
+  int32_t value;
+  uint64_t baseMillis = (uint64_t)decoder.blockHeader().baseTime * 1000;
+  while (query->samples < query->limit && decoder.next(&time, &value)) {
+    uint32_t timestamp = decoder.blockHeader().baseTime + time / 1000;
+    if (timestamp < query->from || timestamp > query->to) {
+      continue;
+    }
+    query->json->beginArray().value((unsigned long long)(baseMillis + time)).value(entry.plant).value((long)value).endArray();
+    query->samples++;
+  }
+  return query->samples < query->limit;
+}
+
+void writeFlowLogQuery(JsonWriter& json, const char* folder, uint32_t from, uint32_t to, int plant, unsigned long limit) {
+  FlowQuery query;
+  LogIndexEntry entries[LOG_INDEX_READ_BATCH];
+  query.json = &json;
+  query.folder = folder;
+  query.plant = plant;
+  query.from = from;
+  query.to = to;
+  query.limit = limit > FLOW_QUERY_MAX_SAMPLES ? FLOW_QUERY_MAX_SAMPLES : limit;
+  query.samples = 0;
+  // Blocks are indexed by their first sample and hold at most FLOW_COLUMN_SIZE one
+  // second samples, look back one block span so a block straddling from is included
+  uint32_t first = from > FLOW_COLUMN_SIZE ? from - FLOW_COLUMN_SIZE : 0;
+  bool more = true;
+  json.beginArray();
+  // Blocks are read and sent with the index unlocked, it is only held while a batch is copied
+  for (unsigned long offset = 0; more; offset += LOG_INDEX_READ_BATCH) {
+    unsigned long count = logIndexRead(folder, first, to, offset, entries, LOG_INDEX_READ_BATCH);
+    for (unsigned long i = 0; more && i < count; i++) {
+      more = writeFlowSamples(entries[i], &query);
+    }
+    more = more && count == LOG_INDEX_READ_BATCH;
+  }
+  json.endArray();
 }
 
 bool createDirectoryIfNotExists(const char* path) {
-  if (!SD.exists(path)) {
-    if (SD.mkdir(path)) {
+  if (!hal.files->exists(path)) {
+    if (hal.files->mkdir(path)) {
       return true;
     } else {
       return false;
@@ -306,24 +444,7 @@ bool createDirectoryIfNotExists(const char* path) {
 }
 
 unsigned long getLogCount(const char* destinationFolder) {
-  File directory = SD.open(destinationFolder);
-  unsigned long fileCount = 0;
-
-  if (directory) {
-    while (true) {
-      File entry = directory.openNextFile();
-      if (!entry) {
-        break;
-      }
-      String fileName = entry.name();
-      if (fileName.startsWith("log-") && fileName.endsWith(".csv")) {
-        fileCount++;
-      }
-      entry.close();
-    }
-    directory.close();
-  }
-  return fileCount;
+  return logIndexSize(destinationFolder);
 }
 
 int getActiveAlarmId(Settings settings, DateTime now) {
@@ -456,7 +577,10 @@ bool isAlarmOn(Settings settings, DateTime now) {
 }
 
 bool saveAlarms(JsonDocument json, Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALARM_STATES]) {
-  JsonArray alarmArray = json["alarm"].as<JsonArray>();
+  return parseAlarms(json["alarm"].as<JsonArrayConst>(), alarm);
+}
+
+bool parseAlarms(JsonArrayConst alarmArray, Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALARM_STATES]) {
   int numAlarms = alarmArray.size();
   if (numAlarms > SETTINGS_MAX_ALARMS) {
     TRACE("Exceeded maximum number of alarms\n");
@@ -467,7 +591,7 @@ bool saveAlarms(JsonDocument json, Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALA
   memset(alarm, 0, sizeof(Alarm) * SETTINGS_MAX_ALARMS * SETTINGS_ALARM_STATES);
 
   for (int alarmIndex = 0; alarmIndex < numAlarms; alarmIndex++) {
-    JsonArray alarmData = alarmArray[alarmIndex].as<JsonArray>();
+    JsonArrayConst alarmData = alarmArray[alarmIndex].as<JsonArrayConst>();
     if (alarmData.size() != SETTINGS_ALARM_STATES) {
       TRACE("Invalid alarm format\n");
       return false;
@@ -475,7 +599,7 @@ bool saveAlarms(JsonDocument json, Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALA
 
     for (int i = 0; i < SETTINGS_ALARM_STATES; i++) {
       
-      JsonObject alarmSetting = alarmData[i].as<JsonObject>();
+      JsonObjectConst alarmSetting = alarmData[i].as<JsonObjectConst>();
 
       if (!alarmSetting.containsKey("weekday") || !alarmSetting.containsKey("hour") || !alarmSetting.containsKey("minute") || !alarmSetting.containsKey("status")) {
         TRACE("Invalid alarm format\n");
@@ -506,7 +630,10 @@ bool saveAlarms(JsonDocument json, Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALA
 }
 
 bool savePlants(JsonDocument json, Plant plants[SETTINGS_MAX_PLANTS]) {
-  JsonArray plantArray = json["plants"].as<JsonArray>();
+  return parsePlants(json["plants"].as<JsonArrayConst>(), plants);
+}
+
+bool parsePlants(JsonArrayConst plantArray, Plant plants[SETTINGS_MAX_PLANTS]) {
   int numPlant = plantArray.size();
   if (numPlant > SETTINGS_MAX_PLANTS) {
     TRACE("Exceeded maximum number of plants\n");
@@ -517,7 +644,7 @@ bool savePlants(JsonDocument json, Plant plants[SETTINGS_MAX_PLANTS]) {
   memset(plants, 0, sizeof(Plant) * SETTINGS_MAX_PLANTS);
 
   for (int plantIndex = 0; plantIndex < numPlant; plantIndex++) {
-    JsonObject plantData = plantArray[plantIndex].as<JsonObject>();
+    JsonObjectConst plantData = plantArray[plantIndex].as<JsonObjectConst>();
 
     // Validate that all required fields are present
     if (!plantData.containsKey("id") || !plantData.containsKey("size") || !plantData.containsKey("status")) {
@@ -545,7 +672,7 @@ bool savePlants(JsonDocument json, Plant plants[SETTINGS_MAX_PLANTS]) {
 }
 
 void beep(uint8_t times, unsigned long delay) {
-  TRACE("beeping times: %d delay: %d\n", times, delay);
+  TRACE_INSTANT(TRACE_CAT_SYSTEM, TRACE_BEEP, times, delay);
   pinMode(BUZZER_PIN, OUTPUT);
   for(uint8_t i = 0; i < times; i++) {
     digitalWrite(BUZZER_PIN, HIGH);
@@ -573,7 +700,7 @@ JsonDocument readConfig() {
     return doc;
   };
 
-  File configFile = SD.open("/config.json");
+  File configFile = hal.files->open("/config.json");
 
   if (!configFile) {
     TRACE("Failed to open config file\n");
@@ -597,30 +724,33 @@ JsonDocument readConfig() {
   return doc;
 }
 
-String scanWifiNetworks() {
+void writeWifiNetworks(JsonWriter& json) {
   int n = WiFi.scanNetworks();
-  String hotspots ="[\n";
+  json.beginArray();
   if (n == 0) {
     TRACE("No networks found.\n");
   } else {
-    // Allocate memory for SSID array
     TRACE("%d networks found: \n", n);
     for (int i = 0; i < n; ++i) {
       TRACE("%d: %s (%d dBm) %s\n", i + 1, WiFi.SSID(i).c_str(), WiFi.RSSI(i), (WiFi.encryptionType(i) == WIFI_AUTH_OPEN) ? "open" : "encrypted");
-      hotspots += "  {\n";
-      hotspots += "    \"ssid\": \"" + WiFi.SSID(i) + "\",\n";
-      hotspots += "    \"rssi\": " + String(WiFi.RSSI(i)) + ",\n";
-      hotspots += "    \"encryptionType\": " + String(WiFi.encryptionType(i)) + "\n";
-      if ((i + 1) < n) {
-        hotspots += "  },\n";
-      } else {
-        hotspots += "  }\n";
-      }
+      json.beginObject();
+      json.field("ssid", WiFi.SSID(i).c_str());
+      json.field("rssi", WiFi.RSSI(i));
+      json.field("encryptionType", (int)WiFi.encryptionType(i));
+      json.endObject();
       vTaskDelay(75 / portTICK_PERIOD_MS);
     }
   }
-  hotspots += "]";
-  return hotspots;
+  json.endArray();
+}
+
+String scanWifiNetworks() {
+  String result;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &result);
+  writeWifiNetworks(json);
+  json.flush();
+  return result;
 }
 
 const char* getResetReason() {
@@ -675,7 +805,7 @@ String uptimeStr() {
   unsigned long seconds = totalSeconds % 60;
 
   // Format the uptime as "hh:mm:ss"
-  char uptime[9]; // Buffer to hold the formatted string
+  char uptime[16]; // Hours grow past two digits after four days
   snprintf(uptime, sizeof(uptime), "%02lu:%02lu:%02lu", hours, minutes, seconds);
 
   return String(uptime);
@@ -685,9 +815,7 @@ String uptimeStr() {
 String addTimeInterval(uint32_t seconds, DateTime now) {
   // Add the total seconds to the current time
   time_t futureTime;
-  TRACE("unixtime: %lu\n", now.unixtime());
-  TRACE("seconds: %lu\n", seconds);
-  TRACE("FutureTimeSec: %lu\n", futureTime);
+  TRACE_INSTANT(TRACE_CAT_SCHEDULE, TRACE_TIME_INTERVAL, now.unixtime(), seconds);
 
   // If using NTP Time
   // tm timeinfo;
@@ -703,55 +831,169 @@ String addTimeInterval(uint32_t seconds, DateTime now) {
   // Convert to Unix time
   char buffer[20];
   strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&futureTime));
-  TRACE("FutureTime: %s\n", buffer);
 
   return String(buffer);
 }
 
-String settingsToJson(const Settings& settings) {
-  // Create a JSON document with an estimated size
-  JsonDocument doc;
+void writeSettings(JsonWriter& json, const Settings& settings) {
+  json.beginObject();
+  json.field("id", settings.id);
+  json.field("hostname", settings.hostname);
+  json.field("lastDateTimeSync", settings.lastDateTimeSync);
+  json.field("updatedOn", settings.updatedOn);
+  json.field("rebootOnWifiFail", settings.rebootOnWifiFail);
+  json.field("flowCalibrationFactor", settings.flowCalibrationFactor);
 
-  // Fill the JSON document
-  doc["id"] = settings.id;
-  doc["hostname"] = settings.hostname;
-  doc["lastDateTimeSync"] = settings.lastDateTimeSync;
-  doc["updatedOn"] = settings.updatedOn;
-  doc["rebootOnWifiFail"] = settings.rebootOnWifiFail;
-  doc["flowCalibrationFactor"] = settings.flowCalibrationFactor;
-  
-  JsonArray alarms = doc["alarms"].to<JsonArray>();
+  json.key("alarms").beginArray();
   for (uint8_t i = 0; i < SETTINGS_MAX_ALARMS; i++) {
-    JsonArray alarmStates = alarms.add<JsonArray>();
+    json.beginArray();
     for (uint8_t j = 0; j < SETTINGS_ALARM_STATES; j++) {
-      JsonObject alarmState = alarmStates.add<JsonObject>();
-      alarmState["weekday"] = settings.alarm[i][j].weekday;
-      alarmState["hour"] = settings.alarm[i][j].hour;
-      alarmState["minute"] = settings.alarm[i][j].minute;
-      alarmState["status"] = settings.alarm[i][j].status;
+      json.beginObject();
+      json.field("id", settings.alarm[i][j].id);
+      json.field("weekday", settings.alarm[i][j].weekday);
+      json.field("hour", settings.alarm[i][j].hour);
+      json.field("minute", settings.alarm[i][j].minute);
+      json.field("status", settings.alarm[i][j].status);
+      json.endObject();
     }
+    json.endArray();
   }
+  json.endArray();
 
-  doc["maxPlants"] = settings.maxPlants;
-  
-  JsonArray plants = doc["plants"].to<JsonArray>();
-  for (uint8_t i = 0; i < settings.maxPlants; i++) {
-    JsonObject plant = plants.add<JsonObject>();
-    plant["id"] = settings.plant[i].id;
-    plant["size"] = settings.plant[i].size;
-    plant["status"] = settings.plant[i].status;
+  json.field("maxPlants", settings.maxPlants);
+
+  json.key("plants").beginArray();
+  for (uint8_t i = 0; i < settings.maxPlants && i < SETTINGS_MAX_PLANTS; i++) {
+    json.beginObject();
+    json.field("id", settings.plant[i].id);
+    json.field("size", settings.plant[i].size);
+    json.field("status", settings.plant[i].status);
+    json.endObject();
   }
+  json.endArray();
 
-  doc["hasDisplay"] = settings.hasDisplay;
-  doc["hasRTC"] = settings.hasRTC;
-  doc["hasEEPROM"] = settings.hasEEPROM;
-  doc["hasMCP"] = settings.hasMCP;
+  json.field("hasDisplay", settings.hasDisplay);
+  json.field("hasRTC", settings.hasRTC);
+  json.field("hasEEPROM", settings.hasEEPROM);
+  json.field("hasMCP", settings.hasMCP);
+  json.endObject();
+}
+
+String settingsToJson(const Settings& settings) {
+  String result;
+  char buffer[JSON_WRITER_BUFFER_SIZE];
+  JsonWriter json(buffer, sizeof(buffer), stringSink, &result);
+  writeSettings(json, settings);
+  json.flush();
+  return result;
+}
+
+static bool patchUint8(JsonVariantConst value, const char* name, uint8_t min, uint8_t max, uint8_t* target, String* error) {
+  if (!value.is<uint8_t>() || value.as<uint8_t>() < min || value.as<uint8_t>() > max) {
+    *error = String(name) + " must be an integer between " + min + " and " + max;
+    return false;
+  }
+  *target = value.as<uint8_t>();
+  return true;
+}
+
+static bool patchBool(JsonVariantConst value, const char* name, bool* target, String* error) {
+  if (!value.is<bool>()) {
+    *error = String(name) + " must be a boolean";
+    return false;
+  }
+  *target = value.as<bool>();
+  return true;
+}
 
-  // Serialize the JSON document to a string
-  String jsonString;
-  serializeJson(doc, jsonString);
+static bool patchHostname(JsonVariantConst value, char hostname[HOSTNAME_MAX_LENGTH], String* error) {
+  const char* name = value.as<const char*>();
+  size_t length = name == NULL ? 0 : strlen(name);
+  if (!value.is<const char*>() || length == 0 || length >= HOSTNAME_MAX_LENGTH) {
+    *error = String("hostname must be a string of 1 to ") + (HOSTNAME_MAX_LENGTH - 1) + " characters";
+    return false;
+  }
+  // RFC 952 labels: letters, digits and hyphens, not starting or ending with a hyphen
+  for (size_t i = 0; i < length; i++) {
+    if (!isalnum((unsigned char)name[i]) && !(name[i] == '-' && i > 0 && i < length - 1)) {
+      *error = "hostname may only contain letters, digits and inner hyphens";
+      return false;
+    }
+  }
+  memset(hostname, 0, HOSTNAME_MAX_LENGTH);
+  memcpy(hostname, name, length);
+  return true;
+}
 
-  return jsonString;
+// Members maintained by the firmware, accepted only when they echo the current value
+static bool patchReadOnly(bool unchanged, const char* name, String* error) {
+  if (unchanged) {
+    return true;
+  }
+  *error = String(name) + " is read-only";
+  return false;
+}
+
+bool applySettingsPatch(JsonVariantConst patch, Settings* settings, String* error) {
+  if (!patch.is<JsonObjectConst>()) {
+    *error = "Patch must be a JSON object";
+    return false;
+  }
+
+  for (JsonPairConst member : patch.as<JsonObjectConst>()) {
+    const char* name = member.key().c_str();
+    JsonVariantConst value = member.value();
+    bool valid;
+
+    if (value.isNull()) {
+      *error = String(name) + " cannot be removed";
+      return false;
+    }
+
+    if (strcmp(name, "hostname") == 0) {
+      valid = patchHostname(value, settings->hostname, error);
+    } else if (strcmp(name, "id") == 0) {
+      valid = patchUint8(value, name, 0, UINT8_MAX, &settings->id, error);
+    } else if (strcmp(name, "rebootOnWifiFail") == 0) {
+      valid = patchBool(value, name, &settings->rebootOnWifiFail, error);
+    } else if (strcmp(name, "flowCalibrationFactor") == 0) {
+      valid = patchUint8(value, name, 1, UINT8_MAX, &settings->flowCalibrationFactor, error);
+    } else if (strcmp(name, "maxPlants") == 0) {
+      valid = patchUint8(value, name, 1, SETTINGS_MAX_PLANTS, &settings->maxPlants, error);
+    } else if (strcmp(name, "alarms") == 0 || strcmp(name, "alarm") == 0) {
+      // Arrays are replaced as a whole, as in RFC 7386
+      valid = value.is<JsonArrayConst>() && parseAlarms(value.as<JsonArrayConst>(), settings->alarm);
+      if (!valid) {
+        *error = String(name) + " must be an array of at most " + SETTINGS_MAX_ALARMS + " valid alarms";
+      }
+    } else if (strcmp(name, "plants") == 0) {
+      valid = value.is<JsonArrayConst>() && parsePlants(value.as<JsonArrayConst>(), settings->plant);
+      if (!valid) {
+        *error = String(name) + " must be an array of at most " + SETTINGS_MAX_PLANTS + " valid plants";
+      }
+    } else if (strcmp(name, "lastDateTimeSync") == 0) {
+      valid = patchReadOnly(value.is<uint32_t>() && value.as<uint32_t>() == settings->lastDateTimeSync, name, error);
+    } else if (strcmp(name, "updatedOn") == 0) {
+      valid = patchReadOnly(value.is<uint32_t>() && value.as<uint32_t>() == settings->updatedOn, name, error);
+    } else if (strcmp(name, "hasDisplay") == 0) {
+      valid = patchReadOnly(value.is<bool>() && value.as<bool>() == settings->hasDisplay, name, error);
+    } else if (strcmp(name, "hasRTC") == 0) {
+      valid = patchReadOnly(value.is<bool>() && value.as<bool>() == settings->hasRTC, name, error);
+    } else if (strcmp(name, "hasEEPROM") == 0) {
+      valid = patchReadOnly(value.is<bool>() && value.as<bool>() == settings->hasEEPROM, name, error);
+    } else if (strcmp(name, "hasMCP") == 0) {
+      valid = patchReadOnly(value.is<bool>() && value.as<bool>() == settings->hasMCP, name, error);
+    } else {
+      *error = String("Unknown setting ") + name;
+      valid = false;
+    }
+
+    if (!valid) {
+      TRACE("Rejected settings patch: %s\n", error->c_str());
+      return false;
+    }
+  }
+  return true;
 }
 
 bool setRTCFromISODate(String isoDate, RTC_DS3231 rtc) {
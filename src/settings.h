@@ -38,9 +38,13 @@
 #include <EEPROM.h>
 #include <SD.h>
 #include <Adafruit_MCP23X17.h>
-#include <WebServer.h>
 #include <ArduinoJson.h>
 #include "constants.h"
+#include "logindex.h"
+#include "flowcodec.h"
+#include "flowhistory.h"
+#include "jsonwriter.h"
+#include "metrics.h"
 
 #define EEPROM_SETTINGS_ADDRESS           0       /* Active plants (battery backed ram address) */
 #define HOSTNAME_MAX_LENGTH               64      /* Max hostname length */
@@ -48,6 +52,7 @@
 #define SETTINGS_ALARM_STATES             2       /* 2 states on and off */
 #define SETTINGS_MAX_PLANTS               11      /* Maximun amount of allowed plants & valves */
 #define SETTINGS_REBOOT_ON_WIFIFAIL       false   /* Reset if wifi fails 0 = false 1 = true */
+#define FLOW_QUERY_MAX_SAMPLES            2000    /* Max flow samples returned by a flow log query */
 
 struct Alarm {
   uint8_t id;
@@ -101,16 +106,48 @@ struct Config {
 };
 
 /**
- * Serialization functions
+ * Serialization functions, the write* variants stream into a JsonWriter
  */
+void stringSink(const char* data, size_t length, void* context);
+void writeAlarms(JsonWriter& json, const Settings& settings);
+void writePlants(JsonWriter& json, const Settings& settings);
+void writeSettings(JsonWriter& json, const Settings& settings);
+void writeWifiNetworks(JsonWriter& json);
+void writeFlowHistory(JsonWriter& json, const FlowHistory& history, uint32_t from, uint32_t to, uint32_t resolution);
 String getAlarms(Settings settings);
 String getPlants(Settings settings);
 String uptimeStr();
 String scanWifiNetworks();
 String addTimeInterval(uint32_t seconds, DateTime now);
 String settingsToJson(const Settings& settings);
-String listDirectory(const char* directory = "/logs", unsigned long from = 0, unsigned long to = 1024);
+String listDirectory(const char* directory = "/logs", uint32_t from = 0, uint32_t to = UINT32_MAX, unsigned long offset = 0, unsigned long limit = LOG_INDEX_PAGE_SIZE);
 String listDirectory2(const char* directory);
+String getFlowHistory(const FlowHistory& history, uint32_t from, uint32_t to, uint32_t resolution);
+
+/**
+ * Settings lock, both cores share the settings: the control core updates
+ * the task log and reads the schedule, the service core applies edits.
+ * Writers, the store commit and readers that need a consistent view hold
+ * it, never across a network write. No-op until beginSettings().
+ */
+void beginSettings();
+class SettingsLock {
+public:
+  SettingsLock();
+  ~SettingsLock();
+private:
+  SettingsLock(const SettingsLock&);
+  SettingsLock& operator=(const SettingsLock&);
+};
+
+/**
+ * Persistence, every save bumps the save count and returns the new one
+ */
+uint32_t saveSettings(Settings* settings);
+// Marks a user edit, updatedOn is the settings version and strictly increases across reboots
+uint32_t touchSettings(Settings* settings, uint32_t unixTime);
+extern MetricHistogram settingsCommitMetric;
+bool applySettingsPatch(JsonVariantConst patch, Settings* settings, String* error);
 
 /**
  * Debugging
@@ -123,6 +160,7 @@ const char* getResetReason();
  * Alarm functions
  */
 bool saveAlarms(JsonDocument json, Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALARM_STATES]);
+bool parseAlarms(JsonArrayConst alarmArray, Alarm alarm[SETTINGS_MAX_ALARMS][SETTINGS_ALARM_STATES]);
 int getActiveAlarmId(Settings settings, DateTime now);
 bool isAlarmOn(Settings settings, DateTime now);
 int getNextAlarmId(Settings settings, DateTime now);
@@ -134,6 +172,9 @@ bool initSDCard();
 JsonDocument readConfig();
 bool createDirectoryIfNotExists(const char* path);
 bool saveLog(DateTime now, String name, int id, int milliliters, int duration, const char* destinationFolder = "/logs");
+bool writeLog(DateTime now, String name, int id, int milliliters, int duration, const char* destinationFolder = "/logs");
+bool writeFlowLog(const FlowBlock& block, const char* destinationFolder = "/flow");
+void writeFlowLogQuery(JsonWriter& json, const char* folder, uint32_t from, uint32_t to, int plant = -1, unsigned long limit = FLOW_QUERY_MAX_SAMPLES);
 unsigned long getLogCount(const char* destinationFolder = "/logs");
 
 
@@ -143,6 +184,7 @@ void turnOnPin(Adafruit_MCP23X17 mcp, int pinNumber);
  * Plant functions
  */
 bool savePlants(JsonDocument json, Plant plants[SETTINGS_MAX_PLANTS]);
+bool parsePlants(JsonArrayConst plantArray, Plant plants[SETTINGS_MAX_PLANTS]);
 uint32_t calculateWateringDuration(uint8_t potSize);
 uint32_t getTotalWateringTime(Settings settings);
 
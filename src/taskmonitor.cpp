@@ -0,0 +1,181 @@
+/**
+ * @file         : taskmonitor.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "taskmonitor.h"
+#include <stdio.h>
+#if defined(ARDUINO)
+  #include <Arduino.h>
+  #include <esp_task_wdt.h>
+#endif
+#include "hal.h"
+#include "tracer.h"
+
+static TaskMonitor* monitors[TASK_MONITOR_MAX];
+static uint8_t monitorCount = 0;
+
+// Lock free maximum, the monitored task and a scrape may race on it
+static void raise(std::atomic<uint32_t>& value, uint32_t sample) {
+  uint32_t current = value.load(std::memory_order_relaxed);
+  while (sample > current && !value.compare_exchange_weak(current, sample, std::memory_order_relaxed)) {
+  }
+}
+
+TaskMonitor::TaskMonitor(const char* name, uint32_t budgetMs, bool watchdog)
+  : taskName(name), budgetMs(budgetMs), watchdog(watchdog), subscribed(false), lastPass(0), lastPeriod(0),
+    longestPeriod(0), worstLatency(0), worstJitter(0),
+    latency(METRICS_LATENCY_BUCKETS, METRICS_MAX_BUCKETS), jitter(METRICS_LATENCY_BUCKETS, METRICS_MAX_BUCKETS) {
+  snprintf(labels, sizeof(labels), "task=\"%s\"", name);
+}
+
+void TaskMonitor::attach() {
+  resetPeriod();
+#if defined(ARDUINO)
+  if (watchdog && !subscribed.load(std::memory_order_relaxed) && esp_task_wdt_add(NULL) == ESP_OK) {
+    subscribed.store(true, std::memory_order_relaxed);
+  }
+#endif
+}
+
+void TaskMonitor::detach() {
+#if defined(ARDUINO)
+  if (subscribed.exchange(false, std::memory_order_relaxed)) {
+    esp_task_wdt_delete(NULL);
+  }
+#endif
+  resetPeriod();
+}
+
+void TaskMonitor::beginPass() {
+  uint32_t now = metricsMicros();
+  uint32_t previous = lastPass.exchange(now, std::memory_order_relaxed);
+  passCount.add();
+  feed();
+  if (previous == 0) {
+    return;
+  }
+  uint32_t period = now - previous;
+  raise(longestPeriod, period);
+  if (period > budgetMs * 1000) {
+    overrunCount.add();
+    TRACE_INSTANT(TRACE_CAT_SCHEDULE, TRACE_TASK_OVERRUN, traceString(taskName), period / 1000);
+  }
+  uint32_t before = lastPeriod.exchange(period, std::memory_order_relaxed);
+  if (before != 0) {
+    uint32_t change = period > before ? period - before : before - period;
+    jitter.observe(change);
+    raise(worstJitter, change);
+  }
+}
+
+void TaskMonitor::resetPeriod() {
+  lastPass.store(0, std::memory_order_relaxed);
+  lastPeriod.store(0, std::memory_order_relaxed);
+}
+
+void TaskMonitor::delay(uint32_t ms) {
+  uint32_t start = metricsMicros();
+  hal.clock->delay(ms);
+  uint32_t elapsed = metricsMicros() - start;
+  // Tick rounding can wake a task slightly early, that is not latency
+  uint32_t late = elapsed > ms * 1000 ? elapsed - ms * 1000 : 0;
+  latency.observe(late);
+  raise(worstLatency, late);
+  feed();
+}
+
+void TaskMonitor::feed() {
+#if defined(ARDUINO)
+  if (subscribed.load(std::memory_order_relaxed)) {
+    esp_task_wdt_reset();
+  }
+#endif
+}
+
+void registerTaskMonitors(TaskMonitor** taskMonitors, uint8_t count) {
+#if defined(ARDUINO)
+  // Reconfigures the watchdog the core already started, a missed feed reboots
+  esp_task_wdt_init(TASK_MONITOR_WDT_TIMEOUT_S, true);
+#endif
+  for (uint8_t i = 0; i < count && monitorCount < TASK_MONITOR_MAX; i++) {
+    monitors[monitorCount++] = taskMonitors[i];
+  }
+  // Series of a family are registered back to back
+  for (uint8_t i = 0; i < monitorCount; i++) {
+    registerHistogram("smartgreen_task_wake_latency_seconds", "How late a task woke up after a delay", &monitors[i]->latency, monitors[i]->labels);
+  }
+  for (uint8_t i = 0; i < monitorCount; i++) {
+    registerHistogram("smartgreen_task_period_jitter_seconds", "Change of a task loop period from one pass to the next", &monitors[i]->jitter, monitors[i]->labels);
+  }
+  for (uint8_t i = 0; i < monitorCount; i++) {
+    registerCounter("smartgreen_task_budget_overruns_total", "Task loop periods longer than their budget", &monitors[i]->overrunCount, monitors[i]->labels);
+  }
+}
+
+static void writeHistogram(JsonWriter& json, const char* name, const MetricHistogram& histogram) {
+  json.key(name).beginArray();
+  for (uint8_t bucket = 0; bucket <= histogram.bucketCount(); bucket++) {
+    json.value(histogram.bucket(bucket));
+  }
+  json.endArray();
+}
+
+void writeTaskMonitors(JsonWriter& json) {
+  json.beginObject();
+  json.field("watchdogTimeout", TASK_MONITOR_WDT_TIMEOUT_S);
+  // Upper bounds in microseconds, the histograms carry one more bucket for everything above
+  json.key("buckets").beginArray();
+  for (uint8_t bucket = 0; bucket < METRICS_MAX_BUCKETS; bucket++) {
+    json.value(METRICS_LATENCY_BUCKETS[bucket]);
+  }
+  json.endArray();
+  json.key("tasks").beginArray();
+  for (uint8_t i = 0; i < monitorCount; i++) {
+    const TaskMonitor* monitor = monitors[i];
+    json.beginObject();
+    json.field("name", monitor->name());
+    json.field("budget", monitor->budget());
+    json.field("watched", monitor->watched());
+    json.field("passes", monitor->passes());
+    json.field("overruns", monitor->overruns());
+    json.field("maxPeriod", monitor->maxPeriod());
+    json.field("maxLatency", monitor->maxLatency());
+    json.field("maxJitter", monitor->maxJitter());
+    writeHistogram(json, "latency", monitor->latency);
+    writeHistogram(json, "jitter", monitor->jitter);
+    json.endObject();
+  }
+  json.endArray();
+  json.endObject();
+}
@@ -0,0 +1,102 @@
+/**
+ * @file         : taskmonitor.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "metrics.h"
+#include "jsonwriter.h"
+
+#define TASK_MONITOR_MAX                  8       /* Monitored tasks, each takes three metric series */
+#define TASK_MONITOR_LABEL_LENGTH         24      /* task="name" label, preformatted for the registry */
+#define TASK_MONITOR_WDT_TIMEOUT_S        15      /* Task watchdog timeout, three web server keep-alive waits */
+
+/**
+ * Scheduling health of one periodic task. beginPass() at the top of every
+ * loop pass measures the loop period against the budget and the jitter
+ * between consecutive periods, delay() records how late the task woke up
+ * compared to the pause it asked for. Both feed the task watchdog once
+ * the task attached to it.
+ */
+class TaskMonitor {
+public:
+  // budgetMs is the longest acceptable loop period, watchdog is false for tasks that may block longer than its timeout
+  TaskMonitor(const char* name, uint32_t budgetMs, bool watchdog = true);
+  void attach();                          // From the monitored task itself
+  void detach();                          // Before a transient task deletes itself
+  void beginPass();
+  void resetPeriod();                     // The next pass starts a new period, e.g. after a planned pause
+  void delay(uint32_t ms);                // hal.clock->delay() with the wake up lateness recorded
+  void feed();
+
+  const char* name() const { return taskName; }
+  uint32_t budget() const { return budgetMs; }
+  bool watched() const { return subscribed.load(std::memory_order_relaxed); }
+  uint32_t passes() const { return passCount.get(); }
+  uint32_t overruns() const { return overrunCount.get(); }
+  uint32_t maxPeriod() const { return longestPeriod.load(std::memory_order_relaxed); }
+  uint32_t maxLatency() const { return worstLatency.load(std::memory_order_relaxed); }
+  uint32_t maxJitter() const { return worstJitter.load(std::memory_order_relaxed); }
+
+private:
+  TaskMonitor(const TaskMonitor&);
+  TaskMonitor& operator=(const TaskMonitor&);
+
+  friend void registerTaskMonitors(TaskMonitor** monitors, uint8_t count);
+  friend void writeTaskMonitors(JsonWriter& json);
+
+  const char* taskName;
+  uint32_t budgetMs;
+  bool watchdog;
+  char labels[TASK_MONITOR_LABEL_LENGTH];
+  std::atomic<bool> subscribed;
+  std::atomic<uint32_t> lastPass;         // metricsMicros() of the previous pass, 0 when there is none
+  std::atomic<uint32_t> lastPeriod;       // Microseconds, 0 until two passes were seen
+  std::atomic<uint32_t> longestPeriod;
+  std::atomic<uint32_t> worstLatency;
+  std::atomic<uint32_t> worstJitter;
+  MetricCounter passCount;
+  MetricCounter overrunCount;
+  MetricHistogram latency;                // Wake up lateness in microseconds
+  MetricHistogram jitter;                 // Period to period change in microseconds
+};
+
+/**
+ * Registers the monitors and their metric families, and arms the task
+ * watchdog on the device. Call once before any task attaches.
+ */
+void registerTaskMonitors(TaskMonitor** monitors, uint8_t count);
+void writeTaskMonitors(JsonWriter& json);
@@ -0,0 +1,268 @@
+/**
+ * @file         : telemetry.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "telemetry.h"
+#include <WiFi.h>
+#include <SD.h>
+#include "heapprofile.h"
+
+static const uint32_t sectionIntervals[TELEMETRY_SECTIONS] = {
+  0,                                // Chip, collected once
+  TELEMETRY_CLOCK_INTERVAL_MS,
+  TELEMETRY_EXPANDER_INTERVAL_MS,
+  TELEMETRY_HEAP_INTERVAL_MS,
+  TELEMETRY_WIFI_INTERVAL_MS,
+  TELEMETRY_STORAGE_INTERVAL_MS,
+  TELEMETRY_CONFIG_INTERVAL_MS
+};
+
+static SystemSnapshot snapshot;
+static portMUX_TYPE snapshotMux = portMUX_INITIALIZER_UNLOCKED;
+static TelemetrySources sources;
+static TaskHandle_t telemetryTaskHandle = NULL;
+TaskMonitor telemetryMonitor("telemetry", TELEMETRY_BUDGET_MS);
+
+void getSystemSnapshot(SystemSnapshot* copy) {
+  portENTER_CRITICAL(&snapshotMux);
+  memcpy(copy, &snapshot, sizeof(SystemSnapshot));
+  portEXIT_CRITICAL(&snapshotMux);
+}
+
+bool hasTelemetrySection(const SystemSnapshot& copy, TelemetrySection section) {
+  return copy.refreshedAt[section] != 0;
+}
+
+// Sections are collected into a scratch copy and published field by field under the lock
+static void publish(TelemetrySection section, const SystemSnapshot& collected) {
+  portENTER_CRITICAL(&snapshotMux);
+  switch (section) {
+    case TELEMETRY_CHIP:
+      memcpy(snapshot.chipModel, collected.chipModel, sizeof(snapshot.chipModel));
+      snapshot.chipCores = collected.chipCores;
+      snapshot.chipRevision = collected.chipRevision;
+      snapshot.flashSize = collected.flashSize;
+      break;
+    case TELEMETRY_CLOCK:
+      snapshot.temperature = collected.temperature;
+      snapshot.timestamp = collected.timestamp;
+      snapshot.offset = collected.offset;
+      snapshot.nextAlarmSecs = collected.nextAlarmSecs;
+      memcpy(snapshot.nextAlarm, collected.nextAlarm, sizeof(snapshot.nextAlarm));
+      break;
+    case TELEMETRY_EXPANDER:
+      snapshot.mcp = collected.mcp;
+      break;
+    case TELEMETRY_HEAP:
+      snapshot.freeHeap = collected.freeHeap;
+      snapshot.heapSize = collected.heapSize;
+      break;
+    case TELEMETRY_WIFI:
+      snapshot.signalDbm = collected.signalDbm;
+      break;
+    case TELEMETRY_STORAGE:
+      snapshot.cardType = collected.cardType;
+      snapshot.cardSize = collected.cardSize;
+      snapshot.freeSize = collected.freeSize;
+      snapshot.logCount = collected.logCount;
+      break;
+    case TELEMETRY_CONFIG:
+      snapshot.configValid = collected.configValid;
+      snapshot.networkEnabled = collected.networkEnabled;
+      memcpy(snapshot.ssid, collected.ssid, sizeof(snapshot.ssid));
+      memcpy(snapshot.password, collected.password, sizeof(snapshot.password));
+      break;
+    default:
+      break;
+  }
+  // Never leave 0 behind, it means not collected yet
+  snapshot.refreshedAt[section] = millis() | 1;
+  portEXIT_CRITICAL(&snapshotMux);
+}
+
+static void observeI2c(uint32_t start) {
+  if (sources.i2cLatency != NULL) {
+    sources.i2cLatency->observe(metricsMicros() - start);
+  }
+}
+
+// The settings are edited from the web server and the watering task, they are
+// only read under SettingsLock and never while the bus is held
+static bool collectClock(SystemSnapshot& collected) {
+  bool hasRTC;
+  {
+    SettingsLock lock;
+    hasRTC = sources.settings->hasRTC;
+  }
+  if (xSemaphoreTake(sources.i2cMutex, TELEMETRY_I2C_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+    return false;
+  }
+  uint32_t start = metricsMicros();
+  DateTime now = sources.rtc->now();
+  collected.temperature = hasRTC ? sources.rtc->getTemperature() : 0;
+  observeI2c(start);
+  xSemaphoreGive(sources.i2cMutex);
+
+  // The system clock is kept in sync with NTP, the RTC may drift away from it
+  time_t systemTime = time(NULL);
+  collected.timestamp = hasRTC ? now.unixtime() : (uint32_t)systemTime;
+  collected.offset = hasRTC ? (int32_t)(now.unixtime() - systemTime) : 0;
+  {
+    SettingsLock lock;
+    collected.nextAlarmSecs = getNextAlarmTime(*sources.settings, now);
+  }
+  time_t nextAlarm = now.unixtime() + collected.nextAlarmSecs;
+  strftime(collected.nextAlarm, sizeof(collected.nextAlarm), "%Y-%m-%d %H:%M:%S", localtime(&nextAlarm));
+  return true;
+}
+
+static bool collectExpander(SystemSnapshot& collected) {
+  bool hasMCP;
+  {
+    SettingsLock lock;
+    hasMCP = sources.settings->hasMCP;
+  }
+  if (!hasMCP) {
+    return false;
+  }
+  if (xSemaphoreTake(sources.i2cMutex, TELEMETRY_I2C_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+    return false;
+  }
+  uint32_t start = metricsMicros();
+  collected.mcp = sources.mcp->readGPIOAB();
+  observeI2c(start);
+  xSemaphoreGive(sources.i2cMutex);
+  return true;
+}
+
+static bool collectStorage(SystemSnapshot& collected) {
+  if (!initSDCard()) {
+    return false;
+  }
+  collected.cardType = SD.cardType();
+  collected.cardSize = SD.cardSize() / (1024 * 1024);
+  collected.freeSize = collected.cardSize - (uint32_t)(SD.usedBytes() / (1024 * 1024));
+  collected.logCount = getLogCount("/logs");
+  return true;
+}
+
+static bool collectConfig(SystemSnapshot& collected) {
+  JsonDocument config = readConfig();
+  collected.configValid = !config.isNull();
+  collected.networkEnabled = config["network"]["enabled"].as<bool>();
+  strlcpy(collected.ssid, config["network"]["ssid"] | "", sizeof(collected.ssid));
+  strlcpy(collected.password, config["network"]["password"] | "", sizeof(collected.password));
+  return true;
+}
+
+static bool collect(TelemetrySection section, SystemSnapshot& collected) {
+  switch (section) {
+    case TELEMETRY_CHIP:
+      strlcpy(collected.chipModel, ESP.getChipModel(), sizeof(collected.chipModel));
+      collected.chipCores = ESP.getChipCores();
+      collected.chipRevision = ESP.getChipRevision();
+      collected.flashSize = ESP.getFlashChipSize();
+      return true;
+    case TELEMETRY_CLOCK:
+      return collectClock(collected);
+    case TELEMETRY_EXPANDER:
+      return collectExpander(collected);
+    case TELEMETRY_HEAP:
+      collected.freeHeap = ESP.getFreeHeap();
+      collected.heapSize = esp_get_free_heap_size();
+      sampleHeap();
+      return true;
+    case TELEMETRY_WIFI:
+      collected.signalDbm = WiFi.RSSI();
+      return true;
+    case TELEMETRY_STORAGE:
+      return collectStorage(collected);
+    case TELEMETRY_CONFIG:
+      return collectConfig(collected);
+    default:
+      return false;
+  }
+}
+
+// Low priority task, refreshes the sections that are due and publishes them one at a time
+static void telemetryTask(void* parameter) {
+  static SystemSnapshot collected;
+  uint32_t lastRefresh[TELEMETRY_SECTIONS] = {0};
+  bool collectedOnce[TELEMETRY_SECTIONS] = {false};
+  telemetryMonitor.attach();
+  for (;;) {
+    telemetryMonitor.beginPass();
+    for (uint8_t section = 0; section < TELEMETRY_SECTIONS; section++) {
+      uint32_t interval = sectionIntervals[section];
+      bool due = !collectedOnce[section] || (interval > 0 && millis() - lastRefresh[section] >= interval);
+      if (!due) {
+        continue;
+      }
+      // A failed section keeps its last value and is retried on the next wake up
+      if (collect((TelemetrySection)section, collected)) {
+        publish((TelemetrySection)section, collected);
+        lastRefresh[section] = millis();
+        collectedOnce[section] = true;
+      }
+    }
+    telemetryMonitor.delay(TELEMETRY_PERIOD_MS);
+  }
+}
+
+// Collects every section once on the calling task, for builds that do not run the collector
+void collectTelemetry(const TelemetrySources& telemetrySources) {
+  static SystemSnapshot collected;
+  sources = telemetrySources;
+  for (uint8_t section = 0; section < TELEMETRY_SECTIONS; section++) {
+    if (collect((TelemetrySection)section, collected)) {
+      publish((TelemetrySection)section, collected);
+    }
+  }
+}
+
+bool startTelemetry(const TelemetrySources& telemetrySources, UBaseType_t priority, BaseType_t core) {
+  if (telemetryTaskHandle != NULL) {
+    return true;
+  }
+  sources = telemetrySources;
+  return xTaskCreatePinnedToCore(
+    telemetryTask,          // Task function
+    "TelemetryTask",        // Name of the task
+    TELEMETRY_STACK_SIZE,   // Stack size
+    NULL,                   // Task input parameter
+    priority,               // Priority of the task
+    &telemetryTaskHandle,   // Task handle
+    core                    // Core where the task should run
+  ) == pdPASS;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file         : telemetry.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include <RTClib.h>
+#include <Adafruit_MCP23X17.h>
+#include "metrics.h"
+#include "taskmonitor.h"
+#include "constants.h"
+#include "settings.h"
+
+#define TELEMETRY_PERIOD_MS               250     /* Collector task wake up interval */
+#define TELEMETRY_BUDGET_MS               2000    /* Longest collector pass period, the storage section is the slow one */
+#define TELEMETRY_STACK_SIZE              8192    /* Collector task stack size */
+#define TELEMETRY_I2C_TIMEOUT_MS          20      /* Skip the bus section instead of waiting on valve control */
+#define TELEMETRY_CLOCK_INTERVAL_MS       1000    /* RTC time, temperature and next alarm */
+#define TELEMETRY_EXPANDER_INTERVAL_MS    1000    /* MCP23017 port state */
+#define TELEMETRY_HEAP_INTERVAL_MS        2000    /* Free heap */
+#define TELEMETRY_WIFI_INTERVAL_MS        5000    /* Signal strength */
+#define TELEMETRY_STORAGE_INTERVAL_MS     60000   /* SD card usage and log count */
+#define TELEMETRY_CONFIG_INTERVAL_MS      300000  /* config.json on the SD card */
+#define TELEMETRY_TEXT_LENGTH             33      /* SSID and short strings including terminator */
+#define TELEMETRY_PASSWORD_LENGTH         65      /* WPA passphrase including terminator */
+
+enum TelemetrySection : uint8_t {
+  TELEMETRY_CHIP = 0,
+  TELEMETRY_CLOCK,
+  TELEMETRY_EXPANDER,
+  TELEMETRY_HEAP,
+  TELEMETRY_WIFI,
+  TELEMETRY_STORAGE,
+  TELEMETRY_CONFIG,
+  TELEMETRY_SECTIONS
+};
+
+/**
+ * Copy of everything /api/systeminfo reports that costs bus, flash or SD
+ * access. Each section is refreshed by the collector at its own interval
+ * and readers only ever copy the struct.
+ */
+struct SystemSnapshot {
+  uint32_t refreshedAt[TELEMETRY_SECTIONS];   // millis() of the last refresh, 0 while never collected
+  // Chip, collected once
+  char chipModel[TELEMETRY_TEXT_LENGTH];
+  uint8_t chipCores;
+  uint8_t chipRevision;
+  uint32_t flashSize;
+  // Clock
+  float temperature;
+  uint32_t timestamp;
+  int32_t offset;
+  uint32_t nextAlarmSecs;
+  char nextAlarm[TELEMETRY_TEXT_LENGTH];
+  // Expander
+  uint16_t mcp;
+  // Heap
+  uint32_t freeHeap;
+  uint32_t heapSize;
+  // WiFi
+  int8_t signalDbm;
+  // Storage
+  uint8_t cardType;
+  uint32_t cardSize;
+  uint32_t freeSize;
+  uint32_t logCount;
+  // Config
+  bool configValid;
+  bool networkEnabled;
+  char ssid[TELEMETRY_TEXT_LENGTH];
+  char password[TELEMETRY_PASSWORD_LENGTH];
+};
+
+// Hardware the collector reads from, owned by the main sketch
+struct TelemetrySources {
+  Settings* settings;
+  RTC_DS3231* rtc;
+  Adafruit_MCP23X17* mcp;
+  SemaphoreHandle_t i2cMutex;
+  MetricHistogram* i2cLatency;      // Optional, observes every bus transaction
+};
+
+extern TaskMonitor telemetryMonitor;
+
+/**
+ * Telemetry collector
+ */
+bool startTelemetry(const TelemetrySources& sources, UBaseType_t priority, BaseType_t core);
+void collectTelemetry(const TelemetrySources& sources);
+void getSystemSnapshot(SystemSnapshot* snapshot);
+bool hasTelemetrySection(const SystemSnapshot& snapshot, TelemetrySection section);
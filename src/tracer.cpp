@@ -0,0 +1,282 @@
+/**
+ * @file         : tracer.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "tracer.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include <Arduino.h>
+  #include <esp_timer.h>
+#else
+  #include <time.h>
+  #include <mutex>
+#endif
+
+struct TraceEventInfo {
+  const char* name;
+  uint8_t category;
+  const char* args[2];
+};
+
+#define TRACE_EVENT_INFO(id, category, name, first, second) { name, category, { first, second } },
+static const TraceEventInfo events[TRACE_EVENT_COUNT] = {
+  TRACE_EVENT_LIST(TRACE_EVENT_INFO)
+};
+#undef TRACE_EVENT_INFO
+
+static const char* categoryNames[] = { "system", "schedule", "watering", "i2c", "storage", "http" };
+
+// One ring per core, the head only ever grows and the slot is head modulo the size
+struct TraceRing {
+  std::atomic<uint32_t> head;
+  uint32_t cleared;                       // Head at the last clearTrace(), the dump starts there
+  TraceRecord records[TRACE_RING_SIZE];
+};
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+static TraceRing rings[TRACE_CORES];
+static char taskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_LENGTH];
+static uint8_t taskCount = 0;
+static const char* strings[TRACE_MAX_STRINGS];
+static uint8_t stringCount = 0;
+// Guards the task and string tables, taken by every traceString() and the first record
+// of a task. A critical section on the device, a spinning flag would never be released
+// by a lower priority holder preempted on the same core
+#if defined(ARDUINO)
+static portMUX_TYPE tableMux = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::mutex tableMutex;
+#endif
+static thread_local int8_t taskSlot = -1;
+
+#define TRACE_TASK_ISR                    0xFF
+
+static void lock() {
+#if defined(ARDUINO)
+  portENTER_CRITICAL(&tableMux);
+#else
+  tableMutex.lock();
+#endif
+}
+
+static void unlock() {
+#if defined(ARDUINO)
+  portEXIT_CRITICAL(&tableMux);
+#else
+  tableMutex.unlock();
+#endif
+}
+
+static uint64_t traceMicros() {
+#if defined(ARDUINO)
+  return esp_timer_get_time();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+#endif
+}
+
+static uint8_t currentCore() {
+#if defined(ARDUINO)
+  return xPortGetCoreID();
+#else
+  return 0;
+#endif
+}
+
+static uint8_t currentTask() {
+#if defined(ARDUINO)
+  if (xPortInIsrContext()) {
+    return TRACE_TASK_ISR;
+  }
+#endif
+  if (taskSlot < 0) {
+    lock();
+    taskSlot = taskCount < TRACE_MAX_TASKS ? taskCount++ : TRACE_MAX_TASKS - 1;
+#if defined(ARDUINO)
+    strlcpy(taskNames[taskSlot], pcTaskGetTaskName(NULL), TRACE_TASK_NAME_LENGTH);
+#else
+    snprintf(taskNames[taskSlot], TRACE_TASK_NAME_LENGTH, "thread %d", taskSlot);
+#endif
+    unlock();
+  }
+  return taskSlot;
+}
+
+void traceRecord(uint16_t id, uint8_t phase, uint32_t first, uint32_t second) {
+  TraceRing& ring = rings[currentCore()];
+  uint8_t task = currentTask();
+  uint32_t position = ring.head.fetch_add(1, std::memory_order_relaxed);
+  TraceRecord& record = ring.records[position & (TRACE_RING_SIZE - 1)];
+  // Readers see 0 while the record is rewritten
+  record.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.timestamp = (uint32_t)traceMicros();
+  record.id = id;
+  record.phase = phase;
+  record.task = task;
+  record.args[0] = first;
+  record.args[1] = second;
+  record.sequence.store(position + 1, std::memory_order_release);
+}
+
+uint32_t traceString(const char* text) {
+  lock();
+  uint8_t index = 0;
+  while (index < stringCount && strings[index] != text) {
+    index++;
+  }
+  if (index == stringCount && stringCount < TRACE_MAX_STRINGS) {
+    strings[stringCount++] = text;
+  }
+  unlock();
+  return index;
+}
+
+void clearTrace() {
+  for (uint8_t core = 0; core < TRACE_CORES; core++) {
+    rings[core].cleared = rings[core].head.load(std::memory_order_relaxed);
+  }
+}
+
+uint32_t traceRecordCount() {
+  uint32_t count = 0;
+  for (uint8_t core = 0; core < TRACE_CORES; core++) {
+    uint32_t head = rings[core].head.load(std::memory_order_relaxed);
+    uint32_t available = head - rings[core].cleared;
+    count += available < TRACE_RING_SIZE ? available : TRACE_RING_SIZE;
+  }
+  return count;
+}
+
+// Copies a record out, false when it was being rewritten or already belongs to a later position
+static bool readRecord(const TraceRecord& source, uint32_t position, TraceRecord* copy) {
+  if (source.sequence.load(std::memory_order_acquire) != position + 1) {
+    return false;
+  }
+  copy->timestamp = source.timestamp;
+  copy->id = source.id;
+  copy->phase = source.phase;
+  copy->task = source.task;
+  copy->args[0] = source.args[0];
+  copy->args[1] = source.args[1];
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return source.sequence.load(std::memory_order_relaxed) == position + 1 && copy->id < TRACE_EVENT_COUNT;
+}
+
+static void writeArgument(JsonWriter& json, const char* name, uint32_t value) {
+  if (name == NULL) {
+    return;
+  }
+  if (name[0] == '$') {
+    lock();
+    const char* text = value < stringCount ? strings[value] : "?";
+    unlock();
+    json.field(name + 1, text);
+  } else {
+    json.field(name, value);
+  }
+}
+
+static const char* categoryName(uint8_t category) {
+  for (uint8_t i = 0; i < sizeof(categoryNames) / sizeof(categoryNames[0]); i++) {
+    if (category == (1 << i)) {
+      return categoryNames[i];
+    }
+  }
+  return "other";
+}
+
+/**
+ * Chrome trace event format, loads in chrome://tracing and ui.perfetto.dev.
+ * Timestamps are rebuilt against the dump time so the 32 bit wrap only
+ * matters for events older than 71 minutes.
+ */
+void writeChromeTrace(JsonWriter& json) {
+  uint64_t now = traceMicros();
+  json.beginObject();
+  json.field("displayTimeUnit", "ms");
+  json.key("traceEvents").beginArray();
+
+  lock();
+  uint8_t tasks = taskCount;
+  unlock();
+  for (uint8_t task = 0; task < tasks; task++) {
+    json.beginObject().field("name", "thread_name").field("ph", "M").field("pid", 0).field("tid", task);
+    json.key("args").beginObject().field("name", taskNames[task]).endObject();
+    json.endObject();
+  }
+  json.beginObject().field("name", "thread_name").field("ph", "M").field("pid", 0).field("tid", TRACE_TASK_ISR);
+  json.key("args").beginObject().field("name", "isr").endObject();
+  json.endObject();
+
+  for (uint8_t core = 0; core < TRACE_CORES; core++) {
+    TraceRing& ring = rings[core];
+    uint32_t head = ring.head.load(std::memory_order_acquire);
+    uint32_t first = head - ring.cleared > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : ring.cleared;
+    for (uint32_t position = first; position != head; position++) {
+      TraceRecord record;
+      if (!readRecord(ring.records[position & (TRACE_RING_SIZE - 1)], position, &record)) {
+        continue;
+      }
+      const TraceEventInfo& info = events[record.id];
+      uint64_t timestamp = now - (uint32_t)((uint32_t)now - record.timestamp);
+      char phase[2] = { (char)record.phase, '\0' };
+      json.beginObject();
+      json.field("name", info.name);
+      json.field("cat", categoryName(info.category));
+      json.field("ph", phase);
+      json.field("ts", (unsigned long long)timestamp);
+      json.field("pid", 0);
+      json.field("tid", record.task);
+      if (record.phase == TRACE_PHASE_INSTANT) {
+        json.field("s", "t");
+      }
+      json.key("args").beginObject();
+      writeArgument(json, info.args[0], record.args[0]);
+      writeArgument(json, info.args[1], record.args[1]);
+      // Counter arguments are plotted as series
+      if (record.phase != TRACE_PHASE_COUNTER) {
+        json.field("core", core);
+      }
+      json.endObject();
+      json.endObject();
+    }
+  }
+  json.endArray();
+  json.endObject();
+}
@@ -0,0 +1,129 @@
+/**
+ * @file         : tracer.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "jsonwriter.h"
+
+#define TRACE_RING_SIZE                   256     /* Events kept per core, power of two */
+#define TRACE_MAX_TASKS                   16      /* Tasks with a name in the dump, later ones share the last slot */
+#define TRACE_MAX_STRINGS                 64      /* Interned strings that can be passed as arguments */
+#define TRACE_TASK_NAME_LENGTH            16      /* configMAX_TASK_NAME_LEN */
+#if defined(ARDUINO)
+  #define TRACE_CORES                     portNUM_PROCESSORS
+#else
+  #define TRACE_CORES                     1
+#endif
+
+// Categories, a category missing from TRACE_CATEGORIES compiles its events away arguments included
+#define TRACE_CAT_SYSTEM                  0x01
+#define TRACE_CAT_SCHEDULE                0x02
+#define TRACE_CAT_WATERING                0x04
+#define TRACE_CAT_I2C                     0x08
+#define TRACE_CAT_STORAGE                 0x10
+#define TRACE_CAT_HTTP                    0x20
+#ifndef TRACE_CATEGORIES
+  #define TRACE_CATEGORIES                0xFF
+#endif
+
+/**
+ * Event table: id, category, name and the names of its two arguments.
+ * Arguments are plain integers, formatting happens when the ring is dumped.
+ * An argument name starting with $ carries a traceString() index.
+ */
+#define TRACE_EVENT_LIST(EVENT) \
+  EVENT(TRACE_BEEP,             TRACE_CAT_SYSTEM,   "beep",             "times",    "delay") \
+  EVENT(TRACE_TIME_INTERVAL,    TRACE_CAT_SCHEDULE, "addTimeInterval",  "now",      "seconds") \
+  EVENT(TRACE_I2C_SCAN,         TRACE_CAT_I2C,      "i2cScan",          "devices",  NULL) \
+  EVENT(TRACE_I2C_DEVICE,       TRACE_CAT_I2C,      "i2cDevice",        "address",  "error") \
+  EVENT(TRACE_WATERING_CYCLE,   TRACE_CAT_WATERING, "waterPlants",      "alarm",    "job") \
+  EVENT(TRACE_WATERING_PLANT,   TRACE_CAT_WATERING, "waterPlant",       "valve",    "millilitres") \
+  EVENT(TRACE_FLOW,             TRACE_CAT_WATERING, "flow",             "millilitres", "pulses") \
+  EVENT(TRACE_SETTINGS_SAVE,    TRACE_CAT_STORAGE,  "saveSettings",     "generation", NULL) \
+  EVENT(TRACE_LOG_WRITE,        TRACE_CAT_STORAGE,  "writeLog",         "plant",    "millilitres") \
+  EVENT(TRACE_HTTP_REQUEST,     TRACE_CAT_HTTP,     "httpRequest",      "$route",   "method") \
+  EVENT(TRACE_TASK_OVERRUN,     TRACE_CAT_SCHEDULE, "taskOverrun",      "$task",    "period") \
+  EVENT(TRACE_BOOT_STAGE,       TRACE_CAT_SYSTEM,   "bootStage",        "$stage",   "ok")
+
+#define TRACE_EVENT_ID(id, category, name, first, second) id,
+enum TraceEventId : uint16_t {
+  TRACE_EVENT_LIST(TRACE_EVENT_ID)
+  TRACE_EVENT_COUNT
+};
+#undef TRACE_EVENT_ID
+
+// Chrome trace phases
+enum TracePhase : uint8_t {
+  TRACE_PHASE_INSTANT = 'i',
+  TRACE_PHASE_BEGIN = 'B',
+  TRACE_PHASE_END = 'E',
+  TRACE_PHASE_COUNTER = 'C'
+};
+
+// 20 bytes, written in place in the ring
+struct TraceRecord {
+  std::atomic<uint32_t> sequence;         // Position + 1 once the record is complete
+  uint32_t timestamp;                     // Microseconds, wraps after 71 minutes
+  uint16_t id;
+  uint8_t phase;
+  uint8_t task;
+  uint32_t args[2];
+};
+
+#define TRACE_EMIT(category, id, phase, first, second) \
+  do { \
+    if ((TRACE_CATEGORIES & (category)) != 0) { \
+      traceRecord(id, phase, first, second); \
+    } \
+  } while (0)
+
+#define TRACE_INSTANT(category, id, first, second)  TRACE_EMIT(category, id, TRACE_PHASE_INSTANT, first, second)
+#define TRACE_BEGIN(category, id, first, second)    TRACE_EMIT(category, id, TRACE_PHASE_BEGIN, first, second)
+#define TRACE_END(category, id, first, second)      TRACE_EMIT(category, id, TRACE_PHASE_END, first, second)
+#define TRACE_COUNTER(category, id, first, second)  TRACE_EMIT(category, id, TRACE_PHASE_COUNTER, first, second)
+
+/**
+ * Tracer, recording never blocks and never allocates. Each core writes its
+ * own ring and overwrites the oldest events, a dump skips records that are
+ * being overwritten while it reads them.
+ */
+void traceRecord(uint16_t id, uint8_t phase, uint32_t first, uint32_t second);
+// Index of a string that outlives the tracer, e.g. a literal or a route uri
+uint32_t traceString(const char* text);
+void clearTrace();
+uint32_t traceRecordCount();
+void writeChromeTrace(JsonWriter& json);
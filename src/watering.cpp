@@ -0,0 +1,236 @@
+/**
+ * @file         : watering.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "watering.h"
+#include "tracer.h"
+
+FlowState flowState = {0};
+TaskMonitor wateringMonitor("watering", WATERING_BUDGET_MS);
+static WateringHooks hooks = {0};
+
+void setWateringHooks(const WateringHooks& wateringHooks) {
+  hooks = wateringHooks;
+}
+
+static void publishStatus(WateringStatus* status) {
+  if (hooks.status != NULL) {
+    hooks.status(status);
+  }
+}
+
+static bool isCancelled(uint32_t jobId) {
+  return hooks.cancelled != NULL && hooks.cancelled(jobId);
+}
+
+void calcFlow() {
+  // Note the time this processing pass was executed
+  uint32_t start = hal.clock->millis();
+  uint32_t pulses = 0;
+
+  wateringMonitor.beginPass();
+  flowState.pulses = 0;
+  while ((hal.clock->millis() - start) < WATERING_SAMPLE_MS) {
+    // Pulses counted since the previous pass, the sensor swaps the count out atomically
+    uint32_t count = hal.flow->takePulses();
+    uint32_t elapsed = hal.clock->millis() - start;
+
+    // Because this loop may not complete in exactly 1 second intervals we calculate the
+    // number of milliseconds that have passed since the last execution and use that to
+    // scale the output. We also apply the calibrationFactor to scale the output based on
+    // the number of pulses per second per units of measure (litres/minute in this case)
+    // coming from the sensor.
+    flowState.rate = ((1000.0 / (elapsed > 0 ? elapsed : 1)) * count) / FLOW_CALIBRATION_FACTOR;
+
+    // Divide the flow rate in litres/minute by 60 to determine how many litres have
+    // passed through the sensor in this 1 second interval, then multiply by 1000 to
+    // convert to millilitres.
+    flowState.millilitres = count == 0 ? 0 : (flowState.rate / 60) * 1000;
+
+    // Add the millilitres passed in this second to the cumulative total
+    flowState.total += flowState.millilitres;
+    pulses += count;
+    flowState.pulses = pulses;
+
+    // Fixed pace, nothing else runs on the control core to stretch or shorten it
+    wateringMonitor.delay(WATERING_POLL_MS);
+  }
+  // yield
+  wateringMonitor.delay(WATERING_YIELD_MS);
+}
+
+void stopWatering() {
+  hal.flow->end();
+  // Turn Pump Off
+  hal.expander->writeGPIOAB(0b1111111111111111);
+  wateringMonitor.delay(WATERING_SETTLE_MS);
+  publishStatus(NULL);
+}
+
+void waterPlant(Settings* settings, uint8_t valve, unsigned int duration, unsigned long millilitres, uint32_t jobId) {
+  struct WateringStatus wateringStatus = {};
+  wateringStatus.plant = valve;
+  // Open Valve
+  hal.expander->pinMode(valve, OUTPUT);
+  hal.expander->digitalWrite(valve, LOW);
+  // Wait time to avoid current surge
+  wateringMonitor.delay(WATERING_SETTLE_MS);
+  wateringStatus.status = WATERING_STATUS_VALVE_OPEN;
+  publishStatus(&wateringStatus);
+  // Start the pump
+  hal.expander->pinMode(PUMP1_PIN, OUTPUT);
+  hal.expander->digitalWrite(PUMP1_PIN, LOW);
+  wateringStatus.status = WATERING_STATUS_PUMPING;
+  publishStatus(&wateringStatus);
+
+  flowState.total = 0;
+  flowState.startedAt = hal.clock->millis();
+  uint32_t startTime = hal.clock->now();
+  if (hooks.started != NULL) {
+    hooks.started(valve, startTime);
+  }
+  hal.flow->begin();
+  // The valve and pump switching pauses are not part of the sampling period
+  wateringMonitor.resetPeriod();
+  TRACE_BEGIN(TRACE_CAT_WATERING, TRACE_WATERING_PLANT, valve, millilitres);
+  for (uint8_t i = 0; i < duration; i++) {
+    // Close the valve early when the job driving this cycle was cancelled
+    if (isCancelled(jobId)) {
+      break;
+    }
+    calcFlow();
+    TRACE_COUNTER(TRACE_CAT_WATERING, TRACE_FLOW, flowState.millilitres, flowState.pulses);
+    uint32_t elapsed = hal.clock->millis() - flowState.startedAt;
+    if (hooks.sample != NULL) {
+      hooks.sample(valve, startTime, elapsed, flowState.millilitres);
+    }
+    wateringStatus.flow = flowState.total;
+    wateringStatus.pulses = flowState.pulses;
+    wateringStatus.duration = elapsed;
+    wateringStatus.status = WATERING_STATUS_WATERING;
+    publishStatus(&wateringStatus);
+  }
+  flowState.endedAt = hal.clock->millis();
+  TRACE_END(TRACE_CAT_WATERING, TRACE_WATERING_PLANT, valve, flowState.total);
+  uint32_t elapsed = flowState.endedAt - flowState.startedAt;
+  if (hooks.finished != NULL) {
+    hooks.finished(valve, hal.clock->now(), flowState.total, duration, elapsed);
+  }
+  hal.flow->end();
+  // Turn Pump Off
+  hal.expander->digitalWrite(PUMP1_PIN, HIGH);
+  wateringMonitor.delay(WATERING_SETTLE_MS);
+  // Turn Valve Off
+  hal.expander->digitalWrite(valve, HIGH);
+  wateringMonitor.delay(WATERING_SETTLE_MS);
+  wateringStatus.status = WATERING_STATUS_FINISHED;
+  wateringStatus.duration = elapsed;
+  publishStatus(&wateringStatus);
+  SettingsLock lock;
+  settings->taskLog.flow[valve] += wateringStatus.flow;
+}
+
+// The clock is read before taking the settings lock, it is an I2C transaction
+static bool alarmOn(Settings* settings, uint32_t unixTime) {
+  SettingsLock lock;
+  return isAlarmOn(*settings, DateTime(unixTime));
+}
+
+static bool alarmActive(Settings* settings, uint32_t unixTime) {
+  SettingsLock lock;
+  return getActiveAlarmId(*settings, DateTime(unixTime)) > -1;
+}
+
+void waterPlants(Settings* settings, uint32_t jobId) {
+  struct WateringStatus wateringStatus = {};
+  wateringStatus.status = WATERING_STATUS_STARTING;
+  publishStatus(&wateringStatus);
+
+  DateTime now(hal.clock->now());
+  int activeAlarmId;
+  {
+    SettingsLock lock;
+    activeAlarmId = getActiveAlarmId(*settings, now);
+    settings->taskLog.lastExecutionId = activeAlarmId;
+  }
+  TRACE_BEGIN(TRACE_CAT_WATERING, TRACE_WATERING_CYCLE, activeAlarmId, jobId);
+  if (hooks.power != NULL) {
+    hooks.power(true);
+  }
+  for (uint8_t plantIndex = 0; plantIndex < SETTINGS_MAX_PLANTS && !isCancelled(jobId); plantIndex++) {
+    Plant plant;
+    {
+      SettingsLock lock;
+      plant = settings->plant[plantIndex];
+    }
+    if (plant.status == 1) {
+      waterPlant(settings, plantIndex, calculateWateringDuration(plant.size), (((plant.size * 1000) / 10 ) / 4), jobId);
+    }
+    if (hooks.progress != NULL) {
+      hooks.progress(jobId, ((plantIndex + 1) * 100) / SETTINGS_MAX_PLANTS);
+    }
+  }
+  if (hooks.power != NULL) {
+    hooks.power(false);
+  }
+  TRACE_END(TRACE_CAT_WATERING, TRACE_WATERING_CYCLE, activeAlarmId, jobId);
+  wateringStatus.status = WATERING_STATUS_COMPLTE;
+  publishStatus(&wateringStatus);
+  // Wait till alarm is off before saving
+  while (alarmOn(settings, hal.clock->now())) {
+    wateringMonitor.delay(WATERING_ALARM_POLL_MS);
+  }
+  now = DateTime(hal.clock->now());
+  SettingsLock lock;
+  settings->taskLog.nextExecutionId = getNextAlarmId(*settings, now);
+  saveSettings(settings);
+}
+
+LoopAction nextLoopAction(const Settings& settings, uint32_t unixTime, bool running) {
+  if (!settings.hasRTC) {
+    return LOOP_IDLE;
+  }
+  if (!running && getActiveAlarmId(settings, DateTime(unixTime)) > -1) {
+    return LOOP_START_WATERING;
+  }
+  return LOOP_IDLE;
+}
+
+// Body of the alarm task, only returns once the alarm window closed so the same alarm never runs twice
+void runAlarmCycle(Settings* settings) {
+  waterPlants(settings);
+  while (alarmActive(settings, hal.clock->now())) {
+    wateringMonitor.delay(WATERING_ALARM_POLL_MS);
+  }
+}
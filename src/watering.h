@@ -0,0 +1,115 @@
+/**
+ * @file         : watering.h
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#pragma once
+#include <Arduino.h>
+#include "constants.h"
+#include "settings.h"
+#include "hal.h"
+#include "taskmonitor.h"
+
+#define WATERING_STATUS_STARTING          1       /* Cycle started */
+#define WATERING_STATUS_VALVE_OPEN        2       /* Valve open, pump still off */
+#define WATERING_STATUS_PUMPING           3       /* Pump on */
+#define WATERING_STATUS_WATERING          4       /* One per second flow sample */
+#define WATERING_STATUS_FINISHED          5       /* Pump and valve off */
+#define WATERING_SETTLE_MS                1000    /* Valve and pump switching gap, avoids the current surge */
+#define WATERING_SAMPLE_MS                1000    /* Flow is integrated and reported once per second */
+#define WATERING_POLL_MS                  12      /* Pulse poll pace within a sample, the old per poll display refresh time FLOW_CALIBRATION_FACTOR was tuned at */
+#define WATERING_YIELD_MS                 10      /* Pause after every flow sample */
+#define WATERING_ALARM_POLL_MS            1000    /* Alarm window check before persisting the cycle */
+#define WATERING_LOOP_MS                  500     /* loop() pause between two schedule checks */
+#define WATERING_BUDGET_MS                1500    /* Longest period between two flow samples */
+
+// Watering process status
+struct WateringStatus {
+  uint8_t id;
+  uint8_t plant;
+  volatile uint32_t flow;
+  volatile uint32_t pulses;
+  uint32_t duration;
+  uint8_t status;
+  String message;
+};
+
+// What a loop() pass does besides pausing
+enum LoopAction : uint8_t {
+  LOOP_IDLE = 0,
+  LOOP_START_WATERING     // An alarm window is open and no cycle runs yet
+};
+
+// Flow meter readings of the running (or last) cycle
+struct FlowState {
+  volatile float rate;                  // Litres per minute
+  volatile uint32_t millilitres;        // Millilitres of the last sample
+  volatile uint32_t total;              // Millilitres since the valve opened
+  volatile uint32_t pulses;             // Pulses of the last one second sample
+  uint32_t startedAt;                   // hal.clock millis() when the pump started
+  uint32_t endedAt;                     // hal.clock millis() when the pump stopped
+};
+
+/**
+ * Everything the cycle reports besides driving the hardware, every hook is
+ * optional.
+ */
+struct WateringHooks {
+  void (*status)(WateringStatus* status);
+  bool (*cancelled)(uint32_t jobId);
+  void (*progress)(uint32_t jobId, uint8_t percent);
+  void (*started)(uint8_t valve, uint32_t unixTime);
+  void (*sample)(uint8_t valve, uint32_t startTime, uint32_t elapsed, uint32_t millilitres);
+  void (*finished)(uint8_t valve, uint32_t unixTime, uint32_t millilitres, uint32_t duration, uint32_t elapsed);
+  void (*power)(bool pumping);          // Around the whole cycle, the device masks the brownout detector
+};
+
+extern FlowState flowState;
+// Attached by whichever task runs the cycle
+extern TaskMonitor wateringMonitor;
+
+void setWateringHooks(const WateringHooks& hooks);
+void calcFlow();
+
+/**
+ * duration in seconds, millilitres is the expected volume (informational)
+ */
+void waterPlant(Settings* settings, uint8_t valve, unsigned int duration, unsigned long millilitres, uint32_t jobId = 0);
+void waterPlants(Settings* settings, uint32_t jobId = 0);
+void stopWatering();
+
+/**
+ * Alarm dispatch, shared by loop() and the season simulator
+ */
+LoopAction nextLoopAction(const Settings& settings, uint32_t unixTime, bool running);
+void runAlarmCycle(Settings* settings);
@@ -0,0 +1,191 @@
+/**
+ * @file         : test_main.cpp
+ * @summary      : Smart Indoor Automation System
+ * @version      : 1.0.0
+ * @project      : smart-green
+ * @description  : A Smart Indoor Automation System
+ * @author       : Benjamin Maggi
+ * @email        : benjaminmaggi@gmail.com
+ * @date         : 23 Apr 2024
+ * @license:     : MIT
+ *
+ * Copyright 2021 Benjamin Maggi <benjaminmaggi@gmail.com>
+ *
+ *
+ * License:
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+/**
+ * Host tests of the hand written CBOR decoder in contentformat.cpp, the
+ * MessagePack and JSON paths are ArduinoJson's own.
+ *
+ * pio test -e test
+ */
+#include <Arduino.h>
+#include <SD.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include "constants.h"
+#include "contentformat.h"
+#include "hal.h"
+#include "hal_fake.h"
+
+FakeClock fakeClock(1719676800, 0);
+FakeGpioExpander fakeExpander;
+FakeFlowSensor fakeFlow;
+FakeStore fakeStore(EEPROM_SIZE);
+Hal hal = { &fakeClock, &fakeExpander, &fakeFlow, NULL, &fakeStore, &SD };
+
+#define TEST_TAG_COUNT                    (1 << 20) /* Far more frames than any stack if each tag recursed */
+
+static DeserializationError decode(JsonDocument& document, const uint8_t* body, size_t length) {
+  return deserializeBody(document, (const char*)body, length, FORMAT_CBOR);
+}
+
+static void appendSink(const char* data, size_t length, void* context) {
+  ((std::string*)context)->append(data, length);
+}
+
+void setUp() {}
+void tearDown() {}
+
+// A body of nothing but tags used to recurse once per byte
+void test_tags_are_skipped_without_recursion() {
+  static uint8_t body[TEST_TAG_COUNT + 1];
+  JsonDocument document;
+  memset(body, 0xC6, sizeof(body) - 1);
+  body[sizeof(body) - 1] = 0x07;
+  TEST_ASSERT_TRUE(decode(document, body, sizeof(body)) == DeserializationError::Ok);
+  TEST_ASSERT_EQUAL(7, document.as<int>());
+
+  TEST_ASSERT_TRUE(decode(document, body, sizeof(body) - 1) == DeserializationError::IncompleteInput);
+}
+
+void test_tags_inside_containers() {
+  // [1(1), 6(6(2))] and {"a": 0(true)}
+  const uint8_t array[] = { 0x82, 0xC1, 0x01, 0xC6, 0xC6, 0x02 };
+  const uint8_t object[] = { 0xA1, 0x61, 'a', 0xC0, 0xF5 };
+  JsonDocument document;
+  TEST_ASSERT_TRUE(decode(document, array, sizeof(array)) == DeserializationError::Ok);
+  TEST_ASSERT_EQUAL(2, document.size());
+  TEST_ASSERT_EQUAL(1, document[0].as<int>());
+  TEST_ASSERT_EQUAL(2, document[1].as<int>());
+  TEST_ASSERT_TRUE(decode(document, object, sizeof(object)) == DeserializationError::Ok);
+  TEST_ASSERT_TRUE(document["a"].as<bool>());
+}
+
+void test_nesting_is_limited() {
+  uint8_t body[CONTENT_FORMAT_MAX_DEPTH + 2];
+  JsonDocument document;
+  memset(body, 0x81, sizeof(body) - 1);
+  body[sizeof(body) - 1] = 0x00;
+  TEST_ASSERT_TRUE(decode(document, body, sizeof(body)) == DeserializationError::TooDeep);
+  // Tags between the levels do not reset the count
+  uint8_t tagged[2 * (CONTENT_FORMAT_MAX_DEPTH + 1) + 1];
+  for (size_t i = 0; i + 1 < sizeof(tagged); i += 2) {
+    tagged[i] = 0xC6;
+    tagged[i + 1] = 0x81;
+  }
+  tagged[sizeof(tagged) - 1] = 0x00;
+  TEST_ASSERT_TRUE(decode(document, tagged, sizeof(tagged)) == DeserializationError::TooDeep);
+}
+
+void test_indefinite_length_containers() {
+  // [_ 1, [_ ], {_ "a": 2}]
+  const uint8_t body[] = { 0x9F, 0x01, 0x9F, 0xFF, 0xBF, 0x61, 'a', 0x02, 0xFF, 0xFF };
+  JsonDocument document;
+  TEST_ASSERT_TRUE(decode(document, body, sizeof(body)) == DeserializationError::Ok);
+  TEST_ASSERT_EQUAL(3, document.size());
+  TEST_ASSERT_EQUAL(1, document[0].as<int>());
+  TEST_ASSERT_EQUAL(0, document[1].size());
+  TEST_ASSERT_EQUAL(2, document[2]["a"].as<int>());
+
+  // Missing break, a break where an item belongs, indefinite text
+  const uint8_t unterminated[] = { 0x9F, 0x01 };
+  const uint8_t misplaced[] = { 0xA1, 0x61, 'a', 0xFF };
+  const uint8_t text[] = { 0x7F, 0x61, 'a', 0xFF };
+  TEST_ASSERT_TRUE(decode(document, unterminated, sizeof(unterminated)) == DeserializationError::IncompleteInput);
+  TEST_ASSERT_TRUE(decode(document, misplaced, sizeof(misplaced)) == DeserializationError::InvalidInput);
+  TEST_ASSERT_TRUE(decode(document, text, sizeof(text)) == DeserializationError::InvalidInput);
+}
+
+void test_truncated_input() {
+  const uint8_t argument[] = { 0x19, 0x01 };             // uint16 missing its low byte
+  const uint8_t text[] = { 0x63, 'a', 'b' };             // 3 byte string with 2 bytes
+  const uint8_t array[] = { 0x83, 0x01, 0x02 };          // 3 items with 2
+  const uint8_t key[] = { 0xA1, 0x61 };                  // key without its byte
+  const uint8_t value[] = { 0xA1, 0x61, 'a' };           // key without its value
+  JsonDocument document;
+  TEST_ASSERT_TRUE(decode(document, argument, sizeof(argument)) == DeserializationError::IncompleteInput);
+  TEST_ASSERT_TRUE(decode(document, text, sizeof(text)) == DeserializationError::IncompleteInput);
+  TEST_ASSERT_TRUE(decode(document, array, sizeof(array)) == DeserializationError::IncompleteInput);
+  TEST_ASSERT_TRUE(decode(document, key, sizeof(key)) == DeserializationError::IncompleteInput);
+  TEST_ASSERT_TRUE(decode(document, value, sizeof(value)) == DeserializationError::IncompleteInput);
+  TEST_ASSERT_TRUE(decode(document, argument, 0) == DeserializationError::EmptyInput);
+
+  // Reserved additional information and trailing bytes
+  const uint8_t reserved[] = { 0x1C };
+  const uint8_t trailing[] = { 0x01, 0x02 };
+  TEST_ASSERT_TRUE(decode(document, reserved, sizeof(reserved)) == DeserializationError::InvalidInput);
+  TEST_ASSERT_TRUE(decode(document, trailing, sizeof(trailing)) == DeserializationError::InvalidInput);
+}
+
+void test_round_trip() {
+  JsonDocument source;
+  source["hostname"] = "indoor \"green\"";
+  source["maxPlants"] = 11;
+  source["updatedOn"] = 4294967295u;
+  source["offset"] = -3600;
+  source["ratio"] = 0.25;
+  source["hasRTC"] = true;
+  source["note"] = nullptr;
+  JsonArray plants = source["plants"].to<JsonArray>();
+  for (int i = 0; i < 3; i++) {
+    JsonObject plant = plants.add<JsonObject>();
+    plant["id"] = i;
+    plant["size"] = 18;
+    plant["status"] = 1;
+  }
+
+  std::string encoded;
+  serializeBody(source, FORMAT_CBOR, appendSink, &encoded);
+  TEST_ASSERT_TRUE(encoded.size() > 0);
+
+  JsonDocument decoded;
+  TEST_ASSERT_TRUE(deserializeBody(decoded, encoded.data(), encoded.size(), FORMAT_CBOR) == DeserializationError::Ok);
+  std::string expected;
+  std::string actual;
+  serializeJson(source, expected);
+  serializeJson(decoded, actual);
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), actual.c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tags_are_skipped_without_recursion);
+  RUN_TEST(test_tags_inside_containers);
+  RUN_TEST(test_nesting_is_limited);
+  RUN_TEST(test_indefinite_length_containers);
+  RUN_TEST(test_truncated_input);
+  RUN_TEST(test_round_trip);
+  return UNITY_END();
+}
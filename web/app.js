@@ -0,0 +1,117 @@
+'use strict';
+
+const WEEKDAYS = ['Sun', 'Mon', 'Tue', 'Wed', 'Thu', 'Fri', 'Sat'];
+const STATUS = ['idle', 'starting', 'valve open', 'pumping', 'watering', 'finished'];
+const SYSTEM_FIELDS = ['chipModel', 'freeHeap', 'SSID', 'signalDbm', 'temperature', 'uptime', 'resetReason'];
+const SYSTEM_INTERVAL_MS = 10000;
+
+const $ = (id) => document.getElementById(id);
+const pad = (n) => String(n).padStart(2, '0');
+let jobLocation = null;
+
+async function getJson(url, options) {
+  const response = await fetch(url, options);
+  if (!response.ok) {
+    throw new Error(`${url}: ${response.status}`);
+  }
+  return response.json();
+}
+
+function row(cells) {
+  const tr = document.createElement('tr');
+  for (const cell of cells) {
+    const td = document.createElement('td');
+    td.textContent = cell;
+    tr.appendChild(td);
+  }
+  return tr;
+}
+
+function weekdays(mask) {
+  return WEEKDAYS.filter((_, day) => mask & (1 << day)).join(' ') || '-';
+}
+
+async function loadPlants() {
+  const { plants } = await getJson('/api/plants');
+  $('plants').replaceChildren(...plants.map((p) => row([p.id, p.size, p.status ? 'yes' : 'no'])));
+}
+
+async function loadAlarms() {
+  const { alarm } = await getJson('/api/alarm');
+  const active = alarm.filter(([start]) => start.weekday);
+  $('alarms').replaceChildren(...active.map(([start, stop]) => row([
+    weekdays(start.weekday),
+    `${pad(start.hour)}:${pad(start.minute)}`,
+    `${pad(stop.hour)}:${pad(stop.minute)}`,
+  ])));
+}
+
+async function loadSystem() {
+  const info = await getJson('/api/systeminfo');
+  const list = [];
+  for (const field of SYSTEM_FIELDS) {
+    if (info[field] === undefined) {
+      continue;
+    }
+    const dt = document.createElement('dt');
+    const dd = document.createElement('dd');
+    dt.textContent = field;
+    dd.textContent = info[field];
+    list.push(dt, dd);
+  }
+  $('system').replaceChildren(...list);
+  $('hostname').textContent = info.settings?.hostname || 'Smart Green';
+  $('clock').textContent = new Date(info.timestamp * 1000).toISOString().slice(0, 19).replace('T', ' ');
+  $('next-alarm').textContent = info.env?.nextAlarm || '-';
+  $('total').textContent = `${info.watering?.totalMillilitres ?? 0} ml`;
+}
+
+function watchWatering() {
+  const events = new EventSource('/api/watering/events');
+  const update = (message) => {
+    const event = JSON.parse(message.data);
+    $('status').textContent = STATUS[event.status] || event.status;
+    $('plant').textContent = event.plant;
+    $('flow').textContent = `${event.millilitres} ml/s, ${event.duration} ms`;
+  };
+  events.addEventListener('status', update);
+  events.addEventListener('flow', update);
+}
+
+async function pollJob() {
+  if (!jobLocation) {
+    return;
+  }
+  const job = await getJson(jobLocation);
+  const running = job.state === 'queued' || job.state === 'running';
+  $('test-alarm').disabled = running;
+  $('cancel-alarm').hidden = !running;
+  if (running) {
+    setTimeout(() => pollJob().catch(console.error), 1000);
+  } else {
+    jobLocation = null;
+  }
+}
+
+$('test-alarm').addEventListener('click', async () => {
+  const response = await fetch('/api/test-alarm');
+  if (response.status === 202) {
+    jobLocation = response.headers.get('Location');
+    pollJob().catch(console.error);
+  }
+});
+
+$('cancel-alarm').addEventListener('click', async () => {
+  if (jobLocation) {
+    await fetch(jobLocation, { method: 'DELETE' });
+  }
+});
+
+Promise.all([loadPlants(), loadAlarms(), loadSystem()]).catch(console.error);
+// /api/systeminfo only serializes the telemetry snapshot, polling it has no side effects
+setInterval(() => {
+  if (!document.hidden) {
+    loadSystem().catch(console.error);
+  }
+}, SYSTEM_INTERVAL_MS);
+watchWatering();